@@ -36,6 +36,9 @@
 // Where the catalog files are kept
 #define CATALOG_DIR "/home/ASTRO/CATALOGS"
 
+// Where compiled (binary) copies of the catalog files are kept
+#define CATALOG_BINARY_DIR CATALOG_DIR "/.compiled"
+
 // Where the bright star files are kept
 #define BRIGHT_STAR_DIR "/home/ASTRO/REF_DATA"
 
@@ -45,7 +48,8 @@
 // Where misc reference data is kept
 #define REF_DATA_DIR "/home/ASTRO/REF_DATA"
 
-// Where archive.dat is kept, holding archived observations
+// Root of the observation archive; PhotArchive keeps its files in
+// ARCHIVE_DIR/PHOT
 #define ARCHIVE_DIR "/home/ASTRO/ARCHIVE"
 
 // Where the default filter information is kept
@@ -39,6 +39,7 @@
 #include "StatusMessage.h"
 #include <Filter.h>
 #include "RequestStatusMessage.h"
+#include "trace.h"
 #include <qhyccd.h>
 #include <system_config.h>
 
@@ -689,6 +690,7 @@ void ReadoutBinToFloat(uint8_t *buffer, int bin, int width, int height, fitsfile
   
 void ReadoutExposure(void) {
   int result;
+  TraceSpan span("ReadoutExposure");
   LogTag("ReadoutExposure()");
 
   MainExposure.CurrentState = Idle;
@@ -699,7 +701,10 @@ void ReadoutExposure(void) {
 
   uint32_t w, h, bpp, channels;
   fprintf(stderr, "iBuffer = %p, \n", iBuffer);
-  result = GetQHYCCDSingleFrame(camhandle, &w, &h, &bpp, &channels, iBuffer);
+  {
+    TraceSpan readout_span("GetQHYCCDSingleFrame");
+    result = GetQHYCCDSingleFrame(camhandle, &w, &h, &bpp, &channels, iBuffer);
+  }
 
   if (bpp != 16) {
     fprintf(stderr, "GetQHYCCDSingleFrame(): wrong pixel depth: %d\n", bpp);
@@ -1,6 +1,6 @@
 /*  HGSC.cc -- Get star info from Hubble Guide Star Catalog
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -17,6 +17,7 @@
  *   <http://www.gnu.org/licenses/>. 
  */
 #include "HGSC.h"
+#include "catalog_bundle.h"
 #include <string.h>		// strdup()
 #include <stdio.h>		// fgets(), sscanf()
 #include <stdlib.h>		// free() -- related to strdup()
@@ -171,6 +172,23 @@ HGSCList::Write (const char *filename) {
 }
 
 HGSCList::HGSCList(const char *starname) {
+  list_size = 0;
+  head = 0;
+  std::shared_ptr<const CatalogBundle> bundle = CatalogBundle::Get(starname);
+  if (bundle) {
+    bundle->AddToList(*this);
+    name_okay = true;
+
+    // (the list is in reverse catalog order)
+    bundle_stars.resize(list_size);
+    int i = list_size;
+    for (HGSC *p = head; p; p = p->next) bundle_stars[--i] = p;
+    catalog_bundle = bundle;
+    return;
+  }
+
+  // No compiled copy (CATALOG_BINARY_DIR can't be written?); fall back
+  // to reading the text
   char HGSCfilename[132];
   sprintf(HGSCfilename, CATALOG_DIR"/%s", starname);
   FILE *fp = fopen(HGSCfilename, "r");
@@ -588,6 +606,17 @@ HGSCList::RelabelAllStars(void) {
 //****************************************************************
 HGSC *
 HGSCList::FindByLabel(const char *label_string) {
+  // Stars added since the list was built from the compiled catalog
+  // aren't in its index
+  if (catalog_bundle && list_size == (int) bundle_stars.size()) {
+    const int i = catalog_bundle->FindByLabel(label_string);
+    if (i >= 0 && strcmp(bundle_stars[i]->label, label_string) == 0) {
+      return bundle_stars[i];
+    }
+    // otherwise, fall through and search the slow way (which also
+    // catches labels that aren't unique)
+  }
+
   HGSCIterator it(*this);
   HGSC *first_found = 0;
   HGSC *star;
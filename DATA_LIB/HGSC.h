@@ -1,7 +1,7 @@
 /* This may look like C code, but it is really -*-c++-*- */
 /*  HGSC.h -- Get star info from Hubble Guide Star Catalog
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -25,6 +25,7 @@
 #include <vector>
 #include <string>
 #include <list>
+#include <memory>
 #include <Filter.h>
 
 enum PhotometryColor { PHOT_V, PHOT_B, PHOT_U, PHOT_R, PHOT_I, PHOT_J,
@@ -51,6 +52,7 @@ private:
 
 class HGSCIterator;
 class HGSCList;
+class CatalogBundle;
 
 class HGSC {
 public:
@@ -94,6 +96,7 @@ private:
   std::list<std::string> ensemble_filters; // use this as ensemble for these filters only
   friend class HGSCIterator;
   friend class HGSCList;
+  friend class CatalogBundle;
 };
 
 class HGSCList {
@@ -101,11 +104,12 @@ public:
   HGSCList(void);		// null list
   void Add(HGSC &star);		// unordered list
   HGSCList(FILE *mapfile);	// picking up previously-stored file
-  HGSCList(const char *starname);
+  HGSCList(const char *starname); // (uses the compiled catalog)
   HGSCList(const DEC_RA &center,
 	   const double radius_radians); // building list from HGSC itself
   void Write(const char *filename);
   int length(void) const { return list_size; }
+  // Returns nullptr if the label isn't in the list or isn't unique
   HGSC *FindByLabel(const char *label_string);
 
   ~HGSCList(void);		// destructor
@@ -123,8 +127,14 @@ private:
 			char *filename);
   void RelabelAllStars(void);
   friend class HGSCIterator;
+  friend class CatalogBundle;
   void CreateFromFile(FILE *mapfile);
   bool name_okay;
+
+  // If the list came from a compiled catalog, FindByLabel() uses the
+  // catalog's label index; bundle_stars[i] is star i of the catalog.
+  std::shared_ptr<const CatalogBundle> catalog_bundle;
+  std::vector<HGSC *> bundle_stars;
 };
 
 class HGSCIterator {
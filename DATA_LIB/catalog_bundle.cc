@@ -0,0 +1,419 @@
+/*  catalog_bundle.cc -- Compiled (binary) copies of the catalog files
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "catalog_bundle.h"
+#include <gendefs.h>
+
+// File layout: a FileHeader, then the double columns (each
+// num_stars long, in the order they are listed in the class), then
+// the uint32_t columns, then the string block. Offset 0 in the string
+// block always holds an empty string and means "none".
+
+#define BUNDLE_MAGIC 0x32444243	// "CBD2"; change if the layout changes
+#define NUM_DOUBLE_COLUMNS (5 + 2*PHOT_NONE)
+#define NUM_UINT32_COLUMNS 8
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t num_stars;
+  uint32_t string_bytes;
+  uint32_t unused;
+  int64_t source_size;		// of the text file this came from
+  int64_t source_mtime_sec;
+  int64_t source_mtime_nsec;
+};
+
+static size_t FileSize(uint32_t num_stars, uint32_t string_bytes) {
+  return (sizeof(FileHeader) +
+	  num_stars*(NUM_DOUBLE_COLUMNS*sizeof(double) +
+		     NUM_UINT32_COLUMNS*sizeof(uint32_t)) +
+	  string_bytes);
+}
+
+static void CatalogFilename(const char *starname, char *filename, int size) {
+  snprintf(filename, size, CATALOG_DIR "/%s", starname);
+}
+
+static void BinaryFilename(const char *starname, char *filename, int size) {
+  snprintf(filename, size, CATALOG_BINARY_DIR "/%s", starname);
+}
+
+CatalogBundle::~CatalogBundle(void) {
+  if (mapping) munmap(mapping, mapping_size);
+}
+
+//****************************************************************
+//        Compiling
+//****************************************************************
+
+// Appends a string to the string block and returns its offset
+static uint32_t AddString(std::vector<char> &strings, const char *s) {
+  if (s == nullptr || *s == 0) return 0;
+  const uint32_t offset = strings.size();
+  strings.insert(strings.end(), s, s + strlen(s) + 1);
+  return offset;
+}
+
+template<typename T>
+static bool WriteColumn(FILE *fp, const std::vector<T> &column) {
+  return fwrite(column.data(), sizeof(T), column.size(), fp) == column.size();
+}
+
+// Parses the text catalog and writes it out in compiled form. "sb" is
+// what stat() said about the text file before it was read.
+int
+CatalogBundle::Compile(const char *starname, const struct stat &sb) {
+  // (no sense parsing the text if there's nowhere to put the result)
+  if (mkdir(CATALOG_BINARY_DIR, 0777) && errno != EEXIST) {
+    static bool complained = false;
+    if (!complained) perror("CatalogBundle: cannot create " CATALOG_BINARY_DIR);
+    complained = true;
+    return -1;
+  }
+
+  char catalog_filename[256];
+  CatalogFilename(starname, catalog_filename, sizeof(catalog_filename));
+  FILE *fp = fopen(catalog_filename, "r");
+  if (!fp) {
+    perror(catalog_filename);
+    return -1;
+  }
+  HGSCList catalog(fp);
+  catalog.name_okay = true;	// so that the stars get deleted
+  fclose(fp);
+
+  // The list comes back in reverse file order
+  std::vector<HGSC *> stars;
+  HGSCIterator it(catalog);
+  for (HGSC *star = it.First(); star; star = it.Next()) {
+    stars.push_back(star);
+  }
+  std::reverse(stars.begin(), stars.end());
+  const uint32_t n = stars.size();
+
+  std::vector<double> dec(n), ra(n), magnitude(n), photometry(n, 0.0),
+    photometry_ensemble(n, 0.0), color_mag(PHOT_NONE*n, 0.0),
+    color_uncty(PHOT_NONE*n, -1.0);
+  std::vector<uint32_t> flags(n, 0), colors(n, 0), label(n), auid(n),
+    report_id(n), comment(n), ensemble_filters(n), name_index(n);
+  std::vector<char> strings(1, 0);
+
+  for (uint32_t i = 0; i < n; i++) {
+    HGSC *star = stars[i];
+    dec[i] = star->location.dec();
+    ra[i] = star->location.ra_radians();
+    magnitude[i] = star->magnitude;
+
+    uint32_t f = 0;
+    if (star->is_comp)               f |= CB_COMP;
+    if (star->is_check)              f |= CB_CHECK;
+    if (star->is_reference)          f |= CB_REFERENCE;
+    if (star->ensemble_all_filters)  f |= CB_ENSEMBLE;
+    if (star->do_not_trust_position) f |= CB_NOPOSIT;
+    if (star->is_official_check)     f |= CB_OFFICIAL_CHECK;
+    if (star->is_backup_check)       f |= CB_BACKUP_CHECK;
+    if (star->do_submit)             f |= CB_SUBMIT;
+    if (star->force)                 f |= CB_FORCE;
+    if (star->is_widefield)          f |= CB_WIDE;
+    if (star->is_variable)           f |= CB_VARIABLE;
+    if (star->photometry_valid) {
+      f |= CB_PHOTOMETRY;
+      photometry[i] = star->photometry;
+    }
+    if (star->photometry_ensemble_valid) {
+      f |= CB_PHOTOMETRY_ENS;
+      photometry_ensemble[i] = star->photometry_ensemble;
+    }
+    flags[i] = f;
+
+    for (int c = 0; c < PHOT_NONE; c++) {
+      if (star->multicolor_data.IsAvailable((PhotometryColor) c)) {
+	colors[i] |= (1 << c);
+	color_mag[c*n + i] = star->multicolor_data.Get((PhotometryColor) c);
+	color_uncty[c*n + i] = star->multicolor_data.GetUncertainty((PhotometryColor) c);
+      }
+    }
+
+    std::string filters;
+    for (std::string &f_name : star->ensemble_filters) {
+      if (filters.size()) filters += ',';
+      filters += f_name;
+    }
+    label[i] = AddString(strings, star->label);
+    auid[i] = AddString(strings, star->A_unique_ID);
+    report_id[i] = AddString(strings, star->report_ID);
+    comment[i] = AddString(strings, star->comment);
+    ensemble_filters[i] = AddString(strings, filters.c_str());
+    name_index[i] = i;
+  }
+  std::stable_sort(name_index.begin(), name_index.end(),
+		   [&](uint32_t a, uint32_t b) {
+		     return strcmp(strings.data() + label[a], strings.data() + label[b]) < 0;
+		   });
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = BUNDLE_MAGIC;
+  header.num_stars = n;
+  header.string_bytes = strings.size();
+  header.source_size = sb.st_size;
+  header.source_mtime_sec = sb.st_mtim.tv_sec;
+  header.source_mtime_nsec = sb.st_mtim.tv_nsec;
+
+  // Write under a temporary name and rename, so that nobody ever maps
+  // a partial file (and anyone who has the old one mapped keeps it).
+  char filename[256];
+  char temp_filename[280];
+  BinaryFilename(starname, filename, sizeof(filename));
+  snprintf(temp_filename, sizeof(temp_filename), "%s.%d", filename, (int) getpid());
+  FILE *out = fopen(temp_filename, "w");
+  if (!out) {
+    perror(temp_filename);
+    return -1;
+  }
+  bool okay = (fwrite(&header, sizeof(header), 1, out) == 1 &&
+	       WriteColumn(out, dec) &&
+	       WriteColumn(out, ra) &&
+	       WriteColumn(out, magnitude) &&
+	       WriteColumn(out, photometry) &&
+	       WriteColumn(out, photometry_ensemble) &&
+	       WriteColumn(out, color_mag) &&
+	       WriteColumn(out, color_uncty) &&
+	       WriteColumn(out, flags) &&
+	       WriteColumn(out, colors) &&
+	       WriteColumn(out, label) &&
+	       WriteColumn(out, auid) &&
+	       WriteColumn(out, report_id) &&
+	       WriteColumn(out, comment) &&
+	       WriteColumn(out, ensemble_filters) &&
+	       WriteColumn(out, name_index) &&
+	       WriteColumn(out, strings));
+  if (fclose(out)) okay = false;
+  if (!okay || rename(temp_filename, filename)) {
+    perror(filename);
+    unlink(temp_filename);
+    return -1;
+  }
+  return 0;
+}
+
+//****************************************************************
+//        Mapping
+//****************************************************************
+
+std::shared_ptr<const CatalogBundle>
+CatalogBundle::Map(const char *starname) {
+  char filename[256];
+  BinaryFilename(starname, filename, sizeof(filename));
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) return nullptr;
+
+  struct stat sb;
+  if (fstat(fd, &sb) || sb.st_size < (off_t) sizeof(FileHeader)) {
+    close(fd);
+    return nullptr;
+  }
+  void *addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return nullptr;
+
+  std::shared_ptr<CatalogBundle> bundle(new CatalogBundle);
+  bundle->mapping = addr;
+  bundle->mapping_size = sb.st_size;
+
+  const FileHeader *header = (const FileHeader *) addr;
+  if (header->magic != BUNDLE_MAGIC ||
+      (size_t) sb.st_size != FileSize(header->num_stars, header->string_bytes)) {
+    return nullptr;		// (old layout; will be recompiled)
+  }
+  const uint32_t n = header->num_stars;
+  bundle->num_stars = n;
+  bundle->source_size = header->source_size;
+  bundle->source_mtime_sec = header->source_mtime_sec;
+  bundle->source_mtime_nsec = header->source_mtime_nsec;
+
+  const double *d = (const double *) (header+1);
+  bundle->dec = d;                 d += n;
+  bundle->ra = d;                  d += n;
+  bundle->magnitude = d;           d += n;
+  bundle->photometry = d;          d += n;
+  bundle->photometry_ensemble = d; d += n;
+  bundle->color_mag = d;           d += PHOT_NONE*n;
+  bundle->color_uncty = d;         d += PHOT_NONE*n;
+  const uint32_t *u = (const uint32_t *) d;
+  bundle->flags = u;               u += n;
+  bundle->colors = u;              u += n;
+  bundle->label = u;               u += n;
+  bundle->auid = u;                u += n;
+  bundle->report_id = u;           u += n;
+  bundle->comment = u;             u += n;
+  bundle->ensemble_filters = u;    u += n;
+  bundle->name_index = u;          u += n;
+  bundle->strings = (const char *) u;
+  bundle->string_bytes = header->string_bytes;
+  return bundle;
+}
+
+bool
+CatalogBundle::IsCurrent(const struct stat &sb) const {
+  return (source_size == (int64_t) sb.st_size &&
+	  source_mtime_sec == (int64_t) sb.st_mtim.tv_sec &&
+	  source_mtime_nsec == (int64_t) sb.st_mtim.tv_nsec);
+}
+
+// Bundles already mapped by this process
+static std::map<std::string, std::shared_ptr<const CatalogBundle>> bundle_cache;
+// Catalogs that couldn't be compiled, and what stat() said about the
+// text when that happened; Get() doesn't try again until the text
+// changes.
+static std::map<std::string, struct stat> failed_compiles;
+static std::mutex bundle_cache_lock;
+
+static bool SameSource(const struct stat &a, const struct stat &b) {
+  return (a.st_size == b.st_size &&
+	  a.st_mtim.tv_sec == b.st_mtim.tv_sec &&
+	  a.st_mtim.tv_nsec == b.st_mtim.tv_nsec);
+}
+
+std::shared_ptr<const CatalogBundle>
+CatalogBundle::Get(const char *starname) {
+  char catalog_filename[256];
+  CatalogFilename(starname, catalog_filename, sizeof(catalog_filename));
+  struct stat sb;
+  if (stat(catalog_filename, &sb) || !S_ISREG(sb.st_mode)) return nullptr;
+
+  std::lock_guard<std::mutex> lock(bundle_cache_lock);
+  auto cached = bundle_cache.find(starname);
+  if (cached != bundle_cache.end() && cached->second->IsCurrent(sb)) {
+    return cached->second;
+  }
+
+  auto failed = failed_compiles.find(starname);
+  if (failed != failed_compiles.end() && SameSource(failed->second, sb)) {
+    return nullptr;
+  }
+
+  std::shared_ptr<const CatalogBundle> bundle = Map(starname);
+  if (!bundle || !bundle->IsCurrent(sb)) {
+    if (Compile(starname, sb) || !(bundle = Map(starname))) {
+      failed_compiles[starname] = sb;
+      return nullptr;
+    }
+  }
+  failed_compiles.erase(starname);
+  bundle_cache[starname] = bundle;
+  return bundle;
+}
+
+//****************************************************************
+//        Lookups
+//****************************************************************
+
+int
+CatalogBundle::FindByLabel(const char *target) const {
+  int low = 0;
+  int high = num_stars;		// one past the end
+  while (low < high) {
+    const int mid = (low + high)/2;
+    const char *l = Label(name_index[mid]);
+    const int cmp = strcmp(l ? l : "", target);
+    if (cmp == 0) {
+      // duplicates would be next to each other in the index
+      for (int n = mid-1; n <= mid+1; n += 2) {
+	if (n < 0 || n >= num_stars) continue;
+	const char *neighbor = Label(name_index[n]);
+	if (neighbor && strcmp(neighbor, target) == 0) return -1;
+      }
+      return name_index[mid];
+    }
+    if (cmp < 0) {
+      low = mid+1;
+    } else {
+      high = mid;
+    }
+  }
+  return -1;
+}
+
+//****************************************************************
+//        Building an HGSCList
+//****************************************************************
+
+void
+CatalogBundle::AddToList(HGSCList &list) const {
+  // Add() pushes onto the front of the list; going through the stars
+  // in file order gives the same list that parsing the text would.
+  for (int i = 0; i < num_stars; i++) {
+    const char *l = Label(i);
+    HGSC *star = new HGSC(dec[i], ra[i], magnitude[i], l ? l : "");
+    const uint32_t f = flags[i];
+
+    star->is_comp = (f & CB_COMP) != 0;
+    star->is_check = (f & CB_CHECK) != 0;
+    star->is_reference = (f & CB_REFERENCE) != 0;
+    star->ensemble_all_filters = (f & CB_ENSEMBLE) != 0;
+    star->do_not_trust_position = (f & CB_NOPOSIT) != 0;
+    star->is_official_check = (f & CB_OFFICIAL_CHECK) != 0;
+    star->is_backup_check = (f & CB_BACKUP_CHECK) != 0;
+    star->do_submit = (f & CB_SUBMIT) != 0;
+    star->force = (f & CB_FORCE) != 0;
+    star->is_widefield = (f & CB_WIDE) != 0;
+    star->is_variable = (f & CB_VARIABLE) != 0;
+    if (f & CB_PHOTOMETRY) {
+      star->photometry = photometry[i];
+      star->photometry_valid = 1;
+    }
+    if (f & CB_PHOTOMETRY_ENS) {
+      star->photometry_ensemble = photometry_ensemble[i];
+      star->photometry_ensemble_valid = 1;
+    }
+
+    const char *s;
+    if ((s = AUID(i))) star->A_unique_ID = strdup(s);
+    if ((s = ReportID(i))) star->report_ID = strdup(s);
+    if ((s = Comment(i))) star->comment = strdup(s);
+    if ((s = EnsembleFilters(i))) {
+      while (*s) {
+	const char *end = strchr(s, ',');
+	if (!end) end = s + strlen(s);
+	star->ensemble_filters.push_back(std::string(s, end - s));
+	s = (*end ? end+1 : end);
+      }
+    }
+
+    for (int c = 0; c < PHOT_NONE; c++) {
+      if (HasColor(i, (PhotometryColor) c)) {
+	star->multicolor_data.Add((PhotometryColor) c, ColorMag(i, (PhotometryColor) c),
+				  ColorUncertainty(i, (PhotometryColor) c));
+      }
+    }
+    list.Add(*star);
+  }
+}
@@ -0,0 +1,135 @@
+// This may look like C code, but it is really -*- C++ -*-
+/*  catalog_bundle.h -- Compiled (binary) copies of the catalog files
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CATALOG_BUNDLE_H
+#define _CATALOG_BUNDLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <memory>
+#include "HGSC.h"
+
+// Every catalog file in CATALOG_DIR gets a compiled twin (same name)
+// in CATALOG_BINARY_DIR. The compiled form is a table with one array
+// per attribute ("struct of arrays"), a string block, and an index of
+// the stars sorted by label; it is mmap'ed, so opening one costs a
+// stat() and an mmap() no matter how big the catalog is.
+//
+// The compiled file remembers the size and modification time of the
+// text file it came from. Get() recompiles it whenever the text has
+// changed, so the text files remain the ones that get edited.
+
+// Bits in Flags()
+#define CB_COMP           0x0001
+#define CB_CHECK          0x0002
+#define CB_REFERENCE      0x0004
+#define CB_ENSEMBLE       0x0008 // ensemble star in all filters
+#define CB_NOPOSIT        0x0010
+#define CB_OFFICIAL_CHECK 0x0020
+#define CB_BACKUP_CHECK   0x0040
+#define CB_SUBMIT         0x0080
+#define CB_FORCE          0x0100
+#define CB_WIDE           0x0200
+#define CB_VARIABLE       0x0400
+#define CB_PHOTOMETRY     0x0800 // Photometry() is valid
+#define CB_PHOTOMETRY_ENS 0x1000 // PhotometryEnsemble() is valid
+
+class CatalogBundle {
+public:
+  // Returns the (compiled and mapped) catalog for "starname", or
+  // nullptr if there is no such catalog file or it couldn't be
+  // compiled (in which case the text is still there to be read; see
+  // HGSCList(starname)). Bundles are cached, so asking again for the
+  // same star is cheap; so are failures, until the text changes.
+  static std::shared_ptr<const CatalogBundle> Get(const char *starname);
+
+  ~CatalogBundle(void);
+
+  int NumStars(void) const { return num_stars; }
+
+  // Stars are numbered 0..NumStars()-1, in the order they appear in
+  // the text file
+  double Dec(int i) const { return dec[i]; } // radians
+  double RA(int i) const { return ra[i]; }   // radians
+  double Magnitude(int i) const { return magnitude[i]; }
+  double Photometry(int i) const { return photometry[i]; }
+  double PhotometryEnsemble(int i) const { return photometry_ensemble[i]; }
+  uint32_t Flags(int i) const { return flags[i]; }
+  bool HasColor(int i, PhotometryColor c) const { return colors[i] & (1 << c); }
+  double ColorMag(int i, PhotometryColor c) const { return color_mag[c*num_stars + i]; }
+  double ColorUncertainty(int i, PhotometryColor c) const {
+    return color_uncty[c*num_stars + i];
+  }
+
+  // These return nullptr if the star doesn't have one
+  const char *Label(int i) const { return String(label[i]); }
+  const char *AUID(int i) const { return String(auid[i]); }
+  const char *ReportID(int i) const { return String(report_id[i]); }
+  const char *Comment(int i) const { return String(comment[i]); }
+  // Comma-separated filter names ("ENSEMBLE:B,V")
+  const char *EnsembleFilters(int i) const { return String(ensemble_filters[i]); }
+
+  // Returns the index of the star with this label, or -1 if there is
+  // no such star or more than one
+  int FindByLabel(const char *label) const;
+
+  // Adds a new HGSC to "list" for every star
+  void AddToList(HGSCList &list) const;
+
+private:
+  CatalogBundle(void) {}
+  static int Compile(const char *starname, const struct stat &sb);
+  static std::shared_ptr<const CatalogBundle> Map(const char *starname);
+  // true if this was compiled from the text file described by "sb"
+  bool IsCurrent(const struct stat &sb) const;
+
+  void *mapping {nullptr};
+  size_t mapping_size {0};
+
+  int num_stars {0};
+  int64_t source_size {0};
+  int64_t source_mtime_sec {0};
+  int64_t source_mtime_nsec {0};
+
+  const double *dec;
+  const double *ra;
+  const double *magnitude;
+  const double *photometry;
+  const double *photometry_ensemble;
+  const double *color_mag;	// [PHOT_NONE][num_stars]
+  const double *color_uncty;	// [PHOT_NONE][num_stars]
+  const uint32_t *flags;
+  const uint32_t *colors;	// bit (1 << PhotometryColor) if present
+  const uint32_t *label;	// (offsets into "strings")
+  const uint32_t *auid;
+  const uint32_t *report_id;
+  const uint32_t *comment;
+  const uint32_t *ensemble_filters;
+  const uint32_t *name_index;	// star numbers, sorted by label
+  const char *strings;
+  uint32_t string_bytes;
+
+  const char *String(uint32_t offset) const {
+    return (offset && offset < string_bytes) ? strings + offset : nullptr;
+  }
+};
+
+#endif
@@ -0,0 +1,368 @@
+/*  phot_archive.cc -- Binary, append-only archive of photometry
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <set>
+#include <gendefs.h>		// ARCHIVE_DIR
+#include "phot_archive.h"
+
+const char *PhotArchive::DEFAULT_DIRECTORY = ARCHIVE_DIR "/PHOT";
+
+// Column files, in the same order as PhotArchive::maps[]
+enum { COL_STAR, COL_JD, COL_FILTER, COL_MAG, COL_ERR, COL_AIRMASS, COL_JUID,
+       NUM_COLUMNS };
+
+static const struct {
+  const char *filename;
+  size_t size;
+} columns[NUM_COLUMNS] = {
+  { "star.col",    sizeof(uint32_t) },
+  { "jd.col",      sizeof(double) },
+  { "filter.col",  sizeof(uint8_t) },
+  { "mag.col",     sizeof(float) },
+  { "err.col",     sizeof(float) },
+  { "airmass.col", sizeof(float) },
+  { "juid.col",    sizeof(juid_t) },
+};
+
+// One record in nights.idx
+struct NightRecord {
+  double first_jd;
+  double last_jd;
+  uint32_t first_row;
+  uint32_t num_rows;
+  char source[104];
+};
+
+static void ReadDictionary(const std::string &filename,
+			   std::vector<std::string> &names,
+			   std::map<std::string, int> &ids) {
+  FILE *fp = fopen(filename.c_str(), "r");
+  if (!fp) return;		// a new archive
+  char buffer[256];
+  while (fgets(buffer, sizeof(buffer), fp)) {
+    char *nl = strchr(buffer, '\n');
+    if (nl) *nl = 0;
+    ids[buffer] = names.size();
+    names.push_back(buffer);
+  }
+  fclose(fp);
+}
+
+// Writes "count" elements of "size" bytes, starting at element "first"
+static int WriteColumn(const std::string &filename,
+		       const void *data,
+		       size_t size,
+		       uint32_t first,
+		       uint32_t count) {
+  const int fd = open(filename.c_str(), O_WRONLY|O_CREAT, 0664);
+  if (fd < 0) {
+    fprintf(stderr, "PhotArchive: cannot open %s: %s\n",
+	    filename.c_str(), strerror(errno));
+    return -1;
+  }
+  int status = 0;
+  // Get rid of anything left by an interrupted append
+  if (ftruncate(fd, first*size) ||
+      pwrite(fd, data, count*size, first*size) != (ssize_t) (count*size) ||
+      fdatasync(fd)) {
+    fprintf(stderr, "PhotArchive: cannot write %s: %s\n",
+	    filename.c_str(), strerror(errno));
+    status = -1;
+  }
+  close(fd);
+  return status;
+}
+
+PhotArchive::PhotArchive(const char *directory, bool writable) :
+  dir(directory), writable(writable) {
+  is_open = (Open() == 0);
+}
+
+PhotArchive::~PhotArchive(void) {
+  UnmapColumns();
+}
+
+int
+PhotArchive::Open(void) {
+  struct stat dir_stat;
+  if (stat(dir.c_str(), &dir_stat)) {
+    if (not writable) {
+      fprintf(stderr, "PhotArchive: no archive at %s\n", dir.c_str());
+      return -1;
+    }
+    if (mkdir(dir.c_str(), 0775)) {
+      fprintf(stderr, "PhotArchive: cannot create %s: %s\n",
+	      dir.c_str(), strerror(errno));
+      return -1;
+    }
+  }
+
+  ReadDictionary(Path("stars.txt"), star_names, star_ids);
+  ReadDictionary(Path("filters.txt"), filter_names, filter_ids);
+
+  FILE *fp = fopen(Path("nights.idx").c_str(), "r");
+  if (fp) {
+    NightRecord r;
+    while (fread(&r, sizeof(r), 1, fp) == 1) {
+      r.source[sizeof(r.source)-1] = 0;
+      nights.push_back(ArchiveNight { r.first_jd, r.last_jd,
+				      r.first_row, r.num_rows, r.source });
+      num_rows = r.first_row + r.num_rows;
+    }
+    fclose(fp);
+  }
+  return MapColumns();
+}
+
+int
+PhotArchive::MapColumns(void) {
+  UnmapColumns();
+  if (num_rows == 0) return 0;
+
+  for (int c = 0; c < NUM_COLUMNS; c++) {
+    const std::string filename = Path(columns[c].filename);
+    const size_t length = num_rows*columns[c].size;
+    const int fd = open(filename.c_str(), O_RDONLY);
+    struct stat col_stat;
+    if (fd < 0 || fstat(fd, &col_stat) || (size_t) col_stat.st_size < length) {
+      fprintf(stderr, "PhotArchive: %s is missing or short\n", filename.c_str());
+      if (fd >= 0) close(fd);
+      UnmapColumns();
+      return -1;
+    }
+    void *addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      perror("PhotArchive: mmap");
+      UnmapColumns();
+      return -1;
+    }
+    maps[c].addr = addr;
+    maps[c].length = length;
+  }
+  c_star = (const uint32_t *) maps[COL_STAR].addr;
+  c_jd = (const double *) maps[COL_JD].addr;
+  c_filter = (const uint8_t *) maps[COL_FILTER].addr;
+  c_mag = (const float *) maps[COL_MAG].addr;
+  c_err = (const float *) maps[COL_ERR].addr;
+  c_airmass = (const float *) maps[COL_AIRMASS].addr;
+  c_juid = (const juid_t *) maps[COL_JUID].addr;
+  return 0;
+}
+
+void
+PhotArchive::UnmapColumns(void) {
+  for (Mapping &m : maps) {
+    if (m.addr) munmap(m.addr, m.length);
+    m.addr = nullptr;
+    m.length = 0;
+  }
+  c_star = nullptr;
+  c_jd = nullptr;
+  c_filter = nullptr;
+  c_mag = c_err = c_airmass = nullptr;
+  c_juid = nullptr;
+}
+
+int
+PhotArchive::LookupOrAdd(const std::string &name,
+			 std::vector<std::string> &names,
+			 std::map<std::string, int> &ids) {
+  auto it = ids.find(name);
+  if (it != ids.end()) return it->second;
+  const int id = names.size();
+  ids[name] = id;
+  names.push_back(name);
+  return id;
+}
+
+bool
+PhotArchive::HasSource(const char *source) const {
+  for (const ArchiveNight &n : nights) {
+    if (n.source == source) return true;
+  }
+  return false;
+}
+
+int
+PhotArchive::StarID(const char *name) const {
+  auto it = star_ids.find(name);
+  return (it == star_ids.end() ? -1 : it->second);
+}
+
+int
+PhotArchive::FilterID(const char *name) const {
+  auto it = filter_ids.find(name);
+  return (it == filter_ids.end() ? -1 : it->second);
+}
+
+//****************************************************************
+//        Add()
+//****************************************************************
+int
+PhotArchive::Add(const std::vector<ArchiveMeasurement> &batch, const char *source) {
+  if (not is_open || not writable) {
+    fprintf(stderr, "PhotArchive: archive not open for writing\n");
+    return -1;
+  }
+  if (strlen(source) >= sizeof(NightRecord::source)) {
+    fprintf(stderr, "PhotArchive: source name too long: %s\n", source);
+    return -1;
+  }
+  if (HasSource(source)) return 0;
+  if (batch.size() == 0) return 0;
+
+  // Filter ids are stored in one byte. Check that before anything
+  // is added to the dictionaries.
+  std::set<std::string> new_filters;
+  for (const ArchiveMeasurement &m : batch) {
+    if (filter_ids.find(m.filter) == filter_ids.end()) new_filters.insert(m.filter);
+  }
+  if (filter_names.size() + new_filters.size() > 256) {
+    fprintf(stderr, "PhotArchive: too many filters\n");
+    return -1;
+  }
+
+  const size_t old_num_stars = star_names.size();
+  const size_t old_num_filters = filter_names.size();
+  const uint32_t count = batch.size();
+
+  std::vector<uint32_t> v_star(count);
+  std::vector<double> v_jd(count);
+  std::vector<uint8_t> v_filter(count);
+  std::vector<float> v_mag(count);
+  std::vector<float> v_err(count);
+  std::vector<float> v_airmass(count);
+  std::vector<juid_t> v_juid(count);
+
+  NightRecord r;
+  memset(&r, 0, sizeof(r));
+  r.first_jd = r.last_jd = batch[0].jd;
+  for (uint32_t i = 0; i < count; i++) {
+    const ArchiveMeasurement &m = batch[i];
+    v_star[i] = LookupOrAdd(m.star, star_names, star_ids);
+    v_filter[i] = LookupOrAdd(m.filter, filter_names, filter_ids);
+    v_jd[i] = m.jd;
+    v_mag[i] = m.mag;
+    v_err[i] = m.err;
+    v_airmass[i] = m.airmass;
+    v_juid[i] = m.juid;
+    if (m.jd < r.first_jd) r.first_jd = m.jd;
+    if (m.jd > r.last_jd) r.last_jd = m.jd;
+  }
+
+  // New names go into the dictionaries first. If the append doesn't
+  // finish, they're just unused names.
+  struct {
+    const char *filename;
+    std::vector<std::string> &names;
+    size_t old_size;
+  } dictionaries[] = { { "stars.txt", star_names, old_num_stars },
+		       { "filters.txt", filter_names, old_num_filters } };
+  for (auto &d : dictionaries) {
+    if (d.names.size() == d.old_size) continue;
+    FILE *fp = fopen(Path(d.filename).c_str(), "a");
+    if (!fp) {
+      fprintf(stderr, "PhotArchive: cannot append to %s\n", d.filename);
+      return -1;
+    }
+    for (size_t i = d.old_size; i < d.names.size(); i++) {
+      fprintf(fp, "%s\n", d.names[i].c_str());
+    }
+    if (fclose(fp)) return -1;
+  }
+
+  const void *data[NUM_COLUMNS] = { v_star.data(), v_jd.data(), v_filter.data(),
+				    v_mag.data(), v_err.data(), v_airmass.data(),
+				    v_juid.data() };
+  UnmapColumns();		// about to truncate them
+  for (int c = 0; c < NUM_COLUMNS; c++) {
+    if (WriteColumn(Path(columns[c].filename), data[c], columns[c].size,
+		    num_rows, count)) {
+      MapColumns();
+      return -1;
+    }
+  }
+
+  // ...and this commits it.
+  r.first_row = num_rows;
+  r.num_rows = count;
+  strcpy(r.source, source);
+  const int fd = open(Path("nights.idx").c_str(), O_WRONLY|O_CREAT|O_APPEND, 0664);
+  if (fd < 0 || write(fd, &r, sizeof(r)) != sizeof(r)) {
+    fprintf(stderr, "PhotArchive: cannot write nights.idx: %s\n", strerror(errno));
+    if (fd >= 0) close(fd);
+    MapColumns();
+    return -1;
+  }
+  close(fd);
+
+  nights.push_back(ArchiveNight { r.first_jd, r.last_jd, r.first_row, r.num_rows, source });
+  num_rows += count;
+  star_index_valid = false;
+  if (MapColumns()) return -1;
+  return count;
+}
+
+//****************************************************************
+//        Queries
+//****************************************************************
+void
+PhotArchive::StarRows(int star_id, std::vector<uint32_t> *rows) {
+  rows->clear();
+  if (star_id < 0 || star_id >= (int) star_names.size()) return;
+
+  if (not star_index_valid) {
+    const int num_stars = star_names.size();
+    star_start.assign(num_stars+1, 0);
+    for (uint32_t row = 0; row < num_rows; row++) {
+      star_start[c_star[row]+1]++;
+    }
+    for (int s = 0; s < num_stars; s++) {
+      star_start[s+1] += star_start[s];
+    }
+    std::vector<uint32_t> next(star_start.begin(), star_start.end()-1);
+    star_rows.resize(num_rows);
+    for (uint32_t row = 0; row < num_rows; row++) {
+      star_rows[next[c_star[row]]++] = row;
+    }
+    star_index_valid = true;
+  }
+  rows->assign(star_rows.begin() + star_start[star_id],
+	       star_rows.begin() + star_start[star_id+1]);
+}
+
+void
+PhotArchive::DateRows(double first_jd, double last_jd, std::vector<uint32_t> *rows) const {
+  rows->clear();
+  for (const ArchiveNight &n : nights) {
+    if (n.last_jd < first_jd || n.first_jd >= last_jd) continue;
+    for (uint32_t row = n.first_row; row < n.first_row + n.num_rows; row++) {
+      if (c_jd[row] >= first_jd && c_jd[row] < last_jd) rows->push_back(row);
+    }
+  }
+}
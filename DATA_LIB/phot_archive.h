@@ -0,0 +1,151 @@
+// This may look like C code, but it is really -*- C++ -*-
+/*  phot_archive.h -- Binary, append-only archive of photometry
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PHOT_ARCHIVE_H
+#define _PHOT_ARCHIVE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+// The archive is a directory holding one file per column, each an
+// array of fixed-size values with one entry per measurement:
+//
+//    star.col     uint32  index into stars.txt (one name per line)
+//    jd.col       double
+//    filter.col   uint8   index into filters.txt
+//    mag.col      float
+//    err.col      float
+//    airmass.col  float   (0 if unknown)
+//    juid.col     int64   image/stack JUID from astro_db.json (0 if unknown)
+//
+// plus nights.idx, one fixed-size record per batch of measurements
+// added (normally one night's report), giving the batch's first row,
+// row count, span of JD, and where it came from. The columns are
+// mmap()ed, so opening the archive costs almost nothing; the per-star
+// index is built on first use with one pass over star.col.
+//
+// Measurements are only ever appended. A batch is committed when its
+// nights.idx record is written (after the columns), so rows past the
+// end of the last batch are leftovers of an interrupted append and are
+// ignored (and overwritten by the next one).
+
+typedef long juid_t;
+
+struct ArchiveMeasurement {
+  std::string star;		// report name, e.g. "SS CYG"
+  double jd;
+  std::string filter;		// AAVSO filter code, e.g. "V"
+  float mag;
+  float err;
+  float airmass;
+  juid_t juid;
+};
+
+struct ArchiveNight {
+  double first_jd;		// earliest and latest measurement
+  double last_jd;
+  uint32_t first_row;
+  uint32_t num_rows;
+  std::string source;		// e.g. "10-4-2019/aavso.report"
+};
+
+class PhotArchive {
+public:
+  static const char *DEFAULT_DIRECTORY;
+
+  PhotArchive(const char *directory = DEFAULT_DIRECTORY, bool writable = false);
+  ~PhotArchive(void);
+  bool IsOpen(void) const { return is_open; }
+
+  // Appends one batch. Returns the number of rows added, or -1 on
+  // error. A batch whose source is already in the archive is not
+  // added again (returns 0).
+  int Add(const std::vector<ArchiveMeasurement> &batch, const char *source);
+  bool HasSource(const char *source) const;
+
+  //********************************
+  //        QUERIES
+  //********************************
+  uint32_t NumRows(void) const { return num_rows; }
+  const std::vector<ArchiveNight> &Nights(void) const { return nights; }
+
+  int NumStars(void) const { return star_names.size(); }
+  const char *StarName(int star_id) const { return star_names[star_id].c_str(); }
+  int StarID(const char *name) const; // -1 if unknown
+  const char *FilterName(int filter_id) const { return filter_names[filter_id].c_str(); }
+  int FilterID(const char *name) const; // -1 if unknown
+
+  // Rows (in the order they were added) for one star
+  void StarRows(int star_id, std::vector<uint32_t> *rows);
+  // Rows with first_jd <= jd < last_jd; uses the night index
+  void DateRows(double first_jd, double last_jd, std::vector<uint32_t> *rows) const;
+
+  int Star(uint32_t row) const { return c_star[row]; }
+  double JD(uint32_t row) const { return c_jd[row]; }
+  int Filter(uint32_t row) const { return c_filter[row]; }
+  float Mag(uint32_t row) const { return c_mag[row]; }
+  float Err(uint32_t row) const { return c_err[row]; }
+  float Airmass(uint32_t row) const { return c_airmass[row]; }
+  juid_t JUID(uint32_t row) const { return c_juid[row]; }
+
+private:
+  std::string dir;
+  bool is_open {false};
+  bool writable;
+  uint32_t num_rows {0};
+
+  std::vector<std::string> star_names;
+  std::map<std::string, int> star_ids;
+  std::vector<std::string> filter_names;
+  std::map<std::string, int> filter_ids;
+  std::vector<ArchiveNight> nights;
+
+  // Per-star index (CSR): rows of star s are
+  // star_rows[star_start[s]] .. star_rows[star_start[s+1]-1]
+  bool star_index_valid {false};
+  std::vector<uint32_t> star_start;
+  std::vector<uint32_t> star_rows;
+
+  // mmap()ed columns
+  struct Mapping {
+    void *addr {nullptr};
+    size_t length {0};
+  };
+  Mapping maps[7];
+  const uint32_t *c_star {nullptr};
+  const double *c_jd {nullptr};
+  const uint8_t *c_filter {nullptr};
+  const float *c_mag {nullptr};
+  const float *c_err {nullptr};
+  const float *c_airmass {nullptr};
+  const juid_t *c_juid {nullptr};
+
+  int Open(void);
+  int MapColumns(void);
+  void UnmapColumns(void);
+  static int LookupOrAdd(const std::string &name,
+			 std::vector<std::string> &names,
+			 std::map<std::string, int> &ids);
+  std::string Path(const char *filename) const { return dir + "/" + filename; }
+};
+
+#endif
@@ -334,6 +334,20 @@ static const char *column_units[TABLE_NUMBER_FIELDS] = {
 
 void
 IStarList::SaveIntoFITSFile(const char *filename, int rewrite_okay) {
+  if (!rewrite_okay) {
+    IStarList existing(filename);
+    if (existing.NumStars) {
+      fprintf(stderr, "image file already has star list.\n");
+      return;
+    }
+  }
+  if (SaveIntoSidecar(filename) == 0) return;
+  fprintf(stderr, "IStarList: putting star list into %s itself.\n", filename);
+  SaveIntoFITSTable(filename, rewrite_okay);
+}
+
+void
+IStarList::SaveIntoFITSTable(const char *filename, int rewrite_okay) {
   fitsfile *fptr;       /* pointer to the FITS file, defined in fitsio.h */
   int status = 0;
 
@@ -565,6 +579,13 @@ void IStarList::InitializeFromFITSFile(fitsfile *fptr) {
   StarArray = 0;
   StarArrayCorrect = 0;
 
+  // A sidecar, if there is one, takes precedence over a table inside
+  // the image.
+  char fits_filename[FLEN_FILENAME];
+  if (fits_file_name(fptr, fits_filename, &status) == 0 &&
+      InitializeFromSidecar(fits_filename, info)) return;
+  status = 0;
+
   if (not GoToStarlistHDU(fptr)) return;
     
   int num_columns;
@@ -22,8 +22,11 @@
 
 #include <stdio.h>
 #include <fitsio.h>
+#include <string>
 #include "dec_ra.h"
 
+class ImageInfo;
+
 // Validity flags:
 #define NLLS_FOR_XY       0x01
 #define MAG_VALID         0x02
@@ -116,13 +119,25 @@ public:
 
   void PrintStarSummary(FILE *fp);
 
+  // The star list for an image is kept in a sidecar file next to the
+  // image (SidecarFilename()), not in the image itself; see
+  // IStarSidecar.cc. Images whose star list is still in a STARS table
+  // inside the FITS file are read the old way. If the sidecar can't
+  // be written, SaveIntoFITSFile() falls back to the table.
   void SaveIntoFITSFile(const char *filename, int rewrite_okay=1);
   IStarList(const char *fits_filename);	// initialize from a FITS file
 
   void InitializeFromFITSFile(fitsfile *fptr);
   IStarList(fitsfile *fptr) { InitializeFromFITSFile(fptr); }
 
+  static std::string SidecarFilename(const char *fits_filename);
+  static void RemoveSidecar(const char *fits_filename);
+
 private:
+  void SaveIntoFITSTable(const char *filename, int rewrite_okay);
+  int SaveIntoSidecar(const char *fits_filename); // 0 on success
+  bool InitializeFromSidecar(const char *fits_filename, ImageInfo &fits_info);
+
 
   IStarOneStar *head, *last;
   IStarOneStar **StarArray;
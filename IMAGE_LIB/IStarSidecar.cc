@@ -0,0 +1,303 @@
+/*  IStarSidecar.cc -- Star lists kept in a binary file beside the image
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>		// pwrite(), ftruncate(), unlink()
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <vector>
+#include <fitsio.h>
+#include "Image.h"
+#include "IStarList.h"
+
+// The STARS table inside a (usually tile-compressed) FITS image is
+// expensive to update: cfitsio has to shift or rewrite everything
+// after it, and every stage of the pipeline (find_stars, star_match,
+// photometry, ...) updates it. Instead, the star list is kept in
+// "<image>.stars", a header followed by one fixed-size record per
+// star. An update only writes the records that actually changed
+// (plus any appended at the end), and reads are done through mmap().
+//
+// The sidecar remembers which exposure it belongs to (DATE-OBS,
+// EXPOSURE and the image size, all from the image's own header), so
+// it still matches after the pair is copied, restored or rsync'ed,
+// and after header-only updates such as a new WCS. If the image has
+// been replaced by a different one, the sidecar is ignored (with a
+// message saying so). Image::WriteFITS() and friends remove the
+// sidecar when they overwrite an image.
+
+static const char SIDECAR_MAGIC[8] = { 'I', 'S', 'T', 'A', 'R', 'S', '2', 0 };
+
+struct SidecarHeader {
+  char     magic[8];
+  uint32_t record_size;		// sizeof(SidecarRecord)
+  uint32_t num_stars;
+  uint32_t fits_width;
+  uint32_t fits_height;
+  double   fits_exposure;	// EXPOSURE, or 0 if none
+  char     fits_date_obs[32];	// DATE-OBS, or "" if none
+};
+
+// Same values as the columns of the FITS table (see
+// IStarList::SaveIntoFITSTable()), but with a full-precision dec.
+struct SidecarRecord {
+  char     name[STARNAME_LENGTH];
+  double   x, y;
+  double   dec, ra;		// radians
+  double   magnitude;
+  double   background;
+  double   counts;
+  double   photometry;
+  double   magnitude_error;
+  uint32_t flags;		// validity_flags | (info_flags << 12)
+  uint32_t unused;
+};
+
+std::string
+IStarList::SidecarFilename(const char *fits_filename) {
+  return std::string(fits_filename) + ".stars";
+}
+
+void
+IStarList::RemoveSidecar(const char *fits_filename) {
+  (void) unlink(SidecarFilename(fits_filename).c_str());
+}
+
+// Fills in the fits_xxx fields of the header from the image's header.
+static void SetImageIdentity(ImageInfo &info, SidecarHeader *h) {
+  h->fits_width = info.width;
+  h->fits_height = info.height;
+  h->fits_exposure = (info.ExposureDurationValid() ? info.GetExposureDuration() : 0.0);
+  memset(h->fits_date_obs, 0, sizeof(h->fits_date_obs));
+  if (info.ExposureStartTimeValid()) {
+    strncpy(h->fits_date_obs, info.GetValueString("DATE-OBS").c_str(),
+	    sizeof(h->fits_date_obs)-1);
+  }
+}
+
+static bool SameImage(const SidecarHeader *a, const SidecarHeader *b) {
+  return (a->fits_width == b->fits_width &&
+	  a->fits_height == b->fits_height &&
+	  a->fits_exposure == b->fits_exposure &&
+	  strncmp(a->fits_date_obs, b->fits_date_obs, sizeof(a->fits_date_obs)) == 0);
+}
+
+static void PackStar(IStarList::IStarOneStar *star, SidecarRecord *r) {
+  memset(r, 0, sizeof(*r));	// so that unchanged records compare equal
+  strncpy(r->name, star->StarName, STARNAME_LENGTH-1);
+  if (star->validity_flags & NLLS_FOR_XY) {
+    r->x = star->nlls_x;
+    r->y = star->nlls_y;
+  } else {
+    r->x = star->StarCenterX();
+    r->y = star->StarCenterY();
+  }
+  if (star->validity_flags & DEC_RA_VALID) {
+    r->dec = star->dec_ra.dec();
+    r->ra = star->dec_ra.ra_radians();
+  }
+  r->magnitude = ((star->validity_flags & MAG_VALID) ? star->magnitude : 0.0);
+  r->photometry = ((star->validity_flags & PHOTOMETRY_VALID) ? star->photometry : -99.0);
+  r->magnitude_error = ((star->validity_flags & ERROR_VALID) ?
+			star->magnitude_error : -99.0);
+  r->background = ((star->validity_flags & BKGD_VALID) ? star->nlls_background : 0.0);
+  r->counts = ((star->validity_flags & COUNTS_VALID) ? star->nlls_counts : 0.0);
+  r->flags = star->validity_flags | (star->info_flags << 12);
+}
+
+// Writes "count" records starting at record "first"
+static int WriteRecords(int fd, const SidecarRecord *records, int first, int count) {
+  const size_t len = count*sizeof(SidecarRecord);
+  const off_t offset = sizeof(SidecarHeader) + first*sizeof(SidecarRecord);
+  if (pwrite(fd, records+first, len, offset) != (ssize_t) len) {
+    perror("IStarList: sidecar write");
+    return -1;
+  }
+  return 0;
+}
+
+//****************************************************************
+//        SaveIntoSidecar()
+//    Returns 0 on success, -1 if the sidecar couldn't be written
+//    (in which case the caller falls back to the FITS table).
+//****************************************************************
+int
+IStarList::SaveIntoSidecar(const char *fits_filename) {
+  fitsfile *fptr;
+  int fits_status = 0;
+  if (fits_open_file(&fptr, fits_filename, READONLY, &fits_status)) return -1;
+  ImageInfo fits_info(fptr);
+  (void) fits_close_file(fptr, &fits_status);
+
+  const std::string sidecar = SidecarFilename(fits_filename);
+  const int fd = open(sidecar.c_str(), O_RDWR|O_CREAT, 0664);
+  if (fd < 0) {
+    fprintf(stderr, "IStarList: cannot open %s: %s\n",
+	    sidecar.c_str(), strerror(errno));
+    return -1;
+  }
+
+  if (StarArrayCorrect == 0) FixStarArray();
+  std::vector<SidecarRecord> records(NumStars);
+  for (int i=0; i<NumStars; i++) {
+    PackStar(StarArray[i], &records[i]);
+  }
+
+  SidecarHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SIDECAR_MAGIC, sizeof(header.magic));
+  header.record_size = sizeof(SidecarRecord);
+  header.num_stars = NumStars;
+  SetImageIdentity(fits_info, &header);
+
+  // Look at what is already there
+  struct stat sidecar_stat;
+  const SidecarHeader *old_header = nullptr;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &sidecar_stat) == 0 &&
+      sidecar_stat.st_size >= (off_t) sizeof(SidecarHeader)) {
+    map = mmap(nullptr, sidecar_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map != MAP_FAILED) {
+      old_header = (const SidecarHeader *) map;
+      if (memcmp(old_header->magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) ||
+	  old_header->record_size != sizeof(SidecarRecord) ||
+	  sidecar_stat.st_size < (off_t) (sizeof(SidecarHeader) +
+					  old_header->num_stars*sizeof(SidecarRecord))) {
+	old_header = nullptr;	// not usable; rewrite all of it
+      }
+    }
+  }
+
+  int status = 0;
+  int old_count = 0;
+  if (old_header) {
+    // Rewrite only runs of records that changed
+    old_count = old_header->num_stars;
+    const SidecarRecord *old_records = (const SidecarRecord *) (old_header+1);
+    const int common = (old_count < NumStars ? old_count : NumStars);
+    int i = 0;
+    while (i < common && status == 0) {
+      if (memcmp(&old_records[i], &records[i], sizeof(SidecarRecord)) == 0) {
+	i++;
+	continue;
+      }
+      int j = i+1;
+      while (j < common &&
+	     memcmp(&old_records[j], &records[j], sizeof(SidecarRecord))) j++;
+      status = WriteRecords(fd, records.data(), i, j-i);
+      i = j;
+    }
+  }
+  // Appended records (or all of them, for a new sidecar)
+  if (status == 0 && NumStars > old_count) {
+    status = WriteRecords(fd, records.data(), old_count, NumStars-old_count);
+  }
+  if (status == 0 &&
+      (old_header == nullptr || memcmp(old_header, &header, sizeof(header)))) {
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      perror("IStarList: sidecar header write");
+      status = -1;
+    }
+  }
+  const off_t final_size = sizeof(SidecarHeader) + NumStars*sizeof(SidecarRecord);
+  if (status == 0 && sidecar_stat.st_size > final_size) {
+    if (ftruncate(fd, final_size)) {
+      perror("IStarList: sidecar truncate");
+      status = -1;
+    }
+  }
+
+  if (map != MAP_FAILED) munmap(map, sidecar_stat.st_size);
+  close(fd);
+  return status;
+}
+
+//****************************************************************
+//        InitializeFromSidecar()
+//    Returns false (with the list untouched) if there is no usable
+//    sidecar for this image.
+//****************************************************************
+bool
+IStarList::InitializeFromSidecar(const char *fits_filename, ImageInfo &fits_info) {
+  const std::string sidecar = SidecarFilename(fits_filename);
+  const int fd = open(sidecar.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat sidecar_stat;
+  if (fstat(fd, &sidecar_stat) ||
+      sidecar_stat.st_size < (off_t) sizeof(SidecarHeader)) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(nullptr, sidecar_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  const SidecarHeader *header = (const SidecarHeader *) map;
+  bool usable = true;
+  if (memcmp(header->magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) ||
+      header->record_size != sizeof(SidecarRecord) ||
+      sidecar_stat.st_size < (off_t) (sizeof(SidecarHeader) +
+				      header->num_stars*sizeof(SidecarRecord))) {
+    fprintf(stderr, "IStarList: %s is not a valid star list.\n", sidecar.c_str());
+    usable = false;
+  } else {
+    SidecarHeader image_id;
+    SetImageIdentity(fits_info, &image_id);
+    if (not SameImage(header, &image_id)) {
+      fprintf(stderr, "IStarList: %s is stale (belongs to %dx%d image from %s, not %s); ignored.\n",
+	      sidecar.c_str(), header->fits_width, header->fits_height,
+	      header->fits_date_obs, image_id.fits_date_obs);
+      usable = false;
+    }
+  }
+
+  if (usable) {
+    const SidecarRecord *records = (const SidecarRecord *) (header+1);
+    const int num_rows = header->num_stars;
+    for (int i=0; i<num_rows; i++) {
+      IStarAdd(0.0, 0.0, 0, 0, 0.0, 0);
+    }
+    FixStarArray();
+
+    for (int i=0; i<num_rows; i++) {
+      const SidecarRecord &r = records[i];
+      IStarOneStar *star = StarArray[i];
+      memcpy(star->StarName, r.name, STARNAME_LENGTH);
+      star->StarName[STARNAME_LENGTH-1] = 0;
+      star->nlls_x = r.x;
+      star->nlls_y = r.y;
+      if (r.flags & DEC_RA_VALID) star->dec_ra = DEC_RA(r.dec, r.ra);
+      if (r.flags & MAG_VALID) star->magnitude = r.magnitude;
+      if (r.flags & PHOTOMETRY_VALID) star->photometry = r.photometry;
+      if (r.flags & BKGD_VALID) star->nlls_background = r.background;
+      if (r.flags & COUNTS_VALID) star->nlls_counts = r.counts;
+      if (r.flags & ERROR_VALID) star->magnitude_error = r.magnitude_error;
+      star->validity_flags = (r.flags | NLLS_FOR_XY) & (0xfff);
+      star->info_flags = (r.flags >> 12);
+    }
+  }
+
+  munmap(map, sidecar_stat.st_size);
+  return usable;
+}
@@ -111,6 +111,11 @@ struct FITSComment {
 		    { "WCSDECCTR", " [rad] Declination of image center" },
 		    { "WCSRACTR", " [rad] Right Ascension of image center" },
 		    { "WCSSCALE", " [arcsec/pixel?] Image x- and y-scale" },
+		    { "WCSCD1_1", " [rad/pixel] WCS CD matrix, xi per x" },
+		    { "WCSCD1_2", " [rad/pixel] WCS CD matrix, xi per y" },
+		    { "WCSCD2_1", " [rad/pixel] WCS CD matrix, eta per x" },
+		    { "WCSCD2_2", " [rad/pixel] WCS CD matrix, eta per y" },
+		    { "WCSPORD", " Order of WCS distortion polynomial" },
 };
 
 const char *CommentForKeyword(const char *keyword) {
@@ -554,8 +559,10 @@ Image::WriteFITS(const char *filename, bool compress) const {
   char FITSFilename[256];
   int status = 0;
 
-  // unlink the file if it previously existed
+  // unlink the file if it previously existed (and its star list,
+  // which belonged to the old image)
   (void) unlink(filename);
+  IStarList::RemoveSidecar(filename);
 
   // '!' means overwrite existing file, if it exists
   sprintf(FITSFilename, "!%s%s", encode_FITS_filename(filename, false),
@@ -629,8 +636,10 @@ Image::WriteFITS32(const char *filename, bool compress) const {
   char FITSFilename[256];
   int status = 0;
 
-  // unlink the file if it previously existed
+  // unlink the file if it previously existed (and its star list,
+  // which belonged to the old image)
   (void) unlink(filename);
+  IStarList::RemoveSidecar(filename);
 
   sprintf(FITSFilename, "!%s%s", filename,
 	  (compress ? "[compress]" : ""));
@@ -688,8 +697,10 @@ Image::WriteFITSFloat(const char *filename, bool compress) const {
   char FITSFilename[256];
   int status = 0;
 
-  // unlink the file if it previously existed
+  // unlink the file if it previously existed (and its star list,
+  // which belonged to the old image)
   (void) unlink(filename);
+  IStarList::RemoveSidecar(filename);
 
   // '!' will result in overwrite of a pre-existing file.
   sprintf(FITSFilename, "!%s%s", filename, (compress ? "[compress]":""));
@@ -884,6 +895,7 @@ Image::find_stars(void) {
     ThisStarList = new IStarList(temp_filename);
   }
   unlink(temp_filename);
+  IStarList::RemoveSidecar(temp_filename);
 }
 
 #define NEWSTARLIST
@@ -2245,6 +2257,22 @@ Image::linearize(void) {
 #endif
 }
 
+int
+Image::linearize(const Image *correction) {
+  if (correction->width != width || correction->height != height) {
+    fprintf(stderr, "Image::linearize: correction is %dx%d, image is %dx%d\n",
+	    correction->width, correction->height, width, height);
+    return -1;
+  }
+  const int num_pixels = width*height;
+  const double *k = correction->i_pixels;
+  for (int i = 0; i < num_pixels; i++) {
+    const double x = i_pixels[i];
+    i_pixels[i] = x + k[i]*x*x;
+  }
+  return 0;
+}
+
 void
 ImageInfo::SetAllInvalid(void) {
   key_values.clear();
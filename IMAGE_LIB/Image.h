@@ -247,6 +247,11 @@ public:
   ~Image(void);
 
   void linearize(void); // should only be done once to an image
+  // Per-pixel correction: each pixel p becomes p + k*p*p, where k is
+  // the matching pixel of "correction" (the "_nonlin" map written by
+  // pixel_linearity). Also should only be done once. Returns 0 on
+  // success, -1 if the sizes don't match.
+  int linearize(const Image *correction);
   void RemoveShutterGradient(double exposure_time);
 
   // Return an image binned
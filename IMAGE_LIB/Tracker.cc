@@ -1,6 +1,6 @@
 /*  Tracker.cc -- implements crude star-tracker to support PEC
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -49,32 +49,52 @@ Tracker::Tracker(Image *image) {
     fprintf(stderr, "Tracker: initial X = %f, initial Y = %f\n",
 	    Current_pos_x, Current_pos_y);
 
-#define TRACKER_BOX_RADIUS_PIXELS 8
-
-    box_left   = (int) Current_pos_x - TRACKER_BOX_RADIUS_PIXELS;
-    box_right  = (int) Current_pos_x + TRACKER_BOX_RADIUS_PIXELS;
-    box_top    = (int) Current_pos_y + TRACKER_BOX_RADIUS_PIXELS;
-    box_bottom = (int) Current_pos_y - TRACKER_BOX_RADIUS_PIXELS;
-    
+    SetBox();
     Update(image, 0);
   }
 }
 
+Tracker::Tracker(Image *image, double x_pos, double y_pos) {
+  tracker_status = TRACKER_LOCK;
+  Current_pos_x = x_pos;
+  Current_pos_y = y_pos;
+  SetBox();
+  Update(image, 0);
+}
+
+void
+Tracker::SetBox(void) {
+  box_left   = (int) Current_pos_x - TRACKER_BOX_RADIUS_PIXELS;
+  box_right  = (int) Current_pos_x + TRACKER_BOX_RADIUS_PIXELS;
+  box_top    = (int) Current_pos_y + TRACKER_BOX_RADIUS_PIXELS;
+  box_bottom = (int) Current_pos_y - TRACKER_BOX_RADIUS_PIXELS;
+}
+
 void
 Tracker::Update(Image *image, int depth) {
   double x_weighted_sum = 0.0;
   double y_weighted_sum = 0.0;
   double total_pixel_sum = 0.0;
+#if DEBUG
   double brightest_tracking_pixel = -1000000.0;
+  int bright_x, bright_y;
+#endif
   // pixel_offset is sort of a floor intensity.  It is subtracted from
   // each pixel value. We use the median pixel value in the tracking
   // box.
   double pixel_offset;
-  int bright_x, bright_y;
   int x, y;
 
   // detect and halt oscillation
   if(depth > 3) return;
+  if(tracker_status == NO_LOCK) return;
+
+  if(box_left < 0 || box_bottom < 0 ||
+     box_right > image->width || box_top > image->height) {
+    // star has drifted off the edge of the image
+    tracker_status = NO_LOCK;
+    return;
+  }
 
   Image *subImage = image->CreateSubImage(box_bottom,
 					  box_left,
@@ -82,33 +102,47 @@ Tracker::Update(Image *image, int depth) {
 					  TRACKER_BOX_RADIUS_PIXELS*2);
 
   pixel_offset = subImage->statistics()->MedianPixel;
+#if DEBUG
   fprintf(stderr, "Median subimage value = %f\n", pixel_offset);
   fprintf(stderr, "box_left = %d, box_bottom = %d\n",
 	  box_left, box_bottom);
   subImage->PrintImage(stderr);
+#endif
   
   for(y=0; y < subImage->height; y++) {
     for(x=0; x < subImage->width; x++) {
       double pixel_value = subImage->pixel(x, y) - pixel_offset;
 
+#if DEBUG
       if(pixel_value > brightest_tracking_pixel) {
 	bright_x = x;
 	bright_y = y;
 	brightest_tracking_pixel = pixel_value;
       }
+#endif
       x_weighted_sum += (x)*pixel_value;
       y_weighted_sum += (y)*pixel_value;
       total_pixel_sum += pixel_value;
     }
   }
 
+  if(total_pixel_sum <= 0.0) {
+    // nothing but background in the box (clouds?)
+    tracker_status = LOST_LOCK_TEMP;
+    delete subImage;
+    return;
+  }
+  tracker_status = TRACKER_LOCK;
+
   Current_pos_x = box_left + x_weighted_sum/total_pixel_sum;
   Current_pos_y = box_bottom + y_weighted_sum/total_pixel_sum;
+#if DEBUG
   fprintf(stderr, "Brightest tracking pixel = %f @ (%d,%d)\n",
 	  brightest_tracking_pixel, bright_x, bright_y);
   fprintf(stderr, "total_pixel_sum = %f\n", total_pixel_sum);
   fprintf(stderr, "Updated position: X=%f, Y=%f\n",
 	  Current_pos_x, Current_pos_y);
+#endif
 
   // re-adjust the box?
   if(Current_pos_x < (box_left + TRACKER_BOX_RADIUS_PIXELS/2) ||
@@ -116,12 +150,13 @@ Tracker::Update(Image *image, int depth) {
      Current_pos_y < (box_bottom + TRACKER_BOX_RADIUS_PIXELS/2) ||
      Current_pos_y > (box_top - TRACKER_BOX_RADIUS_PIXELS/2)) {
     // Yes: new box
+#if DEBUG
     fprintf(stderr, "Shifting tracker box.\n");
-    box_left   = (int) Current_pos_x - TRACKER_BOX_RADIUS_PIXELS;
-    box_right  = (int) Current_pos_x + TRACKER_BOX_RADIUS_PIXELS;
-    box_top    = (int) Current_pos_y + TRACKER_BOX_RADIUS_PIXELS;
-    box_bottom = (int) Current_pos_y - TRACKER_BOX_RADIUS_PIXELS;
+#endif
+    SetBox();
+    delete subImage;
     Update(image, depth+1);		// repeat
+    return;
   }
   
   // now need to decide whether there is really a star here.
@@ -1,7 +1,7 @@
 /* This may look like C code, but it is really -*-c++-*- */
 /*  Tracker.h -- implements crude star-tracker to support PEC
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -26,11 +26,22 @@
 #define LOST_LOCK_TEMP	1
 #define NO_LOCK 	2
 
+// The star is followed inside a box this far (in pixels) on either
+// side of its last known position.
+#define TRACKER_BOX_RADIUS_PIXELS 8
+
 class Tracker {
 public:
+  // Locks onto the brightest star in the image
   Tracker(Image *image);
-  ~Tracker(void);
+  // Locks onto the star near (x_pos, y_pos)
+  Tracker(Image *image, double x_pos, double y_pos);
+  ~Tracker(void) {;}
 
+  // Re-measures the star's position in a new image. If the box falls
+  // off the edge of the image, the lock is lost for good; if the box
+  // holds nothing brighter than the background, the lock is lost
+  // for this image only and the old position is kept.
   void Update(Image *image, int depth=0);
 
   int TrackerStatus(void) { return tracker_status; }
@@ -48,6 +59,8 @@ private:
   int box_bottom;
 
   int tracker_status;
+
+  void SetBox(void);		// centered on Current_pos_x/y
 };
 
 #endif
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <HGSC.h>
 #include <list>
+#include <vector>
 #include <string.h>
 
 BadPixels::BadPixels(void) {
@@ -208,38 +209,51 @@ BadPixels::UpdateTargetForBadPixels(Image *image, const char *object_name) {
   fprintf(stdout, "Catalog fetch for %s: completed.\n", object_name);
   
   const WCS *wcs = image->GetImageInfo()->GetWCS();
+  std::vector<HGSC *> selected;
+  std::vector<DEC_RA> locations;
   HGSCIterator it(catalog);
   for (HGSC *hgsc = it.First(); hgsc; hgsc = it.Next()) {
     if (hgsc->is_comp || hgsc->is_check || hgsc->do_submit) {
-      IStarList::IStarOneStar *star = new IStarList::IStarOneStar;
-      strcpy(star->StarName, hgsc->label);
-      star->validity_flags = (NLLS_FOR_XY | CORRELATED);
-      star->info_flags = 0;
-      bool mandatory = false;
-      if (hgsc->is_comp) {
-	star->info_flags |= STAR_IS_COMP;
-	fprintf(stdout, "P");
-	mandatory = true;
-      }
-      if (hgsc->is_check) {
-	star->info_flags |= STAR_IS_CHECK;
-	fprintf(stdout, "K");
-      }
-      if (hgsc->do_submit) {
-	star->info_flags |= STAR_IS_SUBMIT;
-	fprintf(stdout, "S");
-	mandatory = true;
-      }
-      // Be aware that this IStarList contains catalog stars that fall
-      // well outside the boundaries of the image. 
-      wcs->Transform(&hgsc->location, &star->nlls_x, &star->nlls_y);
-      if (mandatory && star->nlls_x >= 0.0 && star->nlls_y >= 0.0 &&
-	  star->nlls_x <= image->width && star->nlls_y <= image->height) {
-	star->info_flags |= STAR_IS_INFRAME;
-      }
+      selected.push_back(hgsc);
+      locations.push_back(hgsc->location);
+    }
+  }
+  std::vector<double> star_x(selected.size());
+  std::vector<double> star_y(selected.size());
+  wcs->TransformToPixels(selected.size(), locations.data(),
+			 star_x.data(), star_y.data());
 
-      isl.IStarAdd(star);
+  for (unsigned int i=0; i<selected.size(); i++) {
+    HGSC *hgsc = selected[i];
+    IStarList::IStarOneStar *star = new IStarList::IStarOneStar;
+    strcpy(star->StarName, hgsc->label);
+    star->validity_flags = (NLLS_FOR_XY | CORRELATED);
+    star->info_flags = 0;
+    bool mandatory = false;
+    if (hgsc->is_comp) {
+      star->info_flags |= STAR_IS_COMP;
+      fprintf(stdout, "P");
+      mandatory = true;
+    }
+    if (hgsc->is_check) {
+      star->info_flags |= STAR_IS_CHECK;
+      fprintf(stdout, "K");
+    }
+    if (hgsc->do_submit) {
+      star->info_flags |= STAR_IS_SUBMIT;
+      fprintf(stdout, "S");
+      mandatory = true;
     }
+    // Be aware that this IStarList contains catalog stars that fall
+    // well outside the boundaries of the image. 
+    star->nlls_x = star_x[i];
+    star->nlls_y = star_y[i];
+    if (mandatory && star->nlls_x >= 0.0 && star->nlls_y >= 0.0 &&
+	star->nlls_x <= image->width && star->nlls_y <= image->height) {
+      star->info_flags |= STAR_IS_INFRAME;
+    }
+
+    isl.IStarAdd(star);
   }
   fprintf(stdout, "\n");
   fprintf(stdout, "IStarList contains %d stars.\n",
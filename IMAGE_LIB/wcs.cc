@@ -23,6 +23,9 @@
 #include <Image.h>		// ImageInfo
 #include <list>
 #include <string>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_multifit.h>
 
 #define Str(x) #x
 #define Xstr(x) Str(x)
@@ -32,6 +35,23 @@ WCS::WCS(WCS_ENUM_TYPE wcs_variant) {
   wcs_is_valid = false;
   wcs_type = wcs_variant;
 }
+
+void
+WCS::TransformToDecRA(int n, const double *x, const double *y,
+		      DEC_RA *dec_ra) const {
+  for (int i=0; i<n; i++) {
+    dec_ra[i] = Transform(x[i], y[i]);
+  }
+}
+
+void
+WCS::TransformToPixels(int n, const DEC_RA *dec_ra,
+		       double *x, double *y) const {
+  for (int i=0; i<n; i++) {
+    DEC_RA point = dec_ra[i];
+    Transform(&point, x+i, y+i);
+  }
+}
   
 WCS *NewWCS(ImageInfo *info) {
   if (!info->KeywordPresent("WCSTYPE")) return 0;
@@ -43,6 +63,9 @@ WCS *NewWCS(ImageInfo *info) {
   if (w_type == "SIMPLE") {
     return new WCS_Simple(info);
   }
+  if (w_type == "POLY") {
+    return new WCS_Poly(info);
+  }
 
   fprintf(stderr, "wcs.cc: illegal WCSTYPE keyword encountered: %s\n", w_type.c_str());
   return new WCS_Simple(0);
@@ -54,6 +77,8 @@ WCS *NewWCS(WCS_ENUM_TYPE wcs_variant) {
     return new WCS_Simple(0);
   case WCS_BILINEAR:
     return new WCS_Bilinear(0);
+  case WCS_POLY:
+    return new WCS_Poly(0);
   }
   
   fprintf(stderr, "wcs.cc: illegal wcs_variant enum encountered: %d\n", (int) wcs_variant);
@@ -409,12 +434,85 @@ WCS_Bilinear::Center(void) const {
   return Transform(width_in_pixels/2, height_in_pixels/2);
 }
 
+// Written out, the bilinear interpolation in Transform() is
+//    value = c0 + c1*fx + c2*fy + c3*fx*fy
+// where fx and fy are the fractional distances across the image
+// (0..1), for both dec and RA. The batch transforms work directly
+// from these coefficients.
+void
+WCS_Bilinear::TransformToDecRA(int n, const double *x, const double *y,
+			       DEC_RA *dec_ra) const {
+  const double dec_c0 = lowerleft_dec;
+  const double dec_c1 = lowerright_dec - lowerleft_dec;
+  const double dec_c2 = upperleft_dec - lowerleft_dec;
+  const double dec_c3 = upperright_dec - upperleft_dec - lowerright_dec + lowerleft_dec;
+  const double ra_c0 = lowerleft_ra;
+  const double ra_c1 = lowerright_ra - lowerleft_ra;
+  const double ra_c2 = upperleft_ra - lowerleft_ra;
+  const double ra_c3 = upperright_ra - upperleft_ra - lowerright_ra + lowerleft_ra;
+  const double inv_width = 1.0/width_in_pixels;
+  const double inv_height = 1.0/height_in_pixels;
+
+  for (int i=0; i<n; i++) {
+    const double fx = x[i]*inv_width;
+    const double fy = y[i]*inv_height;
+    const double dec = dec_c0 + dec_c1*fx + dec_c2*fy + dec_c3*fx*fy;
+    double ra = ra_c0 + ra_c1*fx + ra_c2*fy + ra_c3*fx*fy;
+    if (ra < 0.0) ra += (2.0*M_PI);
+    dec_ra[i] = DEC_RA(dec, ra);
+  }
+}
+
+void
+WCS_Bilinear::TransformToPixels(int n, const DEC_RA *dec_ra,
+				double *x, double *y) const {
+  const double dec_c0 = lowerleft_dec;
+  const double dec_c1 = lowerright_dec - lowerleft_dec;
+  const double dec_c2 = upperleft_dec - lowerleft_dec;
+  const double dec_c3 = upperright_dec - upperleft_dec - lowerright_dec + lowerleft_dec;
+  const double ra_c0 = lowerleft_ra;
+  const double ra_c1 = lowerright_ra - lowerleft_ra;
+  const double ra_c2 = upperleft_ra - lowerleft_ra;
+  const double ra_c3 = upperright_ra - upperleft_ra - lowerright_ra + lowerleft_ra;
+  // RA at the center of the image; the incoming RA is moved by 2*pi
+  // if needed to put it on the same side of 00:00:00 as this.
+  const double center_ra = ra_c0 + ra_c1/2.0 + ra_c2/2.0 + ra_c3/4.0;
+
+  for (int i=0; i<n; i++) {
+    const double target_dec = dec_ra[i].dec();
+    double target_ra = dec_ra[i].ra_radians();
+    if (target_ra - center_ra > M_PI) target_ra -= (2.0*M_PI);
+    if (target_ra - center_ra < -M_PI) target_ra += (2.0*M_PI);
+
+    // Newton's method. The c3 (twist) terms are tiny, so this
+    // converges to full precision in a handful of steps from the
+    // center of the image; a fixed count keeps the loop branch-free.
+    double fx = 0.5;
+    double fy = 0.5;
+    for (int iter=0; iter<5; iter++) {
+      const double err_dec = dec_c0 + dec_c1*fx + dec_c2*fy + dec_c3*fx*fy - target_dec;
+      const double err_ra = ra_c0 + ra_c1*fx + ra_c2*fy + ra_c3*fx*fy - target_ra;
+      const double j11 = dec_c1 + dec_c3*fy;
+      const double j12 = dec_c2 + dec_c3*fx;
+      const double j21 = ra_c1 + ra_c3*fy;
+      const double j22 = ra_c2 + ra_c3*fx;
+      const double det = j11*j22 - j12*j21;
+      fx -= (j22*err_dec - j12*err_ra)/det;
+      fy -= (j11*err_ra - j21*err_dec)/det;
+    }
+    x[i] = fx*width_in_pixels;
+    y[i] = fy*height_in_pixels;
+  }
+}
+
 
 //****************************************************************
 //        WCS_Simple
 //****************************************************************
 WCS_Simple::WCS_Simple(void) : WCS(WCS_SIMPLE) {
   cos_dec = 1.0;
+  cos_rot = 1.0;
+  sin_rot = 0.0;
 }
 
 std::list<std::string> simple_keywords
@@ -433,11 +531,18 @@ WCS_Simple::WCS_Simple(ImageInfo *info) : WCS(WCS_SIMPLE) {
   double declination = 0.0;
   double right_ascension = 0.0;
 
+  cos_dec = 1.0;
+  cos_rot = 1.0;
+  sin_rot = 0.0;
+
   if (info == 0) {
     wcs_is_valid = false;
     return;
   }
 
+  image_width = info->width;
+  image_height = info->height;
+
   for (auto keyword : simple_keywords) {
     if (!info->KeywordPresent(keyword.c_str())) {
       fprintf(stderr, "%s keyword missing.\n",
@@ -454,6 +559,9 @@ WCS_Simple::WCS_Simple(ImageInfo *info) : WCS(WCS_SIMPLE) {
     right_ascension = info->GetValueDouble("WCSRACTR");
 
     center_point = DEC_RA(declination, right_ascension);
+    cos_dec = cos(declination);
+    cos_rot = cos(rotation_angle);
+    sin_rot = sin(rotation_angle);
   }
 
   wcs_is_valid = !any_err;
@@ -482,6 +590,8 @@ WCS_Simple::Set(DEC_RA &center,
   scale = img_scale;
   rotation_angle = rotation;
   cos_dec = cos(center.dec());
+  cos_rot = cos(rotation);
+  sin_rot = sin(rotation);
 }
 
 
@@ -496,8 +606,6 @@ DEC_RA
 WCS_Simple::Transform(double x, double y) const {
   const double center_x = image_width/2.0;
   const double center_y = image_height/2.0;
-  const double cos_rot = cos(rotation_angle);
-  const double sin_rot = sin(rotation_angle);
 
   const double offset_x = x-center_x;
   const double offset_y = y-center_y;
@@ -515,8 +623,6 @@ WCS_Simple::Transform(double x, double y) const {
   // convert from Dec/RA to pixel coordinates
 void
 WCS_Simple::Transform(DEC_RA *dec_ra, double *x, double *y) const {
-  const double cos_rot = cos(rotation_angle);
-  const double sin_rot = sin(rotation_angle);
   const double delta_dec = dec_ra->dec()-center_point.dec();
   const double delta_ra = (dec_ra->ra_radians()-center_point.ra_radians())*cos_dec;
 
@@ -535,3 +641,444 @@ WCS_Simple::PrintRotAndScale(void) const {
   fprintf(stderr, "Rotation angle = %.1lf deg, Scale = %.2lf arcsec/pixel\n",
 	  180.0*rotation_angle/M_PI, scale);
 }
+
+// Same arithmetic as the single-point Transform()s, with all the
+// per-WCS factors folded together ahead of the loop.
+void
+WCS_Simple::TransformToDecRA(int n, const double *x, const double *y,
+			     DEC_RA *dec_ra) const {
+  const double center_x = image_width/2.0;
+  const double center_y = image_height/2.0;
+  const double dec_per_pixel = scale*M_PI/(3600.0*180.0);
+  const double ra_per_pixel = dec_per_pixel/cos_dec;
+  const double dec0 = center_point.dec();
+  const double ra0 = center_point.ra_radians();
+
+  for (int i=0; i<n; i++) {
+    const double offset_x = x[i]-center_x;
+    const double offset_y = y[i]-center_y;
+    const double offset_ew = offset_x*cos_rot + offset_y*sin_rot;
+    const double offset_ns = offset_y*cos_rot - offset_x*sin_rot;
+    dec_ra[i] = DEC_RA(dec0 + offset_ns*dec_per_pixel,
+		       ra0 + offset_ew*ra_per_pixel);
+  }
+}
+
+void
+WCS_Simple::TransformToPixels(int n, const DEC_RA *dec_ra,
+			      double *x, double *y) const {
+  const double pixels_per_radian = (3600.0*180.0/M_PI)/scale;
+  const double ew_factor = cos_dec*pixels_per_radian;
+  const double dec0 = center_point.dec();
+  const double ra0 = center_point.ra_radians();
+  const double center_x = image_width/2.0;
+  const double center_y = image_height/2.0;
+
+  for (int i=0; i<n; i++) {
+    const double delta_ew = (dec_ra[i].ra_radians()-ra0)*ew_factor;
+    const double delta_ns = (dec_ra[i].dec()-dec0)*pixels_per_radian;
+    x[i] = center_x + delta_ew*cos_rot - delta_ns*sin_rot;
+    y[i] = center_y + delta_ew*sin_rot + delta_ns*cos_rot;
+  }
+}
+
+//****************************************************************
+//        WCS_Poly
+//****************************************************************
+WCS_Poly::WCS_Poly(void) : WCS(WCS_POLY) {
+  image_width = image_height = 0.0;
+  cd[0][0] = cd[1][1] = 1.0;
+  cd[0][1] = cd[1][0] = 0.0;
+  order = 1;
+  memset(dist_a, 0, sizeof(dist_a));
+  memset(dist_b, 0, sizeof(dist_b));
+  fit_rms = 0.0;
+  Refresh();
+}
+
+WCS_Poly::WCS_Poly(ImageInfo *info) : WCS_Poly() {
+  bool any_err = false;
+
+  if (info == 0) return; // this creates an "empty" WCS
+
+  image_width = info->width;
+  image_height = info->height;
+
+  static const char *poly_keywords[] = {
+    "WCSDECCTR", "WCSRACTR", "WCSCD1_1", "WCSCD1_2",
+    "WCSCD2_1", "WCSCD2_2", "WCSPORD" };
+  for (const char *keyword : poly_keywords) {
+    if (!info->KeywordPresent(keyword)) {
+      fprintf(stderr, "%s keyword missing.\n", keyword);
+      any_err = true;
+    }
+  }
+
+  if (!any_err) {
+    center_point = DEC_RA(info->GetValueDouble("WCSDECCTR"),
+			  info->GetValueDouble("WCSRACTR"));
+    cd[0][0] = info->GetValueDouble("WCSCD1_1");
+    cd[0][1] = info->GetValueDouble("WCSCD1_2");
+    cd[1][0] = info->GetValueDouble("WCSCD2_1");
+    cd[1][1] = info->GetValueDouble("WCSCD2_2");
+    order = info->GetValueInt("WCSPORD");
+    if (order < 1 || order > WCS_POLY_MAX_ORDER) {
+      fprintf(stderr, "wcs.cc: illegal WCSPORD value: %d\n", order);
+      order = 1;
+      any_err = true;
+    }
+    // Missing distortion terms are taken as zero
+    for (int p=0; p<=order; p++) {
+      for (int q=0; p+q<=order; q++) {
+	if (p+q < 2) continue;
+	char keyword[32];
+	sprintf(keyword, "WCSA_%d_%d", p, q);
+	if (info->KeywordPresent(keyword)) dist_a[p][q] = info->GetValueDouble(keyword);
+	sprintf(keyword, "WCSB_%d_%d", p, q);
+	if (info->KeywordPresent(keyword)) dist_b[p][q] = info->GetValueDouble(keyword);
+      }
+    }
+  }
+  Refresh();
+  wcs_is_valid = !any_err;
+}
+
+void
+WCS_Poly::UpdateFITSHeader(ImageInfo *info) const {
+  if (info == 0 || !wcs_is_valid) return;
+
+  info->SetValueString("WCSTYPE", "POLY");
+  SetValuePrecise(info, "WCSDECCTR", center_point.dec());
+  SetValuePrecise(info, "WCSRACTR", center_point.ra_radians());
+  // The CD terms are only ~1e-5, so %.15lf would lose precision
+  const char *cd_keywords[2][2] = { { "WCSCD1_1", "WCSCD1_2" },
+				    { "WCSCD2_1", "WCSCD2_2" } };
+  for (int i=0; i<2; i++) {
+    for (int j=0; j<2; j++) {
+      char buffer[80];
+      sprintf(buffer, "%.16le", cd[i][j]);
+      info->SetValue(string(cd_keywords[i][j]), string(buffer));
+    }
+  }
+  char order_string[16];
+  sprintf(order_string, "%d", order);
+  info->SetValue(string("WCSPORD"), string(order_string));
+  for (int p=0; p<=order; p++) {
+    for (int q=0; p+q<=order; q++) {
+      if (p+q < 2) continue;
+      char keyword[32];
+      char buffer[80];
+      sprintf(keyword, "WCSA_%d_%d", p, q);
+      sprintf(buffer, "%.16le", dist_a[p][q]);
+      info->SetValue(string(keyword), string(buffer));
+      sprintf(keyword, "WCSB_%d_%d", p, q);
+      sprintf(buffer, "%.16le", dist_b[p][q]);
+      info->SetValue(string(keyword), string(buffer));
+    }
+  }
+}
+
+void
+WCS_Poly::SetImageSize(int width, int height) {
+  image_width = width;
+  image_height = height;
+}
+
+void
+WCS_Poly::Set(DEC_RA &center,
+	      double img_scale,	// arcsec/pixel
+	      double rotation) { // radians
+  const double s = img_scale*M_PI/(3600.0*180.0); // radians/pixel
+  center_point = center;
+  cd[0][0] = s*cos(rotation);
+  cd[0][1] = s*sin(rotation);
+  cd[1][0] = -s*sin(rotation);
+  cd[1][1] = s*cos(rotation);
+  order = 1;
+  memset(dist_a, 0, sizeof(dist_a));
+  memset(dist_b, 0, sizeof(dist_b));
+  Refresh();
+  wcs_is_valid = true;
+}
+
+void
+WCS_Poly::SetDistortion(int poly_order,
+			const double a[WCS_POLY_MAX_ORDER+1][WCS_POLY_MAX_ORDER+1],
+			const double b[WCS_POLY_MAX_ORDER+1][WCS_POLY_MAX_ORDER+1]) {
+  if (poly_order < 1 || poly_order > WCS_POLY_MAX_ORDER) {
+    fprintf(stderr, "WCS_Poly::SetDistortion(): illegal order: %d\n", poly_order);
+    return;
+  }
+  order = poly_order;
+  memset(dist_a, 0, sizeof(dist_a));
+  memset(dist_b, 0, sizeof(dist_b));
+  for (int p=0; p<=order; p++) {
+    for (int q=0; p+q<=order; q++) {
+      if (p+q < 2) continue;
+      dist_a[p][q] = a[p][q];
+      dist_b[p][q] = b[p][q];
+    }
+  }
+}
+
+void
+WCS_Poly::Refresh(void) {
+  sin_dec0 = sin(center_point.dec());
+  cos_dec0 = cos(center_point.dec());
+  ra0 = center_point.ra_radians();
+
+  const double det = cd[0][0]*cd[1][1] - cd[0][1]*cd[1][0];
+  cd_inv[0][0] = cd[1][1]/det;
+  cd_inv[0][1] = -cd[0][1]/det;
+  cd_inv[1][0] = -cd[1][0]/det;
+  cd_inv[1][1] = cd[0][0]/det;
+}
+
+inline void
+WCS_Poly::ToSky(double xi, double eta, double *dec, double *ra) const {
+  const double denom = cos_dec0 - eta*sin_dec0;
+  *dec = atan2(sin_dec0 + eta*cos_dec0, sqrt(xi*xi + denom*denom));
+  double r = ra0 + atan2(xi, denom);
+  if (r < 0.0) r += (2.0*M_PI);
+  if (r >= 2.0*M_PI) r -= (2.0*M_PI);
+  *ra = r;
+}
+
+inline void
+WCS_Poly::ToPlane(double dec, double ra, double *xi, double *eta) const {
+  const double sin_dec = sin(dec);
+  const double cos_dec = cos(dec);
+  const double sin_dra = sin(ra - ra0);
+  const double cos_dra = cos(ra - ra0);
+  const double cos_c = sin_dec0*sin_dec + cos_dec0*cos_dec*cos_dra;
+  *xi = cos_dec*sin_dra/cos_c;
+  *eta = (cos_dec0*sin_dec - sin_dec0*cos_dec*cos_dra)/cos_c;
+}
+
+inline void
+WCS_Poly::Distort(double u, double v, double *up, double *vp) const {
+  double du = 0.0;
+  double dv = 0.0;
+  if (order >= 2) {
+    double u_pow[WCS_POLY_MAX_ORDER+1];
+    double v_pow[WCS_POLY_MAX_ORDER+1];
+    u_pow[0] = v_pow[0] = 1.0;
+    for (int k=1; k<=order; k++) {
+      u_pow[k] = u_pow[k-1]*u;
+      v_pow[k] = v_pow[k-1]*v;
+    }
+    for (int p=0; p<=order; p++) {
+      for (int q=(p < 2 ? 2-p : 0); p+q<=order; q++) {
+	const double term = u_pow[p]*v_pow[q];
+	du += dist_a[p][q]*term;
+	dv += dist_b[p][q]*term;
+      }
+    }
+  }
+  *up = u + du;
+  *vp = v + dv;
+}
+
+// The distortion is a small correction, so simple fixed-point
+// iteration converges quickly.
+inline void
+WCS_Poly::Undistort(double up, double vp, double *u, double *v) const {
+  double uu = up;
+  double vv = vp;
+  if (order >= 2) {
+    for (int iter=0; iter<6; iter++) {
+      double du, dv;
+      Distort(uu, vv, &du, &dv);
+      uu = up - (du - uu);
+      vv = vp - (dv - vv);
+    }
+  }
+  *u = uu;
+  *v = vv;
+}
+
+DEC_RA
+WCS_Poly::Transform(double x, double y) const {
+  DEC_RA result;
+  TransformToDecRA(1, &x, &y, &result);
+  return result;
+}
+
+void
+WCS_Poly::Transform(DEC_RA *dec_ra, double *x, double *y) const {
+  TransformToPixels(1, dec_ra, x, y);
+}
+
+void
+WCS_Poly::TransformToDecRA(int n, const double *x, const double *y,
+			   DEC_RA *dec_ra) const {
+  const double center_x = image_width/2.0;
+  const double center_y = image_height/2.0;
+
+  for (int i=0; i<n; i++) {
+    double up, vp;
+    Distort(x[i]-center_x, y[i]-center_y, &up, &vp);
+    const double xi = cd[0][0]*up + cd[0][1]*vp;
+    const double eta = cd[1][0]*up + cd[1][1]*vp;
+    double dec, ra;
+    ToSky(xi, eta, &dec, &ra);
+    dec_ra[i] = DEC_RA(dec, ra);
+  }
+}
+
+void
+WCS_Poly::TransformToPixels(int n, const DEC_RA *dec_ra,
+			    double *x, double *y) const {
+  const double center_x = image_width/2.0;
+  const double center_y = image_height/2.0;
+
+  for (int i=0; i<n; i++) {
+    double xi, eta;
+    ToPlane(dec_ra[i].dec(), dec_ra[i].ra_radians(), &xi, &eta);
+    const double up = cd_inv[0][0]*xi + cd_inv[0][1]*eta;
+    const double vp = cd_inv[1][0]*xi + cd_inv[1][1]*eta;
+    double u, v;
+    Undistort(up, vp, &u, &v);
+    x[i] = center_x + u;
+    y[i] = center_y + v;
+  }
+}
+
+DEC_RA
+WCS_Poly::Center(void) const {
+  return center_point;
+}
+
+void
+WCS_Poly::PrintRotAndScale(void) const {
+  const double scale = sqrt(fabs(cd[0][0]*cd[1][1] - cd[0][1]*cd[1][0]))*
+    (3600.0*180.0/M_PI);
+  const double rotation_angle = atan2(cd[0][1], cd[0][0]);
+  fprintf(stderr, "Rotation angle = %.1lf deg, Scale = %.2lf arcsec/pixel, order = %d\n",
+	  180.0*rotation_angle/M_PI, scale, order);
+}
+
+//****************************************************************
+//        WCS_Poly::Fit()
+//   xi and eta are each fit with a full polynomial in (u,v) that
+//   includes a constant term. A non-zero constant term means the
+//   tangent point isn't at the image center; the center is moved and
+//   the fit redone until the constant terms vanish. The linear terms
+//   are then the CD matrix, and the higher terms (run back through
+//   the inverse of the CD matrix) are the distortion coefficients.
+//****************************************************************
+int
+WCS_Poly::Fit(int poly_order, DEC_RA &center,
+	      int n, const double *x, const double *y, const DEC_RA *dec_ra) {
+  if (poly_order < 1 || poly_order > WCS_POLY_MAX_ORDER) {
+    fprintf(stderr, "WCS_Poly::Fit(): illegal order: %d\n", poly_order);
+    return -1;
+  }
+  const int num_terms = (poly_order+1)*(poly_order+2)/2;
+  if (n <= num_terms) {
+    fprintf(stderr, "WCS_Poly::Fit(): %d stars not enough for order %d\n",
+	    n, poly_order);
+    return -1;
+  }
+
+  constexpr int MAX_TERMS = (WCS_POLY_MAX_ORDER+1)*(WCS_POLY_MAX_ORDER+2)/2;
+  int term_p[MAX_TERMS];
+  int term_q[MAX_TERMS];
+  {
+    int k=0;
+    for (int p=0; p<=poly_order; p++) {
+      for (int q=0; p+q<=poly_order; q++) {
+	term_p[k] = p;
+	term_q[k] = q;
+	k++;
+      }
+    }
+  }
+
+  // u and v are normalized to roughly -1..1 inside the fit to keep
+  // the matrix well-conditioned
+  const double center_x = image_width/2.0;
+  const double center_y = image_height/2.0;
+  const double norm = (image_width > image_height ? image_width : image_height)/2.0;
+  const double inv_norm = (norm > 0.0 ? 1.0/norm : 1.0);
+
+  gsl_matrix *X = gsl_matrix_alloc(n, num_terms);
+  gsl_vector *xi_vec = gsl_vector_alloc(n);
+  gsl_vector *eta_vec = gsl_vector_alloc(n);
+  gsl_vector *c_xi = gsl_vector_alloc(num_terms);
+  gsl_vector *c_eta = gsl_vector_alloc(num_terms);
+  gsl_matrix *cov = gsl_matrix_alloc(num_terms, num_terms);
+  gsl_multifit_linear_workspace *work = gsl_multifit_linear_alloc(n, num_terms);
+
+  for (int i=0; i<n; i++) {
+    const double u = (x[i]-center_x)*inv_norm;
+    const double v = (y[i]-center_y)*inv_norm;
+    for (int k=0; k<num_terms; k++) {
+      gsl_matrix_set(X, i, k, pow(u, term_p[k])*pow(v, term_q[k]));
+    }
+  }
+
+  center_point = center;
+  for (int pass=0; pass<6; pass++) {
+    Refresh();
+    for (int i=0; i<n; i++) {
+      double xi, eta;
+      ToPlane(dec_ra[i].dec(), dec_ra[i].ra_radians(), &xi, &eta);
+      gsl_vector_set(xi_vec, i, xi);
+      gsl_vector_set(eta_vec, i, eta);
+    }
+    double chisq;
+    gsl_multifit_linear(X, xi_vec, c_xi, cov, &chisq, work);
+    gsl_multifit_linear(X, eta_vec, c_eta, cov, &chisq, work);
+
+    // term 0 is the constant term
+    const double xi0 = gsl_vector_get(c_xi, 0);
+    const double eta0 = gsl_vector_get(c_eta, 0);
+    if (sqrt(xi0*xi0 + eta0*eta0) < 1.0e-12) break;
+    double dec, ra;
+    ToSky(xi0, eta0, &dec, &ra);
+    center_point = DEC_RA(dec, ra);
+  }
+
+  double c[2][WCS_POLY_MAX_ORDER+1][WCS_POLY_MAX_ORDER+1];
+  for (int k=0; k<num_terms; k++) {
+    const double f = pow(inv_norm, term_p[k]+term_q[k]);
+    c[0][term_p[k]][term_q[k]] = gsl_vector_get(c_xi, k)*f;
+    c[1][term_p[k]][term_q[k]] = gsl_vector_get(c_eta, k)*f;
+  }
+
+  gsl_multifit_linear_free(work);
+  gsl_matrix_free(cov);
+  gsl_vector_free(c_eta);
+  gsl_vector_free(c_xi);
+  gsl_vector_free(eta_vec);
+  gsl_vector_free(xi_vec);
+  gsl_matrix_free(X);
+
+  for (int j=0; j<2; j++) {
+    cd[j][0] = c[j][1][0];
+    cd[j][1] = c[j][0][1];
+  }
+  order = poly_order;
+  Refresh();
+  memset(dist_a, 0, sizeof(dist_a));
+  memset(dist_b, 0, sizeof(dist_b));
+  for (int k=0; k<num_terms; k++) {
+    const int p = term_p[k];
+    const int q = term_q[k];
+    if (p+q < 2) continue;
+    dist_a[p][q] = cd_inv[0][0]*c[0][p][q] + cd_inv[0][1]*c[1][p][q];
+    dist_b[p][q] = cd_inv[1][0]*c[0][p][q] + cd_inv[1][1]*c[1][p][q];
+  }
+  wcs_is_valid = true;
+
+  // residuals, in pixels
+  double sum_sq = 0.0;
+  for (int i=0; i<n; i++) {
+    double fit_x, fit_y;
+    TransformToPixels(1, dec_ra+i, &fit_x, &fit_y);
+    sum_sq += (fit_x-x[i])*(fit_x-x[i]) + (fit_y-y[i])*(fit_y-y[i]);
+  }
+  fit_rms = sqrt(sum_sq/n);
+  return 0;
+}
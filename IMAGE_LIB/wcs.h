@@ -25,7 +25,7 @@
 
 class ImageInfo;
 
-enum WCS_ENUM_TYPE { WCS_SIMPLE, WCS_BILINEAR };
+enum WCS_ENUM_TYPE { WCS_SIMPLE, WCS_BILINEAR, WCS_POLY };
 
 class WCS {
  public:
@@ -45,6 +45,18 @@ class WCS {
   virtual DEC_RA Center(void) const = 0;
   virtual void PrintRotAndScale(void) const = 0;
 
+  // Batch versions of the two Transform() calls. These are much
+  // faster than calling Transform() once per star: everything that
+  // depends only on the WCS is computed once per call rather than
+  // once per point. The default versions just loop over the
+  // single-point Transform(); the derived classes override them.
+  // convert n pixel coordinates to Dec/RA
+  virtual void TransformToDecRA(int n, const double *x, const double *y,
+				DEC_RA *dec_ra) const;
+  // convert n Dec/RA locations to pixel coordinates
+  virtual void TransformToPixels(int n, const DEC_RA *dec_ra,
+				 double *x, double *y) const;
+
  protected:
   WCS_ENUM_TYPE wcs_type;
   bool wcs_is_valid;
@@ -78,6 +90,13 @@ class WCS_Bilinear : public WCS {
 
   DEC_RA Center(void) const;
   void PrintRotAndScale(void) const;
+
+  void TransformToDecRA(int n, const double *x, const double *y,
+			DEC_RA *dec_ra) const;
+  // Unlike the single-point Transform(), this solves the bilinear
+  // equations directly (Newton's method) instead of by bisection.
+  void TransformToPixels(int n, const DEC_RA *dec_ra,
+			 double *x, double *y) const;
   
  private:
   double upperleft_dec;
@@ -121,13 +140,103 @@ class WCS_Simple : public WCS {
   DEC_RA Center(void) const;
   void PrintRotAndScale(void) const;
 
+  void TransformToDecRA(int n, const double *x, const double *y,
+			DEC_RA *dec_ra) const;
+  void TransformToPixels(int n, const DEC_RA *dec_ra,
+			 double *x, double *y) const;
+
  private:
   double rotation_angle;
   DEC_RA center_point;
   double scale; // arcseconds per pixel
   double cos_dec;
+  double cos_rot;
+  double sin_rot;
+  double image_width; // pixels
+  double image_height; // pixels
+};
+
+// WCS_Poly is a true tangent-plane (gnomonic) projection around the
+// image center, with an optional polynomial distortion term in the
+// style of the FITS "SIP" convention. Pixel offsets (u,v) from the
+// image center are first distorted:
+//     u' = u + sum(A[p][q] * u^p * v^q)
+//     v' = v + sum(B[p][q] * u^p * v^q)     (2 <= p+q <= order)
+// and then turned into tangent-plane coordinates (xi, eta), in
+// radians, with a 2x2 matrix (the FITS "CD" matrix):
+//     xi  = cd[0][0]*u' + cd[0][1]*v'
+//     eta = cd[1][0]*u' + cd[1][1]*v'
+// xi increases with increasing RA and eta with increasing dec. With
+// order = 1 (no distortion) this is the same as WCS_Simple, except
+// that it stays accurate far from the image center and near the pole.
+#define WCS_POLY_MAX_ORDER 3
+
+class WCS_Poly : public WCS {
+ public:
+  WCS_Poly(void);
+  WCS_Poly(ImageInfo *info);
+  ~WCS_Poly(void) {;}
+
+  void SetImageSize(int width, int height);
+  // Starts out with no distortion
+  void Set(DEC_RA &center,
+	   double scale,	// arcsec/pixel
+	   double rotation);	// radians (same sense as WCS_Simple)
+  // a[p][q] and b[p][q] are only used for 2 <= p+q <= order
+  void SetDistortion(int order,
+		     const double a[WCS_POLY_MAX_ORDER+1][WCS_POLY_MAX_ORDER+1],
+		     const double b[WCS_POLY_MAX_ORDER+1][WCS_POLY_MAX_ORDER+1]);
+
+  // Least-squares fit of the linear terms and the distortion terms to
+  // n stars whose pixel positions and Dec/RA locations are both
+  // known. The image size must already have been set. "center" is
+  // only a starting guess; the tangent point is refined by the
+  // fit. Returns 0 on success, -1 if there were too few stars for the
+  // requested order (needs at least (order+1)(order+2)/2 + 1).
+  int Fit(int order, DEC_RA &center,
+	  int n, const double *x, const double *y, const DEC_RA *dec_ra);
+  // rms of the fit residuals, in pixels
+  double FitResidual(void) const { return fit_rms; }
+
+  void UpdateFITSHeader(ImageInfo *info) const;
+
+  // The following methods are for general users
+
+  // convert from pixel coordinates to Dec/RA
+  DEC_RA Transform(double x, double y) const;
+  // convert from Dec/RA to pixel coordinates
+  void Transform(DEC_RA *dec_ra, double *x, double *y) const;
+  DEC_RA Center(void) const;
+  void PrintRotAndScale(void) const;
+
+  void TransformToDecRA(int n, const double *x, const double *y,
+			DEC_RA *dec_ra) const;
+  void TransformToPixels(int n, const DEC_RA *dec_ra,
+			 double *x, double *y) const;
+
+ private:
+  DEC_RA center_point;
   double image_width; // pixels
   double image_height; // pixels
+  double cd[2][2];     // radians/pixel
+  int order;
+  double dist_a[WCS_POLY_MAX_ORDER+1][WCS_POLY_MAX_ORDER+1];
+  double dist_b[WCS_POLY_MAX_ORDER+1][WCS_POLY_MAX_ORDER+1];
+  double fit_rms;
+
+  // everything below is derived from the above by Refresh()
+  double sin_dec0;
+  double cos_dec0;
+  double ra0;	       // radians
+  double cd_inv[2][2]; // pixels/radian
+
+  void Refresh(void);
+  // (xi,eta) -> dec/ra, and the reverse (all in radians)
+  inline void ToSky(double xi, double eta, double *dec, double *ra) const;
+  inline void ToPlane(double dec, double ra, double *xi, double *eta) const;
+  // (u,v) -> (u',v'), and the reverse
+  inline void Distort(double u, double v, double *up, double *vp) const;
+  inline void Undistort(double up, double vp, double *u, double *v) const;
 };
 
 #endif
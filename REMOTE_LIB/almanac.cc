@@ -0,0 +1,312 @@
+/*  almanac.cc -- Sun and moon positions, twilight, and moon phase
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <math.h>
+#include <map>
+#include <memory>
+#include <system_config.h>
+#include "almanac.h"
+
+static const double J2000 = 2451545.0;
+
+// Reduce an angle (degrees) into 0..360
+static double Rev(double degrees) {
+  return degrees - 360.0*floor(degrees/360.0);
+}
+
+static double SiteLatitude(void) {
+  static const double latitude = system_config.Latitude()*DEGREES;
+  return latitude;
+}
+
+// radians, east positive
+static double SiteLongitude(void) {
+  static const double longitude = system_config.Longitude()*DEGREES;
+  return longitude;
+}
+
+static double Obliquity(double days_since_j2000) {
+  return (23.439 - 0.0000004*days_since_j2000)*DEGREES;
+}
+
+static DEC_RA EclipticToEquatorial(double lambda, double beta, double epsilon) {
+  const double x = cos(beta)*cos(lambda);
+  const double y = cos(epsilon)*cos(beta)*sin(lambda) - sin(epsilon)*sin(beta);
+  const double z = sin(epsilon)*cos(beta)*sin(lambda) + cos(epsilon)*sin(beta);
+  double ra = atan2(y, x);
+  if (ra < 0.0) ra += 2.0*M_PI;
+  return DEC_RA(asin(z), ra);
+}
+
+static void ToVector(const DEC_RA &p, double *x, double *y, double *z) {
+  const double cos_dec = cos(p.dec());
+  *x = cos_dec*cos(p.ra_radians());
+  *y = cos_dec*sin(p.ra_radians());
+  *z = sin(p.dec());
+}
+
+double LocalSiderealAngle(JULIAN when) {
+  const double d = when.day() - J2000;
+  return Rev(280.46061837 + 360.98564736629*d)*DEGREES + SiteLongitude();
+}
+
+static double Altitude(const DEC_RA &p, double lst) {
+  const double hour_angle = lst - p.ra_radians();
+  const double lat = SiteLatitude();
+  return asin(sin(lat)*sin(p.dec()) + cos(lat)*cos(p.dec())*cos(hour_angle));
+}
+
+DEC_RA SunPosition(JULIAN when) {
+  const double n = when.day() - J2000;
+  const double L = Rev(280.460 + 0.9856474*n);
+  const double g = Rev(357.528 + 0.9856003*n)*DEGREES;
+  const double lambda = (L + 1.915*sin(g) + 0.020*sin(2.0*g))*DEGREES;
+  return EclipticToEquatorial(lambda, 0.0, Obliquity(n));
+}
+
+// Moon's ecliptic longitude, latitude, and horizontal parallax, all
+// radians
+static void MoonEcliptic(JULIAN when, double *lambda, double *beta, double *parallax) {
+  const double T = (when.day() - J2000)/36525.0;
+  auto S = [](double deg) { return sin(deg*DEGREES); };
+  auto C = [](double deg) { return cos(deg*DEGREES); };
+
+  *lambda = (218.32 + 481267.881*T
+	     + 6.29*S(135.0 + 477198.87*T)
+	     - 1.27*S(259.3 - 413335.36*T)
+	     + 0.66*S(235.7 + 890534.22*T)
+	     + 0.21*S(269.9 + 954397.74*T)
+	     - 0.19*S(357.5 + 35999.05*T)
+	     - 0.11*S(186.5 + 966404.03*T))*DEGREES;
+  *beta = (5.13*S(93.3 + 483202.02*T)
+	   + 0.28*S(228.2 + 960400.89*T)
+	   - 0.28*S(318.3 + 6003.15*T)
+	   - 0.17*S(217.6 - 407332.21*T))*DEGREES;
+  *parallax = (0.9508
+	       + 0.0518*C(135.0 + 477198.87*T)
+	       + 0.0095*C(259.3 - 413335.36*T)
+	       + 0.0078*C(235.7 + 890534.22*T)
+	       + 0.0028*C(269.9 + 954397.74*T))*DEGREES;
+}
+
+DEC_RA MoonPosition(JULIAN when) {
+  double lambda, beta, parallax;
+  MoonEcliptic(when, &lambda, &beta, &parallax);
+  return EclipticToEquatorial(lambda, beta, Obliquity(when.day() - J2000));
+}
+
+double MoonIllumination(JULIAN when) {
+  // The phase angle is close enough to 180 deg minus the sun-moon
+  // elongation
+  const double elongation = AngularSeparation(SunPosition(when), MoonPosition(when));
+  return (1.0 - cos(elongation))/2.0;
+}
+
+double AngularSeparation(const DEC_RA &a, const DEC_RA &b) {
+  double ax, ay, az, bx, by, bz;
+  ToVector(a, &ax, &ay, &az);
+  ToVector(b, &bx, &by, &bz);
+  double dot = ax*bx + ay*by + az*bz;
+  if (dot > 1.0) dot = 1.0;
+  if (dot < -1.0) dot = -1.0;
+  return acos(dot);
+}
+
+//****************************************************************
+//        NightAlmanac
+//****************************************************************
+
+// The local mean noon at or before "when"
+static JULIAN LocalNoonBefore(JULIAN when) {
+  // JD is an integer at noon UT, so JD + longitude/360 is an integer
+  // at local mean noon.
+  const double offset = SiteLongitude()/(2.0*M_PI);
+  return JULIAN(floor(when.day() + offset) - offset);
+}
+
+NightAlmanac::NightAlmanac(JULIAN when) : start(LocalNoonBefore(when)) {
+  const int num_samples = (int) (1.0/STEP + 0.5) + 1;
+  samples.resize(num_samples);
+  for (int i = 0; i < num_samples; i++) {
+    const JULIAN t = start.add_days(i*STEP);
+    const double lst = LocalSiderealAngle(t);
+    const DEC_RA sun = SunPosition(t);
+    double lambda, beta, parallax;
+    MoonEcliptic(t, &lambda, &beta, &parallax);
+    const DEC_RA moon = EclipticToEquatorial(lambda, beta, Obliquity(t.day() - J2000));
+
+    Sample &s = samples[i];
+    s.sun_altitude = Altitude(sun, lst);
+    ToVector(moon, &s.moon_x, &s.moon_y, &s.moon_z);
+    s.moon_parallax = parallax;
+    s.moon_illumination = (1.0 - cos(AngularSeparation(sun, moon)))/2.0;
+  }
+
+  events[SUNSET] = FindCrossing(-0.833*DEGREES, true);
+  events[CIVIL_DUSK] = FindCrossing(-6.0*DEGREES, true);
+  events[NAUTICAL_DUSK] = FindCrossing(-12.0*DEGREES, true);
+  events[ASTRO_DUSK] = FindCrossing(-18.0*DEGREES, true);
+  events[ASTRO_DAWN] = FindCrossing(-18.0*DEGREES, false);
+  events[NAUTICAL_DAWN] = FindCrossing(-12.0*DEGREES, false);
+  events[CIVIL_DAWN] = FindCrossing(-6.0*DEGREES, false);
+  events[SUNRISE] = FindCrossing(-0.833*DEGREES, false);
+}
+
+const NightAlmanac &
+NightAlmanac::ForNight(JULIAN when) {
+  static std::map<long, std::unique_ptr<NightAlmanac>> cache;
+  const long key = lround(LocalNoonBefore(when).day());
+  auto it = cache.find(key);
+  if (it == cache.end()) {
+    it = cache.emplace(key, std::unique_ptr<NightAlmanac>(new NightAlmanac(when))).first;
+  }
+  return *(it->second);
+}
+
+const char *
+NightAlmanac::EventName(EventType event) {
+  static const char *names[NUM_EVENTS] = {
+    "sunset", "civil dusk", "nautical dusk", "astronomical dusk",
+    "astronomical dawn", "nautical dawn", "civil dawn", "sunrise" };
+  return (event >= 0 && event < NUM_EVENTS) ? names[event] : "?";
+}
+
+// The sun is tabulated on a fixed grid, so once the grid brackets the
+// crossing, bisection on the exact position finishes the job.
+JULIAN
+NightAlmanac::FindCrossing(double altitude, bool descending) const {
+  for (unsigned int i = 0; i+1 < samples.size(); i++) {
+    const double a0 = samples[i].sun_altitude - altitude;
+    const double a1 = samples[i+1].sun_altitude - altitude;
+    if ((descending && a0 >= 0.0 && a1 < 0.0) ||
+	(!descending && a0 < 0.0 && a1 >= 0.0)) {
+      double t0 = start.day() + i*STEP;
+      double t1 = t0 + STEP;
+      for (int iter = 0; iter < 20; iter++) { // 10 min/2^20 << 1 sec
+	const double tm = (t0 + t1)/2.0;
+	const double am = Altitude(SunPosition(JULIAN(tm)),
+				   LocalSiderealAngle(JULIAN(tm))) - altitude;
+	if ((am >= 0.0) == descending) {
+	  t0 = tm;
+	} else {
+	  t1 = tm;
+	}
+      }
+      return JULIAN((t0 + t1)/2.0);
+    }
+  }
+  return JULIAN();
+}
+
+void
+NightAlmanac::Locate(JULIAN when, int *index, double *fraction) const {
+  double f = (when.day() - start.day())/STEP;
+  if (f < 0.0) f = 0.0;
+  if (f > samples.size()-1) f = samples.size()-1;
+  int i = (int) f;
+  if (i >= (int) samples.size()-1) i = samples.size()-2;
+  *index = i;
+  *fraction = f - i;
+}
+
+double
+NightAlmanac::SunAltitude(JULIAN when) const {
+  int i;
+  double f;
+  Locate(when, &i, &f);
+  return samples[i].sun_altitude*(1.0-f) + samples[i+1].sun_altitude*f;
+}
+
+void
+NightAlmanac::MoonVector(JULIAN when, double *x, double *y, double *z) const {
+  int i;
+  double f;
+  Locate(when, &i, &f);
+  const Sample &s0 = samples[i];
+  const Sample &s1 = samples[i+1];
+  const double vx = s0.moon_x*(1.0-f) + s1.moon_x*f;
+  const double vy = s0.moon_y*(1.0-f) + s1.moon_y*f;
+  const double vz = s0.moon_z*(1.0-f) + s1.moon_z*f;
+  const double len = sqrt(vx*vx + vy*vy + vz*vz);
+  *x = vx/len;
+  *y = vy/len;
+  *z = vz/len;
+}
+
+DEC_RA
+NightAlmanac::MoonPosition(JULIAN when) const {
+  double x, y, z;
+  MoonVector(when, &x, &y, &z);
+  double ra = atan2(y, x);
+  if (ra < 0.0) ra += 2.0*M_PI;
+  return DEC_RA(asin(z), ra);
+}
+
+double
+NightAlmanac::MoonAltitude(JULIAN when) const {
+  int i;
+  double f;
+  Locate(when, &i, &f);
+  const double parallax = samples[i].moon_parallax*(1.0-f) + samples[i+1].moon_parallax*f;
+  const double geocentric = Altitude(MoonPosition(when), LocalSiderealAngle(when));
+  return geocentric - parallax*cos(geocentric);
+}
+
+double
+NightAlmanac::MoonIllumination(JULIAN when) const {
+  int i;
+  double f;
+  Locate(when, &i, &f);
+  return samples[i].moon_illumination*(1.0-f) + samples[i+1].moon_illumination*f;
+}
+
+double
+NightAlmanac::MoonSeparation(const DEC_RA &target, JULIAN when) const {
+  double sep;
+  MoonSeparations(&target, 1, when, &sep);
+  return sep;
+}
+
+void
+NightAlmanac::Altitudes(const DEC_RA *targets, int count, JULIAN when,
+			double *altitudes) const {
+  const double lst = LocalSiderealAngle(when);
+  const double sin_lat = sin(SiteLatitude());
+  const double cos_lat = cos(SiteLatitude());
+  for (int i = 0; i < count; i++) {
+    const double dec = targets[i].dec();
+    const double hour_angle = lst - targets[i].ra_radians();
+    altitudes[i] = asin(sin_lat*sin(dec) + cos_lat*cos(dec)*cos(hour_angle));
+  }
+}
+
+void
+NightAlmanac::MoonSeparations(const DEC_RA *targets, int count, JULIAN when,
+			      double *separations) const {
+  double mx, my, mz;
+  MoonVector(when, &mx, &my, &mz);
+  for (int i = 0; i < count; i++) {
+    const double dec = targets[i].dec();
+    const double ra = targets[i].ra_radians();
+    const double cos_dec = cos(dec);
+    double dot = mx*cos_dec*cos(ra) + my*cos_dec*sin(ra) + mz*sin(dec);
+    if (dot > 1.0) dot = 1.0;
+    if (dot < -1.0) dot = -1.0;
+    separations[i] = acos(dot);
+  }
+}
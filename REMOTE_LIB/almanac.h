@@ -0,0 +1,116 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  almanac.h -- Sun and moon positions, twilight, and moon phase
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _ALMANAC_H
+#define _ALMANAC_H
+
+#include <vector>
+#include "dec_ra.h"
+#include "julian.h"
+
+// Everything here is computed from the site's latitude and longitude
+// (from system_config) using the low-precision formulae of the
+// Astronomical Almanac: the sun is good to about 0.01 deg, the moon
+// to about 0.3 deg, and event times to about a minute. That's plenty
+// for scheduling, twilight flats, and moon avoidance; it is not
+// meant for pointing.
+//
+// Positions are geocentric, of date. (The moon's parallax, up to 1
+// deg, is applied only to its altitude.)
+
+DEC_RA SunPosition(JULIAN when);
+DEC_RA MoonPosition(JULIAN when);
+// Fraction of the moon's disk that is lit, 0.0 (new) .. 1.0 (full)
+double MoonIllumination(JULIAN when);
+// Great-circle angle between two positions, radians
+double AngularSeparation(const DEC_RA &a, const DEC_RA &b);
+// Local apparent sidereal time at the site, radians
+double LocalSiderealAngle(JULIAN when);
+
+// A NightAlmanac covers one night at the site, from local noon to the
+// following local noon. It finds the night's sunset, sunrise, and
+// twilight times once, and tabulates the sun and moon every few
+// minutes so that queries during the night are interpolations rather
+// than recomputations.
+//
+// Usage:
+//    const NightAlmanac &night = NightAlmanac::ForNight(JULIAN(time(0)));
+//    JULIAN dark = night.Event(NightAlmanac::ASTRO_DUSK);
+//    double sep = night.MoonSeparation(star_location, dark);
+
+class NightAlmanac {
+public:
+  enum EventType {
+    SUNSET, CIVIL_DUSK, NAUTICAL_DUSK, ASTRO_DUSK,
+    ASTRO_DAWN, NAUTICAL_DAWN, CIVIL_DAWN, SUNRISE,
+    NUM_EVENTS
+  };
+
+  // The night whose afternoon/evening/morning contains "when".
+  NightAlmanac(JULIAN when);
+
+  // Cached: the almanac for the night containing "when" is built the
+  // first time it's asked for; later calls for the same night return
+  // the same object. Not thread-safe.
+  static const NightAlmanac &ForNight(JULIAN when);
+
+  JULIAN NightStart(void) const { return start; } // local noon
+  JULIAN NightEnd(void) const { return start.add_days(1.0); }
+
+  // Returns an invalid JULIAN (is_valid() == false) if the event
+  // doesn't happen this night (e.g., no astronomical darkness near
+  // the summer solstice at high latitude).
+  JULIAN Event(EventType event) const { return events[event]; }
+  static const char *EventName(EventType event);
+
+  // Single queries; "when" should be within this night.
+  double SunAltitude(JULIAN when) const; // radians
+  DEC_RA MoonPosition(JULIAN when) const;
+  double MoonAltitude(JULIAN when) const; // radians, topocentric
+  double MoonIllumination(JULIAN when) const;
+  double MoonSeparation(const DEC_RA &target, JULIAN when) const; // radians
+
+  // Batch queries: one time, many targets. Outputs are radians and
+  // must have room for "count" values.
+  void Altitudes(const DEC_RA *targets, int count, JULIAN when,
+		 double *altitudes) const;
+  void MoonSeparations(const DEC_RA *targets, int count, JULIAN when,
+		       double *separations) const;
+
+private:
+  JULIAN start;
+  JULIAN events[NUM_EVENTS];
+
+  // Tabulated every STEP days, from "start" through start+1.0
+  static constexpr double STEP = 10.0/(24.0*60.0);
+  struct Sample {
+    double sun_altitude;	// radians
+    double moon_x, moon_y, moon_z; // unit vector, equatorial
+    double moon_parallax;	// radians
+    double moon_illumination;
+  };
+  std::vector<Sample> samples;
+
+  // Index and fraction for interpolating at "when"
+  void Locate(JULIAN when, int *index, double *fraction) const;
+  void MoonVector(JULIAN when, double *x, double *y, double *z) const;
+  JULIAN FindCrossing(double altitude, bool descending) const;
+};
+
+#endif
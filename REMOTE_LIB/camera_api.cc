@@ -38,6 +38,7 @@
 #include "scope_api.h"		// to get CameraPointsAt()
 #include "image_notify.h"
 #include "image_profile.h"
+#include "trace.h"
 #include <iostream>
 
 #ifdef INDI
@@ -67,13 +68,13 @@ int trial_connect_to_camera(void) {
   struct sockaddr_in my_address;
 
   memset(&my_address, 0, sizeof(my_address));
-  jellybean = gethostbyname(CAMERA_HOST); // defined in ports.h
+  jellybean = gethostbyname(CameraHost()); // defined in ports.h
   if(jellybean == 0) {
     herror("Cannot lookup jellybean host name:");
     return -1;
   } else {
     my_address.sin_addr = *((struct in_addr *)(jellybean->h_addr_list[0]));
-    my_address.sin_port = htons(CAMERA_PORT); // port number, see ports.h
+    my_address.sin_port = htons(CameraPort()); // port number, see ports.h
     my_address.sin_family = AF_INET;
     fprintf(stderr, "Connecting to %s for camera\n",
 	    inet_ntoa(my_address.sin_addr));
@@ -114,6 +115,7 @@ void connect_to_camera(void) {
 }
 
 void update_fits_data(const char *fits_filename, const char *purpose) {
+  TraceSpan span("update_fits_data");
   ImageInfo info(fits_filename);
 
   // Note: (this is important) this is the point where "north is up"
@@ -193,6 +195,7 @@ do_expose_image(double exposure_time_seconds,
 		Drifter *drifter = 0) {
   GenMessage    *inbound_message;
   FITSMessage  *FITSimage;
+  TraceSpan span("do_expose_image");
 
   if (drifter) {
     drifter->ExposureStart(exposure_time_seconds);
@@ -400,6 +403,20 @@ char *expose_image(double exposure_time_seconds,
   return next_valid_filename;
 }
 
+Image *expose_image_in_memory(double exposure_time_seconds,
+			      exposure_flags &ExposureFlags,
+			      Drifter *drifter) {
+  Image *new_image = nullptr;	// stays nullptr if the exposure fails
+
+  time(&ExposureStartTime);	// remember when this starts
+  do_expose_image(exposure_time_seconds,
+		  &new_image,
+		  ExposureFlags,
+		  "-",
+		  drifter);
+  return new_image;
+}
+
 void
 host_expose_image(double exposure_time_seconds,
 		  exposure_flags &ExposureFlags,
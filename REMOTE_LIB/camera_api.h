@@ -186,6 +186,14 @@ char *expose_image(double exposure_time_seconds,
 		   exposure_flags &ExposureFlags,
 		   const char *purpose = 0,
 		   Drifter *drifter = 0);
+// This form never touches the disk: the exposure comes back as an
+// Image held in memory (caller owns it; nullptr on failure). None of
+// the FITS header additions that expose_image() makes (pointing,
+// focus, purpose) are made.
+Image *expose_image_in_memory(double exposure_time_seconds,
+			      exposure_flags &ExposureFlags,
+			      Drifter *drifter = 0);
+
 inline char *expose_image_next(double exposure_time_seconds,
 			       exposure_flags &ExposureFlags,
 			       const char *purpose = 0,
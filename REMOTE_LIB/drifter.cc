@@ -1,6 +1,6 @@
 /*  drifter.cc -- Implements image drift management
  *
- *  Copyright (C) 2018 Mark J. Munkacsy
+ *  Copyright (C) 2018, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -19,6 +19,7 @@
 
 #include "drifter.h"
 #include <iostream>
+#include <algorithm>		// sort()
 #include <time.h>		// time(), time_t
 #include <unistd.h>		// sleep()
 #include "scope_api.h"		// guide()
@@ -51,13 +52,11 @@ AxisDrifter::AxisDrifter(FILE *logfile, const char *name_of_axis, Drifter *paren
   initialized = false;
   drift_rate = 0.0;
   drift_accel = 0.0;
+  num_measurements = 0;
+  newest = DRIFT_WINDOW-1;
 }
 
 AxisDrifter::~AxisDrifter(void) {
-  std::list<AxisMeasurement *>::iterator it;
-  for (it=measurements.begin(); it != measurements.end(); it++) {
-    delete (*it);
-  }
   fprintf(log, "Shutting down AxisDrifter(%s)\n", axis_name);
 }
 
@@ -72,17 +71,19 @@ AxisDrifter::AcceptCenter(double measurement, JULIAN when) { // extracted from i
     orig_time = when;
   }
   initialized = true;
-  AxisMeasurement *m = new AxisMeasurement;
+  // Once the window is full, this overwrites the oldest measurement
+  newest = (newest+1) % DRIFT_WINDOW;
+  if (num_measurements < DRIFT_WINDOW) num_measurements++;
+  AxisMeasurement *m = &measurements[newest];
   m->when = when;
   m->delta_t = 24.0*3600.0*(m->when - orig_time); // in seconds
   m->measured_posit = (180.0*3600.0/M_PI)* (measurement - orig_position); //arcsec
   m->cum_measured_posit = m->measured_posit + cum_guidance_arcsec;
-  measurements.push_back(m);
+  m->weight = 1.0;
 
   fprintf(log, "%s Measurements follow:\n", axis_name);
-  std::list<AxisMeasurement *>::iterator it;
-  for (it=measurements.begin(); it != measurements.end(); it++) {
-    AxisMeasurement *m = (*it);
+  for (int i = 0; i < num_measurements; i++) {
+    AxisMeasurement *m = &Measurement(i);
     fprintf(log, "%lf, meas=%lf, cum=%lf, weight=%lf\n",
 	    m->delta_t, m->measured_posit, m->cum_measured_posit, m->weight);
   }
@@ -94,23 +95,22 @@ AxisDrifter::AcceptCenter(double measurement, JULIAN when) { // extracted from i
 void
 AxisDrifter::RecalculateDriftRate(void) {
   double weight = 1.0;
-  std::list<AxisMeasurement *>::iterator it;
 
-  if (measurements.size() < 2) {
+  if (num_measurements < 2) {
     drift_rate = 0.0;
     drift_intercept = 0.0;
     drift_accel = 0.0;
     return;
   }
 
-  reference_time = measurements.back()->when;
+  reference_time = measurements[newest].when;
   constexpr int order = (INCLUDE_ACC_TERM ? 3 : 2);
   gsl_matrix *sum_xx = gsl_matrix_calloc(order, order);
   gsl_matrix *w = gsl_matrix_alloc(order, 1);
   gsl_matrix *sum_xy = gsl_matrix_calloc(order, 1);
 
-  for (it=measurements.begin(); it != measurements.end(); it++) {
-    AxisMeasurement *m = (*it);
+  for (int i = 0; i < num_measurements; i++) {
+    AxisMeasurement *m = &Measurement(i);
     m->weight = weight;
     weight *= 1.05;
     m->delta_t = (m->when - reference_time)*24.0*3600.0; // seconds
@@ -208,6 +208,8 @@ AxisDrifter::ExposureUpdate(double time_to_next_update) {
 
 Drifter::Drifter(FILE *logfile) {
   log = logfile;
+  pending_guide_dec = 0.0;
+  pending_guide_ra = 0.0;
   dec_drifter = new AxisDrifter(log, "DEC", this);
   dec_drifter->SetAxis(true); /*IsDec*/
   ra_drifter = new AxisDrifter(log, "RA", this);
@@ -216,6 +218,7 @@ Drifter::Drifter(FILE *logfile) {
 }
 
 Drifter::~Drifter(void) {
+  StopTracking();
   delete dec_drifter;
   delete ra_drifter;
   fprintf(log, "Shutting down drifter.\n");
@@ -296,6 +299,158 @@ Drifter::ExposureGuide(void) {  // blocks for duration of exposure
   fflush(log);
 }
   
+//****************************************************************
+//        Sub-frame tracking
+//****************************************************************
+
+// Stars closer than this to the edge aren't tracked
+static const int TRACK_EDGE_MARGIN = 3*TRACKER_BOX_RADIUS_PIXELS;
+static const unsigned int MAX_TRACKED_STARS = 4;
+// A star whose shift disagrees with the median shift by more than
+// this is ignored for that image
+static const double TRACK_TOLERANCE_PIXELS = 2.0;
+
+static double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  const int n = v.size();
+  return (n%2 ? v[n/2] : (v[n/2-1] + v[n/2])/2.0);
+}
+
+void
+Drifter::StopTracking(void) {
+  for (TrackedStar &s : tracked_stars) {
+    delete s.tracker;
+  }
+  tracked_stars.clear();
+}
+
+bool
+Drifter::StartTracking(Image *reference) {
+  StopTracking();
+
+  ImageInfo *info = reference->GetImageInfo();
+  if (info == nullptr || !info->WCSValid()) {
+    fprintf(log, "StartTracking: reference image has no plate solution.\n");
+    return false;
+  }
+  const WCS *wcs = info->GetWCS();
+  const double cx = reference->width/2.0;
+  const double cy = reference->height/2.0;
+  ref_center = wcs->Transform(cx, cy);
+  const DEC_RA step_x = wcs->Transform(cx+1.0, cy);
+  const DEC_RA step_y = wcs->Transform(cx, cy+1.0);
+  ddec_dx = step_x.dec() - ref_center.dec();
+  ddec_dy = step_y.dec() - ref_center.dec();
+  dra_dx = remainder(step_x.ra_radians() - ref_center.ra_radians(), 2.0*M_PI);
+  dra_dy = remainder(step_y.ra_radians() - ref_center.ra_radians(), 2.0*M_PI);
+
+  // Use the brightest stars that aren't too close to an edge
+  IStarList *list = reference->GetIStarList();
+  std::vector<int> candidates;
+  for (int star = 0; star < list->NumStars; star++) {
+    const double x = list->StarCenterX(star);
+    const double y = list->StarCenterY(star);
+    if (list->IStarNumberPixels(star) >= 4 &&
+	x > TRACK_EDGE_MARGIN && x < reference->width - TRACK_EDGE_MARGIN &&
+	y > TRACK_EDGE_MARGIN && y < reference->height - TRACK_EDGE_MARGIN) {
+      candidates.push_back(star);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+	    [list](int a, int b) { return list->IStarPixelSum(a) > list->IStarPixelSum(b); });
+  if (candidates.size() > MAX_TRACKED_STARS) candidates.resize(MAX_TRACKED_STARS);
+
+  for (int star : candidates) {
+    TrackedStar s;
+    s.tracker = new Tracker(reference, list->StarCenterX(star), list->StarCenterY(star));
+    if (s.tracker->Position(&s.ref_x, &s.ref_y) == 0 &&
+	s.tracker->TrackerStatus() == TRACKER_LOCK) {
+      tracked_stars.push_back(s);
+      fprintf(log, "StartTracking: star at (%.1lf, %.1lf)\n", s.ref_x, s.ref_y);
+    } else {
+      delete s.tracker;
+    }
+  }
+  if (tracked_stars.empty()) {
+    fprintf(log, "StartTracking: no stars suitable for tracking.\n");
+    return false;
+  }
+  fflush(log);
+  return true;
+}
+
+bool
+Drifter::TrackImage(Image *i) {
+  if (!Tracking()) return false;
+  ImageInfo *info = i->GetImageInfo();
+  if (info == nullptr || !info->ExposureMidpointValid()) {
+    fprintf(log, "TrackImage: image has no exposure time.\n");
+    return false;
+  }
+
+  // How far has each star moved since the reference image?
+  std::vector<double> dx, dy;
+  for (unsigned int k = 0; k < tracked_stars.size(); ) {
+    TrackedStar &s = tracked_stars[k];
+    s.tracker->Update(i);
+    if (s.tracker->TrackerStatus() == NO_LOCK) {
+      fprintf(log, "TrackImage: lost star at (%.1lf, %.1lf)\n", s.ref_x, s.ref_y);
+      delete s.tracker;
+      tracked_stars.erase(tracked_stars.begin() + k);
+      continue;
+    }
+    double x, y;
+    if (s.tracker->TrackerStatus() == TRACKER_LOCK &&
+	s.tracker->Position(&x, &y) == 0) {
+      dx.push_back(x - s.ref_x);
+      dy.push_back(y - s.ref_y);
+    }
+    k++;
+  }
+  if (!Tracking()) {
+    fprintf(log, "TrackImage: all tracked stars lost.\n");
+    fflush(log);
+    return false;
+  }
+  if (dx.empty()) {
+    fprintf(log, "TrackImage: no tracked stars visible in this image.\n");
+    fflush(log);
+    return false;
+  }
+
+  // Average the stars that agree with the median shift
+  const double med_x = median(dx);
+  const double med_y = median(dy);
+  double sum_x = 0.0;
+  double sum_y = 0.0;
+  int n = 0;
+  for (unsigned int k = 0; k < dx.size(); k++) {
+    if (fabs(dx[k] - med_x) <= TRACK_TOLERANCE_PIXELS &&
+	fabs(dy[k] - med_y) <= TRACK_TOLERANCE_PIXELS) {
+      sum_x += dx[k];
+      sum_y += dy[k];
+      n++;
+    }
+  }
+  const double shift_x = sum_x/n;
+  const double shift_y = sum_y/n;
+  fprintf(log, "TrackImage: %d of %lu stars, shift = (%.2lf, %.2lf) pixels\n",
+	  n, (unsigned long) tracked_stars.size(), shift_x, shift_y);
+
+  // The stars moving by (dx, dy) means the image center (the place
+  // the mount is pointing) moved by (-dx, -dy).
+  const DEC_RA center(ref_center.dec() - ddec_dx*shift_x - ddec_dy*shift_y,
+		      ref_center.ra_radians() - dra_dx*shift_x - dra_dy*shift_y);
+  AcceptCenter(center, info->GetExposureMidpoint());
+  return true;
+}
+
+bool
+Drifter::TrackImage(const char *image_filename) {
+  Image image(image_filename);
+  return TrackImage(&image);
+}
+
 void
 Drifter::print(FILE *fp) {
   fprintf(fp, "Dec drift: ");
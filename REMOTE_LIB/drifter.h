@@ -1,7 +1,7 @@
 /* This may look like C code, but it is really -*-c++-*- */
 /*  drifter.h -- Implements image drift management
  *
- *  Copyright (C) 2018 Mark J. Munkacsy
+ *  Copyright (C) 2018, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -21,7 +21,8 @@
 #define _DRIFTER_H
 
 #include <Image.h>
-#include <list>
+#include <Tracker.h>
+#include <vector>
 #include <stdio.h>
 #include "julian.h"
 #include "dec_ra.h"
@@ -34,6 +35,10 @@ struct AxisMeasurement {
   double weight;
 };
 
+// The drift rate is fit to (at most) this many of the most recent
+// measurements; older ones are overwritten.
+#define DRIFT_WINDOW 24
+
 class Drifter;
 
 class AxisDrifter {
@@ -70,7 +75,13 @@ class AxisDrifter {
   bool north_up; // same as Image.NorthIsUp()
   bool axis_is_dec;
 
-  std::list<AxisMeasurement *>measurements;
+  // ring buffer of the last DRIFT_WINDOW measurements
+  AxisMeasurement measurements[DRIFT_WINDOW];
+  int num_measurements;
+  int newest;			// index of the most recent measurement
+  // i == 0 is the oldest measurement in the window
+  AxisMeasurement &Measurement(int i) {
+    return measurements[(newest + 1 - num_measurements + i + DRIFT_WINDOW) % DRIFT_WINDOW]; }
 
   const char *axis_name;
   FILE *log;
@@ -91,11 +102,37 @@ class Drifter {
 
   void AcceptGuideAmount(double amount, bool axis_is_dec);
 
+  // Sub-frame tracking. StartTracking() picks a few bright stars in a
+  // plate-solved image; after that, TrackImage() measures each new
+  // image by centroiding those stars in small boxes (see Tracker.h)
+  // and passes the result to AcceptCenter(). That takes milliseconds
+  // rather than a find_stars/star_match pass, so each image's drift
+  // is known before the next exposure starts. If every star is lost,
+  // tracking stops and Tracking() goes false.
+  bool StartTracking(Image *reference);
+  bool TrackImage(Image *i);
+  bool TrackImage(const char *image_filename);
+  bool Tracking(void) const { return !tracked_stars.empty(); }
+
   void print(FILE *fp);
 
  private:
   AxisDrifter *dec_drifter;
   AxisDrifter *ra_drifter;
+
+  struct TrackedStar {
+    Tracker *tracker;
+    double ref_x;		// position in the reference image
+    double ref_y;
+  };
+  std::vector<TrackedStar> tracked_stars;
+  // Reference image center and the sky motion (radians) of one pixel
+  // step in x and in y there
+  DEC_RA ref_center;
+  double ddec_dx, ddec_dy;
+  double dra_dx, dra_dy;
+
+  void StopTracking(void);
   time_t exposure_start_time;
   double exposure_duration;
   double pending_guide_dec;
@@ -27,6 +27,7 @@
 #include "RequestStatusMessage.h"
 #include "StatusMessage.h"
 #include "FITSMessage.h"
+#include "trace.h"
 #include <iostream>
 using namespace std;
 
@@ -63,6 +64,7 @@ GenMessage::~GenMessage(void) {
 }
 
 int GenMessage::send(void) {
+  TraceSpan span("GenMessage::send");
   int total_bytes_written = 0;
   const unsigned char MagicNumber = MagicValue; // from gen_message.h
 
@@ -85,6 +87,7 @@ int GenMessage::send(void) {
     total_bytes_written += bytes_written;
   }
 
+  TraceCounter("GenMessage::send bytes", total_bytes_written);
   //cerr << "GenMessage::send() wrote Magic Number + "
   //     << total_bytes_written << " bytes." << endl;
   return 0;
@@ -117,6 +120,9 @@ int fetch_bytes(int socket,
 }
   
 GenMessage * GenMessage::ReceiveMessage(int socket) {
+  // Note that this span includes however long the caller had to wait
+  // for the other end to start sending (e.g., the exposure time).
+  TraceSpan span("GenMessage::receive");
   GenMessage *new_message = 0;
   unsigned char preface[5];	// holds magic # and byte count
 
@@ -155,6 +161,7 @@ GenMessage * GenMessage::ReceiveMessage(int socket) {
     delete message;
     return 0;
   }
+  TraceCounter("GenMessage::receive bytes", MessageSize);
 
   {
 
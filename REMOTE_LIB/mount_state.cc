@@ -0,0 +1,237 @@
+/*  mount_state.cc -- Snapshot of mount state shared by the scope server
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>		// clock_gettime()
+#include <fcntl.h>
+#include <unistd.h>		// ftruncate()
+#include <sys/mman.h>		// shm_open(), mmap()
+#include <sys/stat.h>
+#include <sys/syscall.h>	// SYS_futex
+#include <linux/futex.h>
+#include <limits.h>		// INT_MAX
+#include <atomic>
+#include "mount_state.h"
+
+#define MOUNT_STATE_SHM "/Mount_State"
+#define MOUNT_STATE_MAGIC 0x4d535431 // "MST1"; change if MountState changes
+
+const char *mount_state_queries[NUM_MOUNT_QUERIES] = {
+  ":GR#", ":GD#", ":GA#", ":GZ#", ":GS#", ":pS#", ":Gstat#", ":Gmte#",
+};
+
+struct SharedMountState {
+  uint32_t magic;
+  std::atomic<uint32_t> sequence; // odd while the server is writing
+  MountState state;
+};
+
+double MountStateClock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1.0e-9;
+}
+
+//****************************************************************
+//        Parsing
+//****************************************************************
+
+// Parses "sDD*MM:SS.S#", "HH:MM:SS.SS#", and the like (any single
+// separator character, optional sign) into DD + MM/60 + SS/3600.
+static bool ParseSexagesimal(const char *s, double *value) {
+  double sign = 1.0;
+  if (*s == '-') {
+    sign = -1.0;
+    s++;
+  } else if (*s == '+') {
+    s++;
+  }
+  int d, m;
+  double sec;
+  if (sscanf(s, "%d%*c%d%*c%lf", &d, &m, &sec) != 3 ||
+      d < 0 || m < 0 || m >= 60 || sec < 0.0 || sec >= 61.0) {
+    return false;
+  }
+  *value = sign*(d + m/60.0 + sec/3600.0);
+  return true;
+}
+
+void ParseMountState(MountState *state) {
+  const char (*reply)[32] = state->reply;
+  double v1, v2;
+  state->valid = 0;
+
+  if (ParseSexagesimal(reply[MQ_RA], &v1) &&
+      ParseSexagesimal(reply[MQ_DEC], &v2)) {
+    state->ra_radians = v1*M_PI/12.0;
+    state->dec_radians = v2*M_PI/180.0;
+    state->valid |= MS_POSITION;
+  }
+  if (ParseSexagesimal(reply[MQ_ALT], &v1) &&
+      ParseSexagesimal(reply[MQ_AZ], &v2)) {
+    state->alt_radians = v1*M_PI/180.0;
+    // varies from +PI to -PI
+    state->az_radians = v2*M_PI/180.0 - M_PI;
+    state->valid |= MS_ALTAZ;
+  }
+  if (ParseSexagesimal(reply[MQ_SIDEREAL], &v1)) {
+    state->sidereal_radians = v1*M_PI/12.0;
+    state->valid |= MS_SIDEREAL;
+  }
+  if (reply[MQ_PIER][0] == 'E' || reply[MQ_PIER][0] == 'W') {
+    state->pier_west = (reply[MQ_PIER][0] == 'W');
+    state->valid |= MS_PIER;
+  }
+  if (sscanf(reply[MQ_STATUS], "%d", &state->status) == 1) {
+    state->valid |= MS_STATUS;
+  }
+  if (sscanf(reply[MQ_LIMIT], "%ld", &state->mins_to_limit) == 1) {
+    state->valid |= MS_LIMIT;
+  }
+}
+
+//****************************************************************
+//        Client side
+//****************************************************************
+static const SharedMountState *reader = nullptr;
+static double last_attach_attempt = -1.0e9;
+
+static void AttachReader(void) {
+  // Don't keep trying (and failing) on computers without a server
+  const double now = MountStateClock();
+  if (now - last_attach_attempt < 10.0) return;
+  last_attach_attempt = now;
+
+  const int fd = shm_open(MOUNT_STATE_SHM, O_RDONLY, 0);
+  if (fd < 0) return;
+  void *addr = mmap(nullptr, sizeof(SharedMountState), PROT_READ,
+		    MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return;
+  const SharedMountState *shared = (const SharedMountState *) addr;
+  if (shared->magic != MOUNT_STATE_MAGIC) {
+    munmap(addr, sizeof(SharedMountState));
+    return;
+  }
+  reader = shared;
+}
+
+bool ReadMountState(MountState *state, double max_age) {
+  if (reader == nullptr) AttachReader();
+  if (reader == nullptr) return false;
+
+  for (int tries = 0; tries < 100; tries++) {
+    const uint32_t before = reader->sequence.load(std::memory_order_acquire);
+    if (before & 1) continue;	// server is mid-update
+    memcpy(state, &reader->state, sizeof(*state));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (reader->sequence.load(std::memory_order_relaxed) == before) {
+      return (state->valid != 0 &&
+	      MountStateClock() - state->timestamp <= max_age);
+    }
+  }
+  return false;
+}
+
+bool WaitForNewMountState(MountState *state, double timeout) {
+  const double previous = state->timestamp;
+  const double deadline = MountStateClock() + timeout;
+  if (reader == nullptr) AttachReader();
+  if (reader == nullptr) return false;
+
+  do {
+    // Fetch the counter before looking at the snapshot; if the server
+    // publishes in between, the futex wait returns at once.
+    const uint32_t seq = reader->sequence.load(std::memory_order_acquire);
+    MountState latest;
+    if (ReadMountState(&latest) && latest.timestamp > previous) {
+      *state = latest;
+      return true;
+    }
+    const double remaining = deadline - MountStateClock();
+    if (remaining <= 0.0) return false;
+    struct timespec ts;
+    ts.tv_sec = (time_t) remaining;
+    ts.tv_nsec = (long) ((remaining - ts.tv_sec)*1.0e9);
+    syscall(SYS_futex, (uint32_t *) &reader->sequence, FUTEX_WAIT, seq,
+	    &ts, nullptr, 0);
+  } while(1);
+}
+
+//****************************************************************
+//        Server side
+//****************************************************************
+static SharedMountState *writer = nullptr;
+
+static int AttachWriter(void) {
+  // Readers may belong to other users, so the snapshot is world-readable
+  const int fd = shm_open(MOUNT_STATE_SHM, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    perror("mount_state: shm_open");
+    return -1;
+  }
+  if (ftruncate(fd, sizeof(SharedMountState))) {
+    perror("mount_state: ftruncate");
+    close(fd);
+    return -1;
+  }
+  void *addr = mmap(nullptr, sizeof(SharedMountState), PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    perror("mount_state: mmap");
+    return -1;
+  }
+  writer = (SharedMountState *) addr;
+  writer->sequence.store(0, std::memory_order_relaxed);
+  writer->state.valid = 0;
+  writer->magic = MOUNT_STATE_MAGIC;
+  return 0;
+}
+
+// Wakes every process blocked in WaitForNewMountState()
+static void WakeReaders(void) {
+  syscall(SYS_futex, (uint32_t *) &writer->sequence, FUTEX_WAKE, INT_MAX,
+	  nullptr, nullptr, 0);
+}
+
+int PublishMountState(const MountState &state) {
+  if (writer == nullptr && AttachWriter()) return -1;
+
+  const uint32_t seq = writer->sequence.load(std::memory_order_relaxed);
+  writer->sequence.store(seq+1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&writer->state, &state, sizeof(state));
+  writer->sequence.store(seq+2, std::memory_order_release);
+  WakeReaders();
+  return 0;
+}
+
+void InvalidateMountState(void) {
+  if (writer == nullptr) return;
+
+  const uint32_t seq = writer->sequence.load(std::memory_order_relaxed);
+  writer->sequence.store(seq+1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  writer->state.valid = 0;
+  writer->sequence.store(seq+2, std::memory_order_release);
+  WakeReaders();
+}
@@ -0,0 +1,123 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  mount_state.h -- Snapshot of mount state shared by the scope server
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MOUNT_STATE_H
+#define _MOUNT_STATE_H
+
+// The scope server (focus_server) polls the mount on its own every
+// fraction of a second and publishes what it learns in a small block
+// of POSIX shared memory. Programs on the same computer read the
+// snapshot directly instead of sending a query through the server to
+// the mount; programs elsewhere still send the query, but the server
+// answers it from the snapshot without touching the mount. Either
+// way the mount's command link stays free for motion commands.
+//
+// The snapshot is protected by a sequence counter (a "seqlock"): the
+// server is the only writer and never waits for readers; a reader
+// that catches the server in the middle of an update just tries
+// again.
+//
+// Each time the server publishes, it wakes any readers that are
+// waiting for a new snapshot (a futex on the sequence counter), so
+// a client can follow a slew poll by poll without sending anything.
+//
+// The server clears the snapshot's "valid" flags before it sends
+// any command that isn't one of the polled queries (e.g., a goto), so
+// nobody will see a pre-slew "tracking" status after a slew starts.
+
+// The queries that are polled. mount_state_queries[] holds the
+// GM2000 command string for each.
+enum MountQuery {
+  MQ_RA,			// :GR#
+  MQ_DEC,			// :GD#
+  MQ_ALT,			// :GA#
+  MQ_AZ,			// :GZ#
+  MQ_SIDEREAL,			// :GS#
+  MQ_PIER,			// :pS#
+  MQ_STATUS,			// :Gstat#
+  MQ_LIMIT,			// :Gmte#
+  NUM_MOUNT_QUERIES,
+};
+extern const char *mount_state_queries[NUM_MOUNT_QUERIES];
+
+// Bits in MountState::valid
+#define MS_POSITION  0x01	// ra_radians, dec_radians
+#define MS_ALTAZ     0x02	// alt_radians, az_radians
+#define MS_SIDEREAL  0x04	// sidereal_radians
+#define MS_PIER      0x08	// pier_west
+#define MS_STATUS    0x10	// status
+#define MS_LIMIT     0x20	// mins_to_limit
+
+struct MountState {
+  double timestamp;		// MountStateClock() when polled
+  int valid;			// MS_xxx bits
+  double ra_radians;		// raw mount coordinates (JNow)
+  double dec_radians;
+  double alt_radians;
+  double az_radians;		// same convention as ScopePointsAt_altaz()
+  double sidereal_radians;	// 0..2*PI
+  int pier_west;		// 1 if scope is west of the pier
+  int status;			// mount status word (:Gstat#)
+  long mins_to_limit;		// minutes until the tracking limit
+
+  // Raw replies from the mount (including the trailing '#'); the
+  // server uses these to answer queries from remote clients.
+  char reply[NUM_MOUNT_QUERIES][32];
+};
+
+// Seconds on a clock shared by every process on this computer
+// (CLOCK_MONOTONIC).
+double MountStateClock(void);
+
+// Fills in the parsed fields and "valid" bits of "state" from
+// state->reply[]. A query whose reply is empty or unparseable leaves
+// its bit clear.
+void ParseMountState(MountState *state);
+
+//****************************************************************
+//        Client side
+//****************************************************************
+
+// Default freshness bound for ReadMountState(), seconds
+#define MOUNT_STATE_MAX_AGE 1.0
+
+// Copies the current snapshot into "state". Returns false if there's
+// no scope server on this computer or if the snapshot is older than
+// "max_age" seconds; check state->valid for the fields you need.
+bool ReadMountState(MountState *state, double max_age = MOUNT_STATE_MAX_AGE);
+
+// Blocks until the server publishes a valid snapshot newer than
+// state->timestamp (set it to 0 to accept the current one), then
+// copies it into "state" and returns true. The server wakes waiters
+// each time it publishes, so this returns within microseconds of a
+// poll. Returns false after "timeout" seconds or if there's no scope
+// server on this computer.
+bool WaitForNewMountState(MountState *state, double timeout);
+
+//****************************************************************
+//        Server side
+//****************************************************************
+
+// Creates the shared memory on first use. Returns 0 on success, -1
+// on error (already reported to stderr).
+int PublishMountState(const MountState &state);
+// Clears the "valid" bits of the published snapshot
+void InvalidateMountState(void);
+
+#endif
@@ -16,9 +16,37 @@
  *   along with this program (file: COPYING).  If not, see
  *   <http://www.gnu.org/licenses/>. 
  */
+#ifndef _PORTS_H
+#define _PORTS_H
+
 #include <gendefs.h>
+#include <stdlib.h>		// getenv(), atoi()
 
 #define SCOPE_PORT  6015
 #define CAMERA_PORT 6016
 #define SCOPE_HOST  JELLYBEAN_HOSTNAME
 #define CAMERA_HOST JELLYBEAN_HOSTNAME
+
+// The clients connect to whatever these return. Normally that is
+// the host and ports above, but setting ASTRO_SERVER_HOST (and,
+// optionally, ASTRO_CAMERA_PORT and ASTRO_SCOPE_PORT) in the
+// environment points them somewhere else, such as at a sim_server
+// (TOOLS/SIMULATOR) running on the local machine.
+static inline const char *CameraHost(void) {
+  const char *host = getenv("ASTRO_SERVER_HOST");
+  return (host && *host) ? host : CAMERA_HOST;
+}
+static inline const char *ScopeHost(void) {
+  const char *host = getenv("ASTRO_SERVER_HOST");
+  return (host && *host) ? host : SCOPE_HOST;
+}
+static inline int CameraPort(void) {
+  const char *port = getenv("ASTRO_CAMERA_PORT");
+  return (port && *port) ? atoi(port) : CAMERA_PORT;
+}
+static inline int ScopePort(void) {
+  const char *port = getenv("ASTRO_SCOPE_PORT");
+  return (port && *port) ? atoi(port) : SCOPE_PORT;
+}
+
+#endif
@@ -1,6 +1,6 @@
 /*  scope_api.cc -- User's view of what the mount can do
  *
- *  Copyright (C) 2007, 2018 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2018, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -36,6 +36,8 @@
 #include "lx_FlatLightMessage.h"
 #include "ports.h"
 #include "mount_model.h"
+#include "mount_state.h"
+#include "almanac.h"		// AngularSeparation()
 #include "scope_api.h"
 
 static int comm_socket;		// file descriptor of socket with
@@ -152,13 +154,13 @@ void connect_to_scope(void) {
   struct sockaddr_in my_address;
 
   memset(&my_address, 0, sizeof(my_address));
-  jellybean = gethostbyname(SCOPE_HOST);
+  jellybean = gethostbyname(ScopeHost());
   if(jellybean == 0) {
     herror("Cannot lookup jellybean host name:");
     exit(2);
   } else {
     my_address.sin_addr = *((struct in_addr *)(jellybean->h_addr_list[0]));
-    my_address.sin_port = htons(SCOPE_PORT); // port number
+    my_address.sin_port = htons(ScopePort()); // port number
     my_address.sin_family = AF_INET;
     fprintf(stderr, "Connecting to scope @ %s\n",
 	    inet_ntoa(my_address.sin_addr));
@@ -691,15 +693,99 @@ bool CheckForStuckInLimit(void) {
   return false; // all is okay
 }
 
-void WaitForGoToDoneRaw(void) {
+//****************************************************************
+//        Slew completion and settling
+// These follow the scope server's telemetry (mount_state.h) when
+// this computer has it, waking up each time the server polls the
+// mount. Otherwise they ask the mount every FALLBACK_POLL_SECS.
+//****************************************************************
+#define FALLBACK_POLL_SECS 0.5
+
+static bool StatusIsSlewing(int status) {
+#if defined GEMINI
+  return ((status & 8) == 0);
+#elif defined GM2000
+  return (status == 2 ||	// parking
+	  status == 3 ||	// unparking
+	  status == 4 ||	// homing
+	  status == 6);		// slewing
+#endif
+}
+
+struct MountSample {
+  double timestamp;		// MountStateClock()
+  bool slewing;
+  DEC_RA position;		// raw; only if asked for
+};
+
+// Replaces *sample with the next one. Set sample->timestamp to 0 to
+// get the first.
+static void NextMountSample(MountSample *sample, bool need_position) {
+#if defined GM2000
+  MountState state;
+  state.timestamp = sample->timestamp;
+  if (WaitForNewMountState(&state, 2.0) &&
+      (state.valid & MS_STATUS) &&
+      (!need_position || (state.valid & MS_POSITION))) {
+    sample->timestamp = state.timestamp;
+    sample->slewing = StatusIsSlewing(state.status);
+    sample->position = DEC_RA(state.dec_radians, state.ra_radians);
+    return;
+  }
+#endif
+  const double wait = sample->timestamp + FALLBACK_POLL_SECS - MountStateClock();
+  if (wait > 0.0) usleep((useconds_t) (wait*1.0e6));
+  sample->timestamp = MountStateClock();
+  sample->slewing = SlewInProgress();
+  if (need_position) sample->position = RawScopePointsAt();
+}
+
+bool WaitForSlewDone(double timeout_secs) {
+  const double deadline = MountStateClock() + timeout_secs;
+  MountSample sample;
+  sample.timestamp = 0.0;
+  do {
+    NextMountSample(&sample, false);
+    if (!sample.slewing) return true;
+  } while (MountStateClock() < deadline);
+  return false;
+}
+
+bool WaitForMountSettled(const SettleCriteria &criteria) {
+  const double start = MountStateClock();
+  double stable_since = -1.0;	// negative until rate is low enough
+  MountSample sample;
+  sample.timestamp = 0.0;
+  NextMountSample(&sample, true);
+
   do {
-    if (SlewInProgress() == false) break; // slew done
-    else {
-      fprintf(stderr, ".");
+    const MountSample previous = sample;
+    NextMountSample(&sample, true);
+    const double dt = sample.timestamp - previous.timestamp;
+    const double rate = (dt <= 0.0 ? 0.0 :
+			 AngularSeparation(previous.position, sample.position)*
+			 (180.0*3600.0/M_PI)/dt);
+    if (sample.slewing || rate > criteria.max_rate) {
+      stable_since = -1.0;
+    } else {
+      if (stable_since < 0.0) stable_since = previous.timestamp;
+      if (sample.timestamp - stable_since >= criteria.stable_secs) {
+	fprintf(stderr, "Mount settled after %.1lf sec\n",
+		sample.timestamp - start);
+	return true;
+      }
     }
-    sleep(2);
-  } while(1);
-  fprintf(stderr, "\n");
+  } while (MountStateClock() - start < criteria.timeout_secs);
+
+  fprintf(stderr, "WaitForMountSettled(): mount still moving after %.0lf sec\n",
+	  criteria.timeout_secs);
+  return false;
+}
+
+void WaitForGoToDoneRaw(void) {
+  if (!WaitForSlewDone()) {
+    fprintf(stderr, "WaitForGoToDone(): slew still in progress; giving up.\n");
+  }
   //DumpCurrentLimits();
 }
 
@@ -717,7 +803,7 @@ void WaitForGoToDone(void) {
     WaitForGoToDoneRaw();
   }
 #endif
-  sleep(5);
+  WaitForMountSettled();
 }
   
 //****************************************************************
@@ -736,6 +822,10 @@ GetMountStatus(void) {
 #if defined GEMINI
   BuildMI250Command(buffer, MI250_GET, 99);
 #elif defined GM2000
+  MountState state;
+  if (ReadMountState(&state) && (state.valid & MS_STATUS)) {
+    return state.status;
+  }
   sprintf(buffer, ":Gstat#");
 #else
 #error NEITHER GEMINI nor GM2000 DEFINED
@@ -782,17 +872,7 @@ bool SlewInProgress(void) {
     return SlewInProgress();
   }
 
-#if defined GEMINI
-  if((response_int & 8) == 0) return true; // slew done
-#elif defined GM2000
-  if(response_int == 2 ||	// parking
-     response_int == 3 ||	// unparking
-     response_int == 4 ||	// homing
-     response_int == 6) {	// slewing
-    return true;
-  }
-#endif
-  return false;
+  return StatusIsSlewing(response_int);
 }
 
 //****************************************************************
@@ -1156,6 +1236,11 @@ double GetSiderealTime(void) {
     exit(2);
   }
 
+  MountState state;
+  if (ReadMountState(&state) && (state.valid & MS_SIDEREAL)) {
+    return state.sidereal_radians;
+  }
+
   if(scope_message(":GS#",
 		   RunFast,
 		   StringResponse,
@@ -1184,8 +1269,18 @@ double GetScopeHA(void) {	// scope hour angle (0 == meridian, rads)
     exit(2);
   }
 
-  DEC_RA current_ra = RawScopePointsAt();
-  double current_st = GetSiderealTime();
+  // Take both from the same snapshot if possible
+  MountState state;
+  DEC_RA current_ra;
+  double current_st;
+  if (ReadMountState(&state) &&
+      (state.valid & (MS_POSITION|MS_SIDEREAL)) == (MS_POSITION|MS_SIDEREAL)) {
+    current_ra = DEC_RA(state.dec_radians, state.ra_radians);
+    current_st = state.sidereal_radians;
+  } else {
+    current_ra = RawScopePointsAt();
+    current_st = GetSiderealTime();
+  }
 
   double ha = current_st - current_ra.ra_radians();
   if (ha > M_PI) ha -= M_PI*2;
@@ -1204,6 +1299,11 @@ ALT_AZ ScopePointsAt_altaz(void) {
     exit(2);
   }
 
+  MountState state;
+  if (ReadMountState(&state) && (state.valid & MS_ALTAZ)) {
+    return ALT_AZ(state.alt_radians, state.az_radians);
+  }
+
   if(scope_message(":GA#",
 		   RunFast,
 		   StringResponse,
@@ -1249,6 +1349,12 @@ DEC_RA RawScopePointsAt(void) {
     fprintf(stderr, "scope_api: comm link never initialized.\n");
     exit(2);
   }
+
+  MountState state;
+  if (ReadMountState(&state) && (state.valid & MS_POSITION)) {
+    return DEC_RA(state.dec_radians, state.ra_radians);
+  }
+
   if(scope_message(":GR#",
 		   RunFast,
 		   StringResponse,
@@ -1473,6 +1579,10 @@ scope_on_west_side_of_pier(void) {
   const bool is_gemini = true;
 #elif defined GM2000
   const bool is_gemini = false;
+  MountState state;
+  if (ReadMountState(&state) && (state.valid & MS_PIER)) {
+    return state.pier_west;
+  }
 #endif
 
   if(scope_message((is_gemini ? ":Gm#" : ":pS#"),
@@ -1856,6 +1966,11 @@ long MinsRemainingToLimit(void) {
   char response[64];
   ScopeResponseStatus Status;
 
+  MountState state;
+  if (ReadMountState(&state) && (state.valid & MS_LIMIT)) {
+    return state.mins_to_limit;
+  }
+
   if(scope_message(":Gmte#",
 		   RunFast,
 		   StringResponse,
@@ -1910,9 +2025,7 @@ bool PerformMeridianFlip(void) { // return true if successful
 
   if (response[0] == '1') {
     // Wait for the mount to finish...
-    while(SlewInProgress()) {
-      sleep(3);
-    }
+    WaitForGoToDone();
     return true; //successful return
   }
 
@@ -81,9 +81,26 @@ int MoveTo(DEC_RA *Location, int encourage_flip = 0);
 // returns 0 on success, -1 if something went wrong.
 int SmallMove(double delta_ra_arcmin, double delta_dec_arcmin);
 
-// wait for scope to stop slewing after a move. This command is always
-// valid. If the scope wasn't in a move, this will immediately return.
+// wait for scope to stop slewing after a move and then settle (see
+// WaitForMountSettled()). This command is always valid. If the scope
+// wasn't in a move, this will return as soon as the mount is seen to
+// be tracking steadily.
 void WaitForGoToDone(void);
+
+// Blocks until the mount reports that no slew is in progress. Returns
+// false if that doesn't happen within timeout_secs.
+bool WaitForSlewDone(double timeout_secs = 600.0);
+
+// The mount has settled when it isn't slewing and its position has
+// changed by less than max_rate for stable_secs in a row.
+struct SettleCriteria {
+  double max_rate {1.0};	// arcsec/sec
+  double stable_secs {2.0};
+  double timeout_secs {120.0};	// give up after this long
+};
+
+// Blocks until the mount has settled. Returns false on timeout.
+bool WaitForMountSettled(const SettleCriteria &criteria = SettleCriteria());
 // Here's a non-blocking way to test whether a slew is still
 // active. Works for both MoveTo() and SmallMove().
 bool SlewInProgress(void);
@@ -0,0 +1,238 @@
+/*  trace.cc -- Lightweight timing spans and counters
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>		// for getenv(), atexit()
+#include <string.h>
+#include <time.h>
+#include <unistd.h>		// for getpid()
+#include <sys/syscall.h>	// for SYS_gettid
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include "trace.h"
+
+bool trace_enabled = false;
+
+static constexpr int RING_SIZE = 8192; // events per thread
+
+struct TraceEvent {
+  const char *name;
+  int64_t start_ns;
+  int64_t duration_ns;		// spans only
+  double value;			// counters only
+  bool is_counter;
+};
+
+struct TraceStat {
+  bool is_counter;
+  long count;
+  double total;			// nsec for spans, sum of values for counters
+  double max;
+  double last;			// counters only
+};
+
+// One of these per thread. The lock is only ever contended when a
+// summary or export is being made.
+struct TraceRing {
+  std::mutex lock;
+  pid_t tid;
+  long next {0};		// total events ever written
+  std::vector<TraceEvent> events;
+  std::unordered_map<const char *, TraceStat> stats;
+};
+
+static std::mutex registry_lock;
+static std::list<TraceRing *> all_rings; // never deleted
+static thread_local TraceRing *this_ring = nullptr;
+static int64_t trace_origin_ns = 0;
+static char *exit_filename = nullptr;
+
+int64_t TraceNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t) ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+static TraceRing *GetRing(void) {
+  if (this_ring == nullptr) {
+    TraceRing *ring = new TraceRing;
+    ring->tid = (pid_t) syscall(SYS_gettid);
+    ring->events.resize(RING_SIZE);
+    std::unique_lock<std::mutex> lock(registry_lock);
+    all_rings.push_back(ring);
+    this_ring = ring;
+  }
+  return this_ring;
+}
+
+static void Record(const TraceEvent &event, double stat_value) {
+  TraceRing *ring = GetRing();
+  std::unique_lock<std::mutex> lock(ring->lock);
+  ring->events[ring->next % RING_SIZE] = event;
+  ring->next++;
+
+  auto it = ring->stats.find(event.name);
+  if (it == ring->stats.end()) {
+    ring->stats[event.name] = TraceStat{event.is_counter, 1, stat_value,
+					stat_value, stat_value};
+  } else {
+    TraceStat &s = it->second;
+    s.count++;
+    s.total += stat_value;
+    if (stat_value > s.max) s.max = stat_value;
+    s.last = stat_value;
+  }
+}
+
+void TraceRecordSpan(const char *name, int64_t start_ns, int64_t duration_ns) {
+  if (!trace_enabled) return;
+  Record(TraceEvent{name, start_ns, duration_ns, 0.0, false}, (double) duration_ns);
+}
+
+void TraceCounter(const char *name, double value) {
+  if (!trace_enabled) return;
+  Record(TraceEvent{name, TraceNow(), 0, value, true}, value);
+}
+
+// Copy a name into the JSON output, escaping the few characters that
+// would break a JSON string.
+static void PrintJSONString(FILE *fp, const char *s) {
+  fputc('"', fp);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') fputc('\\', fp);
+    if ((unsigned char) *s >= ' ') fputc(*s, fp);
+  }
+  fputc('"', fp);
+}
+
+int TraceWriteChromeJSON(const char *filename) {
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    perror("TraceWriteChromeJSON: cannot create file");
+    return -1;
+  }
+
+  const int pid = getpid();
+  bool first = true;
+  fprintf(fp, "{\"traceEvents\":[\n");
+
+  std::unique_lock<std::mutex> registry(registry_lock);
+  for (TraceRing *ring : all_rings) {
+    std::unique_lock<std::mutex> lock(ring->lock);
+    const long first_event = (ring->next > RING_SIZE ? ring->next - RING_SIZE : 0);
+    for (long n = first_event; n < ring->next; n++) {
+      const TraceEvent &e = ring->events[n % RING_SIZE];
+      fprintf(fp, "%s{\"name\":", (first ? "" : ",\n"));
+      PrintJSONString(fp, e.name);
+      // Chrome trace timestamps are in microseconds
+      const double ts = (e.start_ns - trace_origin_ns)/1000.0;
+      if (e.is_counter) {
+	fprintf(fp, ",\"ph\":\"C\",\"ts\":%.3lf,\"pid\":%d,\"tid\":%d,\"args\":{\"value\":%.6g}}",
+		ts, pid, ring->tid, e.value);
+      } else {
+	fprintf(fp, ",\"ph\":\"X\",\"ts\":%.3lf,\"dur\":%.3lf,\"pid\":%d,\"tid\":%d}",
+		ts, e.duration_ns/1000.0, pid, ring->tid);
+      }
+      first = false;
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+  return 0;
+}
+
+void TraceSummary(std::list<std::string> &lines) {
+  if (!trace_enabled) return;
+
+  // Merge across threads. Different threads can hold the same name
+  // at different addresses (if it came from different compilation
+  // units), so the merge is by string.
+  std::list<std::pair<std::string, TraceStat>> merged;
+  {
+    std::unique_lock<std::mutex> registry(registry_lock);
+    for (TraceRing *ring : all_rings) {
+      std::unique_lock<std::mutex> lock(ring->lock);
+      for (auto &item : ring->stats) {
+	const TraceStat &s = item.second;
+	bool found = false;
+	for (auto &m : merged) {
+	  if (m.first == item.first && m.second.is_counter == s.is_counter) {
+	    m.second.count += s.count;
+	    m.second.total += s.total;
+	    if (s.max > m.second.max) m.second.max = s.max;
+	    m.second.last = s.last;
+	    found = true;
+	    break;
+	  }
+	}
+	if (!found) merged.push_back(std::make_pair(std::string(item.first), s));
+      }
+      ring->stats.clear();
+    }
+  }
+
+  merged.sort([](const std::pair<std::string, TraceStat> &a,
+		 const std::pair<std::string, TraceStat> &b) {
+		return a.first < b.first; });
+
+  for (auto &m : merged) {
+    const TraceStat &s = m.second;
+    char buffer[256];
+    if (s.is_counter) {
+      snprintf(buffer, sizeof(buffer),
+	       "trace: %s n=%ld sum=%.6g max=%.6g last=%.6g",
+	       m.first.c_str(), s.count, s.total, s.max, s.last);
+    } else {
+      snprintf(buffer, sizeof(buffer),
+	       "trace: %s n=%ld mean=%.4g max=%.4g total=%.4g (msec)",
+	       m.first.c_str(), s.count, s.total/s.count/1.0e6,
+	       s.max/1.0e6, s.total/1.0e6);
+    }
+    lines.push_back(std::string(buffer));
+  }
+}
+
+static void WriteTraceAtExit(void) {
+  if (exit_filename) {
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s.%d.json", exit_filename, getpid());
+    if (TraceWriteChromeJSON(filename) == 0) {
+      fprintf(stderr, "trace written to %s\n", filename);
+    }
+  }
+}
+
+void TraceEnable(bool enable) {
+  if (enable && trace_origin_ns == 0) {
+    trace_origin_ns = TraceNow();
+  }
+  trace_enabled = enable;
+}
+
+// Runs before main() in every program linked with the library
+static struct TraceStartup {
+  TraceStartup(void) {
+    const char *prefix = getenv("ASTRO_TRACE");
+    if (prefix && *prefix) {
+      exit_filename = strdup(prefix);
+      TraceEnable(true);
+      atexit(WriteTraceAtExit);
+    }
+  }
+} trace_startup;
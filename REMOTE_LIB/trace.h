@@ -0,0 +1,81 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  trace.h -- Lightweight timing spans and counters
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+#include <list>
+#include <string>
+
+// Tracing is off unless the environment variable ASTRO_TRACE is set
+// (or TraceEnable(true) is called). When ASTRO_TRACE is set, its
+// value is used as a filename prefix and, when the process exits, a
+// Chrome-trace JSON file named "<prefix>.<pid>.json" is written. That
+// file can be loaded into chrome://tracing or ui.perfetto.dev.
+//
+// Each thread records into its own fixed-size ring buffer, so only
+// the most recent events of a long-running process are kept. Running
+// totals (count, total time, max time) per span name are kept
+// separately and are not lost when the ring wraps.
+//
+// All names passed in must be string constants (only the pointer is
+// stored).
+//
+// Usage:
+//    void ReadoutExposure(void) {
+//      TraceSpan span("ReadoutExposure");
+//      ...
+//    }
+//    TraceCounter("fits_bytes", nbytes);
+
+extern bool trace_enabled;
+inline bool TraceEnabled(void) { return trace_enabled; }
+
+void TraceEnable(bool enable);
+
+// Nanoseconds from CLOCK_MONOTONIC
+int64_t TraceNow(void);
+
+void TraceRecordSpan(const char *name, int64_t start_ns, int64_t duration_ns);
+void TraceCounter(const char *name, double value);
+
+class TraceSpan {
+public:
+  TraceSpan(const char *name) :
+    span_name(name), start_ns(TraceEnabled() ? TraceNow() : -1) {}
+  ~TraceSpan(void) {
+    if (start_ns >= 0) TraceRecordSpan(span_name, start_ns, TraceNow() - start_ns);
+  }
+private:
+  const char *span_name;
+  const int64_t start_ns;
+};
+
+// Write everything currently held in the ring buffers as a
+// Chrome-trace JSON file. Returns 0 on success, -1 on error.
+int TraceWriteChromeJSON(const char *filename);
+
+// Appends one human-readable line per span name and per counter
+// name (all threads combined) to "lines", covering everything since
+// the previous call (or since startup). Nothing is appended if
+// tracing is off or if nothing was recorded.
+void TraceSummary(std::list<std::string> &lines);
+
+#endif
@@ -62,15 +62,23 @@ struct SerialByte {
   int data;
 } this_byte;
 
-void ReadByte(PRB &ring) {
-  char buffer[8];
+// The Arduino answers within a few msec; this is generous.
+#define READ_TIMEOUT_MSEC 5000
+#define EOM_BYTE ((PREFIX_EOM << 4) + PREFIX_EOM)
 
-  while (ring.NumPoints() == 0) {
-    usleep(10000);
-  }
-  unsigned int r = ring.PopData();
+// ReadCommand() reads one whole message (through the EOM byte, which
+// can't appear anywhere else) and then ReadByte() walks through it.
+static unsigned char message[16];
+static int message_len = 0;
+static int message_next = 0;
 
-  int one_byte = r;
+void ReadByte(PRB &ring) {
+  if (message_next >= message_len) {
+    this_byte.prefix = NODATA;
+    this_byte.data = 0;
+    return;
+  }
+  int one_byte = message[message_next++];
   this_byte.prefix = (one_byte & 0xf0) >> 4;
   this_byte.data = (one_byte & 0x0f);
 
@@ -79,6 +87,13 @@ void ReadByte(PRB &ring) {
 }
 
 void ReadCommand(PRB &ring) {
+  message_len = ring.ReadMessage(message, sizeof(message), EOM_BYTE,
+				 READ_TIMEOUT_MSEC);
+  message_next = 0;
+  if (message_len < 0) {
+    fprintf(stderr, "c14focuser: no response from Arduino.\n");
+    message_len = 0;
+  }
   ReadByte(ring);
   if (this_byte.prefix == NODATA) {
     command_in.cc_status = COMMAND_NONE;
@@ -209,21 +224,11 @@ static void *ListenerThread(void *arg) {
     return nullptr;
   }
   while(1) {
-    char buffer[8];
-    int r = serialport_read_until(c14focuser_fd, buffer, 0xff, 1, 100/*msec*/);
-    if (r == -1) {
+    // Blocks until bytes arrive (or 100 msec pass, so that
+    // pthread_cancel() is noticed promptly)
+    if (ring->FillFrom(c14focuser_fd, 100/*msec*/) < 0) {
       fprintf(stderr, "c14focuser: read from Arduino failed.\n");
       return nullptr;
-    } else if (r == -2) {
-      // normal timeout: do nothing
-      // fprintf(stderr, "-");
-      ;
-    } else {
-      ring->AddNewData(buffer[0]);
-      fprintf(listener_log, "0x%02x ", buffer[0]);
-      if (buffer[0] == 0x33) fprintf(listener_log, "\n");
-      fflush(listener_log);
-      //fprintf(stderr, "X");
     }
   }
   fclose(listener_log);
@@ -7,6 +7,7 @@
 #include <string>
 #include "focus.h"
 #include "json.h"
+#include "prb.h"
 
 #define TEST_MODE
 #define MAX_RESPONSE_SIZE 8192
@@ -20,76 +21,6 @@ char *BuildJSONCommand(int cmd_type,
 		       const char *value_string = nullptr);
 void get_focus_encoder(void);
 
-// Protected Ring Buffer
-class PRB {
-public:
-  PRB(void);
-  ~PRB(void);
-
-  unsigned int buflen;
-
-  // "i" should be incremented with
-  // i = (i+1) % this->buflen;
-  unsigned int &Get(unsigned int i) { return buffer[i]; }
-
-  unsigned int NumPoints(void);
-
-  void AddNewData(unsigned int value);
-  unsigned int PopData(void);
-
-private:
-  unsigned int *buffer;
-  unsigned int ring_start; // index of first valid entry
-  unsigned int ring_next; // index of next valid value
-  //sem_t write_protect_semaphore;
-};
-
-PRB::PRB(void) : buflen(8192), ring_start(0), ring_next(0), buffer(new unsigned int[8192]) {
-#if 0
-  int res = sem_init(&write_protect_semaphore,
-		     0, // shared across threads
-		     1); // initialized to unlocked state
-  if (res) {
-    perror("sem_init(): initialization error: ");
-    exit(-2);
-  }
-#endif
-  ;
-}
-
-PRB::~PRB(void) {
-  delete [] buffer;
-#if 0
-  sem_destroy(&write_protect_semaphore);
-#endif
-}
-
-unsigned int PRB::NumPoints(void) {
-  if (ring_start > ring_next) {
-    return buflen - (ring_start - ring_next);
-  } else {
-    return ring_next - ring_start;
-  }
-}
-
-void PRB::AddNewData(unsigned int value) {
-  buffer[ring_next] = value;
-  ring_next = (ring_next+1)%buflen;
-}
-
-#define PRB_EMPTY 0xffff;
-unsigned int PRB::PopData(void) {
-  if (ring_start == ring_next) return PRB_EMPTY;
-  const unsigned int value = buffer[ring_start];
-  ring_start = (ring_start+1)%buflen;
-  return value;
-}
-				   
-
-//****************************************************************
-//        end of PRB
-//****************************************************************
-
 int focus_fd = -1;
 static int &esattofocuser_fd = focus_fd;
 static PRB *shared_prb = nullptr;
@@ -106,14 +37,7 @@ void InitFocuser(void) {
 }
 
 char ReadByte(PRB *ring) {
-  char buffer[8];
-
-  while (ring->NumPoints() == 0) {
-    usleep(10000);
-  }
-  unsigned int r = ring->PopData();
-
-  return (char) r;
+  return (char) ring->ReadByte(60*1000);
 }
 
 FILE *sender_log = nullptr;
@@ -166,17 +90,15 @@ static void *ListenerThread(void *arg) {
     return nullptr;
   }
   while(1) {
-    char buffer[8];
-    int r = serialport_read_until(esattofocuser_fd, buffer, 0xff, 1, 100/*msec*/);
-    if (r == -1) {
+    const int r = ring->FillFrom(esattofocuser_fd, 100/*msec*/);
+    if (r < 0) {
       fprintf(stderr, "esattofocuser: read from USB failed.\n");
       return nullptr;
-    } else if (r == -2) {
+    } else if (r == 0) {
       // normal timeout: do nothing
       fprintf(stderr, "-");
     } else {
-      ring->AddNewData(buffer[0]);
-      fprintf(listener_log, "0x%02x ", buffer[0]);
+      fprintf(listener_log, "%d bytes ", r);
       fflush(listener_log);
       fprintf(stderr, "X");
     }
@@ -244,7 +166,7 @@ void Test2(PRB &ring) {
 }
 
 int main(int argc, char **argv) {
-  PRB shared_memory;
+  PRB shared_memory(MAX_RESPONSE_SIZE);
   shared_prb = &shared_memory;
   
   pthread_t listener_thread;
@@ -273,7 +195,7 @@ int main(int argc, char **argv) {
 //#else // NOT test mode
 
 static int initialized = 0;
-static PRB ring;
+static PRB ring(MAX_RESPONSE_SIZE);
 
 void initialize_focuser(void) {
   pthread_t listener_thread;
@@ -45,22 +45,12 @@ static const char *GetTimeASCII(void) {
 }
 
 static int ReadByte(PRB *ring) {
-  char buffer[8];
-  // ReadByte() checks for a character every 0.01 seconds. We wait for
-  // at most one minute before we give up.
-  int timeout = 60*100; // 60 secs at 0.01 sec/cycle.
-
-  while (ring->NumPoints() == 0) {
-    usleep(10000);
-    if (timeout-- <= 0) {
-      fprintf(stderr, "esatto: ReadByte() timeout. Returning EOF.\n");
-      // oops. Timed out. Return EOF.
-      return EOF;
-    }
+  // We wait for at most one minute before we give up.
+  const int c = ring->ReadByte(60*1000);
+  if (c == EOF) {
+    fprintf(stderr, "esatto: ReadByte() timeout. Returning EOF.\n");
   }
-  unsigned int r = ring->PopData();
-
-  return (char) r;
+  return c;
 }
 
 static FILE *sender_log = nullptr;
@@ -149,20 +139,11 @@ static void *ListenerThread(void *arg) {
     return nullptr;
   }
   while(1) {
-    char buffer[8];
-    int r = serialport_read_until(esattofocuser_fd, buffer, 0xff, 1, 100/*msec*/);
-    if (r == -1) {
+    // Blocks until bytes arrive (or 100 msec pass, so that
+    // pthread_cancel() is noticed promptly)
+    if (ring->FillFrom(esattofocuser_fd, 100/*msec*/) < 0) {
       fprintf(stderr, "esattofocuser: read from USB failed.\n");
       return nullptr;
-    } else if (r == -2) {
-      // normal timeout: do nothing
-      //fprintf(stderr, "-");
-      ;
-    } else {
-      ring->AddNewData(buffer[0]);
-      //fprintf(listener_log, "0x%02x ", buffer[0]);
-      //fflush(listener_log);
-      //fprintf(stderr, "X");
     }
   }
   fclose(listener_log);
@@ -1,6 +1,6 @@
 /*  focus_server.cc -- Main program (server) handling commands for the mount
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -20,6 +20,7 @@
 #include <stdlib.h>		// exit()
 #include <string.h>		// memset()
 #include <errno.h>
+#include <signal.h>
 #include <sys/time.h>		// struct timeval
 #include <sys/types.h>
 #include <unistd.h>
@@ -31,28 +32,59 @@
 #include "flatlight.h"
 #include "ports.h"
 #include "scope_message_handler.h"
+#include "mount_telemetry.h"
+#include "mount_reader.h"
 
 void ProcessMessages(void);
 
 /*
  * invocation:
- * focus_server
+ * focus_server [-p poll_msec]
+ *
+ * -p sets how often the mount's position and status are polled (see
+ * mount_telemetry.h); 0 turns polling off.
+ *
+ * "kill -USR1" makes the server print the mount round-trip time
+ * histograms (see mount_reader.h) on stderr.
  */
 
+static volatile sig_atomic_t latency_report_requested = 0;
+
+static void request_latency_report(int) {
+  latency_report_requested = 1;
+}
+
 void usage(const char *string) {
-  fprintf(stderr, "%s: usage: focus_server \n",
+  fprintf(stderr, "%s: usage: focus_server [-p poll_msec]\n",
 	  string);
   exit(2);
 }
 
 int main(int argc, char **argv) {
-  if(argc != 1) {
+  int ch;
+  int poll_msec = 500;
+
+  while((ch = getopt(argc, argv, "p:")) != -1) {
+    switch(ch) {
+    case 'p':
+      poll_msec = atoi(optarg);
+      break;
+
+    case '?':
+    default:
+      usage("invalid option");
+    }
+  }
+  if(optind != argc) {
     usage("wrong # arguments");
   }
 
   write_log = 1;
   InitFlatLight();
   initialize_lx200();
+  init_mount_reader();
+  init_mount_telemetry(poll_msec);
+  signal(SIGUSR1, request_latency_report);
   ProcessMessages();
 
 }
@@ -132,12 +164,27 @@ void ProcessMessages(void) {
       }
     }
     
-    fprintf(stderr, "Calling select() with n=%d after setting fd=%d\n",
-	    largest_fd+1, s1);
-    retval = select(largest_fd+1, &server_fds_r, 0, 0, 0);
-    fprintf(stderr, "select() returned %d.\n", retval);
+    // Wake up in time for the next telemetry poll
+    const int timeout_msec = mount_telemetry_timeout_msec();
+    struct timeval *timeout = 0;
+    if (timeout_msec >= 0) {
+      tv.tv_sec = timeout_msec/1000;
+      tv.tv_usec = (timeout_msec%1000)*1000;
+      timeout = &tv;
+    }
+    retval = select(largest_fd+1, &server_fds_r, 0, 0, timeout);
+    if (retval != 0) {
+      fprintf(stderr, "select() returned %d.\n", retval);
+    }
+
+    if (latency_report_requested) {
+      latency_report_requested = 0;
+      mount_latency_report(stderr);
+    }
 
-    if(retval < 0) {
+    if(retval < 0 && errno == EINTR) {
+      continue;
+    } else if(retval < 0) {
       perror("focus_server: select failure");
       exit(2);
     } else {
@@ -186,6 +233,7 @@ void ProcessMessages(void) {
 	}
       }
     }
+    poll_mount_telemetry();
     /*NOTREACHED*/
   }
 }
@@ -0,0 +1,194 @@
+/*  mount_reader.cc -- Buffered reads of mount replies, with latency stats
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>		// isalpha()
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>		// clock_gettime()
+#include <unistd.h>
+#include <map>
+#include <string>
+#include "mount_reader.h"
+#include "track.h"		// lx200_fd
+#include "lx200.h"
+
+static char input[1024];
+static int input_start = 0;	// first unread byte
+static int input_end = 0;	// one past the last byte received
+
+double mount_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1.0e-9;
+}
+
+void init_mount_reader(void) {
+  const int flags = fcntl(lx200_fd, F_GETFL);
+  if (flags < 0 || fcntl(lx200_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    perror("mount_reader: cannot make mount link non-blocking");
+  }
+  input_start = input_end = 0;
+}
+
+// Waits until the deadline for more input. Returns the number of
+// bytes added, 0 on timeout, -1 on error.
+static int fill_input(double deadline) {
+  if (input_start == input_end) {
+    input_start = input_end = 0;
+  } else if (input_end >= (int) sizeof(input) - 1) {
+    memmove(input, input + input_start, input_end - input_start);
+    input_end -= input_start;
+    input_start = 0;
+  }
+
+  do {
+    const double remaining = deadline - mount_clock();
+    struct pollfd pfd;
+    pfd.fd = lx200_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    const int ready = poll(&pfd, 1, (remaining > 0.0 ? (int) (remaining*1000.0 + 0.999) : 0));
+    if (ready < 0) {
+      if (errno == EINTR) continue;
+      perror("mount_reader: poll");
+      return -1;
+    }
+    if (ready == 0) return 0;
+
+    // read_mount() null-terminates what it reads, so leave room
+    const int n = read_mount(lx200_fd, input + input_end,
+			     sizeof(input) - 1 - input_end);
+    if (n > 0) {
+      input_end += n;
+      return n;
+    }
+    if (n == 0) {
+      fprintf(stderr, "mount_reader: mount closed the connection\n");
+      return -1;
+    }
+    if (errno != EAGAIN && errno != EINTR) {
+      perror("mount_reader: read");
+      return -1;
+    }
+  } while (mount_clock() < deadline);
+  return 0;
+}
+
+int mount_read_char(double deadline) {
+  if (input_start == input_end && fill_input(deadline) <= 0) return EOF;
+  return (unsigned char) input[input_start++];
+}
+
+int mount_read_string(char *buffer, int buffer_size, double deadline) {
+  int count = 0;
+  buffer[0] = 0;
+  do {
+    // Take whatever is buffered, up through the '#'
+    while (input_start < input_end && count < buffer_size-1) {
+      const char c = input[input_start++];
+      buffer[count++] = c;
+      if (c == '#') {
+	buffer[count] = 0;
+	return count;
+      }
+    }
+    buffer[count] = 0;
+    if (count >= buffer_size-1) {
+      fprintf(stderr, "WARNING: mount_read_string failed to read '#'\n");
+      fprintf(stderr, "...instead, read: %s\n", buffer);
+      return count;
+    }
+  } while (fill_input(deadline) > 0);
+  return -1;
+}
+
+int mount_read_fixed(char *buffer, int count, double deadline) {
+  int n = 0;
+  while (n < count) {
+    if (input_start == input_end && fill_input(deadline) <= 0) break;
+    buffer[n++] = input[input_start++];
+  }
+  return n;
+}
+
+int mount_discard_input(void) {
+  while (fill_input(0.0) > 0) {
+    ;				// collect anything waiting on the link
+  }
+  const int dropped = input_end - input_start;
+  if (dropped) {
+    input[input_end] = 0;
+    fprintf(stderr, "mount_reader: discarding %d stray bytes: '%s'\n",
+	    dropped, input + input_start);
+  }
+  input_start = input_end = 0;
+  return dropped;
+}
+
+//****************************************************************
+//        Latency histograms
+//****************************************************************
+
+// Bucket i holds round trips shorter than (0.25 msec)*2^i; the last
+// bucket holds everything longer.
+#define NUM_BUCKETS 17
+
+struct LatencyHistogram {
+  unsigned long count {0};
+  double total {0.0};
+  double max {0.0};
+  unsigned long bucket[NUM_BUCKETS] {};
+};
+
+static std::map<std::string, LatencyHistogram> histograms;
+
+void mount_latency_record(const char *command, double seconds) {
+  const char *s = command;
+  if (*s == ':') s++;
+  const char *end = s;
+  while (isalpha(*end)) end++;
+  LatencyHistogram &h = histograms[std::string(s, end - s)];
+
+  h.count++;
+  h.total += seconds;
+  if (seconds > h.max) h.max = seconds;
+  int b = 0;
+  double limit = 0.00025;
+  while (b < NUM_BUCKETS-1 && seconds >= limit) {
+    b++;
+    limit *= 2.0;
+  }
+  h.bucket[b]++;
+}
+
+void mount_latency_report(FILE *fp) {
+  fprintf(fp, "Mount round-trip times (msec). Column n counts replies under\n");
+  fprintf(fp, "0.25, 0.5, 1, 2, ... msec; the last column is everything longer.\n");
+  for (auto &entry : histograms) {
+    const LatencyHistogram &h = entry.second;
+    fprintf(fp, "%-8s n=%-7lu mean=%8.2lf max=%8.2lf |",
+	    entry.first.c_str(), h.count, 1000.0*h.total/h.count, 1000.0*h.max);
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+      fprintf(fp, " %lu", h.bucket[b]);
+    }
+    fprintf(fp, "\n");
+  }
+}
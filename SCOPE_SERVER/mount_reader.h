@@ -0,0 +1,52 @@
+/*  mount_reader.h -- Buffered reads of mount replies, with latency stats
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+
+// Replies from the mount are read in chunks, as many bytes as are
+// waiting, into a buffer; the functions below take replies out of
+// that buffer and only go to the link (with poll()) when it runs
+// dry. Since replies are consumed in order, several commands can be
+// sent at once and their replies read back one after another.
+//
+// All timeouts are deadlines on mount_clock().
+
+// Seconds, CLOCK_MONOTONIC
+double mount_clock(void);
+
+// Puts lx200_fd into non-blocking mode. Call after initialize_lx200().
+void init_mount_reader(void);
+
+// Reads one character. Returns EOF if the deadline passes first.
+int mount_read_char(double deadline);
+// Reads a '#'-terminated reply (the '#' is kept) into "buffer", which
+// is always null-terminated. Returns the length, or -1 if the
+// deadline passes first (buffer then holds whatever did arrive).
+int mount_read_string(char *buffer, int buffer_size, double deadline);
+// Reads exactly "count" characters. Returns the number read (fewer
+// than "count" only if the deadline passed).
+int mount_read_fixed(char *buffer, int count, double deadline);
+
+// Throws away anything already received (e.g., a reply that showed up
+// after its command timed out). Returns the number of bytes dropped.
+int mount_discard_input(void);
+
+// Round-trip time histograms, one per command (":GR#" and
+// ":Sr12:00:00#" are filed under "GR" and "Sr")
+void mount_latency_record(const char *command, double seconds);
+void mount_latency_report(FILE *fp);
@@ -0,0 +1,134 @@
+/*  mount_telemetry.cc -- Server-side polling of mount state
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "mount_state.h"
+#include "mount_telemetry.h"
+#include "mount_reader.h"
+#include "track.h"		// lx200_fd
+#include "lx200.h"
+
+// After a query times out, wait this long before polling again
+#define POLL_BACKOFF_SECS 5.0
+
+static int poll_interval_msec = 0;
+static double next_poll = 0.0;
+static MountState snapshot;
+
+// Which MountState::valid bit covers the reply to each query
+static const int query_valid_bit[NUM_MOUNT_QUERIES] = {
+  MS_POSITION, MS_POSITION, MS_ALTAZ, MS_ALTAZ,
+  MS_SIDEREAL, MS_PIER, MS_STATUS, MS_LIMIT,
+};
+
+void init_mount_telemetry(int poll_msec) {
+  poll_interval_msec = poll_msec;
+  snapshot.valid = 0;
+  next_poll = MountStateClock();
+}
+
+int mount_telemetry_timeout_msec(void) {
+  if (poll_interval_msec <= 0) return -1;
+  const double wait = next_poll - MountStateClock();
+  return (wait <= 0.0 ? 0 : (int) (wait*1000.0 + 1.0));
+}
+
+// Sends all the queries in one write and reads the replies back in
+// order; the mount answers each as it gets to it, so the whole poll
+// costs one round trip. Returns 0 on success, -1 on timeout or error.
+static int query_mount(MountState *state) {
+  char batch[NUM_MOUNT_QUERIES*8+1];
+  batch[0] = 0;
+  for (int q = 0; q < NUM_MOUNT_QUERIES; q++) {
+    strcat(batch, mount_state_queries[q]);
+  }
+  const int len = strlen(batch);
+
+  mount_discard_input();
+  const double start_time = mount_clock();
+  if (write_mount(lx200_fd, batch, len) != len) {
+    perror("mount_telemetry: unable to send queries");
+    return -1;
+  }
+
+  const double deadline = start_time + 1.0;
+  for (int q = 0; q < NUM_MOUNT_QUERIES; q++) {
+    if (mount_read_string(state->reply[q], sizeof(state->reply[q]), deadline) < 0) {
+      fprintf(stderr, "mount_telemetry: no response to %s\n",
+	      mount_state_queries[q]);
+      return -1;
+    }
+  }
+  mount_latency_record("poll", mount_clock() - start_time);
+  return 0;
+}
+
+void poll_mount_telemetry(void) {
+  if (poll_interval_msec <= 0) return;
+  const double now = MountStateClock();
+  if (now < next_poll) return;
+
+  MountState state;
+  memset(&state, 0, sizeof(state));
+  state.timestamp = now;
+  if (query_mount(&state)) {
+    // Mount isn't answering; leave the snapshot invalid for a while
+    mount_telemetry_invalidate();
+    next_poll = MountStateClock() + POLL_BACKOFF_SECS;
+    return;
+  }
+  ParseMountState(&state);
+  snapshot = state;
+  PublishMountState(snapshot);
+
+  // Schedule from the start of this poll so the rate doesn't drift,
+  // but never fall behind by more than one interval
+  next_poll += poll_interval_msec/1000.0;
+  if (next_poll < MountStateClock()) next_poll = MountStateClock();
+}
+
+const char *cached_mount_reply(const char *command) {
+  if (poll_interval_msec <= 0) return 0;
+  for (int q = 0; q < NUM_MOUNT_QUERIES; q++) {
+    if (strcmp(command, mount_state_queries[q]) == 0) {
+      // Fresh means no older than two poll intervals (or the
+      // clients' default bound, if that's longer)
+      double max_age = 2.0*poll_interval_msec/1000.0;
+      if (max_age < MOUNT_STATE_MAX_AGE) max_age = MOUNT_STATE_MAX_AGE;
+      if ((snapshot.valid & query_valid_bit[q]) &&
+	  MountStateClock() - snapshot.timestamp <= max_age) {
+	return snapshot.reply[q];
+      }
+      return 0;
+    }
+  }
+  return 0;
+}
+
+bool is_polled_mount_query(const char *command) {
+  for (int q = 0; q < NUM_MOUNT_QUERIES; q++) {
+    if (strcmp(command, mount_state_queries[q]) == 0) return true;
+  }
+  return false;
+}
+
+void mount_telemetry_invalidate(void) {
+  snapshot.valid = 0;
+  InvalidateMountState();
+}
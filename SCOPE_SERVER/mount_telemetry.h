@@ -0,0 +1,39 @@
+/*  mount_telemetry.h -- Server-side polling of mount state
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>. 
+ */
+
+// Polls the mount every "poll_msec" and publishes the result (see
+// mount_state.h). A poll_msec of 0 turns polling off.
+void init_mount_telemetry(int poll_msec);
+
+// How long the server's select() may wait before the next poll is
+// due; -1 if polling is off.
+int mount_telemetry_timeout_msec(void);
+
+// Polls the mount if a poll is due.
+void poll_mount_telemetry(void);
+
+// If "command" is one of the polled queries and the snapshot is
+// fresh, returns the mount's reply to it. Otherwise returns 0.
+const char *cached_mount_reply(const char *command);
+
+// True if "command" is one of the queries that are polled
+bool is_polled_mount_query(const char *command);
+
+// Called before any command that might change the mount's state
+void mount_telemetry_invalidate(void);
@@ -1,6 +1,6 @@
-/*  prb.cc -- Manages shared memory ring buffer
+/*  prb.cc -- Ring buffer between a serial listener thread and its reader
  *
- *  Copyright (C) 2022 Mark J. Munkacsy
+ *  Copyright (C) 2022, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -14,61 +14,143 @@
  *
  *   You should have received a copy of the GNU General Public License
  *   along with this program (file: COPYING).  If not, see
- *   <http://www.gnu.org/licenses/>. 
+ *   <http://www.gnu.org/licenses/>.
  */
 
 #include "prb.h"
-#include <semaphore.h>
-
-PRB::PRB(int size) : buflen(size), ring_start(0), ring_next(0), buffer(new unsigned int[size]) {
-#if 0
-  int res = sem_init(&write_protect_semaphore,
-		     0, // shared across threads
-		     1); // initialized to unlocked state
-  if (res) {
-    perror("sem_init(): initialization error: ");
-    exit(-2);
-  }
-#endif
-  ;
+#include <stdio.h>		// EOF
+#include <errno.h>
+#include <limits.h>		// INT_MAX
+#include <time.h>		// clock_gettime()
+#include <poll.h>
+#include <unistd.h>		// read()
+#include <sys/syscall.h>	// SYS_futex
+#include <linux/futex.h>
+
+PRB::PRB(int size) : head(0), tail(0), dropped(0) {
+  uint32_t n = 1;
+  while (n < (uint32_t) size) n <<= 1;
+  buffer = new unsigned char[n];
+  mask = n-1;
+}
+
+PRB::~PRB(void) {
+  delete [] buffer;
 }
 
 void
 PRB::Reset(void) {
-  ring_start = 0;
-  ring_next = 0;
+  tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
 }
 
-PRB::~PRB(void) {
-  delete [] buffer;
-#if 0
-  sem_destroy(&write_protect_semaphore);
-#endif
+unsigned int PRB::NumPoints(void) const {
+  return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
 }
 
-unsigned int PRB::NumPoints(void) {
-  if (ring_start > ring_next) {
-    return buflen - (ring_start - ring_next);
-  } else {
-    return ring_next - ring_start;
+//****************************************************************
+//        Listener side
+//****************************************************************
+void PRB::Publish(uint32_t new_head) {
+  head.store(new_head, std::memory_order_release);
+  syscall(SYS_futex, (uint32_t *) &head, FUTEX_WAKE_PRIVATE, INT_MAX,
+	  nullptr, nullptr, 0);
+}
+
+bool PRB::AddNewData(unsigned char value) {
+  const uint32_t h = head.load(std::memory_order_relaxed);
+  if (h - tail.load(std::memory_order_acquire) > mask) {
+    if (dropped++ == 0) fprintf(stderr, "PRB: ring full; dropping data\n");
+    return false;
   }
+  buffer[h & mask] = value;
+  Publish(h+1);
+  return true;
 }
 
-void PRB::AddNewData(unsigned int value) {
-  buffer[ring_next] = value;
-  ring_next = (ring_next+1)%buflen;
+int PRB::FillFrom(int fd, int timeout_msec) {
+  uint32_t h = head.load(std::memory_order_relaxed);
+  const uint32_t space = (mask+1) - (h - tail.load(std::memory_order_acquire));
+  if (space == 0) {
+    // Leave the bytes in the kernel's buffer until the reader catches up
+    usleep(1000);
+    return 0;
+  }
+
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  const int ready = poll(&pfd, 1, timeout_msec);
+  if (ready < 0) return (errno == EINTR ? 0 : -1);
+  if (ready == 0) return 0;
+  if (pfd.revents & (POLLERR|POLLHUP|POLLNVAL)) return -1;
+
+  unsigned char chunk[256];
+  const int n = read(fd, chunk, (space < sizeof(chunk) ? space : sizeof(chunk)));
+  if (n < 0) return ((errno == EAGAIN || errno == EINTR) ? 0 : -1);
+
+  // Copy everything first, then make it visible (and wake the reader)
+  // once
+  for (int i = 0; i < n; i++) {
+    buffer[h & mask] = chunk[i];
+    h++;
+  }
+  if (n > 0) Publish(h);
+  return n;
 }
 
-#define PRB_EMPTY 0xffff;
-unsigned int PRB::PopData(void) {
-  if (ring_start == ring_next) return PRB_EMPTY;
-  const unsigned int value = buffer[ring_start];
-  ring_start = (ring_start+1)%buflen;
+//****************************************************************
+//        Reader side
+//****************************************************************
+int PRB::PopData(void) {
+  const uint32_t t = tail.load(std::memory_order_relaxed);
+  if (t == head.load(std::memory_order_acquire)) return EOF;
+  const unsigned char value = buffer[t & mask];
+  tail.store(t+1, std::memory_order_release);
   return value;
 }
-				   
+
+static double NowMsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000.0 + ts.tv_nsec*1.0e-6;
+}
+
+int PRB::ReadByte(int timeout_msec) {
+  int c = PopData();
+  if (c != EOF) return c;
+
+  const double deadline = NowMsec() + timeout_msec;
+  do {
+    // If the listener adds a byte after PopData() looked, "head" no
+    // longer equals "t" and the futex wait returns immediately.
+    const uint32_t t = tail.load(std::memory_order_relaxed);
+    const double remaining = deadline - NowMsec();
+    if (remaining <= 0.0) return EOF;
+    struct timespec ts;
+    ts.tv_sec = (time_t) (remaining/1000.0);
+    ts.tv_nsec = (long) ((remaining - ts.tv_sec*1000.0)*1.0e6);
+    syscall(SYS_futex, (uint32_t *) &head, FUTEX_WAIT_PRIVATE, t,
+	    &ts, nullptr, 0);
+    c = PopData();
+  } while (c == EOF);
+  return c;
+}
+
+int PRB::ReadMessage(unsigned char *msg, int buf_max,
+		     unsigned char delimiter, int timeout_msec) {
+  const double deadline = NowMsec() + timeout_msec;
+  int count = 0;
+  while (count < buf_max) {
+    const double remaining = deadline - NowMsec();
+    const int c = ReadByte(remaining > 0.0 ? (int) (remaining + 0.5) : 0);
+    if (c == EOF) return -1;
+    msg[count++] = c;
+    if (c == delimiter) break;
+  }
+  return count;
+}
 
 //****************************************************************
 //        end of PRB
 //****************************************************************
-
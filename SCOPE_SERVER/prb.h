@@ -1,7 +1,7 @@
 /* This may look like C code, but it is really -*-c++-*- */
-/*  prb.h -- Manages shared memory ring buffer
+/*  prb.h -- Ring buffer between a serial listener thread and its reader
  *
- *  Copyright (C) 2022 Mark J. Munkacsy
+ *  Copyright (C) 2022, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -15,36 +15,71 @@
  *
  *   You should have received a copy of the GNU General Public License
  *   along with this program (file: COPYING).  If not, see
- *   <http://www.gnu.org/licenses/>. 
+ *   <http://www.gnu.org/licenses/>.
  */
 
 #ifndef _PRB_H
 #define _PRB_H
 
+#include <stdint.h>
+#include <atomic>
+
 // Protected Ring Buffer
+//
+// Exactly one thread (the listener) puts bytes in and exactly one
+// thread takes them out; no locks are needed. "head" is only written
+// by the listener and "tail" only by the reader. Both count bytes
+// forever (wrapping at 2^32) and are masked to index the buffer, so
+// head - tail is always the number of bytes held.
+//
+// A reader that finds the ring empty sleeps on a futex on "head" and
+// is woken by the listener as soon as bytes arrive, so a reply is
+// seen as soon as it comes off the wire.
+
 class PRB {
 public:
-  PRB(int size);
+  PRB(int size);		// rounded up to a power of two
   ~PRB(void);
 
+  // Discards everything in the ring. Only call this when the
+  // listener thread isn't running (or from the reader, accepting that
+  // bytes arriving at that moment may be kept).
   void Reset(void);
 
-  unsigned int buflen;
+  unsigned int NumPoints(void) const;
 
-  // "i" should be incremented with
-  // i = (i+1) % this->buflen;
-  unsigned int &Get(unsigned int i) { return buffer[i]; }
+  //********************************
+  //        Listener side
+  //********************************
+  // Returns false (and drops the byte) if the ring is full
+  bool AddNewData(unsigned char value);
+  // Waits up to timeout_msec for "fd" to become readable and adds
+  // as much as can be read and fits. (If the ring is full, the bytes
+  // are left unread until there's room.) Returns the number of bytes
+  // added (0 on timeout) or -1 if the read failed.
+  int FillFrom(int fd, int timeout_msec);
 
-  unsigned int NumPoints(void);
-
-  void AddNewData(unsigned int value);
-  unsigned int PopData(void);
+  //********************************
+  //        Reader side
+  //********************************
+  // Returns EOF if the ring is empty
+  int PopData(void);
+  // Returns EOF if nothing arrives within timeout_msec
+  int ReadByte(int timeout_msec);
+  // Reads through the first "delimiter" (which is stored). Returns the
+  // number of bytes stored, or -1 if timeout_msec passes first. If
+  // buf_max bytes arrive without a delimiter, returns buf_max.
+  int ReadMessage(unsigned char *buffer, int buf_max,
+		  unsigned char delimiter, int timeout_msec);
 
 private:
-  unsigned int *buffer;
-  unsigned int ring_start; // index of first valid entry
-  unsigned int ring_next; // index of next valid value
-  //sem_t write_protect_semaphore;
+  unsigned char *buffer;
+  uint32_t mask;		// buffer size - 1
+  std::atomic<uint32_t> head;	// next byte to be written
+  std::atomic<uint32_t> tail;	// next byte to be read
+  unsigned long dropped;	// AddNewData() bytes lost to a full ring
+
+  void Publish(uint32_t new_head);
 };
 
 #endif
@@ -1,7 +1,7 @@
 /*  scope_message_handler.cc -- Handle server-side messages with
  *  commands to be sent to the mount
  *
- *  Copyright (C) 2007,2020 Mark J. Munkacsy
+ *  Copyright (C) 2007,2020,2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -19,9 +19,7 @@
  */
 #include <stdio.h>
 #include <string.h>
-#include <sys/time.h>		// struct timeval
-#include <sys/types.h>
-#include <unistd.h>		// select()
+#include <unistd.h>		// sleep()
 #include "lx_gen_message.h"
 #include "scope_message_handler.h"
 #include "lx_FocusMessage.h"
@@ -35,6 +33,8 @@
 #include "focus.h"
 #include "track.h"
 #include "lx200.h"
+#include "mount_telemetry.h"
+#include "mount_reader.h"
 
 #define DEBUG1 1		// set to zero to shut off messages
 
@@ -122,37 +122,6 @@ void handle_track_message(lxTrackMessage *msg, int socket_fd) {
   send_status_message(socket_fd, SCOPE_IDLE);
 }
 
-void read_variable_string(char *buffer, int sizeof_buffer) {
-  // This is a variable-length response.  Terminated by a "#".
-  int count;
-  char one_char;
-  int retval;
-
-  for(count=0; count < sizeof_buffer; count++) {
-    retval = read_mount(lx200_fd, &one_char, 1);
-    if(retval == 0) {
-      // not sure what a return value of 0 really means, but it happens.
-      usleep(50000);
-      retval = read_mount(lx200_fd, &one_char, 1);
-    }
-    if(retval != 1) {
-      perror("scope_message_handler: string response error");
-      fprintf(stderr, "...read() returned %d\n", retval);
-      break;
-    }
-    *buffer++ = one_char;
-    *buffer = 0;
-    // This is the string-termination character for all
-    // variable-length LX200 strings.
-    if(one_char == '#') break;
-  }
-  if (count >= sizeof_buffer) {
-    fprintf(stderr, "WARNING: read_variable_string failed to read '#'\n");
-    fprintf(stderr, "...instead, read: %s\n", buffer);
-  }
-}
-  
-
 void send_scope_query(void) {
   const char *query_string = "\006";
 
@@ -162,54 +131,22 @@ void send_scope_query(void) {
 }
 
 void flush_scope_data(void) {
-  fd_set scope_fd_set;
-  struct timeval timeout_interval;
   char buffer[32];
-  char *buffer_ptr = buffer;
-    
-  FD_ZERO(&scope_fd_set);
-  FD_SET(lx200_fd, &scope_fd_set);
-
-  timeout_interval.tv_sec = 4;
-  timeout_interval.tv_usec = 0;
-
-#if DEBUG1
-  fprintf(stderr, "    (waiting %ld seconds for response)\n",
-	  timeout_interval.tv_sec);
-#endif
-  do {
-    int retval = select(lx200_fd+1,
-			&scope_fd_set,
-			0, 0,
-			&timeout_interval);
-
-    if(retval == 0) break;
-
-    if(retval < 0) {
-      // This is an error.  Probably means we have an error in this
-      // code somewhere.
-      perror("scope message: select failed");
-      break;
+  int count = 0;
+  // Give the mount up to 4 seconds to start answering, then take
+  // only what has already arrived
+  double deadline = mount_clock() + 4.0;
+  int c;
+
+  while((c = mount_read_char(deadline)) != EOF) {
+    buffer[count++] = c;
+    if (count >= (int) sizeof(buffer)) {
+      fprintf(stderr, "WARNING: flush_buffer overflow. Dumping buffer.\n");
+      count = 0;
     }
-
-    // Read the telescope's response
-    retval = read_mount(lx200_fd, buffer_ptr, 1);
-    if(retval > 0) {
-      buffer_ptr += retval;
-      if (buffer_ptr >= buffer + sizeof(buffer)) {
-	fprintf(stderr, "WARNING: flush_buffer overflow. Dumping buffer.\n");
-	buffer_ptr = buffer;
-      }
-    }
-    FD_ZERO(&scope_fd_set);
-    FD_SET(lx200_fd, &scope_fd_set);
-
-    timeout_interval.tv_sec = 0;
-    timeout_interval.tv_usec = 0;
-
-  } while(1);
-
-  *buffer_ptr = 0;
+    deadline = 0.0;
+  }
+  buffer[count] = 0;
 
 #if DEBUG1
   fprintf(stderr, "scope response = '%s'\n", buffer);
@@ -242,127 +179,148 @@ void handle_scope_message(lxScopeMessage *msg, int socket_fd) {
 
   buffer[0] = 0;		// default response message is nil
 
+  // Position and status queries can usually be answered from the
+  // telemetry snapshot without bothering the mount.
+  if (msg->GetResponseType() == StringResponse) {
+    const char *cached = cached_mount_reply(msg->GetMessageString());
+    if (cached) {
+#if DEBUG1
+      fprintf(stderr, "cached response to '%s' = '%s'\n",
+	      msg->GetMessageString(), cached);
+#endif
+      lxScopeResponseMessage *outbound =
+	new lxScopeResponseMessage(socket_fd, (char *) cached, Status);
+      outbound->send();
+      delete outbound;
+      return;
+    }
+  }
+  // Anything other than a polled query might start the mount moving
+  // (or stop it), so the snapshot can no longer be trusted.
+  if (!is_polled_mount_query(msg->GetMessageString())) {
+    mount_telemetry_invalidate();
+  }
+
+  // A reply that straggled in after its command timed out would
+  // otherwise be taken as the reply to this command
+  mount_discard_input();
+
   // Send the user's message to the telescope
 #if DEBUG1
   fprintf(stderr, "sending string to scope: '%s'\n", msg->GetMessageString());
 #endif
+  const double start_time = mount_clock();
   if(write_mount(lx200_fd,
 		 msg->GetMessageString(),
 		 message_size) != message_size) {
     perror("scope Message(): unable to send scope message");
   }
 
-  /* now do a select() with a timeout to either get a response from
+  /* now wait (with a timeout) to either get a response from
      the telescope or to get an error timeout. */
 #if DEBUG1
   fprintf(stderr, "   (expected response = %d)\n", msg->GetResponseType());
 #endif
   if(msg->GetResponseType() != Nothing) {
-    fd_set scope_fd_set;
-    struct timeval timeout_interval;
-    
-    FD_ZERO(&scope_fd_set);
-    FD_SET(lx200_fd, &scope_fd_set);
+    double timeout_secs = 1.0;
 
     switch (msg->GetExecutionTime()) {
     case RunFast:		// RunFast = 1 second
-      timeout_interval.tv_sec = 1;
-      timeout_interval.tv_usec = 0;
+      timeout_secs = 1.0;
       break;
 
-    case RunMedium:		// RunMedium = 1 second
-      timeout_interval.tv_sec = 5;
-      timeout_interval.tv_usec = 0;
+    case RunMedium:		// RunMedium = 5 seconds
+      timeout_secs = 5.0;
       break;
 
     case RunSlow:		// RunSlow = 20 seconds
-      timeout_interval.tv_sec = 20;
-      timeout_interval.tv_usec = 0;
+      timeout_secs = 20.0;
       break;
     }
+    const double deadline = start_time + timeout_secs;
 
 #if DEBUG1
-    fprintf(stderr, "    (waiting %ld seconds for response)\n",
-	    timeout_interval.tv_sec);
+    fprintf(stderr, "    (waiting %.0lf seconds for response)\n",
+	    timeout_secs);
 #endif
-    int retval = select(lx200_fd+1,
-			&scope_fd_set,
-			0, 0,
-			&timeout_interval);
-
-    if(retval < 0) {
-      // This is an error.  Probably means we have an error in this
-      // code somewhere.
-      perror("scope message: select failed");
-      Status = Aborted;
-    } else if(retval == 0) {
-      // Timeout.  Probably a telescope problem.
-      fprintf(stderr, "    (result is <timeout>)\n");
-      Status = TimeOut;
-    } else {
-      // Read the telescope's response
-      if(msg->GetResponseType() == FixedLength) {
+    int retval;
+    // Read the telescope's response
+    if(msg->GetResponseType() == FixedLength) {
 	
-	if(msg->GetResponseCharCount() >= sizeof(buffer)) {
-	  fprintf(stderr,
-		  "scope_message_handler: buffer too small (%lu vs. %lu)\n",
-		  (unsigned long) msg->GetResponseCharCount(), 
-		  (unsigned long) sizeof(buffer));
+      if(msg->GetResponseCharCount() >= sizeof(buffer)) {
+	fprintf(stderr,
+		"scope_message_handler: buffer too small (%lu vs. %lu)\n",
+		(unsigned long) msg->GetResponseCharCount(), 
+		(unsigned long) sizeof(buffer));
+	Status = Aborted;
+      } else {
+	retval = mount_read_fixed(buffer, msg->GetResponseCharCount(), deadline);
+	if(retval == 0) {
+	  Status = TimeOut;
+	} else if(retval != msg->GetResponseCharCount()) {
+	  fprintf(stderr, "Short response from LX200 (%d of %d chars)\n",
+		  retval, msg->GetResponseCharCount());
 	  Status = Aborted;
-	} else {
-	  retval = read_mount(lx200_fd, buffer,
-			msg->GetResponseCharCount());
-	  if(retval != msg->GetResponseCharCount()) {
-	    perror("Error reading response from LX200");
-	    Status = Aborted;
-	  }
-	  buffer[retval] = 0;
-#if DEBUG1
-	  fprintf(stderr, "scope response = '%s'\n", buffer);
-#endif
 	}
-      } else if(msg->GetResponseType() == MixedModeResponse) {
-	char first_char;
-	retval = read_mount(lx200_fd, &first_char, 1);
-	if(retval != 1) {
-	  perror("scope_message_handler: first_char response error");
-	  buffer[0] = 0;
-	} else {
-
-	  buffer[0] = first_char;
-	  // see if this character is in the list of valid
-	  // single-character responses that came with the message from
-	  // the user. If it is, we're done. If this char is something
-	  // else, then we read a string (terminated by a "#").
-	  char single_char_choices[32];
-	  msg->GetSingleCharacterResponses(single_char_choices);
-	  int character_was_found = 0; // flag
-	  for(char *one_choice = single_char_choices;
-	      *one_choice;
-	      one_choice++) {
-	    if(first_char == *one_choice) {
-	      // Yes! Matches. This means this is the only character we
-	      // will receive.
-	      buffer[1] = 0;
-	      character_was_found = 1;
-	      break;
-	    }
-	  }
-	  if(!character_was_found) {
-	    read_variable_string(buffer+1, sizeof(buffer) - 1);
+	buffer[retval] = 0;
+      }
+    } else if(msg->GetResponseType() == MixedModeResponse) {
+      const int first_char = mount_read_char(deadline);
+      if(first_char == EOF) {
+	Status = TimeOut;
+	buffer[0] = 0;
+      } else {
+
+	buffer[0] = first_char;
+	buffer[1] = 0;
+	// see if this character is in the list of valid
+	// single-character responses that came with the message from
+	// the user. If it is, we're done. If this char is something
+	// else, then we read a string (terminated by a "#").
+	char single_char_choices[32];
+	msg->GetSingleCharacterResponses(single_char_choices);
+	int character_was_found = 0; // flag
+	for(char *one_choice = single_char_choices;
+	    *one_choice;
+	    one_choice++) {
+	  if(first_char == *one_choice) {
+	    // Yes! Matches. This means this is the only character we
+	    // will receive.
+	    character_was_found = 1;
+	    break;
 	  }
 	}
-      } else if(msg->GetResponseType() == StringResponse) {
-	// This is a variable-length response.  Terminated by a "#".
+	if(!character_was_found &&
+	   mount_read_string(buffer+1, sizeof(buffer) - 1, deadline) < 0) {
+	  fprintf(stderr, "scope_message_handler: incomplete response '%s'\n",
+		  buffer);
+	  Status = Aborted;
+	}
+      }
+    } else if(msg->GetResponseType() == StringResponse) {
+      // This is a variable-length response.  Terminated by a "#".
 #if DEBUG1
-	fprintf(stderr, "    (reading string response.)\n");
+      fprintf(stderr, "    (reading string response.)\n");
 #endif
-	read_variable_string(buffer, sizeof(buffer));
+      if(mount_read_string(buffer, sizeof(buffer), deadline) < 0) {
+	if (buffer[0]) {
+	  fprintf(stderr, "scope_message_handler: incomplete response '%s'\n",
+		  buffer);
+	  Status = Aborted;
+	} else {
+	  Status = TimeOut;
+	}
       }
+    }
+    if (Status == TimeOut) {
+      // Probably a telescope problem.
+      fprintf(stderr, "    (result is <timeout>)\n");
+    } else {
+      mount_latency_record(msg->GetMessageString(), mount_clock() - start_time);
+    }
 #if DEBUG1
-      fprintf(stderr, "scope response = '%s'\n", buffer);
+    fprintf(stderr, "scope response = '%s'\n", buffer);
 #endif
-    }
   }
   // Remember, by the way, that the default status was set to Okay at
   // the very beginning.
@@ -115,7 +115,7 @@ LookupByAUID(char *name) {
 }
 
 StrategyDatabaseEntry *
-LookupByLocalName(char *local_name) {
+LookupByLocalName(const char *local_name) {
   int j;
   for(j=0; j<number_entries; j++) {
     if(sloppy_cmp(main_array[j].local_name, local_name) == 0)
@@ -35,7 +35,7 @@ struct StrategyDatabaseEntry {
 const StrategyDatabaseEntry *LookupByDesignation(char *designation);
 const StrategyDatabaseEntry *LookupByReportingName(char *name);
 const StrategyDatabaseEntry *LookupByAUID(char *name);
-StrategyDatabaseEntry *LookupByLocalName(char *local_name);
+StrategyDatabaseEntry *LookupByLocalName(const char *local_name);
 
 void SetupStrategyDatabase(void);
 void ClearStrategyDatabase(void);
@@ -27,6 +27,8 @@
 #include <julian.h>
 #include <Image.h>
 #include <system_config.h>
+#include "pointing_refiner.h"
+#include "image_pipeline.h"
 
 #include <unistd.h>		// sleep()
 
@@ -63,178 +65,111 @@ Finder::SetBadPixelAvoidance(bool turn_on) {
 FinderResult
 Finder::Execute(void) {
   exposure_flags finder_flags("finder");
-  int initial_tries = 0;	// counts failures to find anything
-  int move_tries = 0;
-  int status;
+  int status = !STATUS_OK;
   DEC_RA current_center;
   static Filter Vc_Filter("Vc");
   BadPixels bp;
-  bool bad_pixel_adjust_completed = false;
-  bool initial_pointing_okay = false;
   double sidereal_time_start;	// sidereal time measured in radians
   double sidereal_time_end;
   DEC_RA raw_mount_points_at;
   const char *image_filename;
 
-  SystemConfig config;
-
   finder_flags.SetFilter(Vc_Filter);
 
   SlewToTarget();
   pointing_target = target_location;
 
-  // outer loop is trying to zero in on correct position
-  // inner loop is just trying to get an image that we can correlate
-
-  do { // loop counting by "move_tries"
-    Image *finder = 0;
-    
-    do { // loop counting by "initial_tries"
-      sidereal_time_start = GetSiderealTime();
-      raw_mount_points_at = RawScopePointsAt();
-      image_filename = expose_image_next(exposure_time, finder_flags, "FINDER");
-
-      fprintf(stderr, "Finder for %s: %s\n",
-	      f_strategy->object(), image_filename);
-      sidereal_time_end = GetSiderealTime();
-      f_session->log(LOG_INFO, "Finder for %s: %f secs: %s",
-		   f_strategy->object(), exposure_time, image_filename);
-    
-      const char *this_dark = f_session->dark_name(exposure_time, 1, false);
-
-      // need to do correlate() here.!!!
-      char parameter_filename[32];
-      strcpy(parameter_filename, "/tmp/correlate.XXXXXX");
-      close(mkstemp(parameter_filename));
-      {
-	char command_buffer[256];
-	sprintf(command_buffer, COMMAND_DIR "/find_stars -d %s -i %s",
-		this_dark, image_filename);
-	if(system(command_buffer) == -1) {
-	  perror("Unable to execute find_stars command");
-	} else {
-	  sprintf(command_buffer,
-		  COMMAND_DIR "/star_match -h -e -f -d %s -n %s -i %s -p %s",
-		  this_dark, f_strategy->object(), image_filename, parameter_filename);
-	  if(system(command_buffer) == -1) {
-	    perror("Unable to execute star_match command");
-	  }
-	  unlink(parameter_filename);
-	}
-      }
-
-      if (finder) delete finder;
-      finder = new Image(image_filename); // pick up new starlist
-      current_center = finder->ImageCenter(status);
-      if(status == STATUS_OK) {
-	// We add this location as the "true" spot that the scope is
-	// pointing at into the mount error file being maintained for
-	// this session.
-	f_session->log(LOG_INFO, "Finder match successful.");
-	break;			// done trying for an image match
-      }
-
-      // didn't work. Any stars seen?
-      IStarList *list = finder->GetIStarList();
-      if(list->NumStars == 0) {
-	f_session->log(LOG_ERROR, "Finder for %s: no stars seen.", f_strategy->object());
-	initial_tries++;
-      } else if(list->NumStars <= 2) {
-	// too few stars
-	f_session->log(LOG_ERROR, "Finder for %s: only %d stars seen.",
-		       f_strategy->object(), list->NumStars);
-	initial_tries++;
-      } else {
-	// otherwise, it just couldn't find a match. Tough.
-	f_session->log(LOG_ERROR, "Finder for %s: couldn't match.",
-		       f_strategy->object());
-	initial_tries++;
-      }
-      // this dithering move is intended to allow a slightly different
-      // starfield to be imaged; maybe we get more stars?
-      f_session->log(LOG_INFO, "Issuing dithering move command.");
-      if(system(COMMAND_DIR "/move 1.5N 1.5W") == -1) {
-	perror("Unable to execute dithering move command.");
-      }
-      // sleep(20);		// wait for mount to settle
-    } while (initial_tries < 3);
-
-    if(status != STATUS_OK) {
-      // couldn't even correlate the image; can't try to move
-      break;
-    }
-
-    // Here's the plan:
-    // The strategy specifies a center and a tolerance. We're going
-    // to do the Finder() thing until that condition is
-    // satisfied. Then we'll do the bad_pixel adjustment to the
-    // target center, and repeat.
-
-    bool force_move = false;
-    double delta_dec, delta_ra, delta_ra_arcsec; // both in radians
+  // Coarse pointing: short, 2x2-binned frames that are never written
+  // to disk, solved in this process against the object's catalog
+  // (read once, here), with corrections issued directly via
+  // SmallMove(). Binning gives each pixel 4x the signal, so a
+  // quarter of the exposure time does as well as a full frame.
+  PointingRefiner refiner(f_strategy->object());
+  refiner.SetExposureTime(exposure_time/4.0);
+  refiner.SetFilter(Vc_Filter);
+  refiner.SetBinning(2);
+  refiner.SetTolerance(f_strategy->GetOffsetTolerance());
+  // Short frames are dominated by hot pixels without a dark; the
+  // unbinned dark gets binned to match inside Image::subtract().
+  const char *coarse_dark = f_session->dark_name(exposure_time/4.0, 1, false);
+  if (coarse_dark) (void) refiner.SetDark(coarse_dark);
+
+  PointingResult coarse = refiner.Refine(pointing_target);
+  f_session->log(LOG_INFO, "Finder for %s: %s after %d frames (%d solved), %d moves, %.1lf sec",
+		 f_strategy->object(),
+		 (coarse.converged ? "converged" : "did not converge"),
+		 coarse.frames, coarse.solved, coarse.moves, coarse.elapsed_secs);
+  if (coarse.solved) {
+    f_session->log(LOG_INFO, "Finder offset = %.3f (arcmin N), %.3f (arcmin E)",
+		   coarse.north_arcmin, coarse.east_arcmin);
+  }
 
-    delta_dec = pointing_target.dec() - current_center.dec();
-    delta_ra  = pointing_target.ra_radians() - current_center.ra_radians();
-    delta_ra_arcsec = delta_ra * cos(pointing_target.dec());
-      
-    f_session->log(LOG_INFO, "Finder offset = %.3f (arcmin S), %.3f (arcmin W)",
-		   delta_dec*60.0*180.0/M_PI,
-		   delta_ra_arcsec*60.0*180.0/M_PI);
-    bool within_tolerance = (fabs(delta_dec) < f_strategy->GetOffsetTolerance() &&
-			     fabs(delta_ra_arcsec) < f_strategy->GetOffsetTolerance());
-    if (!initial_pointing_okay) {
-      if (within_tolerance) {
-	initial_pointing_okay = true;
-      } else {
-	force_move = true;
-      }
+  if (avoid_bad_pixels and coarse.converged) {
+    // The bad pixel map is in full-resolution pixels, so this needs
+    // an unbinned frame.
+    f_session->log(LOG_INFO, "Starting bad pixel avoidance.");
+    refiner.SetBinning(1);
+    refiner.SetExposureTime(exposure_time);
+    const char *full_dark = f_session->dark_name(exposure_time, 1, false);
+    if (full_dark) (void) refiner.SetDark(full_dark);
+    Image *full_frame = refiner.Measure(pointing_target);
+    if (full_frame) {
+      pointing_target = bp.UpdateTargetForBadPixels(full_frame, f_strategy->object());
+      delete full_frame;
+      refiner.SetBinning(2);
+      refiner.SetExposureTime(exposure_time/4.0);
+      if (coarse_dark) (void) refiner.SetDark(coarse_dark);
+      coarse = refiner.Refine(pointing_target);
+    } else {
+      f_session->log(LOG_ERROR, "Finder for %s: bad pixel frame didn't match.",
+		     f_strategy->object());
     }
+  }
 
-    if (avoid_bad_pixels and initial_pointing_okay and !bad_pixel_adjust_completed) {
-      f_session->log(LOG_INFO, "Starting bad pixel avoidance.");
-      bad_pixel_adjust_completed = true;
-      pointing_target = bp.UpdateTargetForBadPixels(finder, f_strategy->object());
-      // update the delta's based on the new target position...
-      delta_dec = pointing_target.dec() - current_center.dec();
-      delta_ra  = pointing_target.ra_radians() - current_center.ra_radians();
-      delta_ra_arcsec = delta_ra * cos(pointing_target.dec());
-      force_move = true;
-    }
-    if (finder) {
-      delete finder;
-      finder = 0;
-    }
+  if (not coarse.converged) {
+    f_session->log(LOG_ERROR,
+		   "%s: didn't converge on proper location.",
+		   f_strategy->object());
+  }
 
-    if(within_tolerance and force_move == false) {
-      // good enough.
-      goto finished;
+  // The final finder image goes to disk as before (it is used later
+  // for exposure planning and quick magnitudes), with its star list
+  // and WCS, just as "star_match -f" used to leave it.
+  sidereal_time_start = GetSiderealTime();
+  raw_mount_points_at = RawScopePointsAt();
+  image_filename = expose_image_next(exposure_time, finder_flags, "FINDER");
+  sidereal_time_end = GetSiderealTime();
+  fprintf(stderr, "Finder for %s: %s\n",
+	  f_strategy->object(), image_filename);
+  f_session->log(LOG_INFO, "Finder for %s: %f secs: %s",
+		 f_strategy->object(), exposure_time, image_filename);
+  {
+    ImagePipeline pipeline;
+    const char *this_dark = f_session->dark_name(exposure_time, 1, false);
+    if (this_dark) (void) pipeline.SetDark(this_dark);
+
+    Image finder(image_filename);
+    IStarList *stars = pipeline.Run(finder, f_strategy->object());
+    const WCS *wcs = (finder.GetImageInfo() ? finder.GetImageInfo()->GetWCS() : nullptr);
+    if (stars and wcs) {
+      ImageInfo file_info(image_filename);
+      wcs->UpdateFITSHeader(&file_info);
+      file_info.WriteFITS();
+      stars->SaveIntoFITSFile(image_filename, 1);
+      current_center = finder.ImageCenter(status);
+      f_session->log(LOG_INFO, "Finder match successful.");
     } else {
-      char command_buffer[256];
-      move_tries++;
-      if(move_tries > 3) {
-	f_session->log(LOG_ERROR,
-		       "%s: didn't converge on proper location.",
-		       f_strategy->object());
-	status = !STATUS_OK;
-	goto finished;
-      }
-
-      sprintf(command_buffer, COMMAND_DIR "/move %.3fN %.3fE",
-	      delta_dec * (180.0/M_PI) * 60.0,
-	      delta_ra_arcsec * (180.0/M_PI) * 60.0);
-      f_session->log(LOG_INFO, "Issuing move command: %s",
-		     command_buffer);
-      if(system(command_buffer) == -1) {
-	perror("Unable to execute move command.");
-      }
-      // sleep(20);		// wait for mount to settle
+      f_session->log(LOG_ERROR, "Finder for %s: final image couldn't match.",
+		     f_strategy->object());
     }
-  }  while(move_tries < 4); // should never trip on this
+    delete stars;
+  }
 
-finished:
   if(finder_imagename) free(finder_imagename);
   finder_imagename = strdup(image_filename);
 
+  if (not coarse.converged) return not FINDER_OKAY;
+
   if(status == STATUS_OK) {
     // see if we should update the mount model
     if (f_session->GetOptions()->update_mount_model) {
@@ -328,7 +263,6 @@ Finder::SlewToTarget(void) {
   }
   // encourage a meridian flip as part of this goto
   MoveTo(&target_location, 1 /*ENCOURAGE_FLIP*/);
-  WaitForGoToDone();
-  sleep(30);
+  WaitForGoToDone();		// (includes waiting for the mount to settle)
 }
 
@@ -17,6 +17,7 @@
  */
 
 #include "focus_manager.h"
+#include "focus_sweep.h"
 #include <session.h>
 #include <scope_api.h>
 #include <time.h>
@@ -237,7 +238,6 @@ void focus_check(Session *session, const std::string &filtername, bool allow_sle
 
     // Find a logfile
     char logfilename[128];
-    char shellfilename[128];
     {
       struct stat stat_info;
       for (int i=0; i < 1000; i++) {
@@ -245,43 +245,53 @@ void focus_check(Session *session, const std::string &filtername, bool allow_sle
 		session->Session_Directory(), i);
 	if (stat(logfilename, &stat_info)) {
 	  // non-zero means failure. This is a good filename
-	  sprintf(shellfilename, "%s/focus_%03d.shell",
-		  session->Session_Directory(), i);
 	  break;
 	}
       }
     }
-    
-    bool use_dash_n_option = 
-      session->GetOptions()->trust_focus_star_position;
-    char buffer[512];
+    FILE *run_log = fopen(logfilename, "w");
+    if (!run_log) {
+      fprintf(session_focus_log, "%s: Cannot create %s\n",
+	      clean_gmt(), logfilename);
+    }
+
+    // The sweep runs right here, on this process's camera and scope
+    // connections; nothing is written to disk but the log.
+    const bool refine_pointing =
+      not session->GetOptions()->trust_focus_star_position;
     double this_blur = -1.0;
     bool focus_valid = false;
     int original_focus = scope_focus(0);
-    sprintf(buffer, COMMAND_DIR "/focus -s %ld -a %s -t 0.2 -D %s -p -l %s > %s 2>&1",
-	    session_start_focus,
-	    (use_dash_n_option ? "-n" : ""),
-	    session->Session_Directory(), logfilename, shellfilename);
-    session->log(LOG_INFO, buffer);
-    int return_value = system(buffer);
-    FILE *fp = fopen("/tmp/focus_param.txt", "r");
-    if (!fp) {
-      fprintf(session_focus_log, "%s: Cannot open /tmp/focus_param.txt\n",
-	      clean_gmt());
-    } else {
-      const int n = fscanf(fp, "Focus = %lf", &this_blur);
-      if (n != 1) {
-	fprintf(session_focus_log,
-		"%s: Invalid blur value from /tmp/focus_param.txt\n",
-		clean_gmt());
-      } else {
+    if (GoToFocusStar(refine_pointing, run_log)) {
+      FocusSweepParams params;
+      params.initial_encoder = session_start_focus;
+      params.log = run_log;
+      // (dark_name() returns "" if dark_manager failed)
+      const char *dark_filename = session->dark_name(params.exposure_time, 1, false);
+      Image *dark = nullptr;
+      if (dark_filename[0]) {
+	dark = new Image(dark_filename);
+	free((char *) dark_filename);
+      }
+      params.dark = dark;
+      FocusSweepResult result = FocusSweep(params);
+      delete dark;
+      if (result.valid) {
+	this_blur = result.best_focus;
 	focus_valid = true;
       }
-      fclose(fp);
+      fprintf(session_focus_log,
+	      "%s: focus sweep took %d frames (%d measured), %.1lf sec\n",
+	      clean_gmt(), result.num_frames, result.num_measured,
+	      result.elapsed_secs);
+    } else {
+      fprintf(session_focus_log, "%s: Cannot get to a focus star\n",
+	      clean_gmt());
     }
+    if (run_log) fclose(run_log);
     fprintf(session_focus_log,
-	    "%s: focus command returned %.0lf (with status %d), focus_valid = %s\n",
-	    clean_gmt(), this_blur, return_value,
+	    "%s: focus sweep returned %.0lf, focus_valid = %s\n",
+	    clean_gmt(), this_blur,
 	    (focus_valid ? "true" : "false"));
     if (focus_valid) {
       add_blur_measurement(this_blur);
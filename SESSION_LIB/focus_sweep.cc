@@ -0,0 +1,668 @@
+/*  focus_sweep.cc -- Autofocus sweep run inside the calling process
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>		// rand()
+#include <math.h>
+#include <unistd.h>		// sleep()
+#include <pthread.h>
+#include <list>
+#include <camera_api.h>
+#include <scope_api.h>
+#include <named_stars.h>
+#include <system_config.h>
+#include <trace.h>
+#include <hyperbola.h>
+#include <model.h>		// TOOLS/FOCUS_MODEL
+#include <estimate_params.h>	// TOOLS/FOCUS_MODEL
+#include <build_ref_image.h>	// TOOLS/FOCUS_MODEL
+#include "pointing_refiner.h"
+#include "focus_sweep.h"
+
+//****************************************************************
+//        class FocusSweeper
+//    One of these per call to FocusSweep(). The camera thread
+//    takes requests from "request_list", moves the focuser, and
+//    exposes; finished frames go onto "done_list" for the fitting
+//    (calling) thread. Both lists are protected by "mutex".
+//****************************************************************
+struct SweepRequest {
+  bool quit;			// tells the camera thread to exit
+  long focus_encoder;		// requested; replaced by actual
+  Image *image;			// filled in by the camera thread
+};
+
+struct SweepMeasurement {
+  long focus_encoder;
+  double blur;			// defocus width, pixels; < 0 if not measurable
+};
+
+struct ResultSummary {
+  int number_bad;
+  int useful_on_high_side;
+  int useful_on_low_side;
+  int useful_near_focus;
+  double span_lowlim;		// bottom of best sampling zone
+  double span_highlim;		// top of best sampling zone
+};
+
+class FocusSweeper {
+public:
+  FocusSweeper(const FocusSweepParams &params);
+  ~FocusSweeper(void) { delete renderer; }
+  FocusSweepResult Run(void);
+
+private:
+  const FocusSweepParams &p;
+  FocusSweepResult result;
+
+  // limits and thresholds, all from SystemConfig
+  double low_threshold;		// below this is "near-focus"
+  double high_threshold;	// above this is "wild" (do not trust)
+  double max_blur;
+  double hyperbola_C;
+  int target_box_size;		// pixels
+  long min_travel, max_travel;
+
+  subframe_t box;
+  RunData run_data;
+  std::list<SweepMeasurement> measurements;
+  RefImageRenderer *renderer {nullptr}; // fitting thread only
+
+  pthread_mutex_t mutex;
+  pthread_cond_t request_ready;
+  pthread_cond_t frame_ready;
+  std::list<SweepRequest *> request_list;
+  std::list<SweepRequest *> done_list;
+  int outstanding {0};		// requested but not yet fitted (fitting thread only)
+
+  bool SetupFromConfig(void);
+  bool FindStar(void);
+  void Request(long focus_encoder);
+  void CreateRequests(int num_requests, long low_limit, long high_limit);
+  void FetchAndProcess(double *current_estimate);
+  double MeasureBlur(Image *image);
+  double Residual(const Model &m, const FocusParams &param, Image *image);
+  void AssessResults(ResultSummary *results, double focus_estimate);
+  long SetFocus(long encoder);
+
+  static void *CameraThread(void *sweeper);
+  void CameraLoop(void);
+};
+
+FocusSweeper::FocusSweeper(const FocusSweepParams &params) : p(params) {
+  pthread_mutex_init(&mutex, nullptr);
+  pthread_cond_init(&request_ready, nullptr);
+  pthread_cond_init(&frame_ready, nullptr);
+  run_data.reset();
+}
+
+long
+FocusSweeper::SetFocus(long encoder) {
+  return scope_focus(encoder, FOCUSER_MOVE_ABSOLUTE, p.focuser);
+}
+
+// Same derivation as focus1.cc
+bool
+FocusSweeper::SetupFromConfig(void) {
+  const double pixel_scale = system_config.PixelScale(); // arcsec/pixel
+  if (not isnormal(pixel_scale)) {
+    fprintf(stderr, "FocusSweep: pixel scale not found in SystemConfig.\n");
+    return false;
+  }
+  const double default_star_size = system_config.AverageSeeing()/pixel_scale;
+  low_threshold = 0.85*default_star_size;
+  high_threshold = low_threshold * 3.5;
+  max_blur = low_threshold * 5;
+  const double mirror_flop = system_config.MirrorShift();
+  target_box_size = 0.35*(mirror_flop*60 + max_blur)/pixel_scale;
+  target_box_size = 3*((target_box_size+2)/3); // must be divisible by 3
+  min_travel = system_config.FocuserMin(p.focuser);
+  max_travel = system_config.FocuserMax(p.focuser);
+  hyperbola_C = system_config.FocusSlope(p.focuser);
+  return true;
+}
+
+//****************************************************************
+//        FindStar()
+//    Full-frame exposure; put the subframe box around the largest
+//    star (same rules as adjust_box() in focus1.cc).
+//****************************************************************
+bool
+FocusSweeper::FindStar(void) {
+  exposure_flags flags("focus");
+  flags.SetFilter(p.filter);
+  Image *image = expose_image_in_memory(p.exposure_time, flags);
+  result.num_frames++;
+  if (image == nullptr) return false;
+  if (p.dark) image->subtract(p.dark);
+
+  const int largest = image->LargestStar();
+  if (largest < 0) {
+    fprintf(stderr, "FocusSweep: no stars found.\n");
+    delete image;
+    return false;
+  }
+  double center_x = image->GetIStarList()->StarCenterX(largest);
+  double center_y = image->GetIStarList()->StarCenterY(largest);
+
+  const Statistics *stats = image->statistics();
+  const double peak = image->pixel((int) center_x, (int) center_y);
+  if (peak - stats->MedianPixel < 5.0*stats->StdDev) {
+    fprintf(stderr, "FocusSweep: star too faint (peak %.0lf, median %.0lf, sigma %.1lf)\n",
+	    peak, stats->MedianPixel, stats->StdDev);
+    delete image;
+    return false;
+  }
+
+  // subframe rows count up from the bottom on the ST-9
+  if (system_config.IsST9()) {
+    center_y = image->height - center_y;
+  }
+
+  if (center_x < target_box_size/2) center_x = target_box_size/2;
+  if (center_y < target_box_size/2) center_y = target_box_size/2;
+  if (center_x > (image->width - target_box_size/2)) {
+    center_x = (image->width - target_box_size/2);
+  }
+  if (center_y > (image->height - target_box_size/2)) {
+    center_y = (image->height - target_box_size/2);
+  }
+
+  box.box_bottom = ((int) center_y) - target_box_size/2;
+  box.box_top = box.box_bottom + target_box_size - 1;
+  box.box_left = 3*((((int) center_x) - target_box_size/2)/3);
+  box.box_right = box.box_left + target_box_size - 1;
+  delete image;
+
+  if (p.log) {
+    fprintf(p.log, "Box set; left = %d, right = %d, top = %d, bottom = %d\n",
+	    box.box_left, box.box_right, box.box_top, box.box_bottom);
+  }
+  return true;
+}
+
+//****************************************************************
+//        Camera thread
+//****************************************************************
+void *
+FocusSweeper::CameraThread(void *sweeper) {
+  ((FocusSweeper *) sweeper)->CameraLoop();
+  return nullptr;
+}
+
+void
+FocusSweeper::CameraLoop(void) {
+  exposure_flags flags("focus");
+  flags.SetFilter(p.filter);
+  flags.subframe = box;
+
+  do {
+    pthread_mutex_lock(&mutex);
+    while (request_list.size() == 0) {
+      pthread_cond_wait(&request_ready, &mutex);
+    }
+    SweepRequest *r = request_list.front();
+    request_list.pop_front();
+    pthread_mutex_unlock(&mutex);
+
+    if (r->quit) {
+      delete r;
+      break;
+    }
+
+    r->focus_encoder = SetFocus(r->focus_encoder);
+    {
+      TraceSpan span("focus_sweep_expose");
+      r->image = expose_image_in_memory(p.exposure_time, flags);
+    }
+
+    pthread_mutex_lock(&mutex);
+    done_list.push_back(r);
+    pthread_cond_signal(&frame_ready);
+    pthread_mutex_unlock(&mutex);
+  } while (1);
+}
+
+void
+FocusSweeper::Request(long focus_encoder) {
+  SweepRequest *r = new SweepRequest;
+  r->quit = false;
+  r->focus_encoder = focus_encoder;
+  r->image = nullptr;
+
+  pthread_mutex_lock(&mutex);
+  // Keep the queue sorted so that the focuser moves monotonically
+  // (avoids backlash errors).
+  auto it = request_list.begin();
+  while (it != request_list.end() && (*it)->focus_encoder < focus_encoder) it++;
+  request_list.insert(it, r);
+  pthread_cond_signal(&request_ready);
+  pthread_mutex_unlock(&mutex);
+  outstanding++;
+}
+
+void
+FocusSweeper::CreateRequests(int num_requests, long low_limit, long high_limit) {
+  if (low_limit < min_travel) low_limit = min_travel;
+  if (high_limit > max_travel) high_limit = max_travel;
+  const long range_delta = (high_limit - low_limit);
+  if (range_delta <= 0) return;
+
+  while (num_requests-- > 0) {
+    const unsigned long r_value = 1733UL * (unsigned long) rand();
+    Request(low_limit + (r_value % range_delta));
+  }
+}
+
+//****************************************************************
+//        MeasureBlur()
+//    Defocus width (pixels) of the obstructed-aperture model that
+//    best matches the star, or -1.0 if no star center was found. This
+//    is "find_match -s -g 0.5" (TOOLS/FOCUS_MODEL/find_match.cc), the
+//    same measurement focus1.cc uses, so the blur thresholds from
+//    SetupFromConfig() mean what they mean there.
+//****************************************************************
+double
+FocusSweeper::MeasureBlur(Image *image) {
+  TraceSpan span("focus_sweep_fit");
+  const double median_pixel = image->HistogramValue(0.3);
+  for (int row = 0; row < image->height; row++) {
+    for (int col = 0; col < image->width; col++) {
+      image->pixel(col, row) = image->pixel(col, row) - median_pixel;
+    }
+  }
+
+  Model trial;
+  trial.defocus_width = 1.95;
+  trial.obstruction_fraction = 0.40;
+  trial.gaussian_sigma = 0.5;
+  trial.max_radius = max_blur;
+
+  FocusParams param;
+  param.max_width_to_consider = 2.5 * max_blur;
+  estimate_params(image, param);
+  if (param.success == false) return -1.0;
+  trial.center_x = param.center_x;
+  trial.center_y = param.center_y;
+
+  // Every frame is the same subframe, so one renderer (and its cache
+  // of annulus profiles) serves the whole sweep.
+  if (renderer == nullptr ||
+      renderer->Width() != image->width ||
+      renderer->Height() != image->height) {
+    delete renderer;
+    renderer = new RefImageRenderer(image->width, image->height);
+  }
+
+  // Coarse scan for a bracket, then golden section search
+  constexpr int NUM_TRIES = 8;
+  const double lo = 0.01;
+  const double delta = max_blur - lo;
+  const double tries[NUM_TRIES] = { lo, lo + 0.04*delta, lo + 0.10*delta,
+				    lo + 0.15*delta, lo + 0.25*delta,
+				    lo + 0.35*delta, lo + 0.65*delta, max_blur };
+  int best = 0;
+  double best_residual = 9.9e99;
+  for (int i=0; i<NUM_TRIES; i++) {
+    trial.defocus_width = tries[i];
+    const double r = Residual(trial, param, image);
+    if (r < best_residual) {
+      best_residual = r;
+      best = i;
+    }
+  }
+  double a = tries[best > 0 ? best-1 : 0];
+  double b = tries[best < NUM_TRIES-1 ? best+1 : NUM_TRIES-1];
+
+  const double gr = (sqrt(5.0)-1.0)/2.0;
+  double c = b - gr*(b-a);
+  double d = a + gr*(b-a);
+  trial.defocus_width = c;
+  double residual_c = Residual(trial, param, image);
+  trial.defocus_width = d;
+  double residual_d = Residual(trial, param, image);
+
+  for (int cycle = 1; cycle < 30 && fabs(c-d) > 0.01; cycle++) {
+    if (residual_c < residual_d) {
+      b = d;
+      d = c;
+      c = b - gr*(b-a);
+      residual_d = residual_c;
+      trial.defocus_width = c;
+      residual_c = Residual(trial, param, image);
+    } else {
+      a = c;
+      c = d;
+      d = a + gr*(b-a);
+      residual_c = residual_d;
+      trial.defocus_width = d;
+      residual_d = Residual(trial, param, image);
+    }
+  }
+  return (a+b)/2.0;
+}
+
+// RMS difference between the image and the model, inside the circle
+// that estimate_params() considered. Same as total_residual() in
+// find_match.cc.
+double
+FocusSweeper::Residual(const Model &m, const FocusParams &param, Image *image) {
+  Image *trial_image = renderer->Render(&m, param.total_flux);
+  const double max_rsquare = param.max_width_to_consider*param.max_width_to_consider/4.0;
+  double residual_err = 0.0;
+  int residual_count = 0;
+
+  for (int row = 0; row < image->height; row++) {
+    for (int col = 0; col < image->width; col++) {
+      const double del_x = (col + 0.5) - param.center_x;
+      const double del_y = (row + 0.5) - param.center_y;
+      if (del_x*del_x + del_y*del_y < max_rsquare) {
+	const double err = image->pixel(col, row) - trial_image->pixel(col, row);
+	residual_err += (err*err);
+	residual_count++;
+      }
+    }
+  }
+  delete trial_image;
+  return (residual_count ? sqrt(residual_err/residual_count) : 9.9e99);
+}
+
+//****************************************************************
+//        FetchAndProcess()
+//    Fits frames as they arrive until every outstanding request is
+//    done, then refits the hyperbola.
+//****************************************************************
+void
+FocusSweeper::FetchAndProcess(double *current_estimate) {
+  while (outstanding > 0) {
+    pthread_mutex_lock(&mutex);
+    while (done_list.size() == 0) {
+      pthread_cond_wait(&frame_ready, &mutex);
+    }
+    SweepRequest *r = done_list.front();
+    done_list.pop_front();
+    pthread_mutex_unlock(&mutex);
+    outstanding--;
+    result.num_frames++;
+
+    SweepMeasurement m;
+    m.focus_encoder = r->focus_encoder;
+    if (r->image and p.dark) r->image->subtract(p.dark); // crops to the subframe
+    m.blur = (r->image ? MeasureBlur(r->image) : -1.0);
+    TraceCounter("focus_sweep_blur", m.blur);
+    fprintf(stderr, "focus = %ld, blur = %lf\n", m.focus_encoder, m.blur);
+    if (p.log) {
+      fprintf(p.log, "ticks = %ld, blur = %.3lf\n", m.focus_encoder, m.blur);
+    }
+
+    if (m.blur > 0.0 && m.blur <= max_blur) {
+      run_data.add(m.focus_encoder, m.blur);
+      result.num_measured++;
+    } else if (m.blur > 0.0) {
+      fprintf(stderr, "measurement of %.2lf exceeds max_blur (%.1lf). Skipping.\n",
+	      m.blur, max_blur);
+    }
+    measurements.push_back(m);
+    delete r->image;
+    delete r;
+  }
+
+  Hyperbola h(*current_estimate);
+  h.reset(*current_estimate);
+  h.SetC(hyperbola_C);
+  (void) h.Solve(&run_data);
+  if (h.NoSolution()) {
+    fprintf(stderr, "FocusSweep: hyperbola failed. Randomly adding a point.\n");
+    if (*current_estimate + 100 > max_travel) {
+      CreateRequests(1, max_travel - 200, max_travel);
+    } else if (*current_estimate - 100 < min_travel) {
+      CreateRequests(1, min_travel, min_travel + 200);
+    } else {
+      CreateRequests(1, (*current_estimate)-100, (*current_estimate)+100);
+    }
+  } else {
+    *current_estimate = h.state_var[HYPER_R];
+    fprintf(stderr, "FocusSweep: updated focus prediction = %lf\n",
+	    *current_estimate);
+  }
+}
+
+void
+FocusSweeper::AssessResults(ResultSummary *results, double focus_estimate) {
+  results->number_bad = 0;
+  results->useful_on_high_side = 0;
+  results->useful_on_low_side = 0;
+  results->useful_near_focus = 0;
+
+  for (const SweepMeasurement &m : measurements) {
+    const double delta_focus = m.focus_encoder - focus_estimate;
+
+    if (m.blur > low_threshold && m.blur < high_threshold) {
+      if (delta_focus < 0.0) {
+	results->useful_on_low_side++;
+      } else {
+	results->useful_on_high_side++;
+      }
+    } else if (m.blur <= low_threshold && m.blur > 0.0) {
+      results->useful_near_focus++;
+    } else {
+      results->number_bad++;
+    }
+  }
+
+  double low_ticks = focus_estimate - low_threshold*hyperbola_C;
+  double high_ticks = focus_estimate + low_threshold*hyperbola_C;
+  if (low_ticks < min_travel) low_ticks = min_travel;
+  if (high_ticks > max_travel) high_ticks = max_travel;
+  results->span_lowlim = low_ticks;
+  results->span_highlim = high_ticks;
+
+  fprintf(stderr, "FocusSweep: %d good on low, %d good on high, %d good near focus, %d bad\n",
+	  results->useful_on_low_side,
+	  results->useful_on_high_side,
+	  results->useful_near_focus,
+	  results->number_bad);
+}
+
+//****************************************************************
+//        Run()
+//    Same control loop as focus() in focus1.cc.
+//****************************************************************
+FocusSweepResult
+FocusSweeper::Run(void) {
+  TraceSpan span("focus_sweep");
+  const int64_t start_ns = TraceNow();
+  const long initial_encoder = (p.initial_encoder ? p.initial_encoder :
+				scope_focus(0, FOCUSER_MOVE_RELATIVE, p.focuser));
+  double good_focus = initial_encoder;
+
+  if (not SetupFromConfig()) return result;
+  if (not FindStar()) return result;
+
+  pthread_t camera_thread;
+  if (pthread_create(&camera_thread, nullptr, &CameraThread, this)) {
+    perror("FocusSweep: cannot create camera thread");
+    return result;
+  }
+
+  // Initial population of requests
+  {
+    double low_ticks = good_focus - low_threshold*hyperbola_C;
+    double high_ticks = good_focus + low_threshold*hyperbola_C;
+    if (low_ticks < min_travel) low_ticks = min_travel;
+    if (high_ticks > max_travel) high_ticks = max_travel;
+
+    constexpr int NUM_STEPS = 11; // best kept odd
+    const long delta = (long) (0.5 + (high_ticks - low_ticks)/NUM_STEPS);
+    for (int i=0; i<NUM_STEPS; i++) {
+      long target_focus = good_focus + (i-NUM_STEPS/2)*delta;
+      if (target_focus < min_travel) target_focus = min_travel;
+      if (target_focus > max_travel) target_focus = max_travel;
+      Request(target_focus);
+    }
+  }
+
+  int max_cycles = 7;
+  do {
+    FetchAndProcess(&good_focus);
+
+    ResultSummary results;
+    AssessResults(&results, good_focus);
+
+    bool ready_to_quit = true;
+    bool too_close_to_edge = false;
+    if (results.useful_on_low_side < 3) {
+      double candidate_highticks = good_focus - 2*hyperbola_C;
+      if (candidate_highticks > max_travel) candidate_highticks = max_travel;
+      if (candidate_highticks - results.span_lowlim < 5) {
+	too_close_to_edge = true;
+      } else {
+	CreateRequests(3 - results.useful_on_low_side,
+		       results.span_lowlim, candidate_highticks);
+	ready_to_quit = false;
+      }
+    }
+    if (results.useful_on_high_side < 3) {
+      double candidate_lowticks = good_focus + 2*hyperbola_C;
+      if (candidate_lowticks < min_travel) candidate_lowticks = min_travel;
+      if (results.span_highlim - candidate_lowticks < 5) {
+	too_close_to_edge = true;
+      } else {
+	CreateRequests(3 - results.useful_on_high_side,
+		       candidate_lowticks, results.span_highlim);
+	ready_to_quit = false;
+      }
+    }
+    if (results.useful_near_focus < 3) {
+      CreateRequests(3 - results.useful_near_focus,
+		     good_focus - 2*hyperbola_C, good_focus + 2*hyperbola_C);
+      ready_to_quit = false;
+    }
+
+    if (too_close_to_edge) {
+      fprintf(stderr, "FocusSweep: too close to focuser limit. Terminating.\n");
+      break;
+    }
+    if (ready_to_quit) {
+      result.valid = true;
+      break;
+    }
+    if (results.number_bad > 6) {
+      fprintf(stderr, "FocusSweep: too many bad measurements. Terminating.\n");
+      break;
+    }
+  } while (--max_cycles);
+
+  // Drain anything still queued, then stop the camera thread
+  pthread_mutex_lock(&mutex);
+  for (SweepRequest *r : request_list) {
+    delete r;
+    outstanding--;
+  }
+  request_list.clear();
+  pthread_mutex_unlock(&mutex);
+  while (outstanding > 0) {
+    pthread_mutex_lock(&mutex);
+    while (done_list.size() == 0) {
+      pthread_cond_wait(&frame_ready, &mutex);
+    }
+    SweepRequest *r = done_list.front();
+    done_list.pop_front();
+    pthread_mutex_unlock(&mutex);
+    outstanding--;
+    delete r->image;
+    delete r;
+  }
+  SweepRequest *quit = new SweepRequest;
+  quit->quit = true;
+  quit->image = nullptr;
+  pthread_mutex_lock(&mutex);
+  request_list.push_back(quit);
+  pthread_cond_signal(&request_ready);
+  pthread_mutex_unlock(&mutex);
+  if (pthread_join(camera_thread, nullptr)) {
+    fprintf(stderr, "FocusSweep: error in rendezvous with camera thread.\n");
+  }
+
+  if (result.valid) {
+    result.best_focus = SetFocus((long) (good_focus + 0.5));
+  } else {
+    SetFocus(initial_encoder);
+  }
+  result.elapsed_secs = (TraceNow() - start_ns)/1.0e9;
+  if (p.log) {
+    fprintf(p.log, "%s focus = %ld after %d frames (%d measured) in %.1lf sec\n",
+	    (result.valid ? "Final" : "Failed; restored"),
+	    (result.valid ? result.best_focus : initial_encoder),
+	    result.num_frames, result.num_measured, result.elapsed_secs);
+    fflush(p.log);
+  }
+  return result;
+}
+
+FocusSweepResult FocusSweep(const FocusSweepParams &params) {
+  FocusSweeper sweeper(params);
+  return sweeper.Run();
+}
+
+//****************************************************************
+//        GoToFocusStar()
+//****************************************************************
+bool GoToFocusStar(bool refine, FILE *log) {
+  // Same choice as pick_focus_star() in TOOLS/FOCUS/focus_star.cc:
+  // the focus star closest in RA. Stop looking after 5 missing
+  // names in a row, which allows bad focus stars to be deleted.
+  DEC_RA where_now = ScopePointsAt();
+  DEC_RA focus_location;
+  char focus_name[16] = "";
+  double closest_RA = 99999999.9;
+  int consecutive_skipped = 0;
+  for (int focus_index = 0; consecutive_skipped < 5; focus_index++) {
+    char candidate[16];
+    sprintf(candidate, "focus%03d", focus_index);
+    NamedStar star(candidate);
+    if (not star.IsKnown()) {
+      consecutive_skipped++;
+      continue;
+    }
+    consecutive_skipped = 0;
+    const double delta_ra = fabs(where_now.ra() - star.Location().ra());
+    if (delta_ra < closest_RA) {
+      closest_RA = delta_ra;
+      focus_location = star.Location();
+      strcpy(focus_name, candidate);
+    }
+  }
+  if (focus_name[0] == 0) {
+    if (log) fprintf(log, "GoToFocusStar(): no focus star\n");
+    return false;
+  }
+
+  if (log) fprintf(log, "GoToFocusStar(): starting goto to %s\n", focus_name);
+  MoveTo(&focus_location, 0 /*don't encourage flip*/);
+  WaitForGoToDone();		// (includes waiting for the mount to settle)
+  if (not refine) return true;
+
+  PointingRefiner refiner(focus_name);
+  refiner.SetTolerance(4.5*M_PI/(180.0*60.0));
+  refiner.SetLog(log);
+  if (refiner.Refine(focus_location).converged) return true;
+  if (log) fprintf(log, "GoToFocusStar(): didn't converge on %s\n", focus_name);
+  return false;
+}
@@ -0,0 +1,69 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  focus_sweep.h -- Autofocus sweep run inside the calling process
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FOCUS_SWEEP_H
+#define _FOCUS_SWEEP_H
+
+#include <stdio.h>
+#include <Image.h>
+#include <Filter.h>
+#include <scope_api.h>		// FocuserName
+
+// This is the same sweep that the "focus" command performs (see
+// TOOLS/FOCUS/focus1.cc), but run in the caller's process using the
+// caller's camera and scope connections. Frames stay in memory, and
+// each frame is fitted while the next one is being exposed.
+//
+// The blur of each frame is the defocus width (in pixels) of the
+// obstructed-aperture model that best matches the brightest star in
+// a subframe around it, the same measurement that "find_match -s"
+// (TOOLS/FOCUS_MODEL) makes for focus1.cc; blur vs. focuser
+// position is fit to a hyperbola whose slope comes from
+// SystemConfig::FocusSlope().
+
+struct FocusSweepParams {
+  double exposure_time {0.2};	// seconds, per frame
+  Filter filter {Filter("Vc")};
+  FocuserName focuser {FOCUSER_DEFAULT};
+  long initial_encoder {0};	// best guess; 0 means "current position"
+  const Image *dark {nullptr};	// full frame; cropped to match each subframe
+  FILE *log {nullptr};		// optional; per-frame results go here
+};
+
+struct FocusSweepResult {
+  bool valid {false};		// if false, focuser was put back where it was
+  long best_focus {0};		// focuser ticks
+  int num_frames {0};		// frames exposed (including the star search)
+  int num_measured {0};		// frames that produced a usable blur
+  double elapsed_secs {0.0};
+};
+
+// Camera and scope must already be connected. On success the focuser
+// is left at best focus.
+FocusSweepResult FocusSweep(const FocusSweepParams &params);
+
+// Slews to the predefined focus star ("focus000", "focus001", ... in
+// the named-star list) closest in RA to where the scope points now,
+// and waits for the mount to settle. If "refine" is set, pointing is
+// then corrected with a PointingRefiner until the star is within 4.5
+// arcmin of center. Returns false if there is no focus star or it
+// could not be reached.
+bool GoToFocusStar(bool refine, FILE *log = nullptr);
+
+#endif
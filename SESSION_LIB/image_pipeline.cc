@@ -0,0 +1,218 @@
+/*  image_pipeline.cc -- In-memory calibrate/detect/solve/photometry chain
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <named_stars.h>
+#include <trace.h>
+#include <daofind.h>		// TOOLS/DAOFIND
+#include <correlate3.h>		// TOOLS/STAR_MATCH
+#include <aperture_phot.h>	// TOOLS/STAR_MATCH
+#include "image_pipeline.h"
+
+ImagePipeline::ImagePipeline(void) {
+  ;
+}
+
+ImagePipeline::~ImagePipeline(void) {
+  delete dark;
+  delete flat;
+}
+
+// Image(const char *) has no way to report a missing file, so check
+// first.
+static Image *LoadCalibrationImage(const char *filename) {
+  struct stat statbuf;
+  if (stat(filename, &statbuf)) {
+    fprintf(stderr, "ImagePipeline: cannot read %s\n", filename);
+    return nullptr;
+  }
+  Image *image = new Image(filename);
+  // Statistics are computed lazily; do it now so that later,
+  // concurrent, users of this image never write to it.
+  (void) image->statistics();
+  return image;
+}
+
+int
+ImagePipeline::SetDark(const char *dark_filename) {
+  delete dark;
+  dark = LoadCalibrationImage(dark_filename);
+  return (dark ? 0 : -1);
+}
+
+int
+ImagePipeline::SetFlat(const char *flat_filename) {
+  delete flat;
+  flat = LoadCalibrationImage(flat_filename);
+  return (flat ? 0 : -1);
+}
+
+//****************************************************************
+//        Calibrate()
+//****************************************************************
+void
+ImagePipeline::Calibrate(Image &image) const {
+  TraceSpan span("pipeline_calibrate");
+  if (dark) image.subtract(dark);
+  if (flat) image.scale(flat);
+}
+
+//****************************************************************
+//        Detect()
+//****************************************************************
+IStarList *
+ImagePipeline::Detect(Image &image) const {
+  TraceSpan span("pipeline_detect");
+  IStarList *stars = new IStarList;
+  (void) DAOFindStars(image, threshold, *stars);
+  TraceCounter("pipeline_stars", stars->NumStars);
+  return stars;
+}
+
+//****************************************************************
+//        Solve()
+//    Same steps as star_match: aperture counts for every star, the
+//    ten brightest marked SELECTED, then correlate(). Returns true
+//    if a WCS was found (and put into the image's ImageInfo).
+//****************************************************************
+bool
+ImagePipeline::Solve(Image &image, IStarList *stars, const char *catalog_name) const {
+  TraceSpan span("pipeline_solve");
+  if (not MeasureAndSelect(image, stars)) return false;
+
+  DEC_RA reference_location;
+  ImageInfo *info = image.GetImageInfo();
+  if (info && info->NominalDecRAValid()) {
+    reference_location = *(info->GetNominalDecRA());
+  } else {
+    // Backup plan: use the position of the named star
+    NamedStar reference_star(catalog_name);
+    if (!reference_star.IsKnown()) {
+      fprintf(stderr, "ImagePipeline: don't know of star named '%s'\n",
+	      catalog_name);
+      return false;
+    }
+    reference_location = reference_star.Location();
+  }
+
+  HGSCList catalog(catalog_name);
+  if (!catalog.NameOK()) {
+    fprintf(stderr, "ImagePipeline: cannot open catalog '%s'\n", catalog_name);
+    return false;
+  }
+
+  return Match(image, stars, catalog, reference_location);
+}
+
+bool
+ImagePipeline::Solve(Image &image, IStarList *stars, HGSCList &catalog,
+		     const DEC_RA &reference_location) const {
+  TraceSpan span("pipeline_solve");
+  return (MeasureAndSelect(image, stars) &&
+	  Match(image, stars, catalog, reference_location));
+}
+
+bool
+ImagePipeline::MeasureAndSelect(Image &image, IStarList *stars) const {
+  if (stars->NumStars < 4) {
+    fprintf(stderr, "ImagePipeline: only %d stars in image. Cannot correlate.\n",
+	    stars->NumStars);
+    return false;
+  }
+
+  for (int i=0; i < stars->NumStars; i++) {
+    aperture_measure(&image, i, stars);
+  }
+
+  constexpr int NUM_WIDEFIELD_STARS = 10;
+  int star_index = NUM_WIDEFIELD_STARS;
+  if (star_index > stars->NumStars) star_index = stars->NumStars;
+  stars->SortByBrightness();
+  while (star_index-- > 0) {
+    stars->FindByIndex(star_index)->validity_flags |= SELECTED;
+  }
+  return true;
+}
+
+bool
+ImagePipeline::Match(Image &image, IStarList *stars, HGSCList &catalog,
+		     const DEC_RA &reference_location) const {
+  ImageInfo *info = image.GetImageInfo();
+  if (info == nullptr) info = image.CreateImageInfo();
+
+  DEC_RA reference = reference_location;
+  Context context;
+  context.image_filename = nullptr;
+  const WCS *wcs = correlate(image, stars, catalog, &reference,
+			     nullptr, nullptr, context);
+  if (wcs == nullptr) return false;
+
+  info->SetWCS(wcs);		// ImageInfo now owns the WCS
+  return true;
+}
+
+//****************************************************************
+//        Photometry()
+//    Instrumental magnitudes, normalized to a one-second exposure,
+//    from the aperture counts left by Solve(). The error is the
+//    shot-noise error of the star alone.
+//****************************************************************
+void
+ImagePipeline::Photometry(Image &image, IStarList *stars) const {
+  TraceSpan span("pipeline_photometry");
+  ImageInfo *info = image.GetImageInfo();
+  const double exptime = ((info && info->ExposureDurationValid()) ?
+			  info->GetExposureDuration() : 1.0);
+  const double egain = ((info && info->EGainValid()) ? info->GeteGain() : 1.0);
+
+  for (int i=0; i < stars->NumStars; i++) {
+    IStarList::IStarOneStar *star = stars->FindByIndex(i);
+    if (!(star->validity_flags & COUNTS_VALID)) continue;
+    if (star->nlls_counts <= 0.0) continue;
+
+    star->photometry = -2.5*log10(star->nlls_counts/exptime);
+    star->magnitude_error = 1.0857/sqrt(star->nlls_counts*egain);
+    star->validity_flags |= (PHOTOMETRY_VALID | ERROR_VALID);
+  }
+}
+
+//****************************************************************
+//        Run(), Analyze()
+//****************************************************************
+IStarList *
+ImagePipeline::Analyze(Image &image, const char *catalog_name) const {
+  IStarList *stars = Detect(image);
+  if (stars->NumStars < 4) {
+    fprintf(stderr, "ImagePipeline: only %d stars in image.\n", stars->NumStars);
+    delete stars;
+    return nullptr;
+  }
+  (void) Solve(image, stars, catalog_name);
+  Photometry(image, stars);
+  return stars;
+}
+
+IStarList *
+ImagePipeline::Run(Image &image, const char *catalog_name) const {
+  TraceSpan span("pipeline_run");
+  Calibrate(image);
+  return Analyze(image, catalog_name);
+}
@@ -0,0 +1,97 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  image_pipeline.h -- In-memory calibrate/detect/solve/photometry chain
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _IMAGE_PIPELINE_H
+#define _IMAGE_PIPELINE_H
+
+#include <Image.h>
+#include <IStarList.h>
+#include <HGSC.h>
+
+// An ImagePipeline does in one process, with nothing written to disk,
+// what used to take a chain of "calibrate", "find_stars",
+// "star_match", and "photometry" commands sharing a scratch FITS
+// file:
+//
+//    Calibrate()   dark subtraction and flat-fielding
+//    Detect()      DAOFIND star detection
+//    Solve()       aperture counts, then correlation against the
+//                  catalog; the resulting WCS goes into the image's
+//                  ImageInfo
+//    Photometry()  instrumental magnitudes from the aperture counts
+//
+// The dark and flat are read once, when the pipeline is set up, and
+// are only read after that. None of the Run()/stage functions change
+// the pipeline, so one pipeline can be used by several threads at
+// once as long as each thread works on its own Image.
+//
+// Usage:
+//    ImagePipeline pipeline;
+//    pipeline.SetDark("/home/IMAGES/DARKS/dark30.fits");
+//    Image image(filename);
+//    IStarList *stars = pipeline.Run(image, "rr-lyr");
+//    ...
+//    delete stars;
+
+class ImagePipeline {
+public:
+  ImagePipeline(void);
+  ~ImagePipeline(void);
+
+  // Returns 0 on success, -1 if the file could not be read. Must not
+  // be called while any Run() is in progress.
+  int SetDark(const char *dark_filename);
+  int SetFlat(const char *flat_filename);
+  void SetThreshold(double sigma) { threshold = sigma; }
+
+  bool HasDark(void) const { return dark != nullptr; }
+
+  // Runs all four stages on "image", which is modified in place (its
+  // pixels are calibrated and its WCS is set). catalog_name is the
+  // name of a file in CATALOG_DIR. Returns the star list (caller
+  // owns it), or nullptr if too few stars were found to
+  // correlate. Stars that matched the catalog are flagged CORRELATED
+  // and carry the catalog name in StarName.
+  IStarList *Run(Image &image, const char *catalog_name) const;
+
+  // Same as Run(), but for an image that has already been calibrated
+  IStarList *Analyze(Image &image, const char *catalog_name) const;
+
+  // The individual stages
+  void Calibrate(Image &image) const;
+  IStarList *Detect(Image &image) const;
+  bool Solve(Image &image, IStarList *stars, const char *catalog_name) const;
+  // Same, but with a catalog already in memory and a given starting
+  // guess for the image center. The catalog is scratch space while
+  // this runs, so it can't be shared between threads.
+  bool Solve(Image &image, IStarList *stars, HGSCList &catalog,
+	     const DEC_RA &reference_location) const;
+  void Photometry(Image &image, IStarList *stars) const;
+
+private:
+  Image *dark {nullptr};
+  Image *flat {nullptr};
+  double threshold {15.0};	// sigma; same default as find_stars
+
+  bool MeasureAndSelect(Image &image, IStarList *stars) const;
+  bool Match(Image &image, IStarList *stars, HGSCList &catalog,
+	     const DEC_RA &reference_location) const;
+};
+
+#endif
@@ -23,9 +23,10 @@
 #include <ctype.h>		// toupper(), isspace()
 #include <stdio.h>
 #include <math.h>		// NAN, isnormal()
-#include <stdlib.h>		// system()
 #include <sys/types.h>
 #include "mag_from_image.h"
+#include "image_pipeline.h"
+#include <HGSC.h>
 #include <string>
 
 static int starname_check(const char *s1, const char *s2) {
@@ -50,6 +51,70 @@ static char *canonical_starname(const char *s) {
   return result;
 }
 
+//****************************************************************
+//        magnitude_in_process()
+//    Does what "analyze" does for a single image: a zero point from
+//    the comp stars in the strategy star's catalog, applied to the
+//    instrumental magnitude of the query star.
+//****************************************************************
+static double magnitude_in_process(const char *image_filename,
+				   const char *dark_filename,
+				   const char *query_star_name,
+				   const char *strategy_name) {
+  ImagePipeline pipeline;
+  if (dark_filename && pipeline.SetDark(dark_filename)) return NAN;
+
+  HGSCList catalog(strategy_name);
+  if (not catalog.NameOK()) {
+    fprintf(stderr, "mag_from_image: no catalog for %s\n", strategy_name);
+    return NAN;
+  }
+
+  Image image(image_filename);
+  ImageInfo *info = image.GetImageInfo();
+  if (info == nullptr) {
+    fprintf(stderr, "mag_from_image: %s has no header\n", image_filename);
+    return NAN;
+  }
+  const PhotometryColor color = FilterToColor(info->GetFilter());
+
+  IStarList *stars = pipeline.Run(image, strategy_name);
+  if (stars == nullptr) return NAN;
+
+  double diff_sum = 0.0;
+  int comp_count = 0;
+  IStarList::IStarOneStar *query_star = nullptr;
+
+  for (int i=0; i < stars->NumStars; i++) {
+    IStarList::IStarOneStar *this_star = stars->FindByIndex(i);
+    if (!((this_star->validity_flags & PHOTOMETRY_VALID) &&
+	  (this_star->validity_flags & CORRELATED))) continue;
+
+    if (starname_check(this_star->StarName, query_star_name)) {
+      query_star = this_star;
+    }
+
+    HGSC *cat = catalog.FindByLabel(this_star->StarName);
+    if (cat && cat->is_comp && cat->multicolor_data.IsAvailable(color)) {
+      diff_sum += (this_star->photometry - cat->multicolor_data.Get(color));
+      comp_count++;
+    }
+  }
+
+  double this_magnitude = NAN;
+  if (comp_count < 1) {
+    fprintf(stderr, "mag_from_image: image %s has no observed comp stars\n",
+	    image_filename);
+  } else if (query_star == nullptr) {
+    fprintf(stderr, "mag_from_image: %s not found in %s\n",
+	    query_star_name, image_filename);
+  } else {
+    this_magnitude = query_star->photometry - diff_sum/comp_count;
+  }
+  delete stars;
+  return this_magnitude;
+}
+
 // returns NAN if could not get a valid brightness from the image
 double magnitude_from_image(const char *image_filename,
 			    const char *dark_filename,
@@ -58,48 +123,32 @@ double magnitude_from_image(const char *image_filename,
   // Do we already have an analysis file? If so, will be the same as
   // the image_filename but with .fits replaced with .analyze
   char analysis_filename[400];
+  FILE *fp = nullptr;
   {
     strcpy(analysis_filename, image_filename);
     int last_char = strlen(image_filename);
-    if (strcmp(analysis_filename+last_char-5, ".fits")) {
-      fprintf(stderr, "mag_from_image: ERROR: bad filename ending: %s\n",
-	      analysis_filename);
-      sprintf(analysis_filename,
-	      "/tmp/script_analyze%d.out", (int) getpid());
-      (void) unlink(analysis_filename);
-    } else {
+    if (last_char > 5 && strcmp(analysis_filename+last_char-5, ".fits") == 0) {
       strcpy(analysis_filename+last_char-5, ".analyze");
+      fp = fopen(analysis_filename, "r");
     }
   }
 
-  FILE *fp = fopen(analysis_filename, "r");
   if (!fp) {
     std::string simple_starname(canonical_starname(query_star_name));
     std::string strategy_name(canonical_starname(strategy_star_name));
     fprintf(stderr, "Looking in image for magnitude of star %s using catalog for %s\n",
 	    simple_starname.c_str(), strategy_name.c_str());
 
-    char buffer[512];
-
-    sprintf(buffer, "analyze -d %s -n %s -o %s %s",
-	    dark_filename,
-	    strategy_name.c_str(),
-	    analysis_filename,
-	    image_filename);
-    if(system(buffer) == -1) {
-      perror("mag_from_image: error executing analyze shell command:");
-    }
-
-    fp = fopen(analysis_filename, "r");
+    const double this_magnitude = magnitude_in_process(image_filename,
+						       dark_filename,
+						       query_star_name,
+						       strategy_name.c_str());
+    fprintf(stderr, "Returning magnitude %.1lf\n", this_magnitude);
+    return this_magnitude;
   }
   
   double this_magnitude = NAN;
 
-  if(!fp) {
-    fprintf(stderr, "mag_from_image: no analysis output file\n");
-    return NAN;
-  }
-
   char buffer[512];
   while(fgets(buffer, sizeof(buffer), fp)) {
     // ignore comment lines
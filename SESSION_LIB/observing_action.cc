@@ -739,8 +739,7 @@ ObservingAction::execute(Session *session) {
       bool quit = false;
       session->log(LOG_INFO, "Received pause message. Starting pause.");
       while (!quit) {
-	sleep(1);
-	if (ReceiveMessage("simple_session", &message_id)) {
+	if (WaitForMessage("simple_session", &message_id)) {
 	  if (message_id == SM_ID_Resume) {
 	    session->log(LOG_INFO, "Received resume message. Resuming.");
 	    quit = true;
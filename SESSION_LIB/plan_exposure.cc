@@ -18,6 +18,7 @@
  */
 
 #include "plan_exposure.h"
+#include "image_pipeline.h"
 
 #include <Image.h>
 #include <HGSC.h>
@@ -30,6 +31,8 @@
 #include <ctype.h>		// isdigit()
 #include <iostream>
 #include <algorithm>
+#include <mutex>
+#include <unordered_map>
 
 //****************************************************************
 //        Reference Data
@@ -181,14 +184,40 @@ void InitializeExposurePlanner(const char *homedir) {
   }
 }
 
+//****************************************************************
+//        Analysis Pipelines
+// One ImagePipeline per exposure time, each holding the matching
+// dark. Created on first use and kept for the life of the process.
+//****************************************************************
+static std::mutex planner_lock;	// protects pipelines, all_measurements,
+				// ReferenceDataValid
+static std::unordered_map<int, ImagePipeline *> pipelines;
+
+static const ImagePipeline *PipelineForExposure(int exptime) {
+  std::unique_lock<std::mutex> lock(planner_lock);
+  auto it = pipelines.find(exptime);
+  if (it != pipelines.end()) return it->second;
+
+  std::string darkname(std::string(master_dirname) +
+		       "/dark" + to_string(exptime) + ".fits");
+  ImagePipeline *pipeline = new ImagePipeline;
+  if (pipeline->SetDark(darkname.c_str())) {
+    delete pipeline;
+    pipeline = nullptr;		// remembered, so we don't keep retrying
+  }
+  pipelines[exptime] = pipeline;
+  return pipeline;
+}
+
 //****************************************************************
 //        AddImageToExposurePlanner()
 // Any image of the sky is useful. Will be used for skyglow, HWFM PSF,
 // and flux/magnitude ratio. THIS SHOULD BE A RAW IMAGE, NOT
-// DARK-SUBTRACTED. 
+// DARK-SUBTRACTED. Can be called from several threads at once (each
+// with a different image).
 //****************************************************************
-void MeasureSkyGlow(Image &image, OneMeasurement &om, const char *image_filename);
-void MeasureStars(Image &image, OneMeasurement &om, const char *image_filename);
+void MeasureSkyGlow(Image &light, OneMeasurement &om);
+void MeasureStars(Image &light, const ImagePipeline &pipeline, OneMeasurement &om);
 
 void AddImageToExposurePlanner(Image &image, const char *image_filename) {
   OneMeasurement om;
@@ -203,45 +232,50 @@ void AddImageToExposurePlanner(Image &image, const char *image_filename) {
   if (not info->EGainValid()) return; // reject the point
   om.egain = info->GeteGain();
   om.okay = true;
+
+  const ImagePipeline *pipeline = PipelineForExposure((int) om.exptime);
+  if (pipeline == nullptr) return; // no matching dark
+
+  // The pipeline calibrates in place, so work on our own copy and
+  // leave the caller's raw image alone.
+  Image light(image.height, image.width);
+  for (int y = 0; y < image.height; y++) {
+    for (int x = 0; x < image.width; x++) {
+      light.pixel(x, y) = image.pixel(x, y);
+    }
+  }
+  light.CreateImageInfo()->PullFrom(info);
+  pipeline->Calibrate(light);
  
   // First grab skyglow
-  MeasureSkyGlow(image, om, image_filename);
+  MeasureSkyGlow(light, om);
   // Then pull out the star data
   if (om.okay) {
-    ReferenceDataValid = false;
-    MeasureStars(image, om, image_filename);
+    MeasureStars(light, *pipeline, om);
   }
   if (om.okay) {
+    std::unique_lock<std::mutex> lock(planner_lock);
+    ReferenceDataValid = false;
     all_measurements.push_back(om);
   }
 }
 
 //****************************************************************
 //        MeasureSkyGlow()
+//    "light" has already been dark-subtracted.
 //****************************************************************
-void MeasureSkyGlow(Image &image, OneMeasurement &om, const char *image_filename) {
-  std::string darkname(std::string(master_dirname) +
-		       "/dark" + to_string((int)om.exptime) + ".fits");
-  
-  struct stat statbuf;
-  if (stat(darkname.c_str(), &statbuf)) {
-    om.okay = false;
-  } else {
-    Image dark(darkname.c_str());
-    Image light(image_filename);
-    light.subtract(&dark);
-  
-    const double median = light.statistics()->MedianPixel;
-    om.skyglow = median/om.exptime;
-  }
+void MeasureSkyGlow(Image &light, OneMeasurement &om) {
+  const double median = light.statistics()->MedianPixel;
+  om.skyglow = median/om.exptime;
 }
 
 //****************************************************************
 //        MeasureStars()
+//    "light" has already been dark-subtracted.
 //****************************************************************
-void MeasureStars(Image &image, OneMeasurement &om, const char *image_filename) {
+void MeasureStars(Image &light, const ImagePipeline &pipeline, OneMeasurement &om) {
   om.okay = false;
-  ImageInfo *info = image.GetImageInfo();
+  ImageInfo *info = light.GetImageInfo();
   if (not info->ObjectValid()) return;
   if (not info->EGainValid()) return;
   const double egain = info->GeteGain();
@@ -249,38 +283,9 @@ void MeasureStars(Image &image, OneMeasurement &om, const char *image_filename)
   HGSCList catalog(object_name);
   if (not catalog.NameOK()) return;
 
-  std::string darkname(std::string(master_dirname) +
-		       "/dark" + to_string((int)om.exptime) + ".fits ");
-  
-  std::string command1(std::string("calibrate ") +
-		       " -d " + darkname +
-		       " -i " + image_filename +
-		       " -o /tmp/photometry.fits");
-		       
-  std::cerr << "Running: " << command1 << std::endl;
-  int ret = system(command1.c_str());
-  if (ret) return;
-
-  std::string command2("find_stars -f -i /tmp/photometry.fits");
-  std::cerr << "Running: " << command2 << std::endl;
-  ret = system(command2.c_str());
-  if (ret) return;
-
-  std::string command3(std::string("star_match -h -f -e ") +
-		       " -n " + object_name +
-		       " -i /tmp/photometry.fits");
-  std::cerr << "Running: " << command3 << std::endl;
-  ret = system(command3.c_str());
-  if (ret) return;
-
-  std::string command4(std::string("photometry -u ") +
-		       " -i /tmp/photometry.fits");
-  std::cerr << "Running: " << command4 << std::endl;
-  ret = system(command4.c_str());
-  if (ret) return;
-
-  Image processed("/tmp/photometry.fits");
-  IStarList *stars = processed.GetIStarList();
+  IStarList *stars = pipeline.Analyze(light, object_name);
+  if (stars == nullptr) return;
+
   double mag_sum = 0.0;
   int num_averaged = 0;
   for (int i=0; i<stars->NumStars; i++) {
@@ -303,6 +308,7 @@ void MeasureStars(Image &image, OneMeasurement &om, const char *image_filename)
     mag_sum += (catalog_mag - (-2.5*log10(flux/om.exptime)));
     num_averaged++;
   } // end loop over all stars
+  delete stars;
 
   if (num_averaged > 0) {
     om.mag_ref.ref_magnitude = mag_sum/num_averaged;
@@ -319,6 +325,7 @@ void MeasureStars(Image &image, OneMeasurement &om, const char *image_filename)
 //****************************************************************
 
 void ExposurePlannerPrintMeasurements(void) {
+  std::unique_lock<std::mutex> lock(planner_lock);
   for (auto om : all_measurements) {
     std::cout << "Filter: " << om.p_color
 	      << " Skyglow = " << om.skyglow
@@ -334,6 +341,7 @@ void ExposurePlannerPrintMeasurements(void) {
 //    Make all the reference data consistent with all observations.
 //****************************************************************
 void UpdateReferenceData(void) {
+  std::unique_lock<std::mutex> lock(planner_lock);
   if (ReferenceDataValid) return;
 
   // Values that need to be refreshed:
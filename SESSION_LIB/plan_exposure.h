@@ -53,7 +53,8 @@ typedef std::unordered_map<PhotometryColor, MagnitudeList> ColorMagnitudeList;
 void InitializeExposurePlanner(const char *homedir);
 
 // Any image of the sky is useful. Will be used for skyglow, HWFM PSF,
-// and flux/magnitude ratio.
+// and flux/magnitude ratio. Safe to call from several threads at
+// once, each with its own image.
 void AddImageToExposurePlanner(Image &image, const char *image_filename);
 
 // You provide a list of star magnitudes of interest. This will return
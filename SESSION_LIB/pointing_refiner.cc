@@ -0,0 +1,132 @@
+/*  pointing_refiner.cc -- Closed-loop pointing correction using
+ *  in-memory, in-process plate solves
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <math.h>
+#include <scope_api.h>
+#include <trace.h>
+#include "pointing_refiner.h"
+
+PointingRefiner::PointingRefiner(const char *catalog_name) :
+  catalog(catalog_name) {
+  if (not catalog.NameOK()) {
+    fprintf(stderr, "PointingRefiner: no catalog for %s\n", catalog_name);
+  }
+}
+
+//****************************************************************
+//        Measure()
+//****************************************************************
+Image *
+PointingRefiner::Measure(const DEC_RA &reference, PointingResult *result) {
+  TraceSpan span("pointing_measure");
+  if (not catalog.NameOK()) return nullptr;
+
+  exposure_flags flags("finder");
+  flags.SetFilter(r_filter);
+  flags.SetBinning(r_binning);
+  flags.subframe = r_subframe;
+
+  Image *frame = expose_image_in_memory(exposure_time, flags);
+  if (result) result->frames++;
+  if (frame == nullptr) return nullptr;
+
+  // In-memory frames don't get update_fits_data(), so supply the one
+  // thing from it that correlate() needs: which way is north.
+  ImageInfo *info = frame->GetImageInfo();
+  if (info == nullptr) info = frame->CreateImageInfo();
+  info->SetRotationAngle(dec_axis_is_flipped() ? 0.0 : M_PI);
+
+  pipeline.Calibrate(*frame);
+  IStarList *stars = pipeline.Detect(*frame);
+  const bool solved = pipeline.Solve(*frame, stars, catalog, reference);
+  if (log) {
+    fprintf(log, "PointingRefiner: %d stars, %s\n",
+	    stars->NumStars, (solved ? "solved" : "no match"));
+  }
+  delete stars;
+  if (not solved) {
+    delete frame;
+    return nullptr;
+  }
+  if (result) result->solved++;
+  return frame;
+}
+
+//****************************************************************
+//        Refine()
+//****************************************************************
+PointingResult
+PointingRefiner::Refine(const DEC_RA &target) {
+  TraceSpan span("pointing_refine");
+  const int64_t start_ns = TraceNow();
+  PointingResult result;
+  int failures = 0;		// consecutive unsolved frames
+  const double cos_dec = cos(target.dec());
+
+  do {
+    Image *frame = Measure(target, &result);
+    if (frame == nullptr) {
+      if (++failures >= 3) break;
+      // this dithering move is intended to allow a slightly different
+      // starfield to be imaged; maybe we get more stars?
+      if (log) fprintf(log, "PointingRefiner: dithering 1.5N 1.5W\n");
+      SmallMove(-1.5/cos_dec, 1.5);
+      WaitForGoToDone();
+      continue;
+    }
+    failures = 0;
+    result.center = frame->GetImageInfo()->GetWCS()->Transform(frame->width/2.0,
+							       frame->height/2.0);
+    delete frame;
+
+    const double delta_dec = target.dec() - result.center.dec();
+    const double delta_ra = (target.ra_radians() - result.center.ra_radians())*cos_dec; // radians
+    result.north_arcmin = delta_dec*60.0*180.0/M_PI;
+    result.east_arcmin = delta_ra*60.0*180.0/M_PI;
+    if (log) {
+      fprintf(log, "PointingRefiner: offset = %.3f (arcmin N), %.3f (arcmin E)\n",
+	      result.north_arcmin, result.east_arcmin);
+    }
+
+    if (fabs(delta_dec) < tolerance && fabs(delta_ra) < tolerance) {
+      result.converged = true;
+      break;
+    }
+    if (result.moves >= max_moves) {
+      if (log) fprintf(log, "PointingRefiner: didn't converge.\n");
+      break;
+    }
+    result.moves++;
+    TraceCounter("pointing_move_arcmin",
+		 sqrt(result.north_arcmin*result.north_arcmin +
+		      result.east_arcmin*result.east_arcmin));
+    SmallMove(result.east_arcmin/cos_dec, result.north_arcmin);
+    WaitForGoToDone();
+  } while (1);
+
+  result.elapsed_secs = (TraceNow() - start_ns)/1.0e9;
+  if (log) {
+    fprintf(log, "PointingRefiner: %s after %d frames, %d moves, %.1lf sec\n",
+	    (result.converged ? "converged" : "failed"),
+	    result.frames, result.moves, result.elapsed_secs);
+    fflush(log);
+  }
+  return result;
+}
@@ -0,0 +1,108 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  pointing_refiner.h -- Closed-loop pointing correction using
+ *  in-memory, in-process plate solves
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _POINTING_REFINER_H
+#define _POINTING_REFINER_H
+
+#include <stdio.h>
+#include <dec_ra.h>
+#include <Filter.h>
+#include <HGSC.h>
+#include <Image.h>
+#include <camera_api.h>		// subframe_t
+#include "image_pipeline.h"
+
+// A PointingRefiner replaces the old "expose to disk, run find_stars,
+// run star_match, read the file back, run move" cycle. Each frame is
+// short and binned, is never written to disk, and is plate-solved
+// against the target's catalog, which is read just once, when the
+// PointingRefiner is built. Corrections go straight to the mount
+// with SmallMove().
+//
+// Usage:
+//    PointingRefiner refiner("rr-lyr");
+//    refiner.SetTolerance(1.0*M_PI/(180.0*60.0));
+//    PointingResult r = refiner.Refine(target_location);
+//    if (r.converged) ...
+
+struct PointingResult {
+  bool converged {false};
+  int frames {0};		// exposures taken
+  int solved {0};		// exposures that plate-solved
+  int moves {0};		// SmallMove() corrections (not dithers)
+  DEC_RA center;		// last solved field center (J2000)
+  double north_arcmin {0.0};	// last offset (target minus center)
+  double east_arcmin {0.0};
+  double elapsed_secs {0.0};
+};
+
+class PointingRefiner {
+public:
+  // catalog_name is the name of a file in CATALOG_DIR
+  PointingRefiner(const char *catalog_name);
+  bool CatalogOK(void) { return catalog.NameOK(); }
+
+  //********************************
+  //        SETUP
+  //********************************
+  void SetExposureTime(double seconds) { exposure_time = seconds; }
+  void SetFilter(const Filter &filter) { r_filter = filter; }
+  void SetBinning(int binning) { r_binning = binning; }
+  // Raw (unbinned) chip coordinates; should be centered on the chip
+  // so that the center of the frame is the center of the field.
+  void SetSubframe(const subframe_t &box) { r_subframe = box; }
+  // The dark must match the exposure time. An unbinned, full-frame
+  // dark is fine: Image::subtract() bins and crops it to match the
+  // frame. Returns 0 on success, -1 if it couldn't be read.
+  int SetDark(const char *dark_filename) { return pipeline.SetDark(dark_filename); }
+  void SetTolerance(double radians) { tolerance = radians; }
+  void SetMaxMoves(int moves) { max_moves = moves; }
+  void SetLog(FILE *fp) { log = fp; }
+
+  //********************************
+  //        EXECUTE
+  //********************************
+
+  // One exposure, solved in memory. "reference" is the starting guess
+  // for the field center. Returns the frame with its WCS in its
+  // ImageInfo (caller owns it), or nullptr if the frame couldn't be
+  // solved. "result" (if not nullptr) has its counters updated.
+  Image *Measure(const DEC_RA &reference, PointingResult *result = nullptr);
+
+  // Measure()/SmallMove() until the field center is within the
+  // tolerance of "target" on both axes, or until max_moves
+  // corrections have been made. A frame that cannot be solved is
+  // followed by a small dither (up to three times in a row).
+  PointingResult Refine(const DEC_RA &target);
+
+private:
+  HGSCList catalog;
+  ImagePipeline pipeline;
+  FILE *log {nullptr};
+
+  double exposure_time {5.0};	// seconds
+  Filter r_filter {Filter("Vc")};
+  int r_binning {2};
+  subframe_t r_subframe;	// default: uncropped
+  double tolerance {1.0*M_PI/(180.0*60.0)}; // radians, both axes
+  int max_moves {3};
+};
+
+#endif
@@ -1,7 +1,7 @@
 // This may look like C code, but it is really -*- C++ -*-
 /*  proc_messages.cc -- handles cross-process messages
  *
- *  Copyright (C) 2015 Mark J. Munkacsy
+ *  Copyright (C) 2015, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -25,89 +25,160 @@
 #include <fcntl.h>		// O_ constants
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>	// SYS_futex
+#include <linux/futex.h>
+#include <limits.h>		// INT_MAX
+#include <stdint.h>
+#include <time.h>		// clock_gettime()
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <errno.h>
+#include <atomic>
 
 #define MAX_PROC_NAME 64	// max # characters in a process name
-#define MAX_MESSAGES 100
+#define MAX_QUEUED 32		// max # messages waiting for one process
 #define MAX_NUM_PROCS 32
 
+#define SM_AREA_NAME "/astro_message_bus"
+#define SM_AREA_MAGIC 0x534d4232 // "SMB2"; change if SM_Area changes
+
 struct SM_Message {
-  bool inuse;
-  int target_proc_index;
   int  SM_message_id;
+  SM_Topic SM_topic;
   long SM_parameter_value;
+  char SM_text[SM_MAX_TEXT];
+};
+
+// One per process name. Everything but "posted" is protected by
+// protect_lock.
+struct SM_Queue {
+  char proc_name[MAX_PROC_NAME];
+  uint32_t topics;		// bit (1<<topic) set if subscribed
+  unsigned int head;		// next slot to be filled
+  unsigned int tail;		// next slot to be read
+  // Bumped every time a message is queued. Receivers wait on this
+  // with a futex.
+  std::atomic<uint32_t> posted;
+  SM_Message messages[MAX_QUEUED];
 };
 
 struct SM_Area {
+  std::atomic<uint32_t> magic;	// set once the area is initialized
   pthread_mutex_t protect_lock;
-  SM_Message all_messages[MAX_MESSAGES];
-  char all_proc_name[MAX_NUM_PROCS][MAX_PROC_NAME];
+  SM_Queue queue[MAX_NUM_PROCS];
 };
 
 SM_Area *area = 0;
 
+static void InitializeArea(void) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  // A process killed while holding the lock mustn't hang everyone else
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&area->protect_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  for (int i=0; i<MAX_NUM_PROCS; i++) {
+    area->queue[i].proc_name[0] = 0;
+    area->queue[i].topics = 0;
+    area->queue[i].head = area->queue[i].tail = 0;
+    area->queue[i].posted.store(0, std::memory_order_relaxed);
+  }
+  area->magic.store(SM_AREA_MAGIC, std::memory_order_release);
+}
+
 void SetupArea(void) {
   // if area is not <nil>, then SetupArea() was previously called
   if (area) return;
 
-  int shm_fd = shm_open("/astro_control_messages", O_RDWR|O_CREAT, 0666);
+  // Whoever creates the area initializes it; everyone else waits for
+  // that to finish.
+  bool creator = true;
+  int shm_fd = shm_open(SM_AREA_NAME, O_RDWR|O_CREAT|O_EXCL, 0666);
+  if (shm_fd < 0 && errno == EEXIST) {
+    creator = false;
+    shm_fd = shm_open(SM_AREA_NAME, O_RDWR, 0);
+  }
   if (shm_fd < 0) {
     perror("proc_messages: error creating shared memory:");
-    return;
+    exit(-2);
   }
+  // (shm_open() is subject to the umask)
+  if (creator) fchmod(shm_fd, 0666);
 
-  if (ftruncate(shm_fd, sizeof(struct SM_Area))) {
-    perror("proc_messages: error setting shared memory size: ");
-    return;
+  if (creator) {
+    if (ftruncate(shm_fd, sizeof(struct SM_Area))) {
+      perror("proc_messages: error setting shared memory size: ");
+      exit(-2);
+    }
+  } else {
+    struct stat st;
+    for (int tries = 0; fstat(shm_fd, &st) == 0 &&
+	   st.st_size < (off_t) sizeof(struct SM_Area); tries++) {
+      if (tries > 1000) {
+	fprintf(stderr, "proc_messages: shared memory %s has the wrong size.\n",
+		SM_AREA_NAME);
+	exit(-2);
+      }
+      usleep(1000);
+    }
   }
   
-  area = (SM_Area *) mmap(0, sizeof(struct SM_Area),
-			  PROT_READ | PROT_WRITE,
-			  MAP_SHARED, shm_fd, 0);
-  if (area == MAP_FAILED) {
+  SM_Area *mapped = (SM_Area *) mmap(0, sizeof(struct SM_Area),
+				     PROT_READ | PROT_WRITE,
+				     MAP_SHARED, shm_fd, 0);
+  close(shm_fd);
+  if (mapped == MAP_FAILED) {
     perror("proc_messages: error mapping shared memory: ");
-    return;
+    exit(-2);
   }
-  
-  // try and obtain the lock. If it fails with EINVAL, this means that
-  // the mutex has not been initialized, and we should go set things
-  // up.
-  if (pthread_mutex_lock(&area->protect_lock)) {
-    // error. Verify that we got EINVAL
-    if (errno == EINVAL) {
-      // need to initialize
-      pthread_mutex_init(&area->protect_lock, NULL);
-      pthread_mutex_lock(&area->protect_lock);
-      for (int i=0; i<MAX_MESSAGES; i++) {
-	area->all_messages[i].inuse = false;
+  area = mapped;
+
+  if (creator) {
+    InitializeArea();
+  } else {
+    for (int tries = 0;
+	 area->magic.load(std::memory_order_acquire) != SM_AREA_MAGIC;
+	 tries++) {
+      if (tries > 1000) {
+	fprintf(stderr, "proc_messages: shared memory %s never initialized.\n",
+		SM_AREA_NAME);
+	exit(-2);
       }
-    } else {
-      // lock failed due to something other than lack of
-      // initialization??
-      perror("proc_messages: error testing lock: ");
+      usleep(1000);
     }
   }
-  // we obtained the lock. Release it immediately
+}
+
+static void LockArea(void) {
+  if (pthread_mutex_lock(&area->protect_lock) == EOWNERDEAD) {
+    // Previous holder died; the queues are only changed in small
+    // steps, so they're still usable.
+    pthread_mutex_consistent(&area->protect_lock);
+  }
+}
+
+static void UnlockArea(void) {
   pthread_mutex_unlock(&area->protect_lock);
 }
 
 #define NO_CREATE 0
 #define CREATE_IF_NEEDED 1
 
+// Must hold protect_lock
 int proc_name_to_index(const char *proc_name, int creation) {
   for (int i=0; i<MAX_NUM_PROCS; i++) {
-    if (area->all_proc_name[i][0] == 0) {
+    if (area->queue[i].proc_name[0] == 0) {
       if (creation == CREATE_IF_NEEDED) {
-	strcpy(area->all_proc_name[i], proc_name);
+	strncpy(area->queue[i].proc_name, proc_name, MAX_PROC_NAME-1);
+	area->queue[i].proc_name[MAX_PROC_NAME-1] = 0;
 	return i;
       } else {
 	return -1; // not found
       }
-    } else if (strcmp(area->all_proc_name[i], proc_name) == 0) {
+    } else if (strncmp(area->queue[i].proc_name, proc_name, MAX_PROC_NAME-1) == 0) {
       return i;
     }
   }
@@ -117,6 +188,34 @@ int proc_name_to_index(const char *proc_name, int creation) {
   /*NOTREACHED*/
   return 0;
 }
+
+static SM_Queue *MyQueue(const char *my_name) {
+  SetupArea();
+  LockArea();
+  SM_Queue *q = &area->queue[proc_name_to_index(my_name, CREATE_IF_NEEDED)];
+  UnlockArea();
+  return q;
+}
+
+// Must hold protect_lock. Returns false if the queue is full.
+static bool Deliver(SM_Queue *q, SM_Topic topic, int message_id,
+		    long message_param, const char *text) {
+  if (q->head - q->tail >= MAX_QUEUED) return false;
+  SM_Message *m = &q->messages[q->head % MAX_QUEUED];
+  m->SM_message_id = message_id;
+  m->SM_topic = topic;
+  m->SM_parameter_value = message_param;
+  m->SM_text[0] = 0;
+  if (text) {
+    strncpy(m->SM_text, text, SM_MAX_TEXT-1);
+    m->SM_text[SM_MAX_TEXT-1] = 0;
+  }
+  q->head++;
+  q->posted.fetch_add(1, std::memory_order_release);
+  syscall(SYS_futex, (uint32_t *) &q->posted, FUTEX_WAKE, INT_MAX,
+	  nullptr, nullptr, 0);
+  return true;
+}
 	
 //****************************************************************
 //        SendMessage
@@ -127,68 +226,217 @@ int SendMessage(const char *destination,
   int ret_value = 0;
   SetupArea();
   // grab the lock
-  pthread_mutex_lock(&area->protect_lock);
+  LockArea();
 
   int proc_index = proc_name_to_index(destination, NO_CREATE);
   if (proc_index < 0) {
     fprintf(stderr, "proc_messages: no process called %s known.\n",
 	    destination);
     ret_value = -1; // error return
-  } else {
-    bool found = false;
-    // otherwise, we successfully found the proc's name
-    for (int i=0; i<MAX_MESSAGES; i++) {
-      if (area->all_messages[i].inuse == false) {
-	area->all_messages[i].target_proc_index = proc_index;
-	area->all_messages[i].SM_message_id = message_id;
-	area->all_messages[i].SM_parameter_value = message_param;
-	area->all_messages[i].inuse = true;
-	found = true;
-	break;
-      }
-    }
-
-    if (!found) {
-      fprintf(stderr, "proc_messages: message queue already full.\n");
-      ret_value = -1; // error_return
-    }
+  } else if (!Deliver(&area->queue[proc_index], SM_TOPIC_NONE,
+		      message_id, message_param, 0)) {
+    fprintf(stderr, "proc_messages: message queue already full.\n");
+    ret_value = -1; // error_return
   }
 
-  pthread_mutex_unlock(&area->protect_lock);
+  UnlockArea();
   return ret_value;
 }
 
 //****************************************************************
 //        ReceiveMessage()
 //****************************************************************
+int ReceiveMessage(const char *my_name, SM_Received *message) {
+  SM_Queue *q = MyQueue(my_name);
+  LockArea();
+  const int ret_value = q->head - q->tail;
+  if (ret_value) {
+    const SM_Message *m = &q->messages[q->tail % MAX_QUEUED];
+    message->message_id = m->SM_message_id;
+    message->message_param = m->SM_parameter_value;
+    message->topic = m->SM_topic;
+    strcpy(message->text, m->SM_text);
+    q->tail++;
+  }
+  UnlockArea();
+
+  return ret_value;
+}
+
 int ReceiveMessage(const char *my_name,
 		   int *message_id,
 		   long *message_param) {
-  int ret_value = 0;
-  int first_message = -1;
-  SetupArea();
-  // grab the lock
-  pthread_mutex_lock(&area->protect_lock);
-
-  int proc_index = proc_name_to_index(my_name, CREATE_IF_NEEDED);
-
-  for (int i=0; i<MAX_MESSAGES; i++) {
-    if (area->all_messages[i].inuse &&
-	area->all_messages[i].target_proc_index == proc_index) {
-      if (first_message < 0) {
-	first_message = i;
-	*message_id = area->all_messages[i].SM_message_id;
-	if (message_param) {
-	  (*message_param) = area->all_messages[i].SM_parameter_value;
-	}
-	area->all_messages[i].inuse = false;
+  SM_Received message;
+  const int ret_value = ReceiveMessage(my_name, &message);
+  if (ret_value) {
+    *message_id = message.message_id;
+    if (message_param) {
+      (*message_param) = message.message_param;
+    }
+  }
+  return ret_value;
+}
+
+//****************************************************************
+//        WaitForMessage()
+//****************************************************************
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1.0e-9;
+}
+
+int WaitForMessage(const char *my_name, SM_Received *message,
+		   double timeout_secs) {
+  SM_Queue *q = MyQueue(my_name);
+  const double deadline = Now() + timeout_secs;
+
+  do {
+    // Fetch the counter before looking at the queue; if a message is
+    // queued in between, the futex wait returns at once.
+    const uint32_t seq = q->posted.load(std::memory_order_acquire);
+    const int ret_value = ReceiveMessage(my_name, message);
+    if (ret_value) return ret_value;
+
+    struct timespec ts;
+    struct timespec *timeout = nullptr;
+    if (timeout_secs >= 0.0) {
+      const double remaining = deadline - Now();
+      if (remaining <= 0.0) return 0;
+      ts.tv_sec = (time_t) remaining;
+      ts.tv_nsec = (long) ((remaining - ts.tv_sec)*1.0e9);
+      timeout = &ts;
+    }
+    syscall(SYS_futex, (uint32_t *) &q->posted, FUTEX_WAIT, seq,
+	    timeout, nullptr, 0);
+  } while(1);
+}
+
+int WaitForMessage(const char *my_name,
+		   int *message_id,
+		   long *message_param,
+		   double timeout_secs) {
+  SM_Received message;
+  const int ret_value = WaitForMessage(my_name, &message, timeout_secs);
+  if (ret_value) {
+    *message_id = message.message_id;
+    if (message_param) {
+      (*message_param) = message.message_param;
+    }
+  }
+  return ret_value;
+}
+
+//****************************************************************
+//        MessageFD()
+// A futex can't be handed to poll(), so a thread waits on the
+// queue's futex and passes each wakeup on through an eventfd.
+//****************************************************************
+struct FDWatch {
+  SM_Queue *queue;
+  int fd;
+};
+
+static void *WatchQueue(void *arg) {
+  const FDWatch *w = (const FDWatch *) arg;
+  uint32_t seen = 0;		// forces a first signal if anything is queued
+  const uint64_t one = 1;
+
+  do {
+    const uint32_t seq = w->queue->posted.load(std::memory_order_acquire);
+    if (seq != seen) {
+      seen = seq;
+      LockArea();
+      const bool waiting = (w->queue->head != w->queue->tail);
+      UnlockArea();
+      if (waiting && write(w->fd, &one, sizeof(one)) != sizeof(one)) {
+	perror("proc_messages: eventfd write");
       }
-      ret_value++;
+    }
+    syscall(SYS_futex, (uint32_t *) &w->queue->posted, FUTEX_WAIT, seen,
+	    nullptr, nullptr, 0);
+  } while(1);
+  /*NOTREACHED*/
+  return nullptr;
+}
+
+int MessageFD(const char *my_name) {
+  static FDWatch watches[4];
+  static int num_watches = 0;
+  static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+  SM_Queue *q = MyQueue(my_name);
+  int ret_value = -1;
+
+  pthread_mutex_lock(&watch_lock);
+  for (int i=0; i<num_watches; i++) {
+    if (watches[i].queue == q) ret_value = watches[i].fd;
+  }
+  if (ret_value < 0 && num_watches < 4) {
+    FDWatch *w = &watches[num_watches];
+    w->queue = q;
+    w->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pthread_t tid;
+    if (w->fd < 0) {
+      perror("proc_messages: eventfd");
+    } else if (pthread_create(&tid, nullptr, WatchQueue, w)) {
+      perror("proc_messages: cannot create watcher thread");
+      close(w->fd);
+    } else {
+      pthread_detach(tid);
+      num_watches++;
+      ret_value = w->fd;
     }
   }
+  pthread_mutex_unlock(&watch_lock);
+  return ret_value;
+}
 
-  pthread_mutex_unlock(&area->protect_lock);
+//****************************************************************
+//        Topics
+//****************************************************************
+// Broadcasts on this topic still sitting in the queue were left there
+// for an earlier subscriber with the same name (maybe one that has
+// since exited), so they are thrown away. Messages sent directly to
+// the process are kept.
+void Subscribe(const char *my_name, SM_Topic topic) {
+  SM_Queue *q = MyQueue(my_name);
+  LockArea();
+  unsigned int keep = q->tail;
+  for (unsigned int i = q->tail; i != q->head; i++) {
+    const SM_Message *m = &q->messages[i % MAX_QUEUED];
+    if (m->SM_topic == topic) continue;
+    if (keep != i) q->messages[keep % MAX_QUEUED] = *m;
+    keep++;
+  }
+  q->head = keep;
+  q->topics |= (1U << topic);
+  UnlockArea();
+}
 
+void Unsubscribe(const char *my_name, SM_Topic topic) {
+  SM_Queue *q = MyQueue(my_name);
+  LockArea();
+  q->topics &= ~(1U << topic);
+  UnlockArea();
+}
+
+int PublishMessage(SM_Topic topic,
+		   int message_id,
+		   long message_param,
+		   const char *text) {
+  int ret_value = 0;
+  SetupArea();
+  LockArea();
+  for (int i=0; i<MAX_NUM_PROCS && area->queue[i].proc_name[0]; i++) {
+    // A subscriber that isn't reading (maybe it has exited) just
+    // misses broadcasts once its queue is full.
+    if ((area->queue[i].topics & (1U << topic)) &&
+	Deliver(&area->queue[i], topic, message_id, message_param, text)) {
+      ret_value++;
+    }
+  }
+  UnlockArea();
   return ret_value;
 }
 
@@ -200,19 +448,16 @@ ProcessList *GetProcessList(void) {
 
   SetupArea();
   // grab the lock
-  pthread_mutex_lock(&area->protect_lock);
+  LockArea();
       
   for (int i=0; i<MAX_NUM_PROCS; i++) {
-    if (area->all_proc_name[i][0] != 0) {
-      char *new_proc = strdup(area->all_proc_name[i]);
+    if (area->queue[i].proc_name[0] != 0) {
+      char *new_proc = strdup(area->queue[i].proc_name);
       result->push_back(new_proc);
     }
   }
 
-  pthread_mutex_unlock(&area->protect_lock);
+  UnlockArea();
 
   return result;
 }
-  
-
-  
@@ -1,7 +1,7 @@
 // This may look like C code, but it is really -*- C++ -*-
 /*  proc_messages.h -- handles cross-process messages
  *
- *  Copyright (C) 2015 Mark J. Munkacsy
+ *  Copyright (C) 2015, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -26,7 +26,17 @@
 // Each process has a process name (a string) which is taken from
 // argv[0] (the name of the executable file)
 // Each message has a message ID (an integer)
-// Each message has an optional message parameter
+// Each message has an optional message parameter (and an optional
+// short text)
+//
+// Each process has its own queue in shared memory. A process can
+// block until something arrives in its queue (WaitForMessage()), or
+// get a file descriptor that becomes readable when something does
+// (MessageFD()) and fold it into its own poll()/select() loop.
+//
+// Besides messages addressed to one process, there are status
+// broadcasts: a process that has subscribed to a topic gets a copy of
+// every message published on that topic.
 
 // SendMessage will return SM_Okay on success or will return
 // SM_Not_Found if the destination string does not match a known
@@ -39,6 +49,26 @@
 #define SM_ID_Abort 1
 #define SM_ID_Pause 2
 #define SM_ID_Resume 3
+// Broadcasts
+#define SM_ID_CoolerStatus 10	// param = CCD temp in 0.01 degC; text
+				// = "ccd_t setpoint_t power%"
+#define SM_ID_ImageReady 11	// text = image filename
+
+enum SM_Topic {
+  SM_TOPIC_NONE,		// (messages sent to one process)
+  SM_TOPIC_COOLER,
+  SM_TOPIC_IMAGE,
+  SM_NUM_TOPICS,
+};
+
+#define SM_MAX_TEXT 128
+
+struct SM_Received {
+  int message_id;
+  long message_param;
+  SM_Topic topic;
+  char text[SM_MAX_TEXT];
+};
 
 // SendMessage() may block briefly if there is contention for the
 // shared memory area used to pass messages back and forth
@@ -57,6 +87,36 @@ int SendMessage(const char *destination,
 int ReceiveMessage(const char *my_name,
 		   int *message_id,
 		   long *message_param = 0);
+// Same, but returns everything about the message
+int ReceiveMessage(const char *my_name, SM_Received *message);
+
+// WaitForMessage() is ReceiveMessage() that blocks until a message
+// arrives or timeout_secs passes (forever if timeout_secs < 0). Returns
+// 0 on timeout.
+int WaitForMessage(const char *my_name,
+		   int *message_id,
+		   long *message_param = 0,
+		   double timeout_secs = -1.0);
+int WaitForMessage(const char *my_name, SM_Received *message,
+		   double timeout_secs = -1.0);
+
+// MessageFD() returns a file descriptor that becomes readable when a
+// message arrives for my_name. After poll() says it's readable, read()
+// 8 bytes from it, then call ReceiveMessage() until it returns 0.
+// Returns -1 on error.
+int MessageFD(const char *my_name);
+
+// Topic subscriptions last until Unsubscribe() (or until the shared
+// memory area is removed), even if the process exits. Subscribe()
+// discards any broadcasts on that topic already in the queue, so a
+// restarted subscriber doesn't see stale ones.
+void Subscribe(const char *my_name, SM_Topic topic);
+void Unsubscribe(const char *my_name, SM_Topic topic);
+// Returns the number of subscribers the message was queued for
+int PublishMessage(SM_Topic topic,
+		   int message_id,
+		   long message_param = 0,
+		   const char *text = 0);
 
 // GetProcessList() will return a list of processes that are known to
 // "notify". 
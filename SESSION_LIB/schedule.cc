@@ -1,6 +1,6 @@
 /*  schedule.cc -- manages the scheduling of observations during a session
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -20,12 +20,15 @@
 #include <string.h>
 #include <stdlib.h>		// mkstemp()
 #include <ctype.h>
+#include <set>
 #include "strategy.h"
 #include "session.h"
 #include "schedule.h"
 #include "observing_action.h"
 #include <scope_api.h>		// ControlTrackingMotor()
 #include <gendefs.h>
+#include <trace.h>
+#include <catalog_bundle.h>
 
 const static int MAX_FAILURES_TO_FLUSH = 2;
 
@@ -54,8 +57,31 @@ Schedule::~Schedule(void) {
   }
 }
 
+// Brings the compiled catalog of every target in the schedule up to
+// date and maps it (CatalogBundle keeps it mapped for the rest of the
+// session), so that the plate solves and photometry done during the
+// night find it in memory instead of parsing the catalog files.
+// Targets without catalogs (darks, flats, ...) are skipped.
+static void
+compile_catalog_bundles(Session *session,
+			const std::vector<Schedule::strategy_time_pair *> &schedule) {
+  TraceSpan span("compile_catalog_bundles");
+  std::set<std::string> targets;
+  for (Schedule::strategy_time_pair *item : schedule) {
+    if (item->oa) targets.insert(item->oa->GetObjectName());
+  }
+
+  int num_ready = 0;
+  for (const std::string &target : targets) {
+    if (target.size() && CatalogBundle::Get(target.c_str())) num_ready++;
+  }
+  session->log(LOG_INFO, "schedule: %d compiled catalogs ready for %d targets",
+	       num_ready, (int) targets.size());
+}
+
 double
 Schedule::create_schedule(void) {
+  TraceSpan span("create_schedule");
   Executing_Session->log(LOG_INFO, "starting create_schedule");
 
   if(Executing_Session->StatusCheck(Session::TASK_RESCHEDULING)
@@ -147,6 +173,7 @@ Schedule::create_schedule(void) {
       }
       fclose(fp_out);
       currently_executing_action = -1;
+      compile_catalog_bundles(Executing_Session, current_schedule);
     }
 
     // unlink(temp_name_in);
@@ -205,7 +232,11 @@ Schedule::Execute_Schedule(void) {
 			   "Starting strategy for %s",
 			   strategy->oa->GetObjectName());
 
-    Execution_Result result = strategy->oa->execute(Executing_Session);
+    Execution_Result result;
+    {
+      TraceSpan span("ObservingAction::execute");
+      result = strategy->oa->execute(Executing_Session);
+    }
     if(result == NO_STARS) {
       strategy->failures_so_far++;
       no_stars_count++;
@@ -275,6 +306,8 @@ Schedule::Execute_Schedule(void) {
       break;
 
     }
+    Executing_Session->LogTraceSummary();
+
     if (force_shutdown) {
       return SCHED_ABORT;
     }
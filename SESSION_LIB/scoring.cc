@@ -19,6 +19,7 @@
 #include "session.h"
 #include "observing_action.h"
 #include "scoring.h"
+#include "trace.h"
 
 double calculate_score(INDIVIDUAL *indiv);
 
@@ -143,6 +144,7 @@ void assign_score(INDIVIDUAL *x) {
 
 double
 calculate_score(INDIVIDUAL *indiv) {
+  TraceSpan span("scheduler_evaluate");
   double cum_score = 0.0;
 
   indiv->trial.Reset();
@@ -35,6 +35,7 @@
 #include <StatusMessage.h>	// cooler mode flags
 #include <gendefs.h>
 #include <astro_db.h>
+#include <trace.h>
 
 void SetDefaultOptions(SessionOptions &s) {
   s.do_focus = 0;
@@ -461,6 +462,7 @@ Session::execute(void) {
   if (UserOptions.use_work_queue) {
     work_queue.AddToQueue("FINI");
   }
+  LogTraceSummary(true);
   log(LOG_INFO, "session: done.");
   if (shutdown_task && shutdown_task[0]) {
     log(LOG_INFO, "Starting shutdown_task.");
@@ -585,6 +587,21 @@ Session::log(int level, const char *format, ...) {
   }
 }
 
+void
+Session::LogTraceSummary(bool force) {
+  if (!TraceEnabled()) return;
+
+  const time_t now = time(0);
+  if (!force && now - last_trace_summary < 30*60) return;
+  last_trace_summary = now;
+
+  std::list<std::string> lines;
+  TraceSummary(lines);
+  for (const std::string &line : lines) {
+    log(LOG_INFO, "%s", line.c_str());
+  }
+}
+
 void
 Session::PutFileIntoLog(int level, const char *filename) {
   tm     *time_data;
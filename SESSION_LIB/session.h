@@ -124,6 +124,11 @@ public:
   void log(int level, const char *format, ...);
   void PutFileIntoLog(int level, const char *filename);
 
+  // If tracing is on (see trace.h), put a summary of the span timings
+  // into the log. Does nothing if a summary was logged within the past
+  // 30 minutes, unless "force" is set.
+  void LogTraceSummary(bool force=false);
+
   double FocusCheckMinutes(void) { return focus_check_periodicity_minutes; }
 
   void EveningDate(int &day, int &month, int &year);
@@ -182,6 +187,7 @@ private:
   Schedule *session_schedule;
   
   FILE *logfile;
+  time_t last_trace_summary {0};
 
   double focus_check_periodicity_minutes;
 
@@ -30,6 +30,7 @@
 #include <Image.h>
 #include <IStarList.h>
 #include <HGSC.h>
+#include <catalog_bundle.h>
 #include <alt_az.h>
 #include <named_stars.h>
 #include <mount_model.h>
@@ -412,8 +413,7 @@ Strategy::execute(Session *session) {
       bool quit = false;
       session->log(LOG_INFO, "Received pause message. Starting pause.");
       while (!quit) {
-	sleep(1);
-	if (ReceiveMessage("simple_session", &message_id)) {
+	if (WaitForMessage("simple_session", &message_id)) {
 	  if (message_id == SM_ID_Resume) {
 	    session->log(LOG_INFO, "Received resume message. Resuming.");
 	    quit = true;
@@ -1376,6 +1376,28 @@ StrategyList::Add(Strategy *s) {
   main_list[strategy_count++] = s;
 }
 
+// Used by RebuildStrategyDatabase() for each catalog star
+static void RememberAUID(const char *label,
+			 const char *auid,
+			 const char *report_id) {
+  if(auid && *auid && label) {
+    // found a star with an AUID
+    // Is this star already in the database?
+    StrategyDatabaseEntry *entry = LookupByLocalName(label);
+    if(!entry) {
+      // Nope, craft a new entry from scratch
+      entry = CreateBlankEntryInDatabase();
+      entry->local_name = strdup(label);
+      entry->strategy_filename = "";
+      entry->designation = "";
+      entry->chartname = "";
+      entry->reporting_name = "";
+    }
+    strcpy(entry->AAVSO_UID, auid);
+    if(report_id) entry->reporting_name = strdup(report_id);
+  }
+}
+
 void
 Strategy::RebuildStrategyDatabase(void) {
   ClearStrategyDatabase();
@@ -1390,37 +1412,27 @@ Strategy::RebuildStrategyDatabase(void) {
     AddStrategyToDatabase(strategy, "");
   }
 
-  // Now read the catalog files
+  // Now read the catalog files (the compiled form if there is one;
+  // nothing here needs the stars as HGSC objects)
   for (Strategy *strategy : all_strategies) {
-    char cat_filename[120];
-    sprintf(cat_filename, "%s/%s", CATALOG_DIR, strategy->object());
-    FILE *fp = fopen(cat_filename, "r");
-
-    // silently ignore strategies that don't have catalog files
-    if(fp) {
-      HGSCList cat_list(fp);
-      HGSCIterator iter(cat_list);
-      HGSC *star;
-
-      for(star = iter.First(); star; star = iter.Next()) {
-	if(star->A_unique_ID && *star->A_unique_ID) {
-	  // found a star with an AUID
-	  // Is this star already in the database?
-	  StrategyDatabaseEntry *entry = LookupByLocalName(star->label);
-	  if(!entry) {
-	    // Nope, craft a new entry from scratch
-	    entry = CreateBlankEntryInDatabase();
-	    entry->local_name = strdup(star->label);
-	    entry->strategy_filename = "";
-	    entry->designation = "";
-	    entry->chartname = "";
-	    entry->reporting_name = "";
-	  }
-	  strcpy(entry->AAVSO_UID, star->A_unique_ID);
-	  if(star->report_ID) entry->reporting_name = strdup(star->report_ID);
+    std::shared_ptr<const CatalogBundle> catalog =
+      CatalogBundle::Get(strategy->object());
+
+    if(catalog) {
+      for(int i = 0; i < catalog->NumStars(); i++) {
+	RememberAUID(catalog->Label(i), catalog->AUID(i), catalog->ReportID(i));
+      }
+    } else {
+      // No compiled copy (CATALOG_BINARY_DIR can't be written?) or no
+      // catalog file at all; silently ignore strategies that don't
+      // have catalog files
+      HGSCList cat_list(strategy->object());
+      if(cat_list.NameOK()) {
+	HGSCIterator iter(cat_list);
+	for(HGSC *star = iter.First(); star; star = iter.Next()) {
+	  RememberAUID(star->label, star->A_unique_ID, star->report_ID);
 	}
       }
-      fclose(fp);
     }
   }
   SaveStrategyDatabase();
@@ -1,7 +1,7 @@
-/*  smart_add_archive.cc -- Searches Image directory for photometry
- *  files and adds data to the observation archive 
+/*  smart_add_archive.cc -- Adds a night's AAVSO report to the
+ *  photometry archive
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -18,35 +18,102 @@
  *   <http://www.gnu.org/licenses/>. 
  */
 #include <string.h>		// for strdup()
-#include <ctype.h>		// for isupper()
-#include <unistd.h> 		// for getopt(), getpid()
-#include <stdlib.h>		// for malloc(), system()
-#include <dirent.h>		// for getdents()
+#include <ctype.h>		// for toupper()
+#include <unistd.h> 		// for getopt()
+#include <stdlib.h>		// for exit()
 #include <stdio.h>
-#include <fcntl.h>		// for open()
+#include <libgen.h>		// basename()
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <math.h>		// fabs()
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <report_file.h>
+#include <phot_archive.h>
+#include <astro_db.h>
+
+// Adds a night's AAVSO report (aavso.report or aavso.report.txt in
+// the night's image directory) to the photometry archive. Adding the
+// same night twice is harmless; the second time is ignored.
+//
+// With -l, converts an old text archive (archive.dat, written by the
+// add_archive awk script) instead.
+//
+// Each measurement is tagged with the JUID of the image (or stack)
+// it was measured on, found in the night's astro_db.json by exposure
+// midpoint and filter. Nights without an astro_db.json (everything
+// before 2022) get 0.
 
 void usage(void) {
       fprintf(stderr,
-	      "usage: smart_add_archive -h home_dir\n");
+	      "usage: smart_add_archive [-a archive_dir] -h home_dir\n"
+	      "       smart_add_archive [-a archive_dir] -l archive.dat\n");
       exit(-2);
 }
 
-struct obs_summary_entry {
-  char *starname;		// in standard format
-  double julian_obs_time;
-  obs_summary_entry *next;
-} *first_obs_summary = 0;
-  
-
 /****************************************************************/
 /*        FORWARD DECLARATIONS                                  */
 /****************************************************************/
-int ends_with(const char *pattern, const char *field);
-void ProcessCSV(char *home_directory, char *filename);
-void AddInfo(char *name, char *julian_day);
-void AddToArchive(obs_summary_entry *obs, char *filename);
+int ImportReport(PhotArchive &archive, const char *home_directory);
+int ImportLegacy(PhotArchive &archive, const char *legacy_filename);
+
+/****************************************************************/
+/*        NightImages                                           */
+/*    The exposures and stacks in one night's astro_db.json.    */
+/****************************************************************/
+class NightImages {
+public:
+  NightImages(const char *home_directory);
+  juid_t Lookup(double jd, const char *filter) const;
+
+private:
+  struct OneImage {
+    double jd;
+    char filter;		// first letter of the filter name
+    juid_t juid;
+  };
+  std::vector<OneImage> images;
+};
+
+NightImages::NightImages(const char *home_directory) {
+  const std::string db_name = std::string(home_directory) + "/astro_db.json";
+  struct stat sb;
+  if (stat(db_name.c_str(), &sb)) return; // no astro_db.json
+
+  AstroDB astro_db(JSON_READONLY, db_name.c_str());
+  for (DB_Entry_t type : { DB_IMAGE, DB_STACKS }) {
+    for (JSON_Expression *exp : astro_db.FetchAllOfType(type)) {
+      JSON_Expression *julian = exp->Value("julian");
+      JSON_Expression *filter = exp->Value("filter");
+      JSON_Expression *juid = exp->Value("juid");
+      if (!juid) juid = exp->Value("JUID");
+      if (!julian or !filter or !juid) continue;
+      images.push_back(OneImage{julian->Value_double(),
+				(char) toupper(filter->Value_char()[0]),
+				juid->Value_int()});
+    }
+  }
+}
+
+// Report times are written with 4 decimal places (8.6 seconds), so
+// the closest image within 0.0001 day with the same filter is the
+// one. astro_db.json has names such as "Vc" and "Rc" where the
+// report has "V" and "R", so only the first letter is compared.
+juid_t
+NightImages::Lookup(double jd, const char *filter) const {
+  juid_t best_juid = 0;
+  double best_delta = 0.0001;
+  for (const OneImage &i : images) {
+    const double delta = fabs(i.jd - jd);
+    if (i.filter == toupper(filter[0]) and delta <= best_delta) {
+      best_juid = i.juid;
+      best_delta = delta;
+    }
+  }
+  return best_juid;
+}
 
 /****************************************************************/
 /* main()						        */
@@ -54,189 +121,189 @@ void AddToArchive(obs_summary_entry *obs, char *filename);
 int main(int argc, char **argv) {
   int ch;			// option character
   char *home_directory = 0;
+  char *legacy_filename = 0;
+  const char *archive_directory = PhotArchive::DEFAULT_DIRECTORY;
 
   // Command line options:
   // -h home_directory
+  // -l legacy_archive
+  // -a archive_directory
 
-  while((ch = getopt(argc, argv, "h:")) != -1) {
+  while((ch = getopt(argc, argv, "h:l:a:")) != -1) {
     switch(ch) {
-    case 'h':			// image filename
+    case 'h':			// image directory
       home_directory = optarg;
       break;
 
+    case 'l':
+      legacy_filename = optarg;
+      break;
+
+    case 'a':
+      archive_directory = optarg;
+      break;
+
     case '?':
     default:
       usage();
    }
   }
 
-  
-  // must specify a home directory
-  if(!home_directory) usage();
-
-  // open the home directory.  Then scan it for *.csv files
-  DIR *dir = opendir(home_directory); // POSIX
-  // int dir_fd = open(home_directory, O_RDONLY); // NetBSD
-  if(!dir) {
-    fprintf(stderr, "Cannot open directory %s\n", home_directory);
-    usage();
-  }
+  // must specify a home directory or an old archive
+  if((home_directory == 0) == (legacy_filename == 0)) usage();
 
-  {
-    struct dirent *d;
-
-    while((d = readdir(dir)) != 0) {
-	//	if(dir->d_type == DT_REG &&
-	if(ends_with(".csv", d->d_name)) {
-	  // Found one!!
-	  fprintf(stderr, "Extracting observations from %s\n",
-		  d->d_name);
-	  ProcessCSV(home_directory, d->d_name);
-	}
-    }
+  PhotArchive archive(archive_directory, true);
+  if (not archive.IsOpen()) {
+    fprintf(stderr, "smart_add_archive: cannot open archive %s\n",
+	    archive_directory);
+    exit(-2);
   }
-  closedir(dir);
 
-  // Now we've built the full list of stars to look for in the
-  // obs_summary_entry structures.
-  obs_summary_entry *obs;
-
-  // Loop through all stars observed, and look for a matching
-  // "photometry" file with the filename of star.phot or star-b.phot
-  // or star-a.phot.
-  for(obs = first_obs_summary; obs; obs=obs->next) {
-    char filename[128];
-
-    sprintf(filename, "%s/%s-b.phot", home_directory, obs->starname);
-    struct stat sb;
-    if(stat(filename, &sb) == 0) {
-      AddToArchive(obs, filename);
-    } else {
-      sprintf(filename, "%s/%s-a.phot", home_directory, obs->starname);
-      if(stat(filename, &sb) == 0) {
-	AddToArchive(obs, filename);
-      } else {
-	sprintf(filename, "%s/%s.phot", home_directory, obs->starname);
-	if(stat(filename, &sb) == 0) {
-	  AddToArchive(obs, filename);
-	} else {
-	  fprintf(stderr, "Couldn't find a photometry file: %s\n",
-		  filename);
-	}
-      }
-    }
-  }
+  const int status = (home_directory ?
+		      ImportReport(archive, home_directory) :
+		      ImportLegacy(archive, legacy_filename));
+  fprintf(stderr, "Archive now holds %u measurements of %d stars from %ld nights.\n",
+	  archive.NumRows(), archive.NumStars(), archive.Nights().size());
+  return status;
 }
-	
 
 /****************************************************************/
-/*    ends_with()
-      Used to check to see if a filename ends with a given ending
-      pattern. 
-      */
+/*        ImportReport()                                        */
 /****************************************************************/
-int ends_with(const char *pattern, const char *field) {
-  const int len_field = strlen(field);
-  const int len_pattern = strlen(pattern);
-
-  // return 1 if there is a match
-  return (strcmp(pattern, field + len_field - len_pattern) == 0);
-}
-
-void ProcessCSV(char *home_directory, char *filename) {
-
-  char *full_pathname = (char *) malloc(5 + strlen(home_directory) +
-					strlen(filename));
-  if(!full_pathname) {
-    fprintf(stderr, "Cannot malloc() for ProcessCSV()\n");
-    return;
+int ImportReport(PhotArchive &archive, const char *home_directory) {
+  static const char *report_names[] = { "aavso.report", "aavso.report.txt" };
+  std::string report_path;
+  const char *report_name = 0;
+  for (const char *name : report_names) {
+    struct stat sb;
+    report_path = std::string(home_directory) + "/" + name;
+    if (stat(report_path.c_str(), &sb) == 0) {
+      report_name = name;
+      break;
+    }
+  }
+  if (!report_name) {
+    fprintf(stderr, "smart_add_archive: no AAVSO report in %s\n", home_directory);
+    return -1;
   }
 
-  sprintf(full_pathname, "%s/%s", home_directory, filename);
-
-  FILE *fp = fopen(full_pathname, "r");
-
-  if(!fp) {
-    fprintf(stderr, "Cannot open .csv file named %s\n", full_pathname);
-    return;
+  // The source is the name of the night's directory plus the report
+  // name, e.g., "10-4-2019/aavso.report"
+  char *dir_copy = strdup(home_directory);
+  const std::string source = std::string(basename(dir_copy)) + "/" + report_name;
+  free(dir_copy);
+  if (archive.HasSource(source.c_str())) {
+    fprintf(stderr, "%s is already in the archive.\n", source.c_str());
+    return 0;
   }
 
-  char buffer[128];
-  char field1[64];
-  char field4[64];
+  FILE *fp = fopen(report_path.c_str(), "r");
+  if (!fp) {
+    fprintf(stderr, "Cannot open %s\n", report_path.c_str());
+    return -1;
+  }
 
+  const NightImages night_images(home_directory);
+  std::vector<ArchiveMeasurement> batch;
+  char delim = ',';
+  char buffer[256];
   while(fgets(buffer, sizeof(buffer), fp)) {
-    // Extract two fields: the first is everything up to the first
-    // comma, the second is everything after the third comma.
-    char *s = buffer;
-    char *d = field1;
-
-    while(*s && *s != ',') *d++ = *s++;
-
-    *d = 0;			// terminate field1
-    // verify ended with a comma
-    if(*s != ',') continue;
-
-    s++; // first char in field 2
-    while(*s && *s != ',') s++;
-    // verify field 2 ended with a comma
-    if(*s != ',') continue;
-
-    s++; // first char in field 3
-    while(*s && *s != ',') s++;
-    // verify field 3 ended with a comma
-    if(*s != ',') continue;
-
-    s++; // first char in field 4
-    d = field4;
-    while(*s && *s != ',' && *s != '\n') *d++ = *s++;
-    *d = 0;			// terminate the field.
-
-    // now put field1 into standard form: all lower case, with spaces
-    // turned into hyphens
-    for(s = field1; *s; s++) {
-      if(isupper(*s)) *s = tolower(*s);
-      if(*s == ' ') *s = '-';
+    if (buffer[0] == '#') {
+      if (strncmp(buffer, "#DELIM=", 7) == 0) delim = buffer[7];
+      continue;
     }
-
-    AddInfo(field1, field4);
+    if (buffer[0] == '\n' || buffer[0] == 0) continue;
+
+    int status;
+    ReportFileLine line(buffer, delim, &status);
+    if (status != 0) continue;
+
+    ArchiveMeasurement m;
+    m.star = line.report_name;
+    m.jd = line.jd;
+    m.filter = line.filter;
+    m.mag = line.magnitude;
+    m.err = line.error_estimate;
+    m.airmass = (line.airmass > 0.0 ? line.airmass : 0.0);
+    m.juid = night_images.Lookup(m.jd, m.filter.c_str());
+    batch.push_back(m);
   }
-
   fclose(fp);
-}
-
-/****************************************************************/
-/*    AddInfo(char *star_name, char *observation_time)          */
-/****************************************************************/
-
-void AddInfo(char *name, char *julian_day) {
-  double julian_day_float = atof(julian_day);
-
-  struct obs_summary_entry *new_entry =
-    (obs_summary_entry *) malloc(sizeof(obs_summary_entry));
-
-  new_entry->starname = strdup(name);
-  new_entry->julian_obs_time = julian_day_float;
-  new_entry->next = first_obs_summary;
 
-  first_obs_summary = new_entry;
-
-  fprintf(stderr, "Found entry for %s\n", name);
+  const int added = archive.Add(batch, source.c_str());
+  if (added < 0) return -1;
+  fprintf(stderr, "Added %d measurements from %s\n", added, source.c_str());
+  return 0;
 }
 
 /****************************************************************/
-/*        AddToArchive(obs, filename)                           */
+/*        ImportLegacy()                                        */
+/*    The old archive is a series of blocks:                    */
+/*       T=2454321.6 F=10-4-2007/ss-cyg.phot                    */
+/*       S=ss-cyg MV=11.235 E=0.003 N=3                         */
+/*       ...                                                    */
+/*    There's no filter (all are V) and no airmass.             */
 /****************************************************************/
+int ImportLegacy(PhotArchive &archive, const char *legacy_filename) {
+  FILE *fp = fopen(legacy_filename, "r");
+  if (!fp) {
+    fprintf(stderr, "Cannot open %s\n", legacy_filename);
+    return -1;
+  }
 
-void AddToArchive(obs_summary_entry *obs, char *filename) {
-  fprintf(stderr, "Adding %s at %.1f using %s\n",
-	  obs->starname, obs->julian_obs_time, filename);
-
-  char buffer[128];
+  std::vector<ArchiveMeasurement> batch;
+  std::map<std::string, std::unique_ptr<NightImages>> nights;
+  const NightImages *night_images = nullptr;
+  std::string source;
+  double jd = 0.0;
+  int total = 0;
+  char buffer[256];
+
+  auto flush = [&](void) {
+    if (batch.size() && archive.Add(batch, source.c_str()) > 0) {
+      total += batch.size();
+    }
+    batch.clear();
+  };
 
-  sprintf(buffer, "add_archive -f %s -t %.1f",
-	  filename, obs->julian_obs_time);
-  if(system(buffer) < 0) {
-    fprintf(stderr, "Error: Cannot execute add_archive\n");
+  while(fgets(buffer, sizeof(buffer), fp)) {
+    char word1[128];
+    char word2[128];
+    if (strncmp(buffer, "T=", 2) == 0) {
+      flush();
+      if (sscanf(buffer, "T=%lf F=%127s", &jd, word2) != 2) {
+	fprintf(stderr, "smart_add_archive: bad line: %s", buffer);
+	jd = 0.0;
+	continue;
+      }
+      // several .phot files can share a name across the years, so the
+      // time is part of the source
+      source = std::string("legacy:") + word2 + "@" + std::to_string(jd);
+      // "10-4-2007/ss-cyg.phot" -> /home/IMAGES/10-4-2007
+      const std::string night(word2, strcspn(word2, "/"));
+      auto &n = nights[night];
+      if (!n) n.reset(new NightImages(("/home/IMAGES/" + night).c_str()));
+      night_images = n.get();
+    } else if (strncmp(buffer, "S=", 2) == 0 && jd != 0.0) {
+      double mag, err;
+      if (sscanf(buffer, "S=%127s MV=%lf E=%lf", word1, &mag, &err) != 3) continue;
+      // "ss-cyg" -> "SS CYG" to match the names in AAVSO reports
+      for (char *s = word1; *s; s++) {
+	*s = (*s == '-' ? ' ' : toupper(*s));
+      }
+      ArchiveMeasurement m;
+      m.star = word1;
+      m.jd = jd;
+      m.filter = "V";
+      m.mag = mag;
+      m.err = err;
+      m.airmass = 0.0;
+      m.juid = night_images->Lookup(jd, "V");
+      batch.push_back(m);
+    }
   }
+  flush();
+  fclose(fp);
+  fprintf(stderr, "Converted %d measurements from %s\n", total, legacy_filename);
+  return 0;
 }
@@ -1,7 +1,7 @@
 /*  smart_analyze_archive.cc -- Pulls data out of the archive for
  *  analysis looking for possible variability
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -19,124 +19,169 @@
  */
 #include <string.h>
 #include <stdlib.h>		// exit()
+#include <unistd.h>		// getopt()
 #include <math.h>
 #include <stdio.h>
-#include <ctype.h>
+#include <vector>
+#include <algorithm>		// std::stable_sort()
+#include <phot_archive.h>
+
+// With no options, summarizes every star in the archive (average,
+// brightest, dimmest, sigma, number of observations) into
+// /tmp/analyze.out, flagging stars whose scatter looks like noise
+// rather than variability. Only one filter (V by default) is used.
+//
+// -s star     list that star's light curve on stdout instead
+// -n          list the nights in the archive on stdout instead
+
+void usage(void) {
+  fprintf(stderr,
+	  "usage: smart_analyze_archive [-a archive_dir] [-f filter] [-s star | -n]\n");
+  exit(-2);
+}
 
 struct star_info {
-  star_info *next;
-  char name[32];
-  double sum_mv;
-  double sum_mv_sq;
-  int    num_obs;
-
-  double avg;
-  double sigma;
-  double brightest;
-  double dimmest;
-} *head;
-
-int num_stars = 0;
-
-star_info *
-FindByName(const char *starname) {
-  star_info *p;
-
-  for(p=head; p; p=p->next) {
-    if(strcmp(starname, p->name) == 0) return p;
+  double sum_mv {0.0};
+  double sum_mv_sq {0.0};
+  int    num_obs {0};
+  double brightest {99.0};
+  double dimmest {-99.0};
+};
+
+void PrintLightCurve(PhotArchive &archive, const char *starname) {
+  const int star_id = archive.StarID(starname);
+  if (star_id < 0) {
+    fprintf(stderr, "%s is not in the archive.\n", starname);
+    exit(-2);
   }
+  std::vector<uint32_t> rows;
+  archive.StarRows(star_id, &rows);
+  std::stable_sort(rows.begin(), rows.end(),
+		   [&archive](uint32_t a, uint32_t b) {
+		     return archive.JD(a) < archive.JD(b); });
+  for (uint32_t row : rows) {
+    fprintf(stdout, "%.5lf %-3s %.3f %.3f %.3f %ld\n",
+	    archive.JD(row),
+	    archive.FilterName(archive.Filter(row)),
+	    archive.Mag(row),
+	    archive.Err(row),
+	    archive.Airmass(row),
+	    archive.JUID(row));
+  }
+}
 
-  p = new star_info;
-  p->next = head;
-  head = p;
-  strcpy(p->name, starname);
-  p->sum_mv =
-    p->sum_mv_sq = 0.0;
-  p->brightest = 99.0;
-  p->dimmest   = -99.0;
-  p->num_obs   = 0;
-
-  num_stars++;
-
-  return p;
+void PrintNights(PhotArchive &archive) {
+  for (const ArchiveNight &n : archive.Nights()) {
+    fprintf(stdout, "%.4lf %.4lf %6u %s\n",
+	    n.first_jd, n.last_jd, n.num_rows, n.source.c_str());
+  }
 }
-    
+
 int
 main(int argc, char **argv) {
-  FILE *fp_in = fopen("/usr/local/ASTRO/ARCHIVE/archive.dat", "r");
-  if(!fp_in) {
-    fprintf(stderr, "Cannot open archive file.\n");
+  int ch;
+  const char *archive_directory = PhotArchive::DEFAULT_DIRECTORY;
+  const char *filter = "V";
+  const char *starname = 0;
+  bool list_nights = false;
+
+  while((ch = getopt(argc, argv, "a:f:s:n")) != -1) {
+    switch(ch) {
+    case 'a':
+      archive_directory = optarg;
+      break;
+
+    case 'f':
+      filter = optarg;
+      break;
+
+    case 's':
+      starname = optarg;
+      break;
+
+    case 'n':
+      list_nights = true;
+      break;
+
+    case '?':
+    default:
+      usage();
+    }
+  }
+
+  PhotArchive archive(archive_directory);
+  if (not archive.IsOpen()) {
+    fprintf(stderr, "Cannot open archive %s\n", archive_directory);
     exit(-2);
   }
 
+  if (starname) {
+    PrintLightCurve(archive, starname);
+    return 0;
+  }
+  if (list_nights) {
+    PrintNights(archive);
+    return 0;
+  }
+
   FILE *fp_out = fopen("/tmp/analyze.out", "w");
   if(!fp_out) {
     fprintf(stderr, "Cannot open output file in /tmp\n");
     exit(-2);
   }
 
-  char orig_line[132];
-  int num_obs = 0;
-
-  while(fgets(orig_line, sizeof(orig_line), fp_in)) {
-    if(orig_line[0] != 'S' ||
-       orig_line[1] != '=') continue;
-
-    char *s = orig_line;
-    while(*s != ' ') s++;
-    *s = 0;
-
-    if(*(s+1) != 'M' || *(s+2) != 'V' || *(s+3) != '=' || !isdigit(*(s+4)))
-      continue;
-
-    double mag;
-    sscanf(s+4, "%lf", &mag);
+  const int filter_id = archive.FilterID(filter);
 
+  std::vector<star_info> stars(archive.NumStars());
+  int num_obs = 0;
+  for (uint32_t row = 0; row < archive.NumRows(); row++) {
+    if (archive.Filter(row) != filter_id) continue;
+    const double mag = archive.Mag(row);
     if(mag < 0.0 || mag > 20.0) {
       fprintf(stderr, "err: invalid magnitude of %f for %s\n",
-	      mag, orig_line+2);
+	      mag, archive.StarName(archive.Star(row)));
       continue;
     }
 
-    star_info *star = FindByName(orig_line+2);
-    
+    star_info *star = &stars[archive.Star(row)];
     star->sum_mv += mag;
     star->sum_mv_sq += (mag*mag);
     star->num_obs++;
 
     if(mag < star->brightest) star->brightest = mag;
     if(mag > star->dimmest)   star->dimmest   = mag;
-
-    if((num_obs++ % 1000) == 0)
-      fprintf(stderr, "%d obs so far.\n", num_obs);
+    num_obs++;
   }
 
-  fprintf(stdout, "Processed %d observations on %d different stars.\n",
-	  num_obs, num_stars);
-
-  star_info *star;
+  int num_stars = 0;
+  for (int s = 0; s < archive.NumStars(); s++) {
+    star_info *star = &stars[s];
+    if (star->num_obs == 0) continue;
+    num_stars++;
 
-  for(star=head; star; star=star->next) {
-    star->avg = (star->sum_mv/star->num_obs);
+    const double avg = (star->sum_mv/star->num_obs);
+    double sigma = 0.0;
     if(star->num_obs > 1)
-      star->sigma = sqrt((star->sum_mv_sq - star->num_obs*star->avg*star->avg)/(star->num_obs - 1));
-    else
-      star->sigma = 0.0;
+      sigma = sqrt((star->sum_mv_sq - star->num_obs*avg*avg)/(star->num_obs - 1));
 
     char flag = ' ';
-    if((star->dimmest - star->brightest) < 3*star->sigma &&
+    if((star->dimmest - star->brightest) < 3*sigma &&
        star->num_obs > 15 &&
-       fabs(star->avg - (star->dimmest + star->brightest)/2.0) < 0.2*(star->dimmest - star->brightest)) flag = '&';
+       fabs(avg - (star->dimmest + star->brightest)/2.0) < 0.2*(star->dimmest - star->brightest)) flag = '&';
 
     fprintf(fp_out, "%32s %.3f %.2f %.2f %.3f %d %c\n",
-	    star->name,
-	    star->avg,
+	    archive.StarName(s),
+	    avg,
 	    star->brightest,
 	    star->dimmest,
-	    star->sigma,
+	    sigma,
 	    star->num_obs,
 	    flag);
   }
+  fclose(fp_out);
 
+  fprintf(stdout, "Processed %d observations on %d different stars.\n",
+	  num_obs, num_stars);
   fprintf(stdout, "Answer put into /tmp/analyze.out\n");
+  return 0;
 }
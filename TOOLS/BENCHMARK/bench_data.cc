@@ -0,0 +1,137 @@
+/*  bench_data.cc -- Benchmark catalog (HGSCList) and AstroDB handling
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>		// for unlink()
+#include <sys/stat.h>		// for mkdir()
+#include <string>
+#include <vector>
+#include <HGSC.h>
+#include <astro_db.h>
+#include "bench_setup.h"
+#include "bench_timer.h"
+#include "starfield.h"
+
+int main(int argc, char **argv) {
+  BenchOptions opts;
+  if (ParseBenchOptions(argc, argv, opts)) {
+    fprintf(stderr, "usage: %s [-s size] [-n reps] [-d work_dir]\n", argv[0]);
+    return 2;
+  }
+
+  //****************************************************************
+  //        HGSCList: a dense field, comparable to a deep AAVSO
+  //        chart merged with the HGSC.
+  //****************************************************************
+  StarFieldParams params;
+  params.width = params.height = opts.size;
+  params.num_stars = 5000;
+  params.faintest_mag = 17.0;
+  StarField field(params);
+
+  const std::string catalog_file = opts.work_dir + "/dense.cat";
+  field.WriteCatalog(catalog_file.c_str());
+
+  char extra[64];
+  sprintf(extra, "stars=%d", params.num_stars);
+
+  RunBenchmark("data", "hgsc_read", opts.reps,
+	       [&]() {
+		 FILE *fp = fopen(catalog_file.c_str(), "r");
+		 if (fp) {
+		   HGSCList catalog(fp);
+		   fclose(fp);
+		 }
+	       }, extra);
+
+  {
+    FILE *fp = fopen(catalog_file.c_str(), "r");
+    if (!fp) {
+      fprintf(stderr, "bench_data: cannot reopen %s\n", catalog_file.c_str());
+      return 2;
+    }
+    HGSCList catalog(fp);
+    fclose(fp);
+    // Looking up every star by name is O(n^2), which is what the
+    // analysis tools actually do.
+    RunBenchmark("data", "hgsc_find_by_label", opts.reps,
+		 [&]() {
+		   for (const StarField::TruthStar &t : field.Truth()) {
+		     if (catalog.FindByLabel(t.name) == nullptr) {
+		       fprintf(stderr, "bench_data: %s missing\n", t.name);
+		     }
+		   }
+		 }, extra);
+  }
+
+  //****************************************************************
+  //        AstroDB: one night's worth of exposures
+  //****************************************************************
+  constexpr int NUM_EXPOSURES = 600;
+  const std::string db_dir = opts.work_dir + "/1-1-2024";
+  if (mkdir(db_dir.c_str(), 0777) && errno != EEXIST) {
+    perror("bench_data: cannot create AstroDB directory");
+    return 2;
+  }
+  std::vector<std::string> image_names;
+  for (int i=0; i<NUM_EXPOSURES; i++) {
+    char name[256];
+    sprintf(name, "%s/image%03d.fits", db_dir.c_str(), i);
+    image_names.push_back(std::string(name));
+  }
+
+  sprintf(extra, "exposures=%d", NUM_EXPOSURES);
+  int rep = 0;
+  RunBenchmark("data", "astrodb_add_exposures", opts.reps,
+	       [&]() {
+		 // each repetition starts from an empty file
+		 unlink((db_dir + "/astro_db.json").c_str());
+		 AstroDB db(JSON_READWRITE, db_dir.c_str());
+		 juid_t directive = db.CreateEmptyDirective();
+		 for (int i=0; i<NUM_EXPOSURES; i++) {
+		   db.AddExposure(image_names[i].c_str(),
+				  (i%2 ? "rr-boo" : "sz-her"),
+				  "V",
+				  directive,
+				  JULIAN(2460000.5 + i/1440.0 + rep),
+				  30.0, // exposure time
+				  1.2,  // airmass
+				  "X12345ABC");
+		 }
+		 db.SyncAndRelease();
+		 rep++;
+	       }, extra);
+
+  RunBenchmark("data", "astrodb_load", opts.reps,
+	       [&]() { AstroDB db(JSON_READONLY, db_dir.c_str()); }, extra);
+
+  {
+    AstroDB db(JSON_READONLY, db_dir.c_str());
+    RunBenchmark("data", "astrodb_lookup_exposure", opts.reps,
+		 [&]() {
+		   for (const std::string &name : image_names) {
+		     if (db.LookupExposure(name.c_str()) == 0) {
+		       fprintf(stderr, "bench_data: %s not found\n", name.c_str());
+		     }
+		   }
+		 }, extra);
+  }
+
+  return 0;
+}
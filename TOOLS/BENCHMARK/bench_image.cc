@@ -0,0 +1,122 @@
+/*  bench_image.cc -- Benchmark Image load/save, statistics, median and stack
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <unistd.h>		// for getopt()
+#include <stdlib.h>		// for atoi()
+#include <Image.h>
+#include "../MEDIAN/median_image.h"
+#include "../STACK/image_match.h"
+#include "bench_setup.h"
+#include "bench_timer.h"
+#include "starfield.h"
+
+int main(int argc, char **argv) {
+  BenchOptions opts;
+  if (ParseBenchOptions(argc, argv, opts)) {
+    fprintf(stderr, "usage: %s [-s size] [-n reps] [-d work_dir]\n", argv[0]);
+    return 2;
+  }
+
+  StarFieldParams params;
+  params.width = params.height = opts.size;
+  StarField field(params);
+
+  char size_string[32];
+  sprintf(size_string, "size=%dx%d", opts.size, opts.size);
+
+  const std::string file16 = opts.work_dir + "/field16.fits";
+  const std::string file32 = opts.work_dir + "/field32.fits";
+  const std::string filefloat = opts.work_dir + "/fieldfloat.fits";
+  field.WriteFITS(file16.c_str(), FIELD_16BIT);
+  field.WriteFITS(file32.c_str(), FIELD_32BIT);
+  field.WriteFITS(filefloat.c_str(), FIELD_FLOAT);
+
+  //****************************************************************
+  //        Load and save
+  //****************************************************************
+  RunBenchmark("image", "load_16", opts.reps,
+	       [&]() { Image i(file16.c_str()); }, size_string);
+  RunBenchmark("image", "load_32", opts.reps,
+	       [&]() { Image i(file32.c_str()); }, size_string);
+  RunBenchmark("image", "load_float", opts.reps,
+	       [&]() { Image i(filefloat.c_str()); }, size_string);
+
+  const std::string scratch = opts.work_dir + "/scratch.fits";
+  RunBenchmark("image", "write_16", opts.reps,
+	       [&]() { field.GetImage()->WriteFITS16(scratch.c_str()); },
+	       size_string);
+  RunBenchmark("image", "write_float", opts.reps,
+	       [&]() { field.GetImage()->WriteFITSFloat(scratch.c_str()); },
+	       size_string);
+
+  //****************************************************************
+  //        Statistics
+  //****************************************************************
+  // statistics() caches its result; scale(1.0) is the cheapest way
+  // to invalidate the cache without changing any pixels.
+  Image *image = field.GetImage();
+  RunBenchmark("image", "statistics", opts.reps,
+	       [&]() { image->scale(1.0); (void) image->statistics(); },
+	       size_string);
+  RunBenchmark("image", "histogram", opts.reps,
+	       [&]() { (void) image->HistogramValue(0.5); },
+	       size_string);
+
+  //****************************************************************
+  //        Median (5 images, each drifted by a fraction of a pixel)
+  //****************************************************************
+  constexpr int NUM_MEDIAN = 5;
+  Image *stack[NUM_MEDIAN];
+  for (int i=0; i<NUM_MEDIAN; i++) {
+    stack[i] = field.ShiftedCopy(0.3*i, -0.2*i, params.seed + i + 1);
+  }
+  RunBenchmark("image", "median_5", opts.reps,
+	       [&]() { delete median_image(stack, NUM_MEDIAN, 0); },
+	       size_string);
+  RunBenchmark("image", "median_average_5", opts.reps,
+	       [&]() { delete median_image(stack, NUM_MEDIAN, 1); },
+	       size_string);
+  for (int i=0; i<NUM_MEDIAN; i++) {
+    delete stack[i];
+  }
+
+  //****************************************************************
+  //        Stack alignment: image_match() on two starlists that
+  //        differ by a known offset. The quick name-based match is
+  //        inhibited so that the brute-force comparison is measured.
+  //****************************************************************
+  IStarList *list1 = field.TruthStarList();
+  IStarList *list2 = field.TruthStarList(12.5, -7.25);
+  double del_x = 0.0;
+  double del_y = 0.0;
+  char match_string[64];
+  sprintf(match_string, "stars=%d", list1->NumStars);
+  RunBenchmark("stack", "image_match", opts.reps,
+	       [&]() {
+		 if (image_match(list1, list2, true, 0.0, 0.0, &del_x, &del_y)) {
+		   fprintf(stderr, "bench_image: image_match() failed.\n");
+		 }
+	       }, match_string);
+  fprintf(stderr, "image_match: del_x = %.2lf (12.50), del_y = %.2lf (-7.25)\n",
+	  del_x, del_y);
+  delete list1;
+  delete list2;
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*  bench_scheduler.cc -- Benchmark the genetic-algorithm scheduler
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>		// for system()
+#include <gendefs.h>		// for COMMAND_DIR
+#include "bench_setup.h"
+#include "bench_timer.h"
+
+// The scheduler needs real strategy files for every star it is asked
+// to schedule, so there is no synthetic input for it. The input file
+// is the same file that Schedule::create_schedule() writes for the
+// "scheduler" program (first line "start_jd stop_jd logfile", then
+// one line per ObservingAction). The easiest way to get one is to
+// save a copy of /tmp/schedule.XXXXXX/schedule.in during a real
+// session.
+//
+// Each repetition runs the scheduler exactly the way a session does,
+// so the time includes process startup and reading the strategy
+// files, but is dominated by the genetic algorithm.
+
+int main(int argc, char **argv) {
+  BenchOptions opts;
+  if (ParseBenchOptions(argc, argv, opts)) {
+    fprintf(stderr, "usage: %s -i scheduler_input [-n reps] [-d work_dir]\n", argv[0]);
+    return 2;
+  }
+
+  if (opts.input_file == nullptr) {
+    SkipBenchmark("scheduler", "genetic_algorithm", "no input file (use -i)");
+    return 0;
+  }
+
+  FILE *fp = fopen(opts.input_file, "r");
+  if (!fp) {
+    SkipBenchmark("scheduler", "genetic_algorithm", "cannot open input file");
+    return 0;
+  }
+  int num_actions = -1;		// first line is the header
+  char buffer[256];
+  while(fgets(buffer, sizeof(buffer), fp)) num_actions++;
+  fclose(fp);
+
+  const std::string output_file = opts.work_dir + "/sched_out";
+  char sys_command[512];
+  sprintf(sys_command, COMMAND_DIR "/scheduler %s %s > /dev/null 2>&1",
+	  opts.input_file, output_file.c_str());
+
+  char extra[64];
+  sprintf(extra, "actions=%d", num_actions);
+  RunBenchmark("scheduler", "genetic_algorithm", opts.reps,
+	       [&]() {
+		 if (system(sys_command)) {
+		   fprintf(stderr, "bench_scheduler: %s failed.\n", sys_command);
+		 }
+	       }, extra);
+  return 0;
+}
@@ -0,0 +1,66 @@
+/*  bench_setup.cc -- Command-line handling shared by the benchmark drivers
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>		// for atoi(), mkdtemp()
+#include <unistd.h>		// for getopt()
+#include "bench_setup.h"
+
+int ParseBenchOptions(int argc, char **argv, BenchOptions &opts) {
+  int ch;
+
+  while((ch = getopt(argc, argv, "s:n:d:i:")) != -1) {
+    switch(ch) {
+    case 's':
+      opts.size = atoi(optarg);
+      break;
+
+    case 'n':
+      opts.reps = atoi(optarg);
+      break;
+
+    case 'd':
+      opts.work_dir = std::string(optarg);
+      break;
+
+    case 'i':
+      opts.input_file = optarg;
+      break;
+
+    case '?':
+    default:
+      return 1;
+    }
+  }
+
+  if (opts.size < 64 || opts.reps < 1) {
+    fprintf(stderr, "%s: size must be >= 64 and reps must be >= 1\n", argv[0]);
+    return 1;
+  }
+
+  if (opts.work_dir.empty()) {
+    char dir_template[] = "/tmp/astro_bench.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+      perror("Unable to create benchmark work directory");
+      return 1;
+    }
+    opts.work_dir = std::string(dir_template);
+  }
+  fprintf(stderr, "%s: work directory is %s\n", argv[0], opts.work_dir.c_str());
+  return 0;
+}
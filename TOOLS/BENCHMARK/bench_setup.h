@@ -0,0 +1,38 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  bench_setup.h -- Command-line handling shared by the benchmark drivers
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BENCH_SETUP_H
+#define _BENCH_SETUP_H
+
+#include <string>
+
+struct BenchOptions {
+  int size {2048};		// synthetic images are size x size
+  int reps {5};			// timed repetitions per case
+  std::string work_dir;		// where synthetic files are written
+  const char *input_file {nullptr}; // driver-specific (-i)
+};
+
+// Handles -s size, -n reps, -d work_dir and -i input_file. If no
+// work_dir is given, a fresh directory is created under /tmp. Returns
+// 0 on success, non-zero if the command line was bad or the work
+// directory couldn't be created.
+int ParseBenchOptions(int argc, char **argv, BenchOptions &opts);
+
+#endif
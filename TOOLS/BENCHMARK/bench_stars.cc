@@ -0,0 +1,134 @@
+/*  bench_stars.cc -- Benchmark star finding, photometry and catalog matching
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <vector>
+#include <Image.h>
+#include <IStarList.h>
+#include "../DAOFIND/daofind.h"
+#include "../STAR_MATCH/correlate3.h"
+#include "../STAR_MATCH/aperture_phot.h"
+#include "bench_setup.h"
+#include "bench_timer.h"
+#include "starfield.h"
+
+// correlate() expects this global (normally defined in star_match3.cc)
+Verbosity verbosity = { .residuals = false,
+			.fixups = false,
+			.starlists = false,
+			.catalog = false,
+			.unmatched = false };
+
+// Builds a starlist the same way star_match does before it calls
+// correlate(): daofind, aperture photometry on every star, then mark
+// the 10 brightest as SELECTED.
+static IStarList *PrepareStarlist(Image &image) {
+  IStarList *list = new IStarList;
+  DAOFindStars(image, 10.0, *list);
+  for (int i=0; i < list->NumStars; i++) {
+    aperture_measure(&image, i, list);
+  }
+  list->SortByBrightness();
+  int star_index = (list->NumStars < 10 ? list->NumStars : 10);
+  while(star_index-- > 0) {
+    list->FindByIndex(star_index)->validity_flags |= SELECTED;
+  }
+  return list;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions opts;
+  if (ParseBenchOptions(argc, argv, opts)) {
+    fprintf(stderr, "usage: %s [-s size] [-n reps] [-d work_dir]\n", argv[0]);
+    return 2;
+  }
+
+  StarFieldParams params;
+  params.width = params.height = opts.size;
+  StarField field(params);
+  Image *image = field.GetImage();
+
+  const std::string image_file = opts.work_dir + "/stars.fits";
+  const std::string catalog_file = opts.work_dir + "/stars.cat";
+  field.WriteFITS(image_file.c_str(), FIELD_16BIT);
+  field.WriteCatalog(catalog_file.c_str());
+
+  char extra[64];
+  sprintf(extra, "size=%dx%d truth_stars=%d",
+	  opts.size, opts.size, (int) field.Truth().size());
+
+  //****************************************************************
+  //        DAOFIND
+  //****************************************************************
+  int num_found = 0;
+  RunBenchmark("stars", "find_stars", opts.reps,
+	       [&]() {
+		 IStarList list;
+		 num_found = DAOFindStars(*image, 10.0, list);
+	       }, extra);
+  fprintf(stderr, "find_stars: found %d of %d stars\n",
+	  num_found, (int) field.Truth().size());
+
+  //****************************************************************
+  //        Aperture photometry of every star in the truth list
+  //****************************************************************
+  IStarList *truth_list = field.TruthStarList();
+  RunBenchmark("stars", "photometry", opts.reps,
+	       [&]() {
+		 for (int i=0; i < truth_list->NumStars; i++) {
+		   aperture_measure(image, i, truth_list);
+		 }
+	       }, extra);
+  delete truth_list;
+
+  //****************************************************************
+  //        correlate() against the generator's catalog. correlate()
+  //        marks up the starlist, so each repetition gets its own
+  //        freshly-built list.
+  //****************************************************************
+  std::vector<IStarList *> lists;
+  for (int i=0; i <= opts.reps; i++) {
+    lists.push_back(PrepareStarlist(*image));
+  }
+  unsigned int next_list = 0;
+  int num_solved = 0;
+  RunBenchmark("stars", "correlate", opts.reps,
+	       [&]() {
+		 DEC_RA reference_location = field.GetWCS().Center();
+		 Context context;
+		 context.image_filename = image_file.c_str();
+		 const WCS *wcs = correlate(*image,
+					    lists[next_list++],
+					    catalog_file.c_str(),
+					    &reference_location,
+					    nullptr, // param_filename
+					    nullptr, // residual_filename
+					    context);
+		 if (wcs) {
+		   num_solved++;
+		   delete wcs;
+		 }
+	       }, extra);
+  fprintf(stderr, "correlate: %d of %d solutions succeeded\n",
+	  num_solved, opts.reps+1);
+  for (IStarList *l : lists) {
+    delete l;
+  }
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  bench_timer.h -- Timing harness shared by the benchmark drivers
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BENCH_TIMER_H
+#define _BENCH_TIMER_H
+
+#include <stdio.h>
+#include <time.h>
+#include <functional>
+
+// Every benchmark result is written to stdout as a single line that
+// looks like this:
+//
+// BENCH suite=image case=load_16 reps=5 min_ms=12.301 mean_ms=12.877 max_ms=13.420 size=2048x2048
+//
+// All diagnostic chatter from the library goes to stderr, so stdout
+// of a benchmark driver can be appended directly to a results file
+// and compared run-over-run.
+
+inline double BenchNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000.0 + ts.tv_nsec/1.0e6; // milliseconds
+}
+
+// Runs "body" once untimed (to warm caches) and then "reps" times,
+// timing each repetition. "extra" is appended to the output line and
+// should be a string of space-separated key=value pairs (or empty).
+inline void RunBenchmark(const char *suite,
+			 const char *case_name,
+			 int reps,
+			 const std::function<void(void)> &body,
+			 const char *extra = "") {
+  body();			// warmup
+
+  double min_ms = 9.9e99;
+  double max_ms = 0.0;
+  double sum_ms = 0.0;
+  for (int i=0; i<reps; i++) {
+    const double t0 = BenchNow();
+    body();
+    const double elapsed = BenchNow() - t0;
+    sum_ms += elapsed;
+    if (elapsed < min_ms) min_ms = elapsed;
+    if (elapsed > max_ms) max_ms = elapsed;
+  }
+
+  printf("BENCH suite=%s case=%s reps=%d min_ms=%.3lf mean_ms=%.3lf max_ms=%.3lf%s%s\n",
+	 suite, case_name, reps, min_ms, sum_ms/reps, max_ms,
+	 (*extra ? " " : ""), extra);
+  fflush(stdout);
+}
+
+// Used when something cannot be measured in this environment (for
+// example, no scheduler input file was provided).
+inline void SkipBenchmark(const char *suite,
+			  const char *case_name,
+			  const char *reason) {
+  printf("BENCH suite=%s case=%s skipped=\"%s\"\n", suite, case_name, reason);
+  fflush(stdout);
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*  make_starfield.cc -- Write a synthetic star-field image (and catalog)
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>		// for getopt()
+#include <stdlib.h>		// for atof(), atoi()
+#include "starfield.h"
+
+void usage(void) {
+  fprintf(stderr,
+	  "usage: make_starfield -o image.fits [-c catalog] [-t truth.csv]\n"
+	  "          [-f 16|32|float] [-p gaussian|moffat] [-w fwhm_pixels]\n"
+	  "          [-s size] [-n num_stars] [-b background] [-h num_hot_pixels]\n"
+	  "          [-r rotation_deg] [-S seed] [-u]\n");
+  exit(-2);
+}
+
+int main(int argc, char **argv) {
+  int ch;			// option character
+  const char *image_filename = nullptr;
+  const char *catalog_filename = nullptr;
+  const char *truth_filename = nullptr;
+  FieldFormat format = FIELD_16BIT;
+  bool compress = true;
+  StarFieldParams params;
+
+  while((ch = getopt(argc, argv, "o:c:t:f:p:w:s:n:b:h:r:S:u")) != -1) {
+    switch(ch) {
+    case 'o':
+      image_filename = optarg;
+      break;
+
+    case 'c':
+      catalog_filename = optarg;
+      break;
+
+    case 't':
+      truth_filename = optarg;
+      break;
+
+    case 'f':
+      if (strcmp(optarg, "16") == 0) {
+	format = FIELD_16BIT;
+      } else if (strcmp(optarg, "32") == 0) {
+	format = FIELD_32BIT;
+      } else if (strcmp(optarg, "float") == 0) {
+	format = FIELD_FLOAT;
+      } else {
+	usage();
+      }
+      break;
+
+    case 'p':
+      if (strcmp(optarg, "gaussian") == 0) {
+	params.psf = PSF_GAUSSIAN;
+      } else if (strcmp(optarg, "moffat") == 0) {
+	params.psf = PSF_MOFFAT;
+      } else {
+	usage();
+      }
+      break;
+
+    case 'w':
+      params.fwhm_pixels = atof(optarg);
+      break;
+
+    case 's':
+      params.width = params.height = atoi(optarg);
+      break;
+
+    case 'n':
+      params.num_stars = atoi(optarg);
+      break;
+
+    case 'b':
+      params.background = atof(optarg);
+      break;
+
+    case 'h':
+      params.num_hot_pixels = atoi(optarg);
+      break;
+
+    case 'r':
+      params.rotation = atof(optarg)*M_PI/180.0;
+      break;
+
+    case 'S':
+      params.seed = atoi(optarg);
+      break;
+
+    case 'u':
+      compress = false;
+      break;
+
+    case '?':
+    default:
+      usage();
+    }
+  }
+
+  if (image_filename == nullptr || params.width < 16 || params.fwhm_pixels <= 0.0) {
+    usage();
+  }
+
+  StarField field(params);
+  field.WriteFITS(image_filename, format, compress);
+
+  if (catalog_filename) {
+    field.WriteCatalog(catalog_filename);
+  }
+
+  if (truth_filename) {
+    FILE *fp = fopen(truth_filename, "w");
+    if (!fp) {
+      perror("Cannot create truth file");
+      return 2;
+    }
+    fprintf(fp, "name,x,y,dec,ra,mag,flux\n");
+    for (const StarField::TruthStar &t : field.Truth()) {
+      fprintf(fp, "%s,%.3lf,%.3lf,%.7lf,%.7lf,%.3lf,%.1lf\n",
+	      t.name, t.x, t.y, t.location.dec(), t.location.ra_radians(),
+	      t.mag, t.total_flux);
+    }
+    fclose(fp);
+  }
+  return 0;
+}
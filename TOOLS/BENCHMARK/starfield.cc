@@ -0,0 +1,256 @@
+/*  starfield.cc -- Generate synthetic star-field images with known truth
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>		// strncpy()
+#include <math.h>
+#include <HGSC.h>
+#include <Filter.h>
+#include "starfield.h"
+
+StarField::StarField(const StarFieldParams &params) : p(params) {
+  wcs.SetImageSize(p.width, p.height);
+  wcs.Set(p.center, p.scale_arcsec, p.rotation);
+
+  std::mt19937 rng(p.seed);
+  std::uniform_real_distribution<double> x_dist(0.0, p.width);
+  std::uniform_real_distribution<double> y_dist(0.0, p.height);
+  // Star counts rise steeply toward faint magnitudes; picking the
+  // magnitude from a uniform distribution in 10^(0.3*mag) gives a
+  // realistic mix of a few bright and many faint stars.
+  std::uniform_real_distribution<double> u_dist(pow(10.0, 0.3*p.brightest_mag),
+						pow(10.0, 0.3*p.faintest_mag));
+
+  for (int i=0; i<p.num_stars; i++) {
+    TruthStar t;
+    sprintf(t.name, "T%04d", i);
+    t.x = x_dist(rng);
+    t.y = y_dist(rng);
+    t.location = wcs.Transform(t.x, t.y);
+    t.mag = log10(u_dist(rng))/0.3;
+    t.total_flux = pow(10.0, -0.4*(t.mag - p.zero_point));
+    truth.push_back(t);
+  }
+
+  image = new Image(p.height, p.width);
+  Render(image, 0.0, 0.0, rng);
+  SetHeader(image);
+}
+
+StarField::StarField(const StarFieldParams &params, HGSCList &catalog) :
+  p(params) {
+  wcs.SetImageSize(p.width, p.height);
+  wcs.Set(p.center, p.scale_arcsec, p.rotation);
+
+  // Stars just off the edge still spill some light onto the image
+  const double margin = 4.0*p.fwhm_pixels;
+  std::vector<HGSC *> stars;
+  std::vector<DEC_RA> locations;
+  HGSCIterator it(catalog);
+  for (HGSC *star = it.First(); star; star = it.Next()) {
+    stars.push_back(star);
+    locations.push_back(star->location);
+  }
+  std::vector<double> star_x(stars.size());
+  std::vector<double> star_y(stars.size());
+  wcs.TransformToPixels(stars.size(), locations.data(),
+			star_x.data(), star_y.data());
+
+  for (unsigned int i=0; i<stars.size(); i++) {
+    const HGSC *star = stars[i];
+    TruthStar t;
+    t.location = locations[i];
+    t.x = star_x[i];
+    t.y = star_y[i];
+    if (t.x < -margin || t.y < -margin ||
+	t.x >= p.width+margin || t.y >= p.height+margin) continue;
+    strncpy(t.name, (star->label ? star->label : "?"), sizeof(t.name));
+    t.name[sizeof(t.name)-1] = 0;
+    t.mag = star->magnitude;
+    t.total_flux = pow(10.0, -0.4*(t.mag - p.zero_point));
+    truth.push_back(t);
+  }
+
+  std::mt19937 rng(p.seed);
+  image = new Image(p.height, p.width);
+  Render(image, 0.0, 0.0, rng);
+  SetHeader(image);
+}
+
+StarField::~StarField(void) {
+  delete image;
+}
+
+//****************************************************************
+//        AddStar()
+//   The PSF is sampled on a 3x3 grid within each pixel out to the
+//   radius where it has fallen below 1/1000 of its peak.
+//****************************************************************
+void
+StarField::AddStar(Image *target, double x, double y, double flux) {
+  double alpha = 0.0;
+  double norm;
+  double radius;
+
+  if (p.psf == PSF_MOFFAT) {
+    alpha = p.fwhm_pixels/(2.0*sqrt(pow(2.0, 1.0/p.moffat_beta) - 1.0));
+    norm = (p.moffat_beta - 1.0)/(M_PI*alpha*alpha);
+    radius = alpha*sqrt(pow(1000.0, 1.0/p.moffat_beta) - 1.0);
+  } else {
+    const double sigma = p.fwhm_pixels/2.3548;
+    alpha = 2.0*sigma*sigma;
+    norm = 1.0/(M_PI*alpha);
+    radius = sigma*sqrt(2.0*log(1000.0));
+  }
+
+  const int x0 = (int) floor(x - radius);
+  const int x1 = (int) ceil(x + radius);
+  const int y0 = (int) floor(y - radius);
+  const int y1 = (int) ceil(y + radius);
+  constexpr int SUB = 3;
+
+  for (int row = (y0 < 0 ? 0 : y0); row <= y1 && row < target->height; row++) {
+    for (int col = (x0 < 0 ? 0 : x0); col <= x1 && col < target->width; col++) {
+      double sum = 0.0;
+      for (int j=0; j<SUB; j++) {
+	const double dy = row + (j+0.5)/SUB - y;
+	for (int k=0; k<SUB; k++) {
+	  const double dx = col + (k+0.5)/SUB - x;
+	  const double r_sq = dx*dx + dy*dy;
+	  if (p.psf == PSF_MOFFAT) {
+	    sum += pow(1.0 + r_sq/(alpha*alpha), -p.moffat_beta);
+	  } else {
+	    sum += exp(-r_sq/alpha);
+	  }
+	}
+      }
+      target->pixel(col, row) += flux*norm*sum/(SUB*SUB);
+    }
+  }
+}
+
+void
+StarField::Render(Image *target, double dx, double dy, std::mt19937 &rng) {
+  for (int row=0; row < target->height; row++) {
+    for (int col=0; col < target->width; col++) {
+      target->pixel(col, row) = p.background +
+	p.gradient_x*(col - p.width/2.0) +
+	p.gradient_y*(row - p.height/2.0);
+    }
+  }
+
+  for (const TruthStar &t : truth) {
+    AddStar(target, t.x + dx, t.y + dy, t.total_flux);
+  }
+
+  // shot noise (gaussian approximation to poisson) plus read noise
+  std::normal_distribution<double> unit_normal(0.0, 1.0);
+  for (int row=0; row < target->height; row++) {
+    for (int col=0; col < target->width; col++) {
+      double &v = target->pixel(col, row);
+      const double sigma = sqrt(v/p.egain + p.read_noise*p.read_noise);
+      v += sigma*unit_normal(rng);
+      if (v < 0.0) v = 0.0;
+      if (v > p.saturation) v = p.saturation;
+    }
+  }
+
+  std::uniform_int_distribution<int> hot_x(0, target->width-1);
+  std::uniform_int_distribution<int> hot_y(0, target->height-1);
+  std::uniform_real_distribution<double> hot_value(5000.0, p.saturation);
+  for (int i=0; i<p.num_hot_pixels; i++) {
+    target->pixel(hot_x(rng), hot_y(rng)) = hot_value(rng);
+  }
+}
+
+void
+StarField::SetHeader(Image *target) {
+  ImageInfo *info = target->GetImageInfo();
+  if (info == nullptr) {
+    info = target->CreateImageInfo();
+  }
+  info->SetNominalDecRA(&p.center);
+  info->SetCdelt(p.scale_arcsec, p.scale_arcsec);
+  info->SetRotationAngle(p.rotation);
+  info->SetExposureStartTime(p.exposure_start);
+  info->SetExposureDuration(p.exposure_time);
+  info->SetEGain(p.egain);
+  info->SetDatamax(p.saturation);
+  info->SetFilter(Filter(p.filter));
+  if (p.object) info->SetObject(p.object);
+  if (p.purpose) info->SetPurpose(p.purpose);
+}
+
+Image *
+StarField::ShiftedCopy(double dx, double dy, unsigned int seed) {
+  std::mt19937 rng(seed);
+  Image *result = new Image(p.height, p.width);
+  Render(result, dx, dy, rng);
+  SetHeader(result);
+  return result;
+}
+
+IStarList *
+StarField::TruthStarList(double dx, double dy) const {
+  IStarList *list = new IStarList;
+  for (const TruthStar &t : truth) {
+    const double x = t.x + dx;
+    const double y = t.y + dy;
+    if (x < 0.0 || y < 0.0 || x >= p.width || y >= p.height) continue;
+
+    IStarList::IStarOneStar *s = new IStarList::IStarOneStar;
+    strcpy(s->StarName, t.name);
+    s->nlls_x = x;
+    s->nlls_y = y;
+    s->photometry = t.mag;
+    s->validity_flags = NLLS_FOR_XY;
+    s->info_flags = 0;
+    list->IStarAdd(s);
+  }
+  return list;
+}
+
+void
+StarField::WriteFITS(const char *filename, FieldFormat format, bool compress) {
+  switch(format) {
+  case FIELD_16BIT:
+    image->WriteFITS16(filename, compress);
+    break;
+  case FIELD_32BIT:
+    image->WriteFITS32(filename, compress);
+    break;
+  case FIELD_FLOAT:
+    image->WriteFITSFloat(filename, compress);
+    break;
+  }
+}
+
+void
+StarField::WriteCatalog(const char *filename) const {
+  // HGSCList::Add() links the star itself into the list, so each star
+  // must outlive the list. The list (and its stars) is deliberately
+  // not freed; this is only called once per generated field.
+  HGSCList *catalog = new HGSCList;
+  for (const TruthStar &t : truth) {
+    HGSC *star = new HGSC(t.location.dec(), t.location.ra_radians(),
+			  t.mag, t.name);
+    star->multicolor_data.Add(PHOT_V, t.mag);
+    catalog->Add(*star);
+  }
+  catalog->Write(filename);
+}
@@ -0,0 +1,113 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  starfield.h -- Generate synthetic star-field images with known truth
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _STARFIELD_H
+#define _STARFIELD_H
+
+#include <Image.h>
+#include <IStarList.h>
+#include <wcs.h>
+#include <dec_ra.h>
+#include <HGSC.h>
+#include <vector>
+#include <random>
+
+enum PSF_Shape { PSF_GAUSSIAN, PSF_MOFFAT };
+enum FieldFormat { FIELD_16BIT, FIELD_32BIT, FIELD_FLOAT };
+
+struct StarFieldParams {
+  int width {2048};
+  int height {2048};
+  int num_stars {400};
+  double brightest_mag {9.0};
+  double faintest_mag {15.5};
+  double zero_point {22.0};	// mag that yields 1 ADU total
+  PSF_Shape psf {PSF_MOFFAT};
+  double fwhm_pixels {3.5};
+  double moffat_beta {2.5};
+  double background {1200.0};	// ADU
+  double gradient_x {0.05};	// ADU/pixel, left-to-right
+  double gradient_y {-0.03};	// ADU/pixel, top-to-bottom
+  double read_noise {5.0};	// ADU (rms)
+  double egain {1.0};		// electrons/ADU, for shot noise
+  int num_hot_pixels {200};
+  double saturation {65530.0};
+  DEC_RA center {0.8, 1.2};	// radians
+  double scale_arcsec {1.52};	// arcsec/pixel
+  double rotation {0.0};	// radians
+  double exposure_time {30.0};	// seconds
+  JULIAN exposure_start {2460000.5};
+  unsigned int seed {12345};
+  const char *filter {"V"};
+  const char *object {"synthetic"};	// nullptr: no OBJECT keyword
+  const char *purpose {"BENCHMARK"};	// nullptr: no PURPOSE keyword
+};
+
+// A StarField holds the image, the WCS that was used to place every
+// star, and the "truth" list of where each star was put and how
+// bright it is.
+class StarField {
+public:
+  struct TruthStar {
+    char name[STARNAME_LENGTH];
+    DEC_RA location;
+    double x, y;		// pixel coordinates
+    double mag;
+    double total_flux;		// ADU
+  };
+
+  StarField(const StarFieldParams &params);
+  // Uses the stars of a catalog instead of random ones, placed using
+  // params.center, scale_arcsec, and rotation (num_stars, brightest_mag
+  // and faintest_mag are ignored). Catalog stars that fall outside the
+  // image are skipped.
+  StarField(const StarFieldParams &params, HGSCList &catalog);
+  ~StarField(void);
+
+  Image *GetImage(void) { return image; }
+  const WCS_Simple &GetWCS(void) const { return wcs; }
+  const std::vector<TruthStar> &Truth(void) const { return truth; }
+
+  // A new, independent copy of the image, shifted by (dx, dy) pixels
+  // and re-noised, as if the mount had drifted between
+  // exposures. Caller owns the result.
+  Image *ShiftedCopy(double dx, double dy, unsigned int seed);
+
+  // An IStarList built directly from the truth table (no star finding)
+  IStarList *TruthStarList(double dx = 0.0, double dy = 0.0) const;
+
+  // Write the image as a FITS file in the requested pixel format
+  void WriteFITS(const char *filename, FieldFormat format, bool compress=true);
+
+  // Write the truth as a per-star catalog file in the same text
+  // format as the files in CATALOG_DIR (readable by HGSCList(FILE *)).
+  void WriteCatalog(const char *filename) const;
+
+private:
+  StarFieldParams p;
+  Image *image;
+  WCS_Simple wcs;
+  std::vector<TruthStar> truth;
+
+  void Render(Image *target, double dx, double dy, std::mt19937 &rng);
+  void AddStar(Image *target, double x, double y, double flux);
+  void SetHeader(Image *target);
+};
+
+#endif
@@ -0,0 +1,211 @@
+/*  bvri_night.cc -- Reduces a whole night's BVRI photometry in one pass
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h> 		// for getopt()
+#include <stdlib.h>
+#include <math.h>		// NaN
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <astro_db.h>
+#include <dbase.h>
+#include <bvri_db.h>
+#include "trans_coef.h"
+#include "bvri_solve.h"
+
+// analyze_bvri works from image files, one target per run, and
+// re-reads the transformation coefficients (and the target's catalog)
+// every time. bvri_night instead takes the instrumental magnitudes
+// that have already been recorded in the night's astro_db.json, and
+// reduces every target found there (or just the targets named on the
+// command line) in a single run, sharing one set of transformation
+// coefficients and one open bvri.db.
+
+void usage(void) {
+  fprintf(stderr,
+	  "usage: bvri_night [-t] [-c] [-d /home/IMAGES/date] [targets...]\n");
+  fprintf(stderr, "     -t     Do not apply color transformations\n");
+  fprintf(stderr, "     -c     Create virtual comp star (standard fields)\n");
+  exit(-2);
+}
+
+// One set of instrumental magnitudes (from an image or from a stack)
+struct NightMeasurementSet {
+  JSON_Expression *inst_mags;
+  JSON_Expression *source;	// the "exposures" or "stacks" entry
+};
+
+// Everything for one target, sorted by filter. Measurements from
+// stacks are kept apart from measurements from individual images
+// because a stack already contains those images.
+struct NightTarget {
+  std::list<NightMeasurementSet> from_stacks[NUM_FILTERS];
+  std::list<NightMeasurementSet> from_images[NUM_FILTERS];
+};
+
+int
+main(int argc, char **argv) {
+  int ch;			// option character
+  bool inhibit_transforms = false;
+  bool use_check_for_comp = false;
+  const char *dir_or_date = nullptr; // nullptr means "today"
+
+  // Command line options:
+  // -t                 Inhibit transformations
+  // -c                 No comp: use check stars instead
+  // -d dir             Directory (or date) holding astro_db.json
+
+  while((ch = getopt(argc, argv, "ctd:")) != -1) {
+    switch(ch) {
+    case 'c':
+      use_check_for_comp = true;
+      break;
+
+    case 't':
+      inhibit_transforms = true;
+      break;
+
+    case 'd':
+      dir_or_date = optarg;
+      break;
+
+    case '?':
+    default:
+      usage();
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  std::set<std::string> requested_targets;
+  for (int i=0; i<argc; i++) {
+    requested_targets.insert(argv[i]);
+  }
+
+  AstroDB astro_db(JSON_READONLY, dir_or_date);
+
+  // A single pass through the night's inst_mags sorts all of them by
+  // target and filter.
+  std::map<std::string, NightTarget> targets;
+  for (JSON_Expression *inst_mags : astro_db.FetchAllOfType(DB_INST_MAGS)) {
+    JSON_Expression *source_exp = inst_mags->Value("exposure");
+    if (source_exp == nullptr) continue;
+    const juid_t source_juid = source_exp->Value_int();
+    JSON_Expression *source = astro_db.FindByJUID(source_juid);
+    if (source == nullptr) {
+      fprintf(stderr, "bvri_night: inst_mags refer to missing juid %ld\n",
+	      source_juid);
+      continue;
+    }
+    JSON_Expression *target_exp = source->Value("target");
+    JSON_Expression *filter_exp = source->Value("filter");
+    if (target_exp == nullptr || filter_exp == nullptr) continue;
+
+    const char *target = target_exp->Value_char();
+    if (requested_targets.size() &&
+	requested_targets.count(target) == 0) continue;
+    const int color_index = filter_to_index(Filter(filter_exp->Value_char()));
+    if (color_index < 0) continue; // not a BVRI filter
+
+    NightTarget &t = targets[target];
+    if (GetJUIDType(source_juid) == DB_STACKS) {
+      t.from_stacks[color_index].push_back({inst_mags, source});
+    } else {
+      t.from_images[color_index].push_back({inst_mags, source});
+    }
+  }
+
+  if (targets.size() == 0) {
+    fprintf(stderr, "bvri_night: no BVRI instrumental magnitudes found.\n");
+    exit(-2);
+  }
+
+  TransformationCoefficients tr; // pick up standard tr coefficients
+
+  // All the data will be put into the database for the day
+  char database_name[256];
+  sprintf(database_name, "%s/bvri.db", astro_db.BaseDirectory());
+  BVRI_DB *db = new BVRI_DB(database_name, DBASE_MODE_WRITE);
+
+  fprintf(stderr, "DBASE starts off with %d records.\n",
+	  db->NumRecords());
+
+  int num_reduced = 0;
+  int num_failed = 0;
+  for (auto &t : targets) {
+    const char *target = t.first.c_str();
+
+    HGSCList catalog(target);
+    if (!catalog.NameOK()) {
+      fprintf(stderr, "bvri_night: cannot open catalog file for %s\n",
+	      target);
+      num_failed++;
+      continue;
+    }
+
+    fprintf(stderr, "Reducing %s\n", target);
+    BVRISolver solver(target, catalog);
+
+    for (int c=0; c<NUM_FILTERS; c++) {
+      // Prefer the stacks; fall back to the individual images
+      std::list<NightMeasurementSet> &sets =
+	(t.second.from_stacks[c].size() ?
+	 t.second.from_stacks[c] : t.second.from_images[c]);
+
+      for (NightMeasurementSet &set : sets) {
+	JSON_Expression *filename_exp = set.source->Value("filename");
+	JSON_Expression *jd_exp = set.inst_mags->Value("jd");
+	JSON_Expression *measurements_exp = set.inst_mags->Value("measurements");
+	if (filename_exp == nullptr ||
+	    jd_exp == nullptr ||
+	    measurements_exp == nullptr) continue;
+
+	JSON_Expression *airmass_exp = set.inst_mags->Value("airmass");
+	if (airmass_exp == nullptr) airmass_exp = set.source->Value("airmass");
+
+	AnalysisImage *image =
+	  solver.AddImage(filename_exp->Value_char(),
+			  JULIAN(jd_exp->Value_double()),
+			  (airmass_exp ? airmass_exp->Value_double() : -1.0),
+			  c);
+	for (JSON_Expression *m : measurements_exp->Value_list()) {
+	  JSON_Expression *uncty_exp = m->Value("uncty");
+	  solver.AddMeasurement(image,
+				m->Value("name")->Value_char(),
+				m->Value("imag")->Value_double(),
+				(uncty_exp ? uncty_exp->Value_double() : NAN));
+	}
+      }
+    }
+
+    if (solver.Solve(tr, inhibit_transforms, use_check_for_comp, db)) {
+      num_failed++;
+    } else {
+      num_reduced++;
+    }
+  }
+
+  fprintf(stderr, "bvri_night: %d targets reduced, %d failed.\n",
+	  num_reduced, num_failed);
+  db->Close();
+  return (num_failed ? 1 : 0);
+}
@@ -631,10 +631,8 @@ main(int argc, char **argv) {
     usage();
   }
 
-  char HGSCfilename[132];
-  sprintf(HGSCfilename, CATALOG_DIR "/%s", target_name);
-  FILE *HGSC_fp = fopen(HGSCfilename, "r");
-  if(!HGSC_fp) {
+  HGSCList Catalog(target_name);
+  if(!Catalog.NameOK()) {
     fprintf(stderr, "Cannot open catalog file for %s\n", target_name);
     exit(-2);
   }
@@ -655,8 +653,6 @@ main(int argc, char **argv) {
     fprintf(fp_out, "################################################\n");
   }
 
-  HGSCList Catalog(HGSC_fp);
-
   put_repeat(' ', 40, fp_out);
   fputc('|', fp_out);
   put_repeat(' ', 8, fp_out);
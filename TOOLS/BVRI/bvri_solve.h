@@ -0,0 +1,166 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  bvri_solve.h -- Reduces one target's BVRI photometry into bvri.db
+ *
+ *  Copyright (C) 2016, 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BVRI_SOLVE_H
+#define _BVRI_SOLVE_H
+
+#include <list>
+#include <map>
+#include <julian.h>
+#include <Filter.h>
+#include <HGSC.h>
+#include <bvri_db.h>
+#include "colors.h"
+#include "trans_coef.h"
+
+// Returns one of i_V, i_R, i_I, i_B, or -1 if the filter isn't one of
+// those four
+int filter_to_index(const Filter &f);
+Filter index_to_filter(int f_i);
+PhotometryColor index_to_pc(int index);
+const char *AAVSO_FilterName(const Filter &f);
+
+//****************************************************************
+//   Key structures:
+// AnalysisImage: one of these for each image
+// SingleMeasurement: one for each star in each image
+// EachStar: Exactly one for each catalog star that shows up anywhere
+//           in the collection of images.
+// Measurement: Exactly one for each color of each catalog star
+//****************************************************************
+
+struct SingleMeasurement;	// forward declaration
+
+// one of these for each star for each color
+class Measurement {
+public:
+  Measurement(void);
+  ~Measurement(void) {;}
+
+  JULIAN jd_exposure_midpoint;
+  double instrumental_mag;
+  bool   is_transformed;
+  double magnitude_raw;  // not transformed
+  double magnitude_tr;	 // transformed
+  double magnitude_err;
+  double check_err_rms; // rms of check star errors
+  double stddev;
+  bool   stddev_valid;
+  int    num_exp;
+  double airmass;
+
+  std::list<SingleMeasurement *> datapoints;
+};
+
+// There is one of these for each image being analyzed.
+class AnalysisImage {
+public:
+  JULIAN    jd_exposure_midpoint;
+  const char *image_filename;
+  int       image_index;
+  int       color_index;        // one of i_V, i_R, i_I, i_B
+  double    airmass;
+  std::list<SingleMeasurement *> image_stars;
+  SingleMeasurement *comp_star;	// each image must have exactly one
+				// comp star
+};
+
+// each star in each image gets one of these
+class EachStar {
+public:
+  EachStar(void);
+  ~EachStar(void) {;}
+
+  HGSC                    *hgsc_star;
+  Measurement measurements[NUM_FILTERS];
+  std::list<SingleMeasurement *> data_points[NUM_FILTERS];
+  char                     A_Unique_ID[16];
+  bool                     is_comp;
+  bool                     is_check;
+  int                      is_virtual_check;
+
+  Colors                   color;
+};
+
+struct SingleMeasurement {
+public:
+  AnalysisImage *image;
+  EachStar      *star;
+  double        instrumental_mag;
+  double        magnitude_err;
+};
+
+//****************************************************************
+//        BVRISolver
+// Holds everything known about one target: the images (one or more
+// per filter) and the catalog stars measured in them. Solve() turns
+// that into differential (and, usually, transformed) magnitudes and
+// check-star errors, and stores them in a bvri.db. Nothing here
+// touches image files, so a whole night's worth of targets can be
+// reduced in one process, sharing one set of transformation
+// coefficients.
+//****************************************************************
+class BVRISolver {
+public:
+  BVRISolver(const char *target, HGSCList &catalog);
+  ~BVRISolver(void);
+
+  // airmass < 0.0 if not known
+  AnalysisImage *AddImage(const char *image_filename,
+			  JULIAN midpoint,
+			  double airmass,
+			  int color_index); // one of i_V, i_R, ...
+  // Stars that aren't in the catalog are ignored. magnitude_err is
+  // NAN if not known.
+  void AddMeasurement(AnalysisImage *image,
+		      const char *star_name,
+		      double instrumental_mag,
+		      double magnitude_err);
+
+  int NumImages(void) const { return all_images.size(); }
+
+  // Reduces everything added so far and replaces the target's records
+  // in "db" with the results. If use_check_for_comp is set (standard
+  // fields), the check stars common to all images are averaged into
+  // a virtual comp star. Returns 0 on success, -1 if there is no comp
+  // star.
+  int Solve(const TransformationCoefficients &tr,
+	    bool inhibit_transforms,
+	    bool use_check_for_comp,
+	    BVRI_DB *db);
+
+private:
+  const char *target;
+  HGSCList &catalog;
+  std::map<HGSC *, EachStar *> star_by_catalog_entry;
+
+  std::list<AnalysisImage *> all_images;
+  std::list<EachStar *> all_stars;
+  std::list<SingleMeasurement *> all_measurements; // (for cleanup)
+  int images_per_filter[NUM_FILTERS] {};
+
+  HGSC *comp_hgsc {nullptr};
+  EachStar *comp_eachstar {nullptr};
+  HGSC *virtual_cat_star {nullptr};
+  EachStar *virtual_eachstar {nullptr};
+
+  void CreateVirtualComp(void);
+};
+
+#endif
@@ -504,15 +504,11 @@ main(int argc, char **argv) {
   // structure for each target star and building the star dictionary
 
   TargetStarTable dictionary;
-  char HGSCfilename[132];
-  sprintf(HGSCfilename, CATALOG_DIR "/%s", starname);
-  FILE *HGSC_fp = fopen(HGSCfilename, "r");
-  if(!HGSC_fp) {
+  HGSCList Catalog(starname);
+  if(!Catalog.NameOK()) {
     fprintf(stderr, "Cannot open catalog file for %s\n", starname);
     exit(-2);
   }
-
-  HGSCList Catalog(HGSC_fp);
   
   const int num_recs = db->get_number_records();
   for (int i=0; i < num_recs; i++) {
@@ -77,14 +77,11 @@ main(int argc, char **argv) {
     usage();
   }
   
-  char HGSCfilename[132];
-  sprintf(HGSCfilename, CATALOG_DIR "/%s", starname);
-  FILE *HGSC_fp = fopen(HGSCfilename, "r");
-  if(!HGSC_fp) {
+  HGSCList Catalog(starname);
+  if(!Catalog.NameOK()) {
     fprintf(stderr, "Cannot open catalog file for %s\n", starname);
     exit(-2);
   }
-  HGSCList Catalog(HGSC_fp);
 
   ImageInfo *info = image->GetImageInfo();
 
@@ -3,138 +3,295 @@
 #include <Image.h>
 #include <assert.h>
 #include <stdio.h>
+#include <math.h>
 #include "build_ref_image.h"
-#include "gaussian_blur.h"
 
 //#define FULL_DEBUG
 
-Image *RefImageUnscaled(int width,
-			int height,
-			Model *m,
-			double integrated_flux);
+RefImageRenderer::RefImageRenderer(int image_width,
+				   int image_height,
+				   int image_magnification) :
+  width(image_width), height(image_height),
+  magnification(image_magnification) {
+  x_weights.sigma = y_weights.sigma = -1.0; // force initial calculation
+  x_weights.span = y_weights.span = 0;
+}
 
-// Build a synthetic image. The image is built "magnified" -- later on
-// we will shrink it down to the correct size.
-Image *RefImage(int width, int height, Model *m, double integrated_flux) {
-  const int Magnification = 5;
-
-  Model mag_model = *m; // clone orig model into a "magnified model"
-  mag_model.center_x *= Magnification;
-  mag_model.center_y *= Magnification;
-  mag_model.defocus_width *= Magnification;
-  mag_model.gaussian_sigma *= Magnification;
-  mag_model.collimation_x *= Magnification;
-  mag_model.collimation_y *= Magnification;
-
-  Image *mag_image = RefImageUnscaled(width * Magnification,
-				      height * Magnification,
-				      &mag_model,
-				      integrated_flux);
-
-  // collapse the image by "unmagnifying" it.
+RefImageRenderer::~RefImageRenderer(void) {
+  for (AnnulusProfile *p : profile_cache) {
+    delete p;
+  }
+}
+
+Image *RefImageRenderer::Render(const Model *m, double integrated_flux) {
   Image *result = new Image(height, width);
-  for (int col = 0; col < width; col++) {
-    for (int row = 0; row < height; row++) {
-      double pixel_sum = 0.0;
-      for (int j=0; j < Magnification; j++) {
-	for (int k=0; k < Magnification; k++) {
-	  pixel_sum += mag_image->pixel(col*Magnification+j,
-					row*Magnification+k);
-	}
+  RenderInto(result, m, integrated_flux);
+  return result;
+}
+
+//****************************************************************
+//        GetProfile()
+//   Look for an annulus that matches the model's geometry in the
+//   cache. If none, build one and put it at the front of the cache.
+//****************************************************************
+const RefImageRenderer::AnnulusProfile *
+RefImageRenderer::GetProfile(const Model *m) {
+  for (auto it = profile_cache.begin(); it != profile_cache.end(); it++) {
+    AnnulusProfile *p = *it;
+    if (p->center_x == m->center_x &&
+	p->center_y == m->center_y &&
+	p->defocus_width == m->defocus_width &&
+	p->obstruction_fraction == m->obstruction_fraction &&
+	p->collimation_x == m->collimation_x &&
+	p->collimation_y == m->collimation_y) {
+      profile_hits++;
+      if (it != profile_cache.begin()) {
+	profile_cache.erase(it);
+	profile_cache.push_front(p);
       }
-      result->pixel(col, row) = pixel_sum;
+      return p;
     }
   }
-  delete mag_image;
-  return result;
+
+  AnnulusProfile *p = BuildProfile(m);
+  profile_builds++;
+  profile_cache.push_front(p);
+  if (profile_cache.size() > MAX_CACHED_PROFILES) {
+    delete profile_cache.back();
+    profile_cache.pop_back();
+  }
+  return p;
+}
+
+//****************************************************************
+//        BuildProfile()
+//   Render the unblurred doughnut at "magnification" resolution. The
+//   doughnut is made up of 5 concentric rings; each ring's center is
+//   shifted by a fraction of the collimation error. area_in_circle()
+//   is only invoked for sub-pixels that straddle one of the ring
+//   edges; sub-pixels that are wholly inside or wholly outside a
+//   circle are resolved by distance alone.
+//****************************************************************
+static double ring_overlap(double cx, double cy, double radius,
+			   int x, int y) {
+  // box_bottom is y, box_top is (y+1.0)
+  // box_left is x, box_right is (x+1.0)
+  const double dx_near = (cx < x ? x - cx : (cx > x+1.0 ? cx - (x+1.0) : 0.0));
+  const double dy_near = (cy < y ? y - cy : (cy > y+1.0 ? cy - (y+1.0) : 0.0));
+  const double dx_far = fmax(fabs(cx - x), fabs(cx - (x+1.0)));
+  const double dy_far = fmax(fabs(cy - y), fabs(cy - (y+1.0)));
+  const double radius_sq = radius*radius;
+
+  if (dx_near*dx_near + dy_near*dy_near >= radius_sq) return 0.0;
+  if (dx_far*dx_far + dy_far*dy_far <= radius_sq) return 1.0;
+  return area_in_circle(cx, -cy, radius, -y, -y-1, x, x+1.0);
 }
 
-// Build a doughnut synthetic image made up of 5 concentric rings.
-Image *RefImageUnscaled(int width,
-			int height,
-			Model *m,
-			double integrated_flux) {
+RefImageRenderer::AnnulusProfile *
+RefImageRenderer::BuildProfile(const Model *m) {
   constexpr int num_rings = 5;
-  // constructor of NoGaussian will zero all pixels, guaranteed.
-  Image *NoGaussian = new Image(height, width);
+  AnnulusProfile *p = new AnnulusProfile;
+  p->center_x = m->center_x;
+  p->center_y = m->center_y;
+  p->defocus_width = m->defocus_width;
+  p->obstruction_fraction = m->obstruction_fraction;
+  p->collimation_x = m->collimation_x;
+  p->collimation_y = m->collimation_y;
 
-  // build NoGaussian pixel by pixel; each ring has an outer radius
-  // and an inner radius.
-  const double outer_circle_radius = m->defocus_width;
+  const double mag = magnification;
+  const double outer_circle_radius = m->defocus_width * mag;
   const double inner_circle_radius = outer_circle_radius *
     m->obstruction_fraction;
   const double ring_width = (outer_circle_radius - inner_circle_radius)/num_rings;
-  const double del_col_x = m->collimation_x/num_rings;
-  const double del_col_y = m->collimation_y/num_rings;
-  const double illuminated_area =
+  const double del_col_x = m->collimation_x * mag/num_rings;
+  const double del_col_y = m->collimation_y * mag/num_rings;
+  p->illuminated_area =
     M_PI * (outer_circle_radius*outer_circle_radius -
 	    inner_circle_radius*inner_circle_radius);
-  // intensity in units of ADU per full pixel
-  const double intensity = integrated_flux/illuminated_area;
 
-  #ifdef FULL_DEBUG
-  FILE *d_fp = fopen("/tmp/refimage.txt", "a");
-  fprintf(d_fp, "outer R = %lf, inner R = %lf\n",
-	  outer_circle_radius, inner_circle_radius);
-  fprintf(d_fp, "center @ (%lf, %lf)\n",
-	  m->center_x, -m->center_y);
-  #endif
+  // bounding box of all the rings, clipped to the (magnified) image
+  const double cx0 = m->center_x * mag;
+  const double cy0 = m->center_y * mag;
+  const double cx_last = cx0 + (num_rings-1)*del_col_x;
+  const double cy_last = cy0 + (num_rings-1)*del_col_y;
+  int x0 = (int) floor(fmin(cx0, cx_last) - outer_circle_radius);
+  int y0 = (int) floor(fmin(cy0, cy_last) - outer_circle_radius);
+  int x1 = (int) ceil(fmax(cx0, cx_last) + outer_circle_radius);
+  int y1 = (int) ceil(fmax(cy0, cy_last) + outer_circle_radius);
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 > width*magnification) x1 = width*magnification;
+  if (y1 > height*magnification) y1 = height*magnification;
+  if (x1 <= x0 || y1 <= y0) {
+    // doughnut lies entirely outside the image
+    p->sub_x0 = p->sub_y0 = p->sub_w = p->sub_h = 0;
+    return p;
+  }
+
+  p->sub_x0 = x0;
+  p->sub_y0 = y0;
+  p->sub_w = x1 - x0;
+  p->sub_h = y1 - y0;
+  p->fraction.assign(p->sub_w * p->sub_h, 0.0);
+
+  if (p->illuminated_area <= 0.0) {
+    // degenerate (perfectly focused) star: a point source
+    const int px = (int) cx0;
+    const int py = (int) cy0;
+    if (px >= x0 && px < x1 && py >= y0 && py < y1) {
+      p->fraction[(py - y0)*p->sub_w + (px - x0)] = 1.0;
+    }
+    p->illuminated_area = 1.0;
+    return p;
+  }
 
   for (int ring = 0; ring < num_rings; ring++) {
     const double outer_ring = outer_circle_radius - ring*ring_width;
     const double inner_ring = outer_ring - ring_width;
-    const double center_x = m->center_x+ring*del_col_x;
-    const double center_y = -(m->center_y+ring*del_col_y);
-    //fprintf(stderr, "outer radius = %.3lf, inner = %.3lf, (x,y) = ( %.2lf, %.2lf)\n",
-    //	    outer_ring, inner_ring, center_x, center_y);
-
-    // For each pixel in the image, calculate the area overlap between
-    // that pixel and the current ring (both inner ring edge and outer
-    // ring edge).
-    for (int x = 0; x < width; x++) {
-      for (int y = 0; y < height; y++) {
-	// box_bottom is y, box_top is (y+1.0)
-	// box_left is x, box_right is (x+1.0)
-	double outer_overlap_area = area_in_circle(center_x,
-						   center_y,
-						   outer_ring,
-						   -y,
-						   -y-1,
-						   x,
-						   x+1.0);
-	double inner_overlap_area = area_in_circle(center_x,
-						   center_y,
-						   inner_ring,
-						   -y,
-						   -y-1,
-						   x,
-						   x+1.0);
-#ifdef FULL_DEBUG
-	if (outer_overlap_area != 0.0 || inner_overlap_area != 0.0) {
-	  fprintf(d_fp, "(%d, %d): outer = %lf, inner = %lf\n",
-		  x, y, outer_overlap_area, inner_overlap_area);
-	}
-#endif
+    const double center_x = cx0 + ring*del_col_x;
+    const double center_y = cy0 + ring*del_col_y;
+
+    // only the sub-pixels within this ring's own bounding box can be
+    // touched by the ring
+    const int rx0 = (int) fmax(x0, floor(center_x - outer_ring));
+    const int ry0 = (int) fmax(y0, floor(center_y - outer_ring));
+    const int rx1 = (int) fmin(x1, ceil(center_x + outer_ring));
+    const int ry1 = (int) fmin(y1, ceil(center_y + outer_ring));
+
+    for (int y = ry0; y < ry1; y++) {
+      double *row_fraction = &p->fraction[(y - y0)*p->sub_w];
+      for (int x = rx0; x < rx1; x++) {
+	const double outer_overlap_area = ring_overlap(center_x, center_y,
+						       outer_ring, x, y);
+	if (outer_overlap_area == 0.0) continue;
+	const double inner_overlap_area = ring_overlap(center_x, center_y,
+						       inner_ring, x, y);
+
 	const double illuminated_part = outer_overlap_area - inner_overlap_area;
 	assert(!isnan(illuminated_part));
 	assert(outer_overlap_area <= 1.0 && outer_overlap_area >= 0.0);
 	assert(inner_overlap_area <= 1.0 && inner_overlap_area >= 0.0);
-      
-	// Store the light from this ring into the image
-	NoGaussian->pixel(x, y) += (intensity * illuminated_part);
-	/* printf("(%d,%d)-> [%lf,%lf]\n",
-	   x, y, outer_overlap_area, inner_overlap_area); */
+	// Store the light from this ring into the doughnut
+	row_fraction[x - x0] += illuminated_part;
       }
     }
   }
-  //fprintf(stderr, "\n");
+#ifdef FULL_DEBUG
+  fprintf(stderr, "RefImageRenderer: built doughnut R=%.3lf, r=%.3lf, %dx%d sub-pixels\n",
+	  outer_circle_radius, inner_circle_radius, p->sub_w, p->sub_h);
+#endif
+  return p;
+}
+
+//****************************************************************
+//        UpdateWeights()
+//   Weight of sub-pixel "s" in output pixel "o" is the integral of a
+//   unit gaussian centered on the sub-pixel's center taken across
+//   the output pixel [o, o+1). Recomputed only when sigma changes.
+//****************************************************************
+void
+RefImageRenderer::UpdateWeights(BlurWeights &w, double sigma, int num_out) {
+  if (w.sigma == sigma) return;
 
-  NoGaussian->WriteFITS("/tmp/no_gaussian.fits");
-  // Now apply a gaussian blur to the resulting image.
-  Image *blurred_image = apply_blur(NoGaussian, m->gaussian_sigma);
-  blurred_image->WriteFITS("/tmp/gaussian_blur.fits");
+  const int num_sub = num_out * magnification;
+  const double reach = 4.0 * sigma; // gaussian is negligible beyond 4 sigma
+  w.sigma = sigma;
+  w.span = (int) ceil((1.0 + 2.0*reach) * magnification) + 2;
+  w.first.resize(num_out);
+  w.weight.assign(num_out * w.span, 0.0);
 
-  delete NoGaussian;
-  return blurred_image;
+  const double inv_root2_sigma = (sigma > 0.0 ? 1.0/(M_SQRT2 * sigma) : 0.0);
+
+  for (int o = 0; o < num_out; o++) {
+    const int first = (int) floor((o - reach) * magnification) - 1;
+    w.first[o] = first;
+    double *wt = &w.weight[o * w.span];
+    for (int k = 0; k < w.span; k++) {
+      const int s = first + k;
+      if (s < 0 || s >= num_sub) continue;
+      const double s_center = (s + 0.5)/magnification;
+      if (sigma <= 0.0) {
+	wt[k] = (s_center >= o && s_center < o+1.0) ? 1.0 : 0.0;
+      } else {
+	wt[k] = 0.5*(erf((o + 1.0 - s_center)*inv_root2_sigma) -
+		     erf((o - s_center)*inv_root2_sigma));
+      }
+    }
+  }
+}
+
+//****************************************************************
+//        RenderInto()
+//   Blurring and collapsing are done together as two separable
+//   passes: first each sub-pixel row of the annulus is reduced to
+//   output columns, then groups of sub-pixel rows are reduced to
+//   output rows.
+//****************************************************************
+void
+RefImageRenderer::RenderInto(Image *dest, const Model *m, double integrated_flux) {
+  assert(dest->width == width && dest->height == height);
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      dest->pixel(col, row) = 0.0;
+    }
+  }
+
+  const AnnulusProfile *p = GetProfile(m);
+  if (p->sub_w == 0 || p->sub_h == 0) return;
+
+  UpdateWeights(x_weights, m->gaussian_sigma, width);
+  UpdateWeights(y_weights, m->gaussian_sigma, height);
+
+  const double intensity = integrated_flux/p->illuminated_area;
+
+  // Pass 1: horizontal blur + collapse
+  scratch.assign(p->sub_h * width, 0.0);
+  for (int col = 0; col < width; col++) {
+    const int first = x_weights.first[col];
+    const int s_start = (first > p->sub_x0 ? first : p->sub_x0);
+    const int s_end = (first + x_weights.span < p->sub_x0 + p->sub_w ?
+		       first + x_weights.span : p->sub_x0 + p->sub_w);
+    if (s_start >= s_end) continue;
+    const double *wt = &x_weights.weight[col * x_weights.span];
+
+    for (int sy = 0; sy < p->sub_h; sy++) {
+      const double *frac = &p->fraction[sy * p->sub_w];
+      double sum = 0.0;
+      for (int s = s_start; s < s_end; s++) {
+	sum += frac[s - p->sub_x0] * wt[s - first];
+      }
+      scratch[sy * width + col] = sum;
+    }
+  }
+
+  // Pass 2: vertical blur + collapse
+  for (int row = 0; row < height; row++) {
+    const int first = y_weights.first[row];
+    const int s_start = (first > p->sub_y0 ? first : p->sub_y0);
+    const int s_end = (first + y_weights.span < p->sub_y0 + p->sub_h ?
+		       first + y_weights.span : p->sub_y0 + p->sub_h);
+    if (s_start >= s_end) continue;
+    const double *wt = &y_weights.weight[row * y_weights.span];
+
+    for (int s = s_start; s < s_end; s++) {
+      const double w = wt[s - first] * intensity;
+      if (w == 0.0) continue;
+      const double *src = &scratch[(s - p->sub_y0) * width];
+      for (int col = 0; col < width; col++) {
+	dest->pixel(col, row) += w * src[col];
+      }
+    }
+  }
+}
+
+Image *RefImage(int width, int height, Model *m, double integrated_flux) {
+  static RefImageRenderer *renderer = nullptr;
+
+  if (renderer == nullptr ||
+      renderer->Width() != width || renderer->Height() != height) {
+    delete renderer;
+    renderer = new RefImageRenderer(width, height);
+  }
+  return renderer->Render(m, integrated_flux);
 }
-					   
@@ -2,7 +2,81 @@
 #define _BUILD_REF_IMAGE_H
 
 #include <Image.h>
+#include <list>
+#include <vector>
+#include "model.h"
 
+// RefImageRenderer builds the synthetic (obstructed-aperture +
+// gaussian) reference image for a Model. The unblurred, supersampled
+// doughnut (5 concentric rings, offset by the collimation error) is
+// cached by (center, radius, obstruction, collimation), so a search
+// that only varies the gaussian sigma never re-renders the
+// annulus. The blur is applied analytically: each supersampled
+// sub-pixel is treated as a point source whose gaussian is integrated
+// exactly (via erf()) across each output pixel. This also performs
+// the "collapse" from supersampled pixels to real pixels in the same
+// step. Nothing is written to disk.
+class RefImageRenderer {
+public:
+  RefImageRenderer(int width, int height, int magnification = 5);
+  ~RefImageRenderer(void);
+
+  // Caller owns the returned Image
+  Image *Render(const Model *m, double integrated_flux);
+  // Writes into an existing Image that must be width x height
+  void RenderInto(Image *dest, const Model *m, double integrated_flux);
+
+  int Width(void) const { return width; }
+  int Height(void) const { return height; }
+
+  // Number of annulus profiles that had to be built (vs. found in the
+  // cache). Useful to confirm that a search is hitting the cache.
+  int NumProfileBuilds(void) const { return profile_builds; }
+  int NumProfileHits(void) const { return profile_hits; }
+
+private:
+  const int width;
+  const int height;
+  const int magnification;
+
+  // An unblurred doughnut, stored at "magnification" resolution,
+  // restricted to the bounding box of all of its rings. Values are
+  // the fraction of each sub-pixel that is illuminated (0..1).
+  struct AnnulusProfile {
+    double center_x, center_y; // unmagnified pixel coordinates
+    double defocus_width;
+    double obstruction_fraction;
+    double collimation_x, collimation_y;
+    double illuminated_area;   // in sub-pixels (magnified pixels^2)
+    int sub_x0, sub_y0;	       // origin of the bounding box (sub-pixels)
+    int sub_w, sub_h;	       // size of the bounding box (sub-pixels)
+    std::vector<double> fraction; // sub_w * sub_h, row-major
+  };
+  std::list<AnnulusProfile *> profile_cache; // most-recent first
+  static constexpr unsigned int MAX_CACHED_PROFILES = 16;
+
+  // Blur weights for one sigma: weight[out * span + (sub - first)]
+  struct BlurWeights {
+    double sigma;
+    int span;		     // max number of sub-pixels touching an output pixel
+    std::vector<int> first;  // first sub-pixel index for each output pixel
+    std::vector<double> weight;
+  };
+  BlurWeights x_weights;
+  BlurWeights y_weights;
+
+  std::vector<double> scratch; // partially-blurred rows (sub_h * width)
+
+  int profile_builds {0};
+  int profile_hits {0};
+
+  const AnnulusProfile *GetProfile(const Model *m);
+  AnnulusProfile *BuildProfile(const Model *m);
+  void UpdateWeights(BlurWeights &w, double sigma, int num_out);
+};
+
+// Convenience wrapper (the original interface). Uses a renderer that
+// persists between calls as long as width and height do not change.
 Image *RefImage(int width, int height, Model *m, double integrated_flux);
 
 #endif
@@ -451,6 +451,7 @@ double total_residual(Model *m_init, FocusParams *param, Image *normalized_image
       }
     }
   }
+  delete trial_image;
   const double rms_residual = sqrt(residual_err/residual_count);
   fprintf(stderr, "RMS residual at %.2lf is %.2lf\n",
 	  m_init->defocus_width, rms_residual);
@@ -1,6 +1,6 @@
 /*  cooler.cc -- Program to control the camera cooler
  *
- *  Copyright (C) 2007, 2017 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2017, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -22,6 +22,7 @@
 #include <time.h>		// time()
 #include <algorithm>		// min()
 #include <camera_api.h>
+#include <proc_messages.h>
 
 //
 // Invocation:
@@ -51,6 +52,20 @@ void do_shutdown(void);
 void do_adjust(void);
 void do_hold(void);
 
+// Reads the cooler and broadcasts what it found (see "notify -w cooler")
+static int cooler_data(double *ambient_t, double *ccd_t, double *setpoint_t,
+		       int *power, double *humidity, int *mode) {
+  const int ret = CCD_cooler_data(ambient_t, ccd_t, setpoint_t, power,
+				  humidity, mode);
+  if (ret) {
+    char text[64];
+    sprintf(text, "%.1lf %.1lf %d%%", *ccd_t, *setpoint_t, *power);
+    PublishMessage(SM_TOPIC_COOLER, SM_ID_CoolerStatus,
+		   lround(*ccd_t * 100.0), text);
+  }
+  return ret;
+}
+
 int main(int argc, char **argv) {
   int command = 0;
   bool perform_adjust = true;
@@ -143,7 +158,7 @@ void do_startup(bool perform_adjust) {
   int initial_mode;
   double humidity;
 
-  if(CCD_cooler_data(&ambient_t,
+  if(cooler_data(&ambient_t,
 		     &ccd_t,
 		     &setpoint_t,
 		     &initial_power,
@@ -186,7 +201,7 @@ void do_startup(bool perform_adjust) {
     time_t delta_t = (now - start_time);
     double target_power = std::min(100.0, delta_t*(1.0/15.0)+std::max(20, initial_power));
     int current_power;
-    if(CCD_cooler_data(&ambient_t,
+    if(cooler_data(&ambient_t,
 		       &ccd_t,
 		       &setpoint_t,
 		       &current_power, // range 0..100
@@ -244,7 +259,7 @@ void do_startup(bool perform_adjust) {
     ////////////////////////////////
     //    STEP 3                  //
     ////////////////////////////////
-    if(CCD_cooler_data(&ambient_t,
+    if(cooler_data(&ambient_t,
 		       &ccd_t,
 		       &setpoint_t,
 		       &initial_power,
@@ -277,7 +292,7 @@ void do_shutdown(void) {
   int initial_mode;
   double humidity;
 
-  if(CCD_cooler_data(&ambient_t,
+  if(cooler_data(&ambient_t,
 		     &ccd_t,
 		     &setpoint_t,
 		     &initial_power,
@@ -313,7 +328,7 @@ void do_adjust(void) {
   ////////////////////////////////
   //    STEP 5                  //
   ////////////////////////////////
-  if(CCD_cooler_data(&ambient_t,
+  if(cooler_data(&ambient_t,
 		     &ccd_t,
 		     &setpoint_t,
 		     &initial_power,
@@ -349,7 +364,7 @@ void do_hold(void) {
   ////////////////////////////////
   //    STEP 5                  //
   ////////////////////////////////
-  if(CCD_cooler_data(&ambient_t,
+  if(cooler_data(&ambient_t,
 		     &ccd_t,
 		     &setpoint_t,
 		     &initial_power,
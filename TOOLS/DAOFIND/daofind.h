@@ -0,0 +1,38 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  daofind.h -- Use IRAF's daofind algorithm to locate stars in an image
+ *
+ *  Copyright (C) 2021 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>. 
+ */
+
+#ifndef _DAOFIND_H
+#define _DAOFIND_H
+
+#include <Image.h>
+#include <IStarList.h>
+
+// Find the stars in an image (which should already have had dark
+// subtraction and flat-fielding applied) and append them to
+// "starlist". The threshold is expressed in multiples of the
+// background standard deviation. If convolution_filename is not
+// nullptr, the convolved image is written there (for debugging).
+// Returns the number of stars found.
+int DAOFindStars(Image &image,
+		 double threshold,
+		 IStarList &starlist,
+		 const char *convolution_filename = nullptr);
+
+#endif
@@ -26,10 +26,9 @@
 #include <named_stars.h>
 #include <HGSC.h>
 #include <libgen.h>
-#include <gsl/gsl_vector.h>
-#include <gsl/gsl_matrix.h>
-#include <gsl/gsl_permutation.h>
-#include <gsl/gsl_linalg.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>		// std::fill()
 #include <gendefs.h>
 
 class AnalysisImage {
@@ -54,6 +53,111 @@ public:
   EachStar                *next_star;
 };
 
+struct Measurement {
+  int    star_index;		// index into Eptr[]
+  int    image_index;		// index into ImageArray[]
+  double y;			// instrumental magnitude
+  double w;			// weight (1/sigma^2)
+};
+
+// Used when a star has no photometric error, and as a floor so that
+// a few very bright measurements can't swamp everything else.
+constexpr double DEFAULT_SIGMA = 0.02;
+constexpr double MIN_SIGMA = 0.003;
+
+//****************************************************************
+//        FindConnected()
+//    Only stars and images that can be reached from the reference
+//    star through shared images have a defined solution.
+//****************************************************************
+static void FindConnected(const std::vector<Measurement> &all_meas,
+			  int reference_star,
+			  int num_stars,
+			  int num_images,
+			  std::vector<bool> &star_connected,
+			  std::vector<bool> &image_connected) {
+  star_connected.assign(num_stars, false);
+  image_connected.assign(num_images, false);
+  star_connected[reference_star] = true;
+
+  // Keep sweeping until nothing new is reached. Each sweep is one
+  // trip through the measurements, and the number of sweeps is the
+  // "diameter" of the star/image graph (almost always 2 or 3).
+  bool changed;
+  do {
+    changed = false;
+    for(const Measurement &m : all_meas) {
+      if(star_connected[m.star_index] != image_connected[m.image_index]) {
+	star_connected[m.star_index] = image_connected[m.image_index] = true;
+	changed = true;
+      }
+    }
+  } while(changed);
+}
+
+//****************************************************************
+//        SolveEnsemble()
+//    Alternating weighted least squares. Returns the number of
+//    iterations needed, or -1 if it didn't converge. E[] and Z[] are
+//    adjusted so that E[reference_star] == reference_mag.
+//****************************************************************
+static int SolveEnsemble(const std::vector<Measurement> &all_meas,
+			 const std::vector<bool> &star_connected,
+			 const std::vector<bool> &image_connected,
+			 int reference_star,
+			 double reference_mag,
+			 std::vector<double> &E,
+			 std::vector<double> &Z) {
+  constexpr int MAX_ITERATIONS = 10000;
+  constexpr double TOLERANCE = 1.0e-6; // magnitudes
+
+  const int num_stars = E.size();
+  const int num_images = Z.size();
+  std::vector<double> sum_w(num_stars > num_images ? num_stars : num_images);
+  std::vector<double> sum_wy(sum_w.size());
+
+  for(int iteration = 1; iteration <= MAX_ITERATIONS; iteration++) {
+    double max_change = 0.0;
+
+    // Stars, with the zero points held fixed
+    std::fill(sum_w.begin(), sum_w.end(), 0.0);
+    std::fill(sum_wy.begin(), sum_wy.end(), 0.0);
+    for(const Measurement &m : all_meas) {
+      sum_w[m.star_index] += m.w;
+      sum_wy[m.star_index] += m.w*(m.y - Z[m.image_index]);
+    }
+    for(int s=0; s<num_stars; s++) {
+      if(!star_connected[s] || sum_w[s] == 0.0) continue;
+      const double new_E = sum_wy[s]/sum_w[s];
+      if(fabs(new_E - E[s]) > max_change) max_change = fabs(new_E - E[s]);
+      E[s] = new_E;
+    }
+
+    // Images, with the star magnitudes held fixed
+    std::fill(sum_w.begin(), sum_w.end(), 0.0);
+    std::fill(sum_wy.begin(), sum_wy.end(), 0.0);
+    for(const Measurement &m : all_meas) {
+      sum_w[m.image_index] += m.w;
+      sum_wy[m.image_index] += m.w*(m.y - E[m.star_index]);
+    }
+    for(int n=0; n<num_images; n++) {
+      if(!image_connected[n] || sum_w[n] == 0.0) continue;
+      const double new_Z = sum_wy[n]/sum_w[n];
+      if(fabs(new_Z - Z[n]) > max_change) max_change = fabs(new_Z - Z[n]);
+      Z[n] = new_Z;
+    }
+
+    // The solution is only defined up to a constant that can be moved
+    // between E[] and Z[]; pin it to the reference star.
+    const double offset = reference_mag - E[reference_star];
+    for(int s=0; s<num_stars; s++) E[s] += offset;
+    for(int n=0; n<num_images; n++) Z[n] -= offset;
+
+    if(max_change < TOLERANCE) return iteration;
+  }
+  return -1;
+}
+
 int main(int argc, char **argv) {
   int ch;			// option character
   FILE *fp_out = 0;
@@ -194,7 +298,7 @@ int main(int argc, char **argv) {
 
   // Now go set the "ensemble_star" flag in the EachStar structure for
   // all the stars that are mentioned in the ensemble definition file
-  EachStar *Eptr[total_star_count];
+  std::vector<EachStar *> Eptr;
   double ZeroPointReference = 0.0;
   int ZeroPointIndex = -1;
   int NumberEnsembleStars = 0;
@@ -222,7 +326,7 @@ int main(int argc, char **argv) {
 	  if(strcmp(a_star->hgsc_star->label, one_star_name) == 0) {
 	    if(found == 0) {
 	      found = 1;
-	      Eptr[NumberEnsembleStars] = a_star;
+	      Eptr.push_back(a_star);
 	      if(name_count == 2) {
 		if(ZeroPointIndex != -1) {
 		  fprintf(stderr,
@@ -255,164 +359,96 @@ int main(int argc, char **argv) {
   // counts of interest:
   //    image_count
   //    NumberEnsembleStars
-
-  // Each element of the Q array is either 0 or 1. Q(i,n) is 1 if star
-  // "i" is found in image "n"
-  // Each element of the EN array is a count of the number of images
-  // each ensemble star is found in.
-  // Each element of the ZN array is a count of the number of ensemble
-  // stars found in that image
-  int Q[NumberEnsembleStars][image_count];
-  int EN[NumberEnsembleStars];
-  int ZN[image_count];
-  double Ey[NumberEnsembleStars];
-  double Zy[image_count];
-
-  // zero those two arrays and the matrix
-  {
-    int i, s;
-    for(i=0; i<image_count; i++) {
-      ZN[i] = 0;
-      Zy[i] = 0.0;
-      for(s=0; s<NumberEnsembleStars; s++) {
-	Q[s][i] = 0;
-      }
-    }
-    for(s=0; s<NumberEnsembleStars; s++) {
-      EN[s] = 0;
-      Ey[s] = 0.0;
-    }
-  }
-  
-  EachStar *ref_star;
-  for(ref_star = AnalysisHead; ref_star; ref_star = ref_star->next_star) {
+  //
+  // The model is
+  //
+  //    y(s,n) = E[s] + Z[n]
+  //
+  // for every measurement y of ensemble star s in image n. There is
+  // one unknown per star and one per image, and each measurement
+  // touches only two of them, so instead of building the full
+  // (stars+images)^2 normal matrix, the weighted least-squares
+  // solution is found by alternately solving for all the E[] with the
+  // Z[] held fixed and for all the Z[] with the E[] held fixed. Each
+  // pass costs one trip through the measurements. Weights are
+  // 1/sigma^2 from each star's photometric error.
+
+  std::vector<Measurement> all_meas;
+  for(EachStar *ref_star = AnalysisHead; ref_star; ref_star = ref_star->next_star) {
     if(ref_star->ensemble_star == 0) continue;
-
-    // this is an ensemble star; need to know in which image it
-    // appears and what its index is in the Eptr[] array.
-    int star_index = ref_star->ensemble_star_index;
-    int image_index = ref_star->host_image->image_index;
-
-    Q[star_index][image_index] = 1;
-    ZN[image_index]++;
-    EN[star_index]++;
-    double this_value = ref_star->image_star->photometry;
-    Zy[image_index] += this_value;
-    Ey[star_index] += this_value;
-  }
-
-  {
-    int i, s;
-    for(i=0; i<image_count; i++) {
-      fprintf(stderr, "image %d: ZN[%d]=%d, Zy[%d]=%.3f, y(avg)=%.3f\n",
-	      i, i, ZN[i], i, Zy[i], ZN[i] ? (Zy[i]/ZN[i]) : 0.0);
-    }
-    for(s=0; s<NumberEnsembleStars; s++) {
-      fprintf(stderr, "star %d: EN[%d]=%d, Ey[%d]=%.3f, y(avg)=%.3f\n",
-	      s, s, EN[s], s, Ey[s], EN[s] ? (Ey[s]/EN[s]) : 0.0);
+    Measurement m;
+    m.star_index = ref_star->ensemble_star_index;
+    m.image_index = ref_star->host_image->image_index;
+    m.y = ref_star->image_star->photometry;
+    double sigma = DEFAULT_SIGMA;
+    if(ref_star->image_star->validity_flags & ERROR_VALID) {
+      sigma = ref_star->image_star->magnitude_error;
     }
+    if(sigma < MIN_SIGMA) sigma = MIN_SIGMA;
+    m.w = 1.0/(sigma*sigma);
+    all_meas.push_back(m);
   }
-
-  const int order = image_count + NumberEnsembleStars;
-  gsl_matrix *matrix = gsl_matrix_calloc(order, order);
-  gsl_vector *product = gsl_vector_calloc(order);
-  gsl_permutation *permutation = gsl_permutation_alloc(order);
-
-  if(!matrix) {
-    fprintf(stderr, "ensemble: allocation of matrix failed\n");
-  }
-  if(!product) {
-    fprintf(stderr, "ensemble: allocation of vector failed\n");
-  }
-  if(!permutation) {
-    fprintf(stderr, "ensemble: permutation create failed\n");
-  }
-
-  if(matrix == 0 || product == 0 || permutation == 0) exit(-2);
-
-  int n, i;
-  for(i=0; i<NumberEnsembleStars; i++) {
-    for(n=0; n<image_count; n++) {
-      (*gsl_matrix_ptr(matrix, n, i)) = Q[i][n];
-      (*gsl_matrix_ptr(matrix, image_count + i, NumberEnsembleStars +
-		       n)) = Q[i][n];
+  fprintf(stderr, "%d images, %d ensemble stars, %ld measurements\n",
+	  image_count, NumberEnsembleStars, all_meas.size());
+
+  std::vector<double> E(NumberEnsembleStars, 0.0);
+  std::vector<double> Z(image_count, 0.0);
+  std::vector<bool> star_connected;
+  std::vector<bool> image_connected;
+  FindConnected(all_meas, ZeroPointIndex, NumberEnsembleStars, image_count,
+		star_connected, image_connected);
+  for(int s=0; s<NumberEnsembleStars; s++) {
+    if(!star_connected[s]) {
+      fprintf(stderr, "build_ensemble: %s shares no images with the reference star; skipped\n",
+	      Eptr[s]->hgsc_star->label);
     }
   }
-  for(n=0; n<image_count; n++) {
-    (*gsl_matrix_ptr(matrix, n, NumberEnsembleStars + n)) = ZN[n];
-    (*gsl_vector_ptr(product, n)) = Zy[n];
-  }
-  for(i=0; i<NumberEnsembleStars; i++) {
-    (*gsl_matrix_ptr(matrix, image_count + i, i)) = EN[i];
-    (*gsl_vector_ptr(product, image_count + i)) = Ey[i];
-  }
-
-  int sig_num;
-  if(gsl_linalg_LU_decomp(matrix, permutation, &sig_num)) {
-    fprintf(stderr, "ensemble: gsl_linalg_LU_decomp() failed.\n");
-    exit(-1);
-  }
-
-  if(gsl_linalg_LU_svx(matrix, permutation, product)) {
-    fprintf(stderr, "ensemble: gls_linalg_LU_solve() failed.\n");
-    exit(-1);
-  }
-
-  gsl_matrix_free(matrix);
-  gsl_permutation_free(permutation);
-
-  double E[NumberEnsembleStars];
-  double Z[image_count];
-  double mag_err[NumberEnsembleStars];
-  double mag_err_sq[NumberEnsembleStars];
-  int mag_err_cnt[NumberEnsembleStars];
-
-  for(i=0; i<NumberEnsembleStars; i++) {
-    E[i] = gsl_vector_get(product, i);
-    mag_err[i] = mag_err_sq[i] = 0.0;
-    mag_err_cnt[i] = 0;
-  }
-
-  double zero_offset = ZeroPointReference - E[ZeroPointIndex];
-  for(i=0; i<NumberEnsembleStars; i++) {
-    E[i] += zero_offset;
+  for(int n=0; n<image_count; n++) {
+    if(!image_connected[n]) {
+      fprintf(stderr, "build_ensemble: %s has no connection to the reference star; skipped\n",
+	      ImageArray[n].image_filename);
+    }
   }
 
-  for(i=0; i<image_count; i++) {
-    Z[i] = gsl_vector_get(product, i+NumberEnsembleStars);
+  const int iterations = SolveEnsemble(all_meas, star_connected, image_connected,
+				       ZeroPointIndex, ZeroPointReference, E, Z);
+  if(iterations < 0) {
+    fprintf(stderr, "ensemble: solution did not converge.\n");
+  } else {
+    fprintf(stderr, "ensemble: converged after %d iterations.\n", iterations);
   }
 
-  for(ref_star = AnalysisHead; ref_star; ref_star = ref_star->next_star) {
-    if(ref_star->ensemble_star == 0) continue;
-
-    // this is an ensemble star; need to know in which image it
-    // appears and what its index is in the Eptr[] array.
-    int star_index = ref_star->ensemble_star_index;
-    int image_index = ref_star->host_image->image_index;
-
-    double this_value = ref_star->image_star->photometry;
-
-    double err = this_value + zero_offset - Z[image_index] - E[star_index];
-    fprintf(stderr, "star %d image %d: meas = %.3f ref = %.3f, err=%.3f\n",
-	    star_index, image_index,
-	    this_value+zero_offset-Z[image_index], E[star_index], err);
-    mag_err[star_index] += err;
-    mag_err_sq[star_index] += (err*err);
-    mag_err_cnt[star_index]++;
+  // Per-star residual statistics
+  std::vector<int> res_cnt(NumberEnsembleStars, 0);
+  std::vector<double> res_sum(NumberEnsembleStars, 0.0);
+  std::vector<double> res_sumsq(NumberEnsembleStars, 0.0);
+  std::vector<double> res_chisq(NumberEnsembleStars, 0.0);
+  for(const Measurement &m : all_meas) {
+    if(!star_connected[m.star_index]) continue;
+    const double err = m.y - Z[m.image_index] - E[m.star_index];
+    res_cnt[m.star_index]++;
+    res_sum[m.star_index] += err;
+    res_sumsq[m.star_index] += (err*err);
+    res_chisq[m.star_index] += (err*err)*m.w;
   }
 
-  for(i=0; i<NumberEnsembleStars; i++) {
+  for(int i=0; i<NumberEnsembleStars; i++) {
+    if(!star_connected[i]) continue;
+    const int cnt = res_cnt[i];
+    const double mean = (cnt ? res_sum[i]/cnt : 0.0);
     double sigma = 0.0;
-    if(mag_err_cnt[i] > 1) {
-      double measure = mag_err[i]/mag_err_cnt[i];
-      sigma = sqrt((mag_err_sq[i] - mag_err[i]*measure*measure)/
-		   (mag_err_cnt[i] - 1));
+    if(cnt > 1) {
+      sigma = sqrt((res_sumsq[i] - cnt*mean*mean)/(cnt - 1));
     }
-    fprintf(stderr, "E[%d] (%s) = %.3f (std=%.3f)\n", i,
-	    Eptr[i]->hgsc_star->label, E[i], sigma);
+    const double chisq_per_point = (cnt ? res_chisq[i]/cnt : 0.0);
+    fprintf(stderr, "E[%d] (%s) = %.3f (std=%.3f, n=%d, mean resid=%.4f, chisq/n=%.2f)\n",
+	    i, Eptr[i]->hgsc_star->label, E[i], sigma, cnt, mean, chisq_per_point);
+    fprintf(fp_out, "# star %s mag %.3f std %.3f n %d chisq/n %.2f\n",
+	    Eptr[i]->hgsc_star->label, E[i], sigma, cnt, chisq_per_point);
   }
     
-  for(i=0; i<image_count; i++) {
+  for(int i=0; i<image_count; i++) {
+    if(!image_connected[i]) continue;
     fprintf(stderr, "Z[%d] (%s) = %.3f\n", i,
 	    ImageArray[i].image_filename, Z[i]);
   }
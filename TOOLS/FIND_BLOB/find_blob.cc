@@ -20,42 +20,243 @@
 #include "Image.h"
 #include <unistd.h>		// getopt()
 #include <stdio.h>
-#include <list>
+#include <stdlib.h>		// atoi()
+#include <math.h>
+#include <vector>
+#include <thread>
+
+// Blobs are the 8-connected groups of pixels above the threshold. The
+// image is labelled in one pass, one row at a time, using union-find;
+// only the current and previous rows' labels are kept. Each label
+// accumulates its blob's flux, moments and bounding box as pixels are
+// added. The image is split into bands of rows, one band per thread,
+// and the bands are stitched together afterwards by comparing the
+// last row of each band with the first row of the next.
 
 struct Blob {
-  double center_row;
-  double center_column;
-  double pixel_radius; // 0.0 means just a row hit
-  double total_flux;
-  bool eaten_already;
-  bool PointIsInsideBlob(double row, double column);
-  bool BlobIsValid(void);
+  int    num_pixels {0};
+  double total_flux {0.0};	// above the median
+  double sum_x {0.0};		// flux-weighted moments
+  double sum_y {0.0};
+  double sum_xx {0.0};
+  double sum_yy {0.0};
+  int    col_min {0};
+  int    col_max {0};
+  int    row_min {0};
+  int    row_max {0};
+
+  // filled in by Finish()
+  double center_row {0.0};
+  double center_column {0.0};
+  double pixel_radius {0.0};
+  double rms_radius {0.0};	// flux-weighted
+
+  void AddPixel(int col, int row, double net_flux);
+  void Merge(const Blob &other);
+  void Finish(void);
+  bool BlobIsValid(const Image *image) const;
 };
 
-bool
-Blob::PointIsInsideBlob(double row, double column) {
-  const double delta_row = center_row - row;
-  const double delta_col = center_column - column;
+void
+Blob::AddPixel(int col, int row, double net_flux) {
+  if (num_pixels == 0) {
+    col_min = col_max = col;
+    row_min = row_max = row;
+  } else {
+    if (col < col_min) col_min = col;
+    if (col > col_max) col_max = col;
+    if (row < row_min) row_min = row;
+    if (row > row_max) row_max = row;
+  }
+  num_pixels++;
+  total_flux += net_flux;
+  sum_x += col*net_flux;
+  sum_y += row*net_flux;
+  sum_xx += col*col*net_flux;
+  sum_yy += row*row*net_flux;
+}
 
-  return (pixel_radius*pixel_radius >=
-	  delta_row*delta_row + delta_col*delta_col);
+void
+Blob::Merge(const Blob &other) {
+  if (other.num_pixels == 0) return;
+  if (num_pixels == 0) {
+    *this = other;
+    return;
+  }
+  if (other.col_min < col_min) col_min = other.col_min;
+  if (other.col_max > col_max) col_max = other.col_max;
+  if (other.row_min < row_min) row_min = other.row_min;
+  if (other.row_max > row_max) row_max = other.row_max;
+  num_pixels += other.num_pixels;
+  total_flux += other.total_flux;
+  sum_x += other.sum_x;
+  sum_y += other.sum_y;
+  sum_xx += other.sum_xx;
+  sum_yy += other.sum_yy;
+}
+
+void
+Blob::Finish(void) {
+  center_column = sum_x/total_flux;
+  center_row    = sum_y/total_flux;
+  // half the larger side of the bounding box, never less than one pixel
+  const int span = ((col_max - col_min) > (row_max - row_min) ?
+		    (col_max - col_min) : (row_max - row_min));
+  pixel_radius = (span+1)/2.0;
+  const double var = (sum_xx/total_flux - center_column*center_column +
+		      sum_yy/total_flux - center_row*center_row);
+  rms_radius = (var > 0.0 ? sqrt(var) : 0.0);
 }
 
 bool
-Blob::BlobIsValid(void) {
+Blob::BlobIsValid(const Image *image) const {
   int avg_flux = total_flux/(pixel_radius*pixel_radius);
   return (pixel_radius < 30.0 &&
 	  total_flux > 10000.0 &&
 	  avg_flux > 100.0 &&
 	  center_row > 5.0 &&
 	  center_column > 5.0 &&
-	  center_row < 505.0 &&
-	  center_column < 505.0);
+	  center_row < image->height - 7.0 &&
+	  center_column < image->width - 7.0);
+}
+
+//****************************************************************
+//        Union-find over blob labels
+//****************************************************************
+static int FindRoot(std::vector<int> &parent, int label) {
+  int root = label;
+  while (parent[root] != root) root = parent[root];
+  // path compression
+  while (parent[label] != root) {
+    const int next = parent[label];
+    parent[label] = root;
+    label = next;
+  }
+  return root;
+}
+
+static void Union(std::vector<int> &parent, int a, int b) {
+  a = FindRoot(parent, a);
+  b = FindRoot(parent, b);
+  if (a < b) parent[b] = a;
+  else if (b < a) parent[a] = b;
+}
+
+// Everything one thread produces for its band of rows. Labels are
+// local to the band; 0 means "background".
+struct Band {
+  int row_start;
+  int row_end;			// one past the last row
+  std::vector<int> parent;	// parent[0] unused
+  std::vector<Blob> blobs;	// indexed by label
+  std::vector<int> first_row;	// labels of row_start
+  std::vector<int> last_row;	// labels of row_end-1
+};
+
+static void LabelBand(const Image *image,
+		      double threshold,
+		      double median,
+		      Band *band) {
+  const int width = image->width;
+  std::vector<int> prev(width, 0);
+  std::vector<int> curr(width, 0);
+  band->parent.assign(1, 0);
+  band->blobs.assign(1, Blob());
+
+  for (int row = band->row_start; row < band->row_end; row++) {
+    const bool first = (row == band->row_start);
+    for (int col = 0; col < width; col++) {
+      const double value = image->pixel(col, row);
+      if (value <= threshold) {
+	curr[col] = 0;
+	continue;
+      }
+      // neighbors already visited: W, NW, N, NE
+      int label = (col > 0 ? curr[col-1] : 0);
+      if (!first) {
+	const int neighbors[3] = { (col > 0 ? prev[col-1] : 0),
+				   prev[col],
+				   (col+1 < width ? prev[col+1] : 0) };
+	for (int n : neighbors) {
+	  if (n == 0) continue;
+	  if (label == 0) label = n;
+	  else if (n != label) Union(band->parent, label, n);
+	}
+      }
+      if (label == 0) {
+	label = band->parent.size();
+	band->parent.push_back(label);
+	band->blobs.push_back(Blob());
+      }
+      curr[col] = label;
+      band->blobs[label].AddPixel(col, row, value - median);
+    }
+    if (first) band->first_row = curr;
+    std::swap(prev, curr);
+  }
+  band->last_row = prev;
+}
+
+static std::vector<Blob> FindBlobs(const Image *image,
+				   double threshold,
+				   double median,
+				   int num_threads) {
+  if (num_threads < 1) num_threads = 1;
+  if (num_threads > image->height) num_threads = image->height;
+
+  std::vector<Band> bands(num_threads);
+  std::vector<std::thread> threads;
+  for (int i=0; i<num_threads; i++) {
+    bands[i].row_start = (image->height*i)/num_threads;
+    bands[i].row_end = (image->height*(i+1))/num_threads;
+    threads.emplace_back(LabelBand, image, threshold, median, &bands[i]);
+  }
+  for (std::thread &t : threads) t.join();
+
+  // Combine the bands' labels into one label space
+  std::vector<int> offset(num_threads);
+  std::vector<int> parent;
+  std::vector<Blob> blobs;
+  for (int i=0; i<num_threads; i++) {
+    offset[i] = parent.size();
+    for (unsigned int l=0; l<bands[i].parent.size(); l++) {
+      parent.push_back(offset[i] + bands[i].parent[l]);
+    }
+    blobs.insert(blobs.end(), bands[i].blobs.begin(), bands[i].blobs.end());
+  }
+
+  // Stitch each band to the one above it
+  const int width = image->width;
+  for (int i=1; i<num_threads; i++) {
+    const std::vector<int> &upper = bands[i-1].last_row;
+    const std::vector<int> &lower = bands[i].first_row;
+    for (int col = 0; col < width; col++) {
+      if (lower[col] == 0) continue;
+      for (int c = col-1; c <= col+1; c++) {
+	if (c < 0 || c >= width || upper[c] == 0) continue;
+	Union(parent, offset[i] + lower[col], offset[i-1] + upper[c]);
+      }
+    }
+  }
+
+  // Fold every label's totals into its root
+  std::vector<Blob> results;
+  for (unsigned int l=0; l<parent.size(); l++) {
+    const int root = FindRoot(parent, l);
+    if (root != (int) l) blobs[root].Merge(blobs[l]);
+  }
+  for (unsigned int l=0; l<parent.size(); l++) {
+    // label 0 of each band is background
+    if (parent[l] != (int) l || blobs[l].num_pixels == 0) continue;
+    results.push_back(blobs[l]);
+    results.back().Finish();
+  }
+  return results;
 }
 
 void usage(void) {
   fprintf(stderr,
-	  "Usage: find_blob [-d dark.fits] [-s flat.fits] -i image.fits\n");
+	  "Usage: find_blob [-d dark.fits] [-s flat.fits] [-t threads] -i image.fits\n");
   exit(-2);
 }
 
@@ -66,9 +267,14 @@ int main(int argc, char **argv) {
   int num_darks = 0;
   Image *flat = 0;
   char *image_filename = 0;
+  int num_threads = std::thread::hardware_concurrency();
 
-  while((option_char = getopt(argc, argv, "i:d:s:")) > 0) {
+  while((option_char = getopt(argc, argv, "i:d:s:t:")) > 0) {
     switch (option_char) {
+    case 't':			// number of threads
+      num_threads = atoi(optarg);
+      break;
+
     case 's':			// scale image (flat field)
       flat = new Image(optarg);
       if(!flat) {
@@ -134,142 +340,28 @@ int main(int argc, char **argv) {
   fprintf(stderr, "Median pixel = %lf, StdDev = %lf, threshold = %lf\n",
 	  stats->MedianPixel, stats->StdDev, threshold);
 
-  std::list <Blob *> all_blobs;
-
-  for (int row = 0; row < image->height; row++) {
-    int start_blob = -1;
-    double flux_sum;
-    int end_blob;
-    for (int column = 0; column < image->width; column++) {
-      if (image->pixel(column, row) > threshold) {
-	if (start_blob < 0) {
-	  // starting new blob
-	  start_blob = end_blob = column;
-	  flux_sum = (image->pixel(column, row) - stats->MedianPixel);
-	} else {
-	  // adding to blob
-	  end_blob = column;
-	  flux_sum += (image->pixel(column, row) - stats->MedianPixel);
-	}
-      } else {
-	if (start_blob >= 0) {
-	  if (end_blob - start_blob >= 2) {
-	    // this ends a blob
-	    Blob *b = new Blob;
-	    b->center_row = row;
-	    b->center_column = (end_blob + start_blob)/2.0;
-	    b->pixel_radius = 0.0;
-	    b->total_flux = flux_sum;
-	    b->eaten_already = false;
-	    all_blobs.push_back(b);
-	    fprintf(stderr, "blob in row %d running from col %d through %d\n",
-		    row, start_blob, end_blob);
-	  } 
-	  // lone hot pixel
-	  start_blob = -1;
-	}
-      }
-    }
-  }
+  std::vector<Blob> all_blobs = FindBlobs(image, threshold,
+					   stats->MedianPixel, num_threads);
 
   fprintf(stderr, "Total of %ld raw blobs found\n", all_blobs.size());
-
-  std::list<Blob *>::iterator it;
-  for (it = all_blobs.begin(); it != all_blobs.end(); it++) {
-    Blob *b = (*it);
-    if (b->eaten_already) continue;
-    const double delta_radius = 2.0;
-    b->total_flux = 0.0;
-
-    double prior_flux;
-    do {
-      prior_flux = b->total_flux;
-
-      b->total_flux = 0;
-      double x_moment = 0.0;
-      double y_moment = 0.0;
-      b->pixel_radius += delta_radius;
-      const double r_sq = b->pixel_radius*b->pixel_radius;
-
-      int col_start = (int) (b->center_column - b->pixel_radius);
-      if (col_start < 0) col_start = 0;
-
-      int col_end = (int) (b->center_column + b->pixel_radius + 0.99);
-      if (col_end >= image->width) col_end = image->width-1;
-
-      int row_start = (int) (b->center_row - b->pixel_radius);
-      if (row_start < 0) row_start = 0;
-
-      int row_end = (int) (b->center_row + b->pixel_radius + 0.99);
-      if (row_end >= image->height) row_end = image->height-1;
-
-      for (int col = col_start; col <= col_end; col++) {
-	const double offset_x = col - b->center_column;
-	for (int row = row_start; row <= row_end; row++) {
-	  const double offset_y = row - b->center_row;
-
-	  // ignore the point if too far away
-	  if (offset_x*offset_x + offset_y*offset_y > r_sq) continue;
-
-	  const double net_flux = image->pixel(col, row) - stats->MedianPixel;
-	  b->total_flux += net_flux;
-	  x_moment += offset_x*net_flux;
-	  y_moment += offset_y*net_flux;
-	}
-      }
-      // recalculate center
-      b->center_column += x_moment/b->total_flux;
-      b->center_row    += y_moment/b->total_flux;
-    } while(prior_flux < b->total_flux*0.95);
-
-    bool invalid = !b->BlobIsValid();
-    
-    fprintf(stderr, "blob center at (%.1lf, %.1lf), flux = %lf, radius = %d%s\n",
-	    b->center_column, b->center_row,
-	    b->total_flux,
-	    (int) (b->pixel_radius + 0.5),
-	    (invalid ? " **INVALID**" : ""));
-
-    if (invalid) continue;
-    
-    std::list<Blob *>::iterator it0;
-    for (it0 = all_blobs.begin(); it0 != all_blobs.end(); it0++) {
-      Blob *bb = (*it0);
-      if (b == bb || bb->eaten_already) continue;
-      if (b->PointIsInsideBlob(bb->center_row, bb->center_column)) {
-	bb->eaten_already = true;
-      }
-    }
-  }
   fprintf(stderr, "------------------- final list --------------\n");
-  int row_min = 9999;
-  int row_max = 0;
-  int col_min = 9999;
-  int col_max = 0;
-  Blob *best_blob = 0;
+  const Blob *best_blob = 0;
   double best_flux = 0.0;
   
-  for (it = all_blobs.begin(); it != all_blobs.end(); it++) {
-    Blob *b = (*it);
-    if (b->eaten_already) continue;
-    if (!b->BlobIsValid()) continue;
-    int x_min = b->center_column - b->pixel_radius;
-    int x_max = b->center_column + b->pixel_radius;
-    int y_min = b->center_row - b->pixel_radius;
-    int y_max = b->center_row + b->pixel_radius;
-
-    if (x_min < col_min) col_min = x_min;
-    if (x_max > col_max) col_max = x_max;
-    if (y_min < row_min) row_min = y_min;
-    if (y_max > row_max) row_max = y_max;
-    
-    fprintf(stderr, "blob center at (%.1lf, %.1lf), flux = %lf, radius = %d\n",
-	    b->center_column, b->center_row,
-	    b->total_flux,
-	    (int) (b->pixel_radius + 0.5));
-    if (b->total_flux > best_flux) {
-      best_flux = b->total_flux;
-      best_blob = b;
+  for (const Blob &b : all_blobs) {
+    // a lone hot pixel (or two) isn't a blob
+    if (b.num_pixels < 3) continue;
+    if (!b.BlobIsValid(image)) continue;
+
+    fprintf(stderr, "blob center at (%.1lf, %.1lf), flux = %lf, radius = %d, rms radius = %.1lf, pixels = %d\n",
+	    b.center_column, b.center_row,
+	    b.total_flux,
+	    (int) (b.pixel_radius + 0.5),
+	    b.rms_radius,
+	    b.num_pixels);
+    if (b.total_flux > best_flux) {
+      best_flux = b.total_flux;
+      best_blob = &b;
     }
   }
 
@@ -280,25 +372,4 @@ int main(int argc, char **argv) {
   } else {
     fprintf(stdout, "INVALID\n");
   }
-
-#if 0
-  FILE *fp_csv = fopen("/tmp/blob.csv", "w");
-  if (row_min < 0) row_min = 0;
-  if (row_max >= image->height) row_max = image->height-1;
-  if (col_min < 0) col_min = 0;
-  if (col_max >= image->width) col_max = image->width-1;
-
-
-  for (int col = col_min; col <= col_max; col++) {
-    fprintf(fp_csv, ",%d", col);
-  }
-  for (int row = row_min; row <= row_max; row++) {
-    fprintf(fp_csv, "\n%d", row);
-    for (int col = col_min; col <= col_max; col++) {
-      fprintf(fp_csv, ",%d", (int) (0.5+image->pixel(col, row)));
-    }
-  }
-  fprintf(fp_csv, "\n");
-  fclose(fp_csv);
-#endif
 }
@@ -128,8 +128,7 @@ Image *find_focus_star(bool no_auto_find,
 
   // we have a valid star. Search for it.
   MoveTo(&star->location, 0 /*don't encourage flip*/);
-  WaitForGoToDone();
-  sleep(30); // wait for mount to stabilize
+  WaitForGoToDone();		// (includes waiting for the mount to settle)
 
   if (no_auto_find) return 0;
 
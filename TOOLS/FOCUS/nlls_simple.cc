@@ -85,12 +85,20 @@ focus_state::focus_state(void) {
 }
 
 int
-nlls(Image *primary_image, focus_state *fs) {
+nlls(Image *primary_image, focus_state *fs, int box_width) {
   int quit;
   int star_id = primary_image->LargestStar();
   if(star_id < 0) return -1;
 
-  const int BoxWidth = 10;
+  const int BoxWidth = box_width;
+  {
+    IStarList *sl = primary_image->GetIStarList();
+    const int left_edge = (int) (sl->StarCenterX(star_id) - BoxWidth/2 + 0.5);
+    const int top_edge  = (int) (sl->StarCenterY(star_id) - BoxWidth/2 + 0.5);
+    if(left_edge < 0 || top_edge < 0 ||
+       left_edge + BoxWidth > primary_image->width ||
+       top_edge + BoxWidth > primary_image->height) return -1;
+  }
 
   obs_data *od = new obs_data;
 
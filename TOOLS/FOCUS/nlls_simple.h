@@ -17,6 +17,11 @@
  *   along with this program (file: COPYING).  If not, see
  *   <http://www.gnu.org/licenses/>. 
  */
+#ifndef _NLLS_SIMPLE_H
+#define _NLLS_SIMPLE_H
+
+class Image;
+
 const int FS_X0    = 0;		// x0 (star center, X)
 const int FS_Y0    = 1;		// y0 (star center, Y)
 const int FS_C     = 2;		// C = total flux
@@ -36,8 +41,10 @@ public:
   double &Beta(void)             { return state_var[FS_Beta]; }
 };
 
-// returns -1 if would not converge
+// returns -1 if would not converge (or if the box_width x box_width
+// box around the largest star doesn't fit inside the image)
 // returns 0 if converged okay
-int nlls(Image *primary_image, focus_state *fs);
+int nlls(Image *primary_image, focus_state *fs, int box_width = 10);
 int nlls1(Image *primary_image, focus_state *fs);
 
+#endif
@@ -1,7 +1,7 @@
 /*  graph_star.cc -- used to graph the lightcurve of a star
  *  in the observation database
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
  *
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -20,8 +20,9 @@
 #include <stdlib.h>		// free()
 #include <stdio.h>
 #include <unistd.h>		// getopt()
-#include <ctype.h>		// isspace()
 #include <string.h>		// strcmp()
+#include <math.h>		// isnan()
+#include <vector>
 
 #include <X11/Intrinsic.h>
 #include <X11/Xcms.h>
@@ -43,10 +44,12 @@
 #include <Xm/Form.h>
 
 #include <Image.h>
+#include <phot_archive.h>
 
 void ShowBusy(void);
 void ShowReady(void);
 void ReadAllData(void);
+void LoadStar(int star_id);
 void StarDataRefresh(void);
 void InitializeGraphics(void);
 ////////////////////////////////////////////////////////////////
@@ -197,79 +200,25 @@ void ExitCallback(Widget W, XtPointer Client_Data, XtPointer call_data) {
   XtAppSetExitFlag(context);
 }
 
-class InputLine {
-public:
-  InputLine(char *input);
-  ~InputLine(void) {
-    delete [] Keywords;
-    delete [] Values;
-  }
-
-  int NumPairs;
-
-  char *PairKeyword(int i) { return Keywords[i]; }
-  char *PairValue(int i) { return Values[i]; }
-
-private:
-  char **Keywords;
-  char **Values;
-};
-
-InputLine::InputLine(char *input) {
-  int field_count = 0;
-  char *s;
-
-  for(s = input; *s; s++) {
-    if(*s == '=') field_count++;
-    if(isalpha(*s) && islower(*s)) *s = toupper(*s);
-  }
-
-  NumPairs = field_count;
-  Keywords = new char *[field_count];
-  Values   = new char *[field_count];
-
-  field_count = 0;
-  s = input;
-  while(field_count < NumPairs) {
-    while(isspace(*s)) s++;
-    Keywords[field_count] = s;
-    while(*s && *s != '=') s++;
-    if(*s != '=') {
-      fprintf(stderr, "graph_star: parse error: %s\n", input);
-      return;
-    }
-    *s++ = 0;
-
-    Values[field_count] = s;
-    while(*s && !isspace(*s)) s++;
-    *s++ = 0;
-    field_count++;
-  }
-}
-      
+// The V measurements of one star. Stars are read from the
+// photometry archive one at a time, as they come up for display.
 struct one_obs {
-  struct one_obs *next;
-
-  struct StarData *star;
   double obs_date;
   double obs_magnitude;
-} *head_obs = 0;
+};
 
 struct StarData {
-  struct StarData *next;
-
   struct one_obs **obs_list;
   int             num_obs;
-  int             obs_so_far;
   int             already_done;
   char           *starname;
-} *head_star = 0;
+};
 
+PhotArchive *archive = 0;
+int V_filter = -1;		// archive's filter ID for "V"
 StarData **star_array = 0;
 int total_num_stars = 0;
 int num_stars_remaining;
-int total_num_obs = 0;
-struct one_obs **obs_array = 0;
 int current_selected_star = -1;
 
 GC gc_black, gc_red, gc_blue;
@@ -483,135 +432,61 @@ void NextCallback(Widget W, XtPointer Client_Data, XtPointer call_data) {
   while(++current_selected_star < total_num_stars) {
     num_stars_remaining--;
     StarData *star = star_array[current_selected_star];
-    if(star->num_obs >= 4 &&
-       star->already_done == 0) {
+    if(star->already_done == 0) {
       star->already_done = 1;
-      StarDataRefresh();
-      return;
+      LoadStar(current_selected_star);
+      if(star->num_obs >= 4) {
+	StarDataRefresh();
+	return;
+      }
     }
   }
 }
 
-struct StarData *LookupStar(char *star_name) {
-  struct StarData *star;
-
-  for(star = head_star; star; star=star->next) {
-    if(strcmp(star->starname, star_name) == 0) {
-      return star;
-    }
+/****************************************************************/
+/*        ReadAllData()						*/
+/*    Only the list of star names is read here; LoadStar() gets */
+/*    one star's measurements when it is needed.                */
+/****************************************************************/
+void ReadAllData(void) {
+  archive = new PhotArchive;
+  if (not archive->IsOpen()) {
+    fprintf(stderr, "graph_star: cannot open archive %s\n",
+	    PhotArchive::DEFAULT_DIRECTORY);
+    exit(2);
   }
+  V_filter = archive->FilterID("V");
 
-  // new star!
-  star = new StarData;
-  star->next = head_star;
-  head_star = star;
-
-  star->obs_list   = 0;
-  star->num_obs    = 0;
-  star->obs_so_far = 0;
-  star->already_done = 0;
-  star->starname   = strdup(star_name);
-
-  total_num_stars++;
-
-  return star;
-}
-
-void FinalizeStars(void) {
-  fprintf(stderr, "Finalizing star list... ");
+  total_num_stars = archive->NumStars();
   star_array = new StarData *[total_num_stars];
-
-  obs_array = new struct one_obs *[total_num_obs];
-  int obs_array_index = 0;
-
-  struct StarData *star;
-  int i = 0;
-
-  for(star = head_star; star; star=star->next) {
-    star_array[i++] = star;
-    star->obs_list = &(obs_array[obs_array_index]);
-    obs_array_index += star->num_obs;
-  }
-
-  fprintf(stderr, " %d stars found.\nFinalizing observations... ",
-	  total_num_stars);
-
-  {
-    struct one_obs *obs;
-
-    for(obs = head_obs; obs; obs=obs->next) {
-      star = obs->star;
-      star->obs_list[star->obs_so_far++] = obs;
-    }
+  for (int i=0; i<total_num_stars; i++) {
+    StarData *star = new StarData;
+    star->obs_list     = 0;
+    star->num_obs      = 0;
+    star->already_done = 0;
+    star->starname     = strdup(archive->StarName(i));
+    star_array[i] = star;
   }
-
-  fprintf(stderr, " %d observations found.\n", total_num_obs);
-
-  fprintf(stderr, "Starting consistency check ...");
-
-  static int failed = 0;
-  for(i=0; i<total_num_stars; i++) {
-    star = star_array[i];
-    int j;
-    for(j=0; j<star->num_obs; j++) {
-      if(star->obs_list[j]->star != star) {
-	if(!failed) {
-	  fprintf(stderr, "\n     failed.\n");
-	  failed = 1;
-	}
-      }
-    }
-  }
-  if(!failed) fprintf(stderr, " Passed.\n");
   num_stars_remaining = total_num_stars;
-}
-  
-void NewObservation(char *star_name,
-		    double current_time,
-		    double current_magnitude) {
-  struct one_obs *new_one = new one_obs;
-
-  new_one->next          = head_obs;
-  head_obs               = new_one;
-  new_one->obs_date      = current_time;
-  new_one->obs_magnitude = current_magnitude;
-  new_one->star          = LookupStar(star_name);
-  new_one->star->num_obs++;
-
-  total_num_obs++;
+  fprintf(stderr, "%d stars, %u measurements in archive.\n",
+	  total_num_stars, archive->NumRows());
 }
 
-void ReadAllData(void) {
-  FILE *fp = fopen("/usr/local/ASTRO/ARCHIVE/archive.dat", "r");
-  char buffer[256];
-  double current_time;
-  double current_magnitude;
-  char *star_name = 0;
-
-  while(fgets(buffer, sizeof(buffer), fp)) {
-    InputLine LineData(buffer);
-
-    int n;
-    for(n=0; n< LineData.NumPairs; n++) {
-      if(strcmp(LineData.PairKeyword(n), "T") == 0) {
-	sscanf(LineData.PairValue(n), "%lf", &current_time);
-      }
-      if(strcmp(LineData.PairKeyword(n), "S") == 0) {
-	star_name = LineData.PairValue(n);
-      }
-    }
-    for(n=0; n< LineData.NumPairs; n++) {
-      if(strcmp(LineData.PairKeyword(n), "MV") == 0) {
-	if(strcmp(LineData.PairValue(n), "NaN") != 0) {
-	  sscanf(LineData.PairValue(n), "%lf", &current_magnitude);
-
-	  NewObservation(star_name, current_time, current_magnitude);
-	}
-      }
-    }
+/****************************************************************/
+/*        LoadStar()						*/
+/****************************************************************/
+void LoadStar(int star_id) {
+  StarData *star = star_array[star_id];
+  std::vector<uint32_t> rows;
+  archive->StarRows(star_id, &rows);
+
+  star->obs_list = new struct one_obs *[rows.size()];
+  star->num_obs = 0;
+  for (uint32_t row : rows) {
+    if (archive->Filter(row) != V_filter or isnan(archive->Mag(row))) continue;
+    struct one_obs *obs = new one_obs;
+    obs->obs_date      = archive->JD(row);
+    obs->obs_magnitude = archive->Mag(row);
+    star->obs_list[star->num_obs++] = obs;
   }
-
-  fclose(fp);
-  FinalizeStars();
 }
-      
@@ -0,0 +1,314 @@
+/*  pixel_linearity.cc -- Per-pixel gain, nonlinearity, and saturation
+ *  maps from a ramp of flats
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+
+#include <Image.h>
+#include <fitsio.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>		// exit(), atoi(), atof()
+#include <unistd.h>		// getopt()
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>		// std::sort(), std::nth_element()
+
+// The input is a ramp: a set of flats (or darks) of the same field
+// with different exposure times, such as measure_linearity takes. For
+// each pixel, ADU vs. exposure time is fit with
+//
+//    y = a + g*t + q*t^2
+//
+// and three maps are written:
+//    <prefix>_gain.fits    g, ADU per second
+//    <prefix>_nonlin.fits  k = -q/g^2; the linear value of a pixel
+//                          is y + k*y^2 (see Image::linearize())
+//    <prefix>_sat.fits     the largest ADU the pixel ever reached
+//
+// Each image is read exactly once. The images are taken in order of
+// increasing exposure time, and a pixel stops accumulating the first
+// time it reaches the saturation limit. That means each pixel's fit
+// uses the first n images of the ramp, so the sums of powers of t
+// are the same for every pixel with the same n and come from one
+// table; a pixel needs only n, sum(y), sum(t*y), sum(t^2*y), and its
+// maximum. The per-image work is split into bands of rows, one per
+// thread.
+
+struct RampImage {
+  std::string filename;
+  double exposure_time;
+};
+
+struct PixelSums {
+  PixelSums(int num_pixels) :
+    n(num_pixels, 0), active(num_pixels, 1),
+    sum_y(num_pixels, 0.0), sum_ty(num_pixels, 0.0), sum_tty(num_pixels, 0.0),
+    max_y(num_pixels, 0.0) { ; }
+
+  std::vector<uint16_t> n;
+  std::vector<uint8_t> active;	// 0 once the pixel has saturated
+  std::vector<double> sum_y;
+  std::vector<double> sum_ty;
+  std::vector<double> sum_tty;
+  std::vector<float> max_y;
+};
+
+void usage(void) {
+  fprintf(stderr,
+	  "usage: pixel_linearity [-b bias.fits] [-s saturation_adu] [-t threads] -o prefix image1.fits image2.fits ...\n");
+  exit(-2);
+}
+
+//****************************************************************
+//        ReadExposureTime()
+//    Header only; returns -1.0 if not available.
+//****************************************************************
+static double ReadExposureTime(const char *filename) {
+  fitsfile *fptr;
+  int status = 0;
+  if (fits_open_file(&fptr, filename, READONLY, &status)) {
+    fprintf(stderr, "pixel_linearity: cannot open %s\n", filename);
+    return -1.0;
+  }
+  ImageInfo info(fptr);
+  (void) fits_close_file(fptr, &status);
+
+  // EXP_T3 is the measured shutter time and is better when present
+  if (info.Expt3Valid()) return info.GetExpt3();
+  if (info.ExposureDurationValid()) return info.GetExposureDuration();
+  fprintf(stderr, "pixel_linearity: %s has no exposure time\n", filename);
+  return -1.0;
+}
+
+//****************************************************************
+//        AccumulateRows()
+//    Adds rows [row_start, row_end) of one image into the sums.
+//****************************************************************
+static void AccumulateRows(const Image *image,
+			   const Image *bias,
+			   double t,
+			   double saturation,
+			   int row_start,
+			   int row_end,
+			   PixelSums *sums) {
+  const int width = image->width;
+  const double tt = t*t;
+  for (int row = row_start; row < row_end; row++) {
+    const int base = row*width;
+    for (int col = 0; col < width; col++) {
+      const int p = base + col;
+      double y = image->pixel(col, row);
+      if (sums->max_y[p] < y) sums->max_y[p] = y;
+      if (bias) y -= bias->pixel(col, row);
+
+      // Written without branches on the per-pixel data so the
+      // compiler can vectorize the loop.
+      const uint8_t use = sums->active[p] & (image->pixel(col, row) < saturation);
+      sums->active[p] = use;
+      const double w = use;
+      sums->n[p] += use;
+      sums->sum_y[p] += w*y;
+      sums->sum_ty[p] += w*t*y;
+      sums->sum_tty[p] += w*tt*y;
+    }
+  }
+}
+
+//****************************************************************
+//        FitPixel()
+//    Solves the 3x3 normal equations for (a, g, q); falls back to a
+//    straight line with fewer than four points. Returns false if
+//    there aren't enough points for even that.
+//****************************************************************
+static bool FitPixel(const double *S,	// S[k] = sum of t^k, k=0..4
+		     double sy, double sty, double stty,
+		     double *g, double *q) {
+  if (S[0] >= 4) {
+    const double m[3][3] = { { S[0], S[1], S[2] },
+			     { S[1], S[2], S[3] },
+			     { S[2], S[3], S[4] } };
+    const double det =
+      m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1]) -
+      m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0]) +
+      m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+    if (det != 0.0) {
+      // Cramer's rule for the 2nd and 3rd unknowns
+      *g = (m[0][0]*(sty*m[2][2] - m[1][2]*stty) -
+	    sy*(m[1][0]*m[2][2] - m[1][2]*m[2][0]) +
+	    m[0][2]*(m[1][0]*stty - sty*m[2][0]))/det;
+      *q = (m[0][0]*(m[1][1]*stty - sty*m[2][1]) -
+	    m[0][1]*(m[1][0]*stty - sty*m[2][0]) +
+	    sy*(m[1][0]*m[2][1] - m[1][1]*m[2][0]))/det;
+      return true;
+    }
+  }
+  if (S[0] >= 2) {
+    const double det = S[0]*S[2] - S[1]*S[1];
+    if (det != 0.0) {
+      *g = (S[0]*sty - S[1]*sy)/det;
+      *q = 0.0;
+      return true;
+    }
+  }
+  return false;
+}
+
+static double Median(std::vector<double> &v) {
+  if (v.size() == 0) return 0.0;
+  std::nth_element(v.begin(), v.begin() + v.size()/2, v.end());
+  return v[v.size()/2];
+}
+
+int main(int argc, char **argv) {
+  int ch;
+  const char *prefix = 0;
+  Image *bias = 0;
+  double saturation = 62000.0;
+  int num_threads = std::thread::hardware_concurrency();
+
+  while((ch = getopt(argc, argv, "b:s:t:o:")) != -1) {
+    switch(ch) {
+    case 'b':
+      bias = new Image(optarg);
+      break;
+
+    case 's':
+      saturation = atof(optarg);
+      break;
+
+    case 't':
+      num_threads = atoi(optarg);
+      break;
+
+    case 'o':
+      prefix = optarg;
+      break;
+
+    case '?':
+    default:
+      usage();
+    }
+  }
+  argc -= optind;
+  argv += optind;
+
+  if (prefix == 0 || argc < 2) usage();
+
+  // Sort the ramp by exposure time using only the headers
+  std::vector<RampImage> ramp;
+  for (int i = 0; i < argc; i++) {
+    const double t = ReadExposureTime(argv[i]);
+    if (t < 0.0) continue;
+    ramp.push_back(RampImage { argv[i], t });
+  }
+  std::sort(ramp.begin(), ramp.end(),
+	    [](const RampImage &a, const RampImage &b) {
+	      return a.exposure_time < b.exposure_time; });
+  const int num_images = ramp.size();
+  if (num_images < 2 || num_images > 65535) {
+    fprintf(stderr, "pixel_linearity: need from 2 to 65535 usable images.\n");
+    exit(-2);
+  }
+
+  // S[n][k] = sum of t^k over the first n images of the ramp
+  std::vector<std::vector<double>> S(num_images+1, std::vector<double>(5, 0.0));
+  for (int n = 1; n <= num_images; n++) {
+    const double t = ramp[n-1].exposure_time;
+    double tk = 1.0;
+    for (int k = 0; k < 5; k++) {
+      S[n][k] = S[n-1][k] + tk;
+      tk *= t;
+    }
+  }
+
+  int width = 0;
+  int height = 0;
+  PixelSums *sums = 0;
+
+  for (const RampImage &r : ramp) {
+    Image image(r.filename.c_str());
+    if (sums == 0) {
+      width = image.width;
+      height = image.height;
+      sums = new PixelSums(width*height);
+      if (bias && (bias->width != width || bias->height != height)) {
+	fprintf(stderr, "pixel_linearity: bias is %dx%d, images are %dx%d\n",
+		bias->width, bias->height, width, height);
+	exit(-2);
+      }
+    } else if (image.width != width || image.height != height) {
+      // Skipping an image in the middle of the ramp would make the
+      // table of sums of t^k wrong, so the ramp ends here.
+      fprintf(stderr, "pixel_linearity: %s is the wrong size; ramp ends here.\n",
+	      r.filename.c_str());
+      break;
+    }
+
+    const int bands = (num_threads < 1 ? 1 :
+		       (num_threads > height ? height : num_threads));
+    std::vector<std::thread> threads;
+    for (int b = 0; b < bands; b++) {
+      threads.emplace_back(AccumulateRows, &image, bias, r.exposure_time, saturation,
+			   (height*b)/bands, (height*(b+1))/bands, sums);
+    }
+    for (std::thread &t : threads) t.join();
+    fprintf(stderr, "%s: t = %.3lf\n", r.filename.c_str(), r.exposure_time);
+  }
+
+  Image gain_map(height, width);
+  Image nonlin_map(height, width);
+  Image sat_map(height, width);
+  std::vector<double> all_gains;
+  std::vector<double> all_k;
+  int num_unfit = 0;
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      const int p = row*width + col;
+      double g, q;
+      sat_map.pixel(col, row) = sums->max_y[p];
+      if (FitPixel(S[sums->n[p]].data(),
+		   sums->sum_y[p], sums->sum_ty[p], sums->sum_tty[p],
+		   &g, &q) && g > 0.0) {
+	const double k = -q/(g*g);
+	gain_map.pixel(col, row) = g;
+	nonlin_map.pixel(col, row) = k;
+	all_gains.push_back(g);
+	all_k.push_back(k);
+      } else {
+	gain_map.pixel(col, row) = 0.0;
+	nonlin_map.pixel(col, row) = 0.0;
+	num_unfit++;
+      }
+    }
+  }
+  delete sums;
+
+  fprintf(stderr, "%d images, %d pixels fit, %d could not be fit\n",
+	  num_images, (int) all_gains.size(), num_unfit);
+  fprintf(stderr, "median gain = %.2lf ADU/sec, median k = %.4le\n",
+	  Median(all_gains), Median(all_k));
+
+  const std::string p(prefix);
+  gain_map.WriteFITSFloat((p + "_gain.fits").c_str());
+  nonlin_map.WriteFITSFloat((p + "_nonlin.fits").c_str());
+  sat_map.WriteFITSFloat((p + "_sat.fits").c_str());
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*  median_image.cc -- Median-combine a set of images
+ *
+ *  Copyright (C) 2007, 2021 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>. 
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <Image.h>
+#include <list>
+#include <string>
+#include "median_image.h"
+
+Image *median_image(Image **i_array, int num_images, int med_avg) {
+  // First verify that all images have the same size
+  int w, h;
+  w = i_array[0]->width;
+  h = i_array[0]->height;
+
+  int j;
+  for(j=0; j<num_images; j++) {
+    if(i_array[j]->width != w ||
+       i_array[j]->height != h) {
+      fprintf(stderr, "median_image: size of image %d mismatch\n",
+	      j+1);
+      return 0;
+    }
+  }
+
+  // Okay, all images match sizes
+  Image *output = new Image(h, w);
+
+  int x, y;
+  double *values = (double *) malloc(num_images * sizeof(double));
+  if(!values) {
+    fprintf(stderr, "median: malloc failed.\n");
+    return 0;
+  }
+  const int middle_item = num_images/2;
+  for(y = 0; y < h; y++) {
+    for(x = 0; x < w; x++) {
+      for(j=0; j<num_images; j++) {
+	values[j] = i_array[j]->pixel(x, y);
+
+	int k = j-1;
+	while(k >= 0) {
+	  if(values[k] > values[k+1]) {
+	    double t = values[k+1];
+	    values[k+1] = values[k];
+	    values[k] = t;
+	  } else {
+	    break;
+	  }
+	  k--;
+	}
+      }
+      if(med_avg) {
+	double sum = 0.0;
+	for(int k=1; k < (num_images-1); k++) {
+	  sum += values[k];
+	}
+	output->pixel(x, y) = (sum/(num_images-2));
+      } else {
+	output->pixel(x, y) = values[middle_item];
+      }
+    }
+  }
+  free(values);
+
+  CarryForwardKeywords(i_array, num_images, output);
+
+  return output;
+}
+
+static std::list<std::string> keywords {
+  "FRAMEX",
+    "FRAMEY",
+    "BINNING",
+    "OFFSET",
+    "CAMGAIN",
+    "READMODE",
+    "FILTER",
+    "EXPOSURE",
+    "DATAMAX" };
+
+void CarryForwardKeywords(Image **i_array,
+			  int num_images,
+			  Image *final_image) {
+  ImageInfo *final_info = final_image->GetImageInfo();
+  if (final_info == nullptr) {
+    final_info = final_image->CreateImageInfo();
+  }
+  
+  for (auto s : keywords) {
+    bool all_images_share_keyword = true;
+    std::string value = "XXX";
+    
+    for (int n=0; n<num_images; n++) {
+      ImageInfo *i_info = i_array[n]->GetImageInfo();
+      if (i_info->KeywordPresent(s)) {
+	if (value == "XXX") {
+	  value = i_info->GetValueLiteral(s);
+	} else {
+	  if (i_info->GetValueLiteral(s) != value) {
+	    all_images_share_keyword = false;
+	  }
+	}
+      } else {
+	all_images_share_keyword = false;
+      }
+    }
+
+    if (all_images_share_keyword) {
+      final_info->SetValue(s, value);
+    }
+  }
+}
@@ -0,0 +1,35 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  median_image.h -- Median-combine a set of images
+ *
+ *  Copyright (C) 2007, 2021 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>. 
+ */
+#ifndef _MEDIAN_IMAGE_H
+#define _MEDIAN_IMAGE_H
+
+#include <Image.h>
+
+// MEDIAN_AVERAGE means taking the average of each pixel of the set of
+// images after rejecting the brightest and the dimmest value of each pixel.
+Image *median_image(Image **i_array, int num_images, int med_avg);
+
+// Copy keywords (FILTER, EXPOSURE, BINNING, ...) into final_image if
+// all of the images in i_array agree on their value.
+void CarryForwardKeywords(Image **i_array,
+			  int num_images,
+			  Image *final_image);
+
+#endif
@@ -1,6 +1,6 @@
 /*  notify.cc -- Main program to send quit commands to other programs
  *
- *  Copyright (C) 2015 Mark J. Munkacsy
+ *  Copyright (C) 2015, 2024 Mark J. Munkacsy
  *
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -22,15 +22,68 @@
 #include <stdlib.h>
 #include <proc_messages.h>
 #include <string.h>		// strcmp()
+#include <poll.h>
+#include <errno.h>
+#include <stdint.h>		// uint64_t
 
 void usage(void) {
   fprintf(stderr, "usage: notify prog_name -l|quit|pause|resume\n");
+  fprintf(stderr, "       notify -w cooler|image\n");
   exit(-2);
 }
 
+// Prints broadcasts on one topic as they arrive, until killed or
+// until whatever is reading our stdout goes away. (With a blocking
+// wait, a watcher whose reader had exited would linger until the next
+// broadcast, which for some topics may never come.)
+void watch(const char *topic_name) {
+  SM_Topic topic = SM_TOPIC_NONE;
+  if (strcmp(topic_name, "cooler") == 0) topic = SM_TOPIC_COOLER;
+  if (strcmp(topic_name, "image") == 0) topic = SM_TOPIC_IMAGE;
+  if (topic == SM_TOPIC_NONE) usage();
+
+  char my_name[64];
+  sprintf(my_name, "notify_%s", topic_name);
+  Subscribe(my_name, topic);
+
+  struct pollfd fds[2];
+  fds[0].fd = MessageFD(my_name);
+  fds[0].events = POLLIN;
+  fds[1].fd = STDOUT_FILENO;
+  fds[1].events = 0;		// only POLLERR/POLLHUP are of interest
+  if (fds[0].fd < 0) {
+    fprintf(stderr, "notify: cannot watch message queue.\n");
+    exit(-2);
+  }
+
+  do {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("notify: poll");
+      exit(-2);
+    }
+    if (fds[1].revents & (POLLERR | POLLHUP)) break;
+    if (fds[0].revents & POLLIN) {
+      uint64_t count;
+      if (read(fds[0].fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+	perror("notify: read");
+      }
+      SM_Received message;
+      while (ReceiveMessage(my_name, &message)) {
+	printf("%d %ld %s\n", message.message_id, message.message_param,
+	       message.text);
+      }
+      fflush(stdout);
+    }
+  } while (1);
+  exit(0);
+}
+
 int main(int argc, char **argv) {
 
-  if (argc == 2 && strcmp(argv[1], "-l") == 0) {
+  if (argc == 3 && strcmp(argv[1], "-w") == 0) {
+    watch(argv[2]);
+  } else if (argc == 2 && strcmp(argv[1], "-l") == 0) {
     ProcessList *pl = GetProcessList();
     ProcessList::iterator it;
 
@@ -5,9 +5,10 @@
 int main(int argc, char **argv) {
   do {
     int message_id;
-    int ret_val = ReceiveMessage("notify_test", &message_id);
-    fprintf(stderr, "ReceiveMessage() returned %d\n", ret_val);
-    sleep(1);
+    long message_param;
+    int ret_val = WaitForMessage("notify_test", &message_id, &message_param);
+    fprintf(stderr, "WaitForMessage() returned %d (id = %d, param = %ld)\n",
+	    ret_val, message_id, message_param);
   } while (1);
   return 0;
 }
@@ -5,19 +5,8 @@ import sys
 import logging
 import threading
 import time
-
-def ToolRoot(start):
-    while True:
-        (head,tail) = os.path.split(start)
-        if tail == "TOOLS":
-            return head
-        elif tail == '':
-            raise Exception("filepath does not contain TOOLS")
-        else:
-            start = head
-
-sys.path.insert(1, ToolRoot(__file__))
-from PYTHON_LIB.ASTRO_DB_LIB import astro_db
+import json
+import concurrent.futures
 
 files = None
 session_history_all = []
@@ -43,32 +32,65 @@ class TargetHistory:
             self.check_fit = None
 
 class SessionHistory:
-    def __init__(self, db):
+    def __init__(self, summary):
         global history_by_target
         global total_analysis_count
         self.targets = []
         self.tgt_history = {} # index by tgt name, value is TargetHistory
 
-        if "analyses" not in db:
-            return
-
-        for a in db['analyses']:
-            total_analysis_count += 1
-            if 'target' not in a:
-                pass
-                #print("Analysis missing target: ", a)
+        total_analysis_count += summary['num_analyses']
+        for a in summary['analyses']:
+            tgt = a['target']
+            if tgt in self.tgt_history:
+                print("Error: found multiple analyses for ", tgt)
             else:
-                tgt = a['target']
-                if tgt in self.tgt_history:
-                    print("Error: found multiple analyses for ", tgt)
-                else:
-                    this_tgt = TargetHistory(tgt, a)
-                    self.tgt_history[tgt] = this_tgt
-                    self.targets.append(tgt)
-                    if tgt not in history_by_target:
-                        history_by_target[tgt] = []
-                    history_by_target[tgt].append(this_tgt)
-                    
+                this_tgt = TargetHistory(tgt, a)
+                self.tgt_history[tgt] = this_tgt
+                self.targets.append(tgt)
+                if tgt not in history_by_target:
+                    history_by_target[tgt] = []
+                history_by_target[tgt].append(this_tgt)
+
+################################################################
+#    The history cache
+# Only the parts of each night's astro_db.json that the history uses
+# are kept, in one file, along with the astro_db.json's mtime and
+# size. A night is only re-read when its astro_db.json has changed
+# since it was cached.
+################################################################
+history_cache = '/home/IMAGES/.session_history.json'
+
+def SummarizeSession(filename):
+    with open(filename, 'r') as fp:
+        db = json.load(fp)
+    summary = { 'num_analyses' : 0, 'analyses' : [] }
+    if 'analyses' not in db:
+        return summary
+
+    for a in db['analyses']:
+        summary['num_analyses'] += 1
+        if 'target' in a:
+            summary['analyses'].append(
+                { k : a[k] for k in ('target', 'ensembles',
+                                     'ensemble_fit', 'check_fit')
+                  if k in a })
+    return summary
+
+def ReadHistoryCache():
+    try:
+        with open(history_cache, 'r') as fp:
+            return json.load(fp)
+    except (IOError, json.decoder.JSONDecodeError):
+        return {}
+
+def WriteHistoryCache(cache):
+    temp_filename = history_cache + '.' + str(os.getpid())
+    try:
+        with open(temp_filename, 'w') as fp:
+            json.dump(cache, fp)
+        os.replace(temp_filename, history_cache)
+    except IOError as x:
+        print("Cannot update history cache ", history_cache, ": ", x.strerror)
 
 history_thread = None
 def BeginStartup(current_dir):
@@ -80,17 +102,50 @@ def Initialize(current_dir):
     global files
     global session_history_all
 
-    files = glob.glob('/home/IMAGES/*/astro_db.json')
+    files = sorted(glob.glob('/home/IMAGES/*/astro_db.json'))
     files = [x for x in files if current_dir not in x]
 
-    #print("Number of databases to read: ", len(files))
+    cache = ReadHistoryCache()
+    new_cache = {}
+    to_read = []
+    for f in files:
+        try:
+            st = os.stat(f)
+        except OSError:
+            continue
+        entry = cache.get(f)
+        if (entry is not None and entry['mtime_ns'] == st.st_mtime_ns and
+            entry['size'] == st.st_size):
+            new_cache[f] = entry
+        else:
+            to_read.append((f, st))
+
+    # Nights that are new (or changed) since the cache was written
+    # are read in parallel.
+    if to_read:
+        print("History: reading ", len(to_read), " of ", len(files),
+              " sessions")
+        with concurrent.futures.ThreadPoolExecutor() as pool:
+            futures = { pool.submit(SummarizeSession, f) : (f, st)
+                        for (f, st) in to_read }
+            for future in concurrent.futures.as_completed(futures):
+                (f, st) = futures[future]
+                try:
+                    summary = future.result()
+                except (IOError, json.decoder.JSONDecodeError) as x:
+                    print("History: cannot read ", f, ": ", x)
+                    continue
+                new_cache[f] = { 'mtime_ns' : st.st_mtime_ns,
+                                 'size' : st.st_size,
+                                 'summary' : summary }
 
     for f in files:
-        print("History processing file ", f)
-        db = astro_db.AstroDB(os.path.dirname(f))
-        this_session = SessionHistory(db.data)
-        session_history_all.append(this_session)
-        #print("finished fetching history from ", f)
+        if f in new_cache:
+            this_session = SessionHistory(new_cache[f]['summary'])
+            session_history_all.append(this_session)
+
+    if to_read or len(new_cache) != len(cache):
+        WriteHistoryCache(new_cache)
 
 def WaitForStartupComplete():
     global history_thread
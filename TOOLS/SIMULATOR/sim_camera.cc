@@ -0,0 +1,362 @@
+/*  sim_camera.cc -- Simulated camera that images the HGSC catalog
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>		// exit()
+#include <string.h>
+#include <unistd.h>		// pipe(), write(), unlink()
+#include <fcntl.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <gen_message.h>
+#include <camera_message.h>
+#include <FITSMessage.h>
+#include <StatusMessage.h>
+#include <HGSC.h>
+#include <wcs.h>
+#include <system_config.h>
+#include <trace.h>
+#include "../BENCHMARK/starfield.h"
+#include "sim_camera.h"
+
+struct SimCamera::Exposure {
+  int socket_fd;
+  unsigned int seq;
+  std::atomic<bool> abandoned {false}; // client went away
+  std::atomic<int> camera_status {CAMERA_SHUTTER_OPEN};
+  bool ok {false};		// FITS file written successfully
+
+  double exposure_time;
+  int binning;
+  int pixel_format;
+  bool compress;
+  bool dark;
+  char filter[2];
+  int gain;
+  int mode;
+  int offset;
+  unsigned int sub_bottom, sub_top, sub_left, sub_right;
+  std::string requested_name;	// "-" means "send back as FITSMessage"
+  std::string fits_file;	// what actually gets written
+
+  DEC_RA pointing;		// mount position at shutter open
+  double defocus_blur;		// pixels
+  JULIAN start_time;
+};
+
+// cfitsio is not reliably re-entrant, so only one exposure thread at
+// a time is allowed to write a FITS file.
+static std::mutex fits_lock;
+
+SimCamera::SimCamera(SimClock &clk, SimMount &m, const SimCameraParams &params) :
+  clock(clk), mount(m), p(params) {
+  SystemConfig config;
+  pixel_scale = config.PixelScale();
+  if (pixel_scale <= 0.0) pixel_scale = 1.52;
+
+  if (pipe(completion_pipe) < 0) {
+    perror("SimCamera: cannot create pipe");
+    exit(2);
+  }
+  fcntl(completion_pipe[0], F_SETFL, O_NONBLOCK);
+}
+
+SimCamera::~SimCamera(void) {
+  close(completion_pipe[0]);
+  close(completion_pipe[1]);
+}
+
+//****************************************************************
+//        Inbound messages
+//****************************************************************
+int
+SimCamera::HandleMessage(int socket_fd) {
+  GenMessage *new_message = GenMessage::ReceiveMessage(socket_fd);
+  if (new_message == 0) return -1;
+
+  if (new_message->MessageID() == CameraMessageID) {
+    CameraMessage *cm = new CameraMessage(new_message);
+    const int cmd = cm->GetCommand();
+    if (cmd == CMD_EXPOSE) {
+      StartExposure(cm, socket_fd);
+    } else if (cmd == CMD_STATUS) {
+      SendStatus(socket_fd, cm);
+    } else if (cmd == CMD_COOLER) {
+      HandleCooler(cm, socket_fd);
+    } else if (cmd == CMD_FILTER_CONFIG || cmd == CMD_SHUTDOWN) {
+      // Same as the real ccd_server: neither is implemented.
+      fprintf(stderr, "sim_server: CameraMessage command %d ignored.\n", cmd);
+    } else {
+      fprintf(stderr, "sim_server: unrecognized CameraMessage command: %d\n",
+	      cmd);
+    }
+    delete cm;
+  } else {
+    fprintf(stderr, "sim_server: bad inbound camera message type: %d\n",
+	    new_message->MessageID());
+  }
+  delete new_message;
+  return 0;
+}
+
+void
+SimCamera::ConnectionClosed(int socket_fd) {
+  auto it = active.find(socket_fd);
+  if (it != active.end()) {
+    it->second->abandoned = true;
+    active.erase(it);
+  }
+}
+
+void
+SimCamera::SendStatus(int socket_fd, CameraMessage *request) {
+  CameraMessage outbound(socket_fd, CMD_STATUS);
+  const bool regulating = (cooler_mode == "SETPOINT");
+  outbound.SetKeywordValue("COOLER_MODE", cooler_mode);
+  outbound.SetCoolerTemp(regulating ? cooler_setpoint : 15.0);
+  outbound.SetAmbientTemp(99.9);
+  outbound.SetCoolerPower(regulating ? 0.35 : 0.0);
+  outbound.SetHumidity(40.0);
+  outbound.SetKeywordValue("SETPOINT", std::to_string(cooler_setpoint));
+
+  int status = CAMERA_IDLE;
+  auto it = active.find(socket_fd);
+  if (it != active.end()) status = it->second->camera_status;
+  outbound.SetKeywordValue("CAMERA_STATUS",
+			   (status == CAMERA_SHUTTER_OPEN ? "EXPOSING" :
+			    status == CAMERA_IO_BUSY ? "READOUT" : "IDLE"));
+  if (request) {
+    outbound.SetUniqueID(request->GetUniqueID());
+  }
+  outbound.send();
+}
+
+void
+SimCamera::HandleCooler(CameraMessage *msg, int socket_fd) {
+  if (msg->IsQuery()) {
+    SendStatus(socket_fd, msg);
+    return;
+  }
+  if (msg->CoolerModeAvail()) {
+    cooler_mode = msg->GetCoolerMode();
+  }
+  if (msg->CoolerSetpointAvail()) {
+    cooler_setpoint = msg->GetCoolerSetpoint();
+  }
+  // no response message at all
+}
+
+void
+SimCamera::StartExposure(CameraMessage *msg, int socket_fd) {
+  if (active.count(socket_fd)) {
+    fprintf(stderr, "sim_server: expose request on fd %d while busy; ignored.\n",
+	    socket_fd);
+    return;
+  }
+
+  auto e = std::make_shared<Exposure>();
+  e->socket_fd = socket_fd;
+  e->seq = next_seq++;
+  e->exposure_time = msg->GetExposureTime();
+  e->binning = (msg->BinningAvail() ? msg->GetBinning() : 1);
+  if (e->binning < 1) e->binning = 1;
+  e->pixel_format = (msg->PixelFormatAvail() ? msg->GetPixelFormat() : PIXEL_UINT16);
+  e->compress = msg->CompressAvail() and msg->GetCompress();
+  e->filter[0] = (msg->FilterAvail() ? msg->GetFilterLetter() : 'V');
+  e->filter[1] = 0;
+  e->dark = (msg->ShutterAvail() and msg->GetShutterOpen() == false);
+  if (e->dark) e->filter[0] = 'D';
+  e->gain = (msg->CameraGainAvail() ? msg->GetCameraGain() : 0);
+  e->mode = (msg->CameraModeAvail() ? msg->GetCameraMode() : 0);
+  e->offset = (msg->CameraOffsetAvail() ? msg->GetOffset() : 5);
+  msg->GetSubFrameData(&e->sub_bottom, &e->sub_top, &e->sub_left, &e->sub_right);
+  e->requested_name = msg->GetLocalImageName();
+  if (e->requested_name == "-") {
+    char buffer[64];
+    sprintf(buffer, "/tmp/sim_server.%d.%u.fits", getpid(), e->seq);
+    e->fits_file = buffer;
+  } else {
+    e->fits_file = e->requested_name;
+  }
+
+  e->pointing = mount.PointsAt();
+  e->defocus_blur = mount.DefocusBlur();
+  e->start_time = clock.JNow();
+
+  active[socket_fd] = e;
+  std::thread(&SimCamera::RunExposure, this, e).detach();
+}
+
+//****************************************************************
+//        Exposure thread
+//****************************************************************
+static void SleepWall(double seconds) {
+  if (seconds > 0.0) usleep((useconds_t) (seconds*1000000.0));
+}
+
+void
+SimCamera::RunExposure(std::shared_ptr<Exposure> e) {
+  SleepWall(clock.WallSeconds(e->exposure_time));
+  e->camera_status = CAMERA_IO_BUSY;
+
+  const double readout_start = SimClock::WallNow();
+  if (not e->abandoned) {
+    TraceSpan span("sim_render");
+    RenderExposure(*e);
+  }
+  SleepWall(p.readout_time - (SimClock::WallNow() - readout_start));
+  e->camera_status = CAMERA_IDLE;
+
+  {
+    std::unique_lock<std::mutex> lock(done_lock);
+    done_list.push_back(e);
+  }
+  const char c = 'x';
+  if (write(completion_pipe[1], &c, 1) != 1) {
+    perror("sim_server: completion pipe write");
+  }
+}
+
+void
+SimCamera::RenderExposure(Exposure &e) {
+  const int bin = e.binning;
+
+  // Subframe limits are in unbinned pixels. All zeros means full frame.
+  int x0 = 0;
+  int y0 = 0;
+  int w = p.width;
+  int h = p.height;
+  if (e.sub_right > e.sub_left && e.sub_top > e.sub_bottom &&
+      (int) e.sub_right < p.width && (int) e.sub_top < p.height) {
+    x0 = e.sub_left;
+    y0 = e.sub_bottom;
+    w = e.sub_right - e.sub_left + 1;
+    h = e.sub_top - e.sub_bottom + 1;
+  }
+
+  WCS_Simple full_frame;
+  full_frame.SetImageSize(p.width, p.height);
+  full_frame.Set(e.pointing, pixel_scale, 0.0);
+
+  const double exposure = (e.exposure_time > 0.001 ? e.exposure_time : 0.001);
+  const double seeing_pixels = p.seeing/pixel_scale;
+  const bool is_16bit = (bin == 1 || e.pixel_format == PIXEL_UINT16);
+
+  StarFieldParams sp;
+  sp.width = w/bin;
+  sp.height = h/bin;
+  sp.center = full_frame.Transform(x0 + w/2.0, y0 + h/2.0);
+  sp.scale_arcsec = pixel_scale*bin;
+  sp.rotation = 0.0;
+  sp.fwhm_pixels = sqrt(seeing_pixels*seeing_pixels +
+			e.defocus_blur*e.defocus_blur)/bin;
+  sp.background = p.bias + (e.dark ? 0.0 : p.sky_rate*exposure*bin*bin);
+  sp.gradient_x = 0.0;
+  sp.gradient_y = 0.0;
+  sp.zero_point = p.zero_point + 2.5*log10(exposure);
+  sp.read_noise = p.read_noise*bin;
+  sp.egain = p.egain;
+  sp.num_hot_pixels = (sp.width*sp.height)/20000;
+  sp.saturation = (is_16bit ? 65535.0 : 65535.0*bin*bin);
+  sp.exposure_time = e.exposure_time;
+  sp.exposure_start = e.start_time;
+  sp.seed = e.seq;
+  sp.filter = e.filter;
+  sp.object = nullptr;
+  sp.purpose = nullptr;
+
+  HGSCList *catalog;
+  if (e.dark) {
+    catalog = new HGSCList;
+  } else {
+    const double radius = 0.5*sqrt((double) w*w + (double) h*h)*
+      pixel_scale*DEGREES/3600.0;
+    catalog = new HGSCList(sp.center, radius);
+  }
+  StarField field(sp, *catalog);
+  delete catalog;
+
+  // Same keywords that ccd_server puts into a real image
+  ImageInfo *info = field.GetImage()->GetImageInfo();
+  info->SetDatamax(is_16bit ? 65530.0 : 65530.0*bin*bin);
+  info->SetCamGain(e.gain);
+  info->SetReadmode(e.mode);
+  info->SetOffset(e.offset);
+  info->SetBinning(bin);
+  info->SetFrameXY(x0, y0);
+  {
+    SystemConfig config;
+    info->SetValueString("TELESCOP", config.Telescope());
+    info->SetValueString("INSTRUME", "sim_server");
+  }
+
+  std::unique_lock<std::mutex> lock(fits_lock);
+  (void) unlink(e.fits_file.c_str());
+  if (is_16bit) {
+    field.WriteFITS(e.fits_file.c_str(), FIELD_16BIT, e.compress);
+  } else if (e.pixel_format == PIXEL_UINT32) {
+    field.WriteFITS(e.fits_file.c_str(), FIELD_32BIT, e.compress);
+  } else {
+    field.WriteFITS(e.fits_file.c_str(), FIELD_FLOAT, e.compress);
+  }
+  e.ok = (access(e.fits_file.c_str(), R_OK) == 0);
+  if (not e.ok) {
+    fprintf(stderr, "sim_server: unable to write %s\n", e.fits_file.c_str());
+  }
+}
+
+//****************************************************************
+//        Finished exposures (main thread)
+//****************************************************************
+void
+SimCamera::SendCompletedExposures(void) {
+  char drain[64];
+  while (read(completion_pipe[0], drain, sizeof(drain)) > 0) {
+    ;
+  }
+
+  std::list<std::shared_ptr<Exposure>> finished;
+  {
+    std::unique_lock<std::mutex> lock(done_lock);
+    finished.swap(done_list);
+  }
+
+  for (auto e : finished) {
+    const bool in_memory = (e->requested_name == "-");
+    auto it = active.find(e->socket_fd);
+    if (e->abandoned || it == active.end() || it->second != e) {
+      // The client disconnected while the exposure was running
+      if (in_memory) (void) unlink(e->fits_file.c_str());
+      continue;
+    }
+    active.erase(it);
+
+    if (in_memory) {
+      if (e->ok) {
+	FITSMessage response_message(e->socket_fd, e->fits_file.c_str());
+	response_message.send();
+      } else {
+	SendStatus(e->socket_fd); // better than leaving the client hanging
+      }
+      (void) unlink(e->fits_file.c_str());
+    } else {
+      SendStatus(e->socket_fd);
+    }
+  }
+}
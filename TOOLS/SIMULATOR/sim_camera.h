@@ -0,0 +1,93 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  sim_camera.h -- Simulated camera that images the HGSC catalog
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _SIM_CAMERA_H
+#define _SIM_CAMERA_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "sim_clock.h"
+#include "sim_mount.h"
+
+class CameraMessage;
+
+struct SimCameraParams {
+  int width {6252};		// unbinned pixels
+  int height {4176};
+  double readout_time {2.5};	// seconds (wall clock, not accelerated)
+  double seeing {2.8};		// arcsec FWHM
+  double sky_rate {3.0};	// ADU/pixel/second (unbinned)
+  double zero_point {21.5};	// V mag giving 1 ADU/second
+  double bias {800.0};		// ADU
+  double read_noise {3.5};	// ADU
+  double egain {0.85};		// e-/ADU
+};
+
+// One SimCamera serves every camera-port connection. Unlike the real
+// camera, each connection may have its own exposure in progress, so
+// many clients can load the system at once.
+//
+// Each exposure runs in its own thread: it sleeps for the (simulated)
+// exposure time, renders the star field around where the mount was
+// pointing when the shutter opened, writes the FITS file, and then
+// holds the result until the readout time has passed. Finished
+// exposures are handed back to the main thread (which owns all the
+// sockets) through a pipe; see CompletionFD().
+
+class SimCamera {
+public:
+  SimCamera(SimClock &clock, SimMount &mount, const SimCameraParams &params);
+  ~SimCamera(void);
+
+  // Returns -1 if the connection has been lost, otherwise 0
+  int HandleMessage(int socket_fd);
+  void ConnectionClosed(int socket_fd);
+
+  // Becomes readable whenever SendCompletedExposures() has work to do
+  int CompletionFD(void) const { return completion_pipe[0]; }
+  void SendCompletedExposures(void);
+
+  struct Exposure;
+
+private:
+  SimClock &clock;
+  SimMount &mount;
+  SimCameraParams p;
+  double pixel_scale;		// arcsec/pixel, unbinned
+
+  int completion_pipe[2];
+  std::mutex done_lock;		// protects done_list
+  std::list<std::shared_ptr<Exposure>> done_list;
+  std::map<int, std::shared_ptr<Exposure>> active; // by socket fd
+  unsigned int next_seq {1};
+
+  double cooler_setpoint {-10.0};
+  std::string cooler_mode {"OFF"};
+
+  void StartExposure(CameraMessage *msg, int socket_fd);
+  void RunExposure(std::shared_ptr<Exposure> e);
+  void RenderExposure(Exposure &e);
+  void SendStatus(int socket_fd, CameraMessage *request = nullptr);
+  void HandleCooler(CameraMessage *msg, int socket_fd);
+};
+
+#endif
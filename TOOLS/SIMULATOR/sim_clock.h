@@ -0,0 +1,59 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  sim_clock.h -- Simulated (optionally accelerated) time for sim_server
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _SIM_CLOCK_H
+#define _SIM_CLOCK_H
+
+#include <sys/time.h>
+#include <julian.h>
+
+// All simulated activity (exposures, slews, sidereal time, DATE-OBS)
+// runs on this clock. With an acceleration factor of 1.0 it is
+// ordinary wall-clock time. With a factor of 10.0, a 60-second
+// exposure finishes in 6 seconds and the sky turns 10x faster, so
+// a whole night of scheduling can be exercised in an hour.
+class SimClock {
+public:
+  SimClock(double acceleration = 1.0) : accel(acceleration) {
+    start_wall = WallNow();
+  }
+
+  double Acceleration(void) const { return accel; }
+
+  // Simulated time, in seconds since the Unix epoch
+  double Now(void) const {
+    return start_wall + (WallNow() - start_wall)*accel;
+  }
+  JULIAN JNow(void) const { return JULIAN(2440587.5 + Now()/(24.0*3600.0)); }
+
+  // How much wall-clock time it takes for "sim_seconds" to pass
+  double WallSeconds(double sim_seconds) const { return sim_seconds/accel; }
+
+  static double WallNow(void) {
+    struct timeval tv;
+    (void) gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec/1000000.0;
+  }
+
+private:
+  const double accel;
+  double start_wall;
+};
+
+#endif
@@ -0,0 +1,405 @@
+/*  sim_mount.cc -- Simulated GM2000 mount, focusers, and flat light
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>		// strtod(), atoi()
+#include <string.h>
+#include <ctype.h>		// isdigit()
+#include <math.h>
+#include <alt_az.h>
+#include "sim_mount.h"
+
+SimMount::SimMount(SimClock &clk, const SimMountParams &params) :
+  clock(clk), p(params) {
+  // Start out tracking a spot on the meridian, 30 deg up from the
+  // celestial equator
+  position = DEC_RA(30.0*DEGREES, 0.0, clock.JNow());
+  focus_esatto = p.best_focus;
+}
+
+//****************************************************************
+//        Helpers for the LX200 string formats
+//****************************************************************
+
+static bool Is(const char *command, const char *prefix) {
+  return strncmp(command, prefix, strlen(prefix)) == 0;
+}
+
+// Accepts "HH:MM:SS", "+DD*MM:SS.S", "DDD*MM", etc. (any non-digit
+// separates fields; a trailing '#' ends the string).
+static bool ParseSexagesimal(const char *s, double *value) {
+  int sign = 1;
+  if (*s == '+' || *s == '-') {
+    if (*s == '-') sign = -1;
+    s++;
+  }
+  double fields[3] = { 0.0, 0.0, 0.0 };
+  int n = 0;
+  while (*s && *s != '#' && n < 3) {
+    if (isdigit(*s) || *s == '.') {
+      char *end;
+      fields[n++] = strtod(s, &end);
+      s = end;
+    } else {
+      s++;
+    }
+  }
+  if (n == 0) return false;
+  *value = sign*(fields[0] + fields[1]/60.0 + fields[2]/3600.0);
+  return true;
+}
+
+// Formats hours or degrees as [+-]DD:MM:SS[.s[s]]#
+static std::string Sexagesimal(double value, bool force_sign,
+			       int decimals, int width) {
+  const int scale = (decimals == 2 ? 100 : (decimals == 1 ? 10 : 1));
+  const bool negative = (value < 0.0);
+  long ticks = lround(fabs(value)*3600.0*scale);
+  const long sec_ticks = ticks % (60*scale);
+  ticks /= (60*scale);
+  const long minutes = ticks % 60;
+  const long whole = ticks / 60;
+
+  char sign[2] = { 0, 0 };
+  if (negative) sign[0] = '-';
+  else if (force_sign) sign[0] = '+';
+
+  char buffer[48];
+  if (decimals) {
+    sprintf(buffer, "%s%0*ld:%02ld:%0*.*lf#", sign, width, whole, minutes,
+	    3+decimals, decimals, sec_ticks/(double) scale);
+  } else {
+    sprintf(buffer, "%s%0*ld:%02ld:%02ld#", sign, width, whole, minutes,
+	    sec_ticks);
+  }
+  return std::string(buffer);
+}
+
+static double NormalizeHours(double h) { // into -12..+12
+  while (h > 12.0) h -= 24.0;
+  while (h < -12.0) h += 24.0;
+  return h;
+}
+
+//****************************************************************
+//        Motion
+//****************************************************************
+
+double
+SimMount::HourAngle(void) {
+  double ha = PointsAt().hour_angle(clock.JNow());
+  if (ha > M_PI) ha -= 2.0*M_PI;
+  return ha;
+}
+
+void
+SimMount::Update(void) {
+  if ((state == Slewing_ || state == Parking) && clock.Now() >= slew_end) {
+    state = state_after_slew;
+    position = slew_to;
+    if (state == Parked || state == Stopped) {
+      stopped_ha = slew_to.hour_angle(clock.JNow());
+    }
+  }
+}
+
+DEC_RA
+SimMount::PointsAt(void) {
+  Update();
+  switch(state) {
+  case Tracking:
+    return position;
+
+  case Stopped:
+  case Parked:
+    // Not tracking, so the sky moves past at the sidereal rate
+    return DEC_RA(position.dec(), stopped_ha, clock.JNow());
+
+  case Slewing_:
+  case Parking:
+  default:
+    {
+      const double move_time = slew_end - slew_start - p.settle_time;
+      double f = (move_time <= 0.0 ? 1.0 :
+		  (clock.Now() - slew_start)/move_time);
+      if (f > 1.0) f = 1.0;
+      const double d_ra = NormalizeHours(slew_to.ra() - slew_from.ra());
+      double ra = slew_from.ra() + f*d_ra;
+      if (ra < 0.0) ra += 24.0;
+      if (ra >= 24.0) ra -= 24.0;
+      return DEC_RA(slew_from.dec() + f*(slew_to.dec() - slew_from.dec()),
+		    ra*M_PI/12.0);
+    }
+  }
+}
+
+bool
+SimMount::Slewing(void) {
+  Update();
+  return (state == Slewing_ || state == Parking);
+}
+
+// The two axes of the GEM move at the same time, so the slew time is
+// set by whichever axis has farther to go.
+void
+SimMount::StartSlew(const DEC_RA &to, MountState final_state) {
+  slew_from = PointsAt();
+  slew_to = to;
+  const double ra_degrees = 15.0*fabs(NormalizeHours(to.ra() - slew_from.ra()));
+  const double dec_degrees = fabs(to.dec() - slew_from.dec())/DEGREES;
+  const double distance = (ra_degrees > dec_degrees ? ra_degrees : dec_degrees);
+
+  slew_start = clock.Now();
+  slew_end = slew_start + distance/p.slew_rate + p.settle_time;
+  state = (final_state == Parked ? Parking : Slewing_);
+  state_after_slew = final_state;
+}
+
+void
+SimMount::StopHere(MountState final_state) {
+  position = PointsAt();
+  stopped_ha = position.hour_angle(clock.JNow());
+  state = final_state;
+}
+
+int
+SimMount::StatusCode(void) {
+  Update();
+  switch(state) {
+  case Tracking: return 0;
+  case Stopped:  return (tracking_on ? 1 : 7);
+  case Slewing_: return 6;
+  case Parking:  return 2;
+  case Parked:   return 5;
+  }
+  return 99;
+}
+
+void
+SimMount::Guide(int north_msec, int east_msec) {
+  if (Slewing()) return;
+  DEC_RA now = PointsAt();
+  const double north_arcsec = p.guide_rate*north_msec/1000.0;
+  const double east_arcsec = p.guide_rate*east_msec/1000.0;
+  const double dec = now.dec() + north_arcsec*DEGREES/3600.0;
+  const double ra_hours = now.ra() + (east_arcsec/3600.0)/15.0/cos(now.dec());
+  position = DEC_RA(dec, ra_hours*M_PI/12.0);
+  if (state != Tracking) stopped_ha = position.hour_angle(clock.JNow());
+}
+
+void
+SimMount::MoveFocuser(bool is_c14, bool is_absolute, long amount) {
+  long &focuser = (is_c14 ? focus_c14 : focus_esatto);
+  if (is_absolute) {
+    focuser = amount;
+  } else {
+    focuser += amount;
+  }
+}
+
+double
+SimMount::DefocusBlur(void) const {
+  return p.focus_slope*fabs(focus_esatto - p.best_focus)/1000.0;
+}
+
+//****************************************************************
+//        Command()
+//****************************************************************
+std::string
+SimMount::Command(const char *command) {
+  const JULIAN now = clock.JNow();
+
+  //********************************
+  // Queries
+  //********************************
+  if (Is(command, ":GR#")) {
+    return Sexagesimal(PointsAt().ra(), false, 2, 2);
+  } else if (Is(command, ":GD#")) {
+    return Sexagesimal(PointsAt().dec()/DEGREES, true, 1, 2);
+  } else if (Is(command, ":GS#")) {
+    return Sexagesimal(SiderealTime(now), false, 2, 2);
+  } else if (Is(command, ":GA#") || Is(command, ":GZ#")) {
+    ALT_AZ alt_az(PointsAt(), now);
+    if (command[2] == 'A') {
+      return Sexagesimal(alt_az.altitude_of()/DEGREES, true, 0, 2);
+    }
+    // The mount counts azimuth from north; ALT_AZ counts from south
+    double az = alt_az.azimuth_of()/DEGREES + 180.0;
+    if (az >= 360.0) az -= 360.0;
+    return Sexagesimal(az, false, 0, 3);
+  } else if (Is(command, ":Gstat#")) {
+    return std::to_string(StatusCode()) + "#";
+  } else if (Is(command, ":pS#") || Is(command, ":Gm#")) {
+    return (WestOfPier() ? "West#" : "East#");
+  } else if (Is(command, ":Gmte#")) {
+    // minutes until the mount reaches its limit at HA = +1 hour
+    const double hours = 1.0 - HourAngle()*12.0/M_PI;
+    char buffer[16];
+    sprintf(buffer, "%04ld#", (hours > 0.0 ? lround(hours*60.0) : 0L));
+    return std::string(buffer);
+  } else if (Is(command, ":Ggui#")) {
+    char buffer[16];
+    sprintf(buffer, "%.4lf#", p.guide_rate);
+    return std::string(buffer);
+  } else if (Is(command, ":Gdat#")) {
+    return (dual_axis ? "1" : "0");
+  } else if (Is(command, ":GaXa#") || Is(command, ":GaXb#")) {
+    char buffer[24];
+    const double angle = (command[4] == 'a' ? HourAngle()/DEGREES :
+			  PointsAt().dec()/DEGREES - 90.0);
+    sprintf(buffer, "%+09.4lf#", angle);
+    return std::string(buffer);
+  } else if (Is(command, ":getalst#")) {
+    return std::to_string(num_align_points) + "#";
+  } else if (Is(command, ":getali")) {
+    return "E#";
+  } else if (Is(command, ":h?#")) {
+    return (state == Parked ? "1" : "2");
+
+  //********************************
+  // Setting targets and parameters
+  //********************************
+  } else if (Is(command, ":Sr")) {
+    double hours;
+    if (!ParseSexagesimal(command+3, &hours)) return "0";
+    target = DEC_RA(target.dec(), hours*M_PI/12.0);
+    return "1";
+  } else if (Is(command, ":Sdat")) {
+    dual_axis = (command[5] == '1');
+    return "1";
+  } else if (Is(command, ":Sd")) {
+    double degrees;
+    if (!ParseSexagesimal(command+3, &degrees)) return "0";
+    target = DEC_RA(degrees*DEGREES, target.ra_radians());
+    return "1";
+  } else if (Is(command, ":SaXa") || Is(command, ":SaXb")) {
+    double &angle = (command[4] == 'a' ? target_ra_axis : target_dec_axis);
+    angle = atof(command+5);
+    return "1";
+  } else if (Is(command, ":Sa")) {
+    double degrees;
+    if (!ParseSexagesimal(command+3, &degrees)) return "0";
+    target_alt = degrees*DEGREES;
+    return "1";
+  } else if (Is(command, ":Sz")) {
+    double degrees;
+    if (!ParseSexagesimal(command+3, &degrees)) return "0";
+    target_az = (degrees - 180.0)*DEGREES;
+    return "1";
+  } else if (Is(command, ":SRTMP") || Is(command, ":SRPRS")) {
+    return "1";
+
+  //********************************
+  // Motion
+  //********************************
+  } else if (Is(command, ":MS#") || Is(command, ":MM#")) {
+    if (state == Parked) return "6Object below limits#";
+    ALT_AZ alt_az(target, now);
+    if (alt_az.altitude_of() < 0.0) return "1Object Below Horizon#";
+    tracking_on = true;
+    StartSlew(target, Tracking);
+    return "0";
+  } else if (Is(command, ":MA#")) {
+    DEC_RA loc;
+    ALT_AZ(target_alt, target_az).DEC_RA_of(now, loc);
+    StartSlew(loc, Tracking);
+    return "0";
+  } else if (Is(command, ":MaX#")) {
+    // Approximate: treat the RA axis angle as hour angle and the Dec
+    // axis angle as the distance below the pole
+    DEC_RA loc((90.0 - fabs(target_dec_axis))*DEGREES,
+	       target_ra_axis*DEGREES, now);
+    StartSlew(loc, Stopped);
+    return "0";
+  } else if (Is(command, ":FLIP#")) {
+    if (Slewing() || state != Tracking) return "0";
+    // A flip swings both axes about 180 degrees and comes back to
+    // the same spot on the sky.
+    const DEC_RA here = PointsAt();
+    StartSlew(here, Tracking);
+    slew_end += 180.0/p.slew_rate;
+    return "1";
+  } else if (Is(command, ":NUDGE")) {
+    int ra_arcsec, dec_arcsec;
+    if (sscanf(command+6, "%d,%d", &ra_arcsec, &dec_arcsec) != 2) {
+      return "1Invalid nudge#";
+    }
+    // scope_api.cc negates the RA term and flips the sign of the Dec
+    // term depending on the side of the pier.
+    const DEC_RA here = PointsAt();
+    const double dec_sign = (WestOfPier() ? -1.0 : 1.0);
+    const double dec = here.dec() + dec_sign*dec_arcsec*DEGREES/3600.0;
+    const double ra_hours = here.ra() -
+      (ra_arcsec/3600.0)/15.0/cos(here.dec());
+    StartSlew(DEC_RA(dec, ra_hours*M_PI/12.0), Tracking);
+    return "0";
+  } else if (Is(command, ":Q#")) {
+    if (Slewing()) StopHere(Tracking);
+    return "";
+  } else if (Is(command, ":hP#")) {
+    StartSlew(DEC_RA(0.0, 0.0, now), Parked);
+    return "";
+  } else if (Is(command, ":PO#")) {
+    if (state == Parked) {
+      position = PointsAt();
+      state = Tracking;
+      tracking_on = true;
+    }
+    return "";
+  } else if (Is(command, ":RT9#")) {
+    tracking_on = false;
+    if (state == Tracking) StopHere(Stopped);
+    return "";
+  } else if (Is(command, ":RT2#") || Is(command, ":AP#")) {
+    tracking_on = true;
+    if (state == Stopped) {
+      position = PointsAt();
+      state = Tracking;
+    }
+    return "";
+
+  //********************************
+  // Syncs and the pointing model
+  //********************************
+  } else if (Is(command, ":CMS#")) {
+    num_align_points++;
+    return "V#";
+  } else if (Is(command, ":CMCFG")) {
+    return "0#";
+  } else if (Is(command, ":CM#")) {
+    position = target;
+    if (state != Tracking) stopped_ha = target.hour_angle(now);
+    return "Coordinates     matched        #";
+  } else if (Is(command, ":newalig#")) {
+    num_align_points = 0;
+    return "V#";
+  } else if (Is(command, ":newalpt")) {
+    char buffer[16];
+    sprintf(buffer, "%03d#", ++num_align_points);
+    return std::string(buffer);
+  } else if (Is(command, ":endalig#")) {
+    return "V#";
+  } else if (Is(command, ":delalig#")) {
+    num_align_points = 0;
+    return "1";
+  }
+
+  // Everything else (:U2#, :p0#, :hW#, :hN#, :Me#, ...) is accepted
+  // silently.
+  return "";
+}
@@ -0,0 +1,113 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  sim_mount.h -- Simulated GM2000 mount, focusers, and flat light
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#ifndef _SIM_MOUNT_H
+#define _SIM_MOUNT_H
+
+#include <string>
+#include <dec_ra.h>
+#include "sim_clock.h"
+
+// SimMount answers the same LX200/GM2000 command strings that
+// scope_api.cc sends through the scope server (":GR#", ":MS#",
+// ":Gstat#", ...). Commands that scope_api.cc never sends are
+// answered as if they had been accepted but otherwise ignored.
+//
+// Slews take (angular distance)/(slew rate) plus a settling time,
+// both measured on the SimClock. While a slew is in progress the
+// reported position moves linearly from the start to the target.
+
+struct SimMountParams {
+  double slew_rate {2.0};	// degrees/second
+  double settle_time {3.0};	// seconds added to every slew
+  double guide_rate {7.5};	// arcsec/second for guide (track) pulses
+  long   best_focus {0};	// Esatto position with the sharpest stars
+  double focus_slope {0.0};	// FWHM growth, pixels per 1000 ticks
+				// of focus error (0 = focus ignored)
+};
+
+class SimMount {
+public:
+  SimMount(SimClock &clock, const SimMountParams &params);
+
+  // Interprets one command and returns the mount's complete response
+  // (possibly empty).
+  std::string Command(const char *command);
+
+  // Where the mount points right now (catalog coordinates; the
+  // simulated mount has no pointing error)
+  DEC_RA PointsAt(void);
+  bool Slewing(void);
+
+  // Guide pulses from an lxTrackMessage
+  void Guide(int north_msec, int east_msec);
+
+  // Focusers
+  void MoveFocuser(bool is_c14, bool is_absolute, long amount);
+  long FocusC14(void) const { return focus_c14; }
+  long FocusEsatto(void) const { return focus_esatto; }
+  // Extra star blur (pixels FWHM, added in quadrature to the seeing)
+  // caused by the Esatto being away from best focus
+  double DefocusBlur(void) const;
+
+  // Flat light: the status byte uses the same bits as the real box
+  void MoveFlatLight(bool up) { flatlight_up = up; }
+  unsigned char FlatLightStatusByte(void) const {
+    return (flatlight_up ? 0x04 : 0x08); }
+
+private:
+  enum MountState { Tracking, Stopped, Slewing_, Parking, Parked };
+
+  SimClock &clock;
+  SimMountParams p;
+
+  MountState state {Tracking};
+  DEC_RA position;		// valid when tracking (or at slew start)
+  double stopped_ha {0.0};	// radians; used when not tracking
+  bool   tracking_on {true};
+
+  // current slew
+  DEC_RA slew_from;
+  DEC_RA slew_to;
+  double slew_start {0.0};	// SimClock seconds
+  double slew_end {0.0};
+  MountState state_after_slew {Tracking};
+
+  // values loaded by :Sr#, :Sd#, :Sa#, :Sz#, :SaXa#, :SaXb#
+  DEC_RA target;
+  double target_alt {0.0};	// radians
+  double target_az {0.0};	// radians, S=0, W=+
+  double target_ra_axis {0.0};	// degrees
+  double target_dec_axis {0.0};	// degrees
+
+  long focus_c14 {0};
+  long focus_esatto {0};
+  bool flatlight_up {false};
+  bool dual_axis {true};
+  int  num_align_points {0};
+
+  void Update(void);		// finish any slew whose time has come
+  void StartSlew(const DEC_RA &to, MountState final_state);
+  void StopHere(MountState final_state);
+  double HourAngle(void);	// radians, -pi..+pi
+  bool WestOfPier(void) { return HourAngle() < 0.0; }
+  int StatusCode(void);
+};
+
+#endif
@@ -0,0 +1,341 @@
+/*  sim_server.cc -- Camera and scope servers with simulated hardware
+ *
+ *  Copyright (C) 2024 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>		// exit(), atof()
+#include <string.h>		// memset()
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>		// getopt(), close()
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <ports.h>
+#include <lx_gen_message.h>
+#include <lx_StatusMessage.h>
+#include <lx_FocusMessage.h>
+#include <lx_ScopeMessage.h>
+#include <lx_ScopeResponseMessage.h>
+#include <lx_TrackMessage.h>
+#include <lx_FlatLightMessage.h>
+#include <lx_ResyncMessage.h>
+#include "sim_clock.h"
+#include "sim_mount.h"
+#include "sim_camera.h"
+
+//****************************************************************
+// sim_server listens on both the camera port and the scope port and
+// speaks the same messages as ccd_server and focus_server, so every
+// client program (session, expose, goto, focus, ...) can be run
+// without any hardware. Point clients at it by setting
+// ASTRO_SERVER_HOST=localhost (see ports.h).
+//****************************************************************
+
+#define MAX_CONNECTIONS 64
+
+struct Connection {
+  int fd;			// -1 means unused
+  bool is_camera;		// otherwise, a scope connection
+};
+
+static Connection connections[MAX_CONNECTIONS];
+
+void usage(void) {
+  fprintf(stderr, "usage: sim_server [-a accel] [-r readout_secs] [-s slew_deg_per_sec]\n");
+  fprintf(stderr, "       [-t settle_secs] [-S seeing_arcsec] [-W width -H height]\n");
+  fprintf(stderr, "       [-f best_focus -b focus_slope] [-c camera_port] [-p scope_port]\n");
+  fprintf(stderr, "  a: time acceleration (10 means 10x faster than real time)\n");
+  fprintf(stderr, "  W, H: unbinned sensor size [pixels]\n");
+  fprintf(stderr, "  f: Esatto position of best focus\n");
+  fprintf(stderr, "  b: defocus blur [pixels FWHM per 1000 ticks from best focus]\n");
+  exit(-2);
+}
+
+static int Listen(int port) {
+  struct sockaddr_in my_address;
+  memset(&my_address, 0, sizeof(my_address));
+  my_address.sin_port = htons(port);
+  my_address.sin_family = AF_INET;
+  my_address.sin_addr.s_addr = INADDR_ANY;
+
+  int s = socket(PF_INET, SOCK_STREAM, 0);
+  if (s < 0) {
+    perror("Error creating socket");
+    exit(2);
+  }
+  int True = 1;
+  if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &True, sizeof(True)) < 0) {
+    perror("Error setting SO_REUSEADDR");
+  }
+  if (bind(s, (struct sockaddr *) &my_address, sizeof(my_address)) < 0) {
+    fprintf(stderr, "sim_server: cannot bind port %d: %s\n", port, strerror(errno));
+    exit(2);
+  }
+  if (listen(s, MAX_CONNECTIONS) < 0) {
+    perror("Error setting up socket queue size");
+    exit(2);
+  }
+  return s;
+}
+
+static void Accept(int listen_fd, bool is_camera) {
+  struct sockaddr_in his_address;
+  socklen_t socketaddresslength = sizeof(his_address);
+  int s = accept(listen_fd, (struct sockaddr *) &his_address, &socketaddresslength);
+  if (s < 0) {
+    perror("sim_server: accept");
+    return;
+  }
+  for (int j=0; j<MAX_CONNECTIONS; j++) {
+    if (connections[j].fd < 0) {
+      connections[j].fd = s;
+      connections[j].is_camera = is_camera;
+      fprintf(stderr, "%s connection established on socket %d.\n",
+	      (is_camera ? "Camera" : "Scope"), s);
+      return;
+    }
+  }
+  fprintf(stderr, "sim_server: too many connections; refusing socket %d\n", s);
+  close(s);
+}
+
+//****************************************************************
+//        Scope messages
+//****************************************************************
+static void SendScopeStatus(SimMount &mount, int socket_fd, int status) {
+  lxStatusMessage outbound(socket_fd, LX_SERVER_READY, status);
+  outbound.SetFocusPositionC14(mount.FocusC14());
+  outbound.SetFocusPositionEsatto(mount.FocusEsatto());
+  outbound.send();
+}
+
+// The mount's answer is cut down to exactly what focus_server would
+// have read from the serial line for this kind of message.
+static void HandleScopeCommand(SimMount &mount, lxScopeMessage *msg, int socket_fd) {
+  std::string reply = mount.Command(msg->GetMessageString());
+  ScopeResponseStatus status = Okay;
+  char buffer[36];
+  buffer[0] = 0;
+
+  switch(msg->GetResponseType()) {
+  case Nothing:
+    reply.clear();
+    break;
+
+  case FixedLength:
+    if ((int) reply.length() < msg->GetResponseCharCount()) {
+      status = TimeOut;
+    } else {
+      reply.resize(msg->GetResponseCharCount());
+    }
+    break;
+
+  case MixedModeResponse:
+    {
+      char single_char_choices[32];
+      msg->GetSingleCharacterResponses(single_char_choices);
+      if (reply.empty()) {
+	status = TimeOut;
+      } else if (strchr(single_char_choices, reply[0])) {
+	reply.resize(1);
+      }
+    }
+    break;
+
+  case StringResponse:
+    if (reply.empty()) status = TimeOut;
+    break;
+  }
+
+  strncpy(buffer, reply.c_str(), sizeof(buffer));
+  buffer[sizeof(buffer)-1] = 0;
+  lxScopeResponseMessage outbound(socket_fd, buffer, status);
+  outbound.send();
+}
+
+static int HandleScopeMessage(SimMount &mount, int socket_fd) {
+  lxGenMessage *new_message = lxGenMessage::ReceiveMessage(socket_fd);
+  if (new_message == 0) return -1;
+
+  switch(new_message->MessageID()) {
+  case lxRequestStatusMessageID:
+  case lxResyncMessageID:
+    SendScopeStatus(mount, socket_fd, SCOPE_IDLE);
+    break;
+
+  case lxScopeMessageID:
+    {
+      lxScopeMessage msg(new_message);
+      HandleScopeCommand(mount, &msg, socket_fd);
+    }
+    break;
+
+  case lxFocusMessageID:
+    {
+      lxFocusMessage msg(new_message);
+      SendScopeStatus(mount, socket_fd, SCOPE_IO_BUSY);
+      mount.MoveFocuser(msg.FocuserIsC14(), msg.FocusTravelIsAbsolute(),
+			msg.GetFocusTravelInMsec());
+      SendScopeStatus(mount, socket_fd, SCOPE_IDLE);
+    }
+    break;
+
+  case lxTrackMessageID:
+    {
+      lxTrackMessage msg(new_message);
+      SendScopeStatus(mount, socket_fd, SCOPE_IO_BUSY);
+      mount.Guide(msg.GetTrackNorthTimeInMsec(), msg.GetTrackEastTimeInMsec());
+      SendScopeStatus(mount, socket_fd, SCOPE_IDLE);
+    }
+    break;
+
+  case lxFlatLightMessageID:
+    {
+      lxFlatLightMessage msg(new_message);
+      if (msg.MoveCommanded()) mount.MoveFlatLight(msg.GetFlatLightDirUp());
+      lxFlatLightMessage outbound(socket_fd);
+      outbound.SetStatusByte(mount.FlatLightStatusByte());
+      outbound.send();
+    }
+    break;
+
+  default:
+    fprintf(stderr, "sim_server: bad inbound scope message type: 0x%x\n",
+	    new_message->MessageID());
+  }
+
+  delete new_message;
+  return 0;
+}
+
+//****************************************************************
+//        main()
+//****************************************************************
+int main(int argc, char **argv) {
+  int ch;			// option character
+  double accel = 1.0;
+  int camera_port = CameraPort();
+  int scope_port = ScopePort();
+  SimMountParams mount_params;
+  SimCameraParams camera_params;
+
+  while((ch = getopt(argc, argv, "a:r:s:t:S:W:H:f:b:c:p:")) != -1) {
+    switch(ch) {
+    case 'a':
+      accel = atof(optarg);
+      break;
+    case 'r':
+      camera_params.readout_time = atof(optarg);
+      break;
+    case 's':
+      mount_params.slew_rate = atof(optarg);
+      break;
+    case 't':
+      mount_params.settle_time = atof(optarg);
+      break;
+    case 'S':
+      camera_params.seeing = atof(optarg);
+      break;
+    case 'W':
+      camera_params.width = atoi(optarg);
+      break;
+    case 'H':
+      camera_params.height = atoi(optarg);
+      break;
+    case 'f':
+      mount_params.best_focus = atol(optarg);
+      break;
+    case 'b':
+      mount_params.focus_slope = atof(optarg);
+      break;
+    case 'c':
+      camera_port = atoi(optarg);
+      break;
+    case 'p':
+      scope_port = atoi(optarg);
+      break;
+    case '?':
+    default:
+      usage();
+    }
+  }
+  if (accel <= 0.0 || mount_params.slew_rate <= 0.0 ||
+      camera_params.width < 16 || camera_params.height < 16) {
+    usage();
+  }
+
+  // A client that goes away mid-send must not kill the server
+  signal(SIGPIPE, SIG_IGN);
+
+  SimClock clock(accel);
+  SimMount mount(clock, mount_params);
+  SimCamera camera(clock, mount, camera_params);
+
+  for (int j=0; j<MAX_CONNECTIONS; j++) connections[j].fd = -1;
+  const int camera_listen = Listen(camera_port);
+  const int scope_listen = Listen(scope_port);
+  fprintf(stderr, "sim_server: camera on port %d, scope on port %d, time x%.1lf\n",
+	  camera_port, scope_port, accel);
+
+  while(1) {
+    fd_set server_fds_r;
+    int largest_fd = camera.CompletionFD();
+    FD_ZERO(&server_fds_r);
+    FD_SET(camera.CompletionFD(), &server_fds_r);
+    FD_SET(camera_listen, &server_fds_r);
+    FD_SET(scope_listen, &server_fds_r);
+    if (camera_listen > largest_fd) largest_fd = camera_listen;
+    if (scope_listen > largest_fd) largest_fd = scope_listen;
+    for (int j=0; j<MAX_CONNECTIONS; j++) {
+      if (connections[j].fd >= 0) {
+	FD_SET(connections[j].fd, &server_fds_r);
+	if (connections[j].fd > largest_fd) largest_fd = connections[j].fd;
+      }
+    }
+
+    int retval = select(largest_fd+1, &server_fds_r, 0, 0, 0);
+    if (retval < 0) {
+      if (errno == EINTR) continue;
+      perror("sim_server: select failure");
+      exit(2);
+    }
+
+    if (FD_ISSET(camera.CompletionFD(), &server_fds_r)) {
+      camera.SendCompletedExposures();
+    }
+
+    for (int j=0; j<MAX_CONNECTIONS; j++) {
+      Connection &c = connections[j];
+      if (c.fd >= 0 && FD_ISSET(c.fd, &server_fds_r)) {
+	const int result = (c.is_camera ? camera.HandleMessage(c.fd) :
+			    HandleScopeMessage(mount, c.fd));
+	if (result < 0) {
+	  // the connection has been lost
+	  fprintf(stderr, "Closing connection on socket %d\n", c.fd);
+	  if (c.is_camera) camera.ConnectionClosed(c.fd);
+	  close(c.fd);
+	  c.fd = -1;
+	}
+      }
+    }
+
+    if (FD_ISSET(camera_listen, &server_fds_r)) Accept(camera_listen, true);
+    if (FD_ISSET(scope_listen, &server_fds_r)) Accept(scope_listen, false);
+  }
+  /*NOTREACHED*/
+}
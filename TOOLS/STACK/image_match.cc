@@ -0,0 +1,147 @@
+/*  image_match.cc -- Find the offset between two images' starlists
+ *
+ *  Copyright (C) 2007 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>. 
+ */
+#include <stdio.h>
+#include <math.h>
+#include <IStarList.h>
+#include "image_match.h"
+
+struct image_delta {
+  double del_x, del_y;
+  int count;			// number of other entries with "same"
+				// x and y.
+};
+
+// image_match: returns 0 on success, 1 if failed
+// puts resulting x and y offsets into *del_x and *del_y.
+int image_match(IStarList *i1_list, IStarList *i2_list,
+		bool inhibit_quick,
+		double expected_x, double expected_y,
+		double *del_x, double *del_y) {
+
+  if (!inhibit_quick) {
+    if(simple_image_match(i1_list, i2_list,
+			  expected_x, expected_y,
+			  del_x, del_y) == 0) return 0;
+  }
+
+  const int i1_size = i1_list->NumStars;
+  const int i2_size = i2_list->NumStars;
+  const int matrix_size = i1_size * i2_size;
+
+  image_delta *mat = new image_delta[matrix_size];
+
+#define MATRIX(h1, h2) mat[h1*i2_size + h2]
+
+  int j1, j2;
+  for(j1 = 0; j1 < i1_size; j1++) {
+    for(j2 = 0; j2 < i2_size; j2++) {
+      image_delta *pair = &(MATRIX(j1, j2));
+      pair->del_x = i2_list->StarCenterX(j2) - i1_list->StarCenterX(j1);
+      pair->del_y = i2_list->StarCenterY(j2) - i1_list->StarCenterY(j1);
+      pair->count = 0;
+    }
+  }
+
+#define TOLERANCE 3.0		// 3 pixels? (match to say same transform)
+#define EXPECTATION_TOLERANCE 18.0 // 8 pixels? (match to say it's same star)
+
+  for(j1 = 0; j1 < matrix_size; j1++) {
+    if(fabs(mat[j1].del_x - expected_x) < EXPECTATION_TOLERANCE &&
+       fabs(mat[j1].del_y - expected_y) < EXPECTATION_TOLERANCE) {
+      for(j2 = 0; j2 < matrix_size; j2++) {
+	if(fabs(mat[j1].del_x - mat[j2].del_x) < 1.0 &&
+	   fabs(mat[j1].del_y - mat[j2].del_y) < 1.0)
+	  mat[j1].count++;
+      }
+    }
+  }
+
+#if 0
+  fprintf(stderr, "-------- expected x = %f, expected y = %f\n",
+	  expected_x, expected_y);
+  for(j1 = 0; j1 < matrix_size; j1++) {
+    if(mat[j1].count > 1) 
+      fprintf(stderr, "(%d, %d) del_x = %f, del_y = %f, count = %d\n",
+	      j1/i2_size, j1 % i2_size, mat[j1].del_x, mat[j1].del_y,
+	      mat[j1].count);
+  }
+#endif
+
+  int biggest = 0;
+  int index_of_biggest = -1;
+  for(j1 = 0; j1 < matrix_size; j1++) {
+    if(mat[j1].count > biggest) {
+      biggest = mat[j1].count;
+      index_of_biggest = j1;
+    }
+  }
+
+  if(index_of_biggest == -1) {
+    delete [] mat;
+    return 1; // no match
+  }
+
+  const double ref_x_delta = mat[index_of_biggest].del_x;
+  const double ref_y_delta = mat[index_of_biggest].del_y;
+  double sum_err_x = 0.0;
+  double sum_err_y = 0.0;
+  double sum_sq_x = 0.0;
+  double sum_sq_y = 0.0;
+  int cnt = 0;
+  
+  for(j1 = 0; j1 < i1_size; j1++) {
+    int min_err_index = -1;
+    double min_err = 1000000.0;
+
+    for(j2 = 0; j2 < i2_size; j2++) {
+      image_delta *pair = &(MATRIX(j1, j2));
+      double err_x = ref_x_delta - pair->del_x;
+      double err_y = ref_y_delta - pair->del_y;
+      double err_sq = err_x*err_x + err_y*err_y;
+      if(err_sq < min_err) {
+	min_err = err_sq;
+	min_err_index = j2;
+      }
+    }
+    
+    if(min_err_index >= 0 &&
+       min_err <= TOLERANCE*TOLERANCE) {
+      double err_x = ref_x_delta - MATRIX(j1,min_err_index).del_x;
+      double err_y = ref_y_delta - MATRIX(j1,min_err_index).del_y;
+      /* fprintf(stderr, "star %d matched to %d at (%.1f %.1f)\n",
+	 j1, min_err_index,
+	 MATRIX(j1,min_err_index).del_x,
+	 MATRIX(j1,min_err_index).del_y); */
+
+      cnt++;
+      sum_err_x += err_x;
+      sum_err_y += err_y;
+      sum_sq_x  += (err_x * err_x);
+      sum_sq_y  += (err_y * err_y);
+    }
+  }
+
+  delete [] mat;
+
+  *del_x = ref_x_delta + sum_err_x/cnt;
+  *del_y = ref_y_delta + sum_err_y/cnt;
+  fprintf(stderr, "Offset = (%f, %f), stdev = (%f, %f), %d matches\n",
+	  *del_x, *del_y, sqrt(sum_sq_x/cnt), sqrt(sum_sq_y/cnt), cnt);
+  return 0;
+}
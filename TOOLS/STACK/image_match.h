@@ -0,0 +1,40 @@
+/* This may look like C code, but it is really -*-c++-*- */
+/*  image_match.h -- Find the offset between two images' starlists
+ *
+ *  Copyright (C) 2007 Mark J. Munkacsy
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program (file: COPYING).  If not, see
+ *   <http://www.gnu.org/licenses/>. 
+ */
+#ifndef _IMAGE_MATCH_H
+#define _IMAGE_MATCH_H
+
+#include <IStarList.h>
+
+// Both return 0 on success, 1 if failed. The resulting x and y
+// offsets (i2 - i1) go into *del_x and *del_y.
+
+// simple_image_match relies on matching star names (in simple_stack.cc)
+int simple_image_match(IStarList *i1_list, IStarList *i2_list,
+		       double expected_x, double expected_y,
+		       double *del_x, double *del_y);
+
+// image_match tries simple_image_match() first (unless inhibit_quick)
+// and then falls back to a brute-force comparison of all star pairs.
+int image_match(IStarList *i1_list, IStarList *i2_list,
+		bool inhibit_quick,
+		double expected_x, double expected_y,
+		double *del_x, double *del_y);
+
+#endif
@@ -171,10 +171,8 @@ main(int argc, char **argv) {
   argc -= optind;
   argv += optind;
 
-  char HGSCfilename[132];
-  sprintf(HGSCfilename, CATALOG_DIR "/%s", starname);
-  FILE *HGSC_fp = fopen(HGSCfilename, "r");
-  if(!HGSC_fp) {
+  HGSCList Catalog(starname);
+  if(!Catalog.NameOK()) {
     fprintf(stderr, "Cannot open catalog file for %s\n", starname);
     exit(-2);
   }
@@ -189,7 +187,6 @@ main(int argc, char **argv) {
     fprintf(fp_out, "################################################\n");
   }
 
-  HGSCList Catalog(HGSC_fp);
   // argc now contains a count of the total number of images being analyzed
   AnalysisImage ImageArray[argc];
 
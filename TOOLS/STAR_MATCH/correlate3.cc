@@ -32,6 +32,7 @@
 #include "correlate3.h"
 #include "correlate_internal3.h"
 #include "matcher3.h"
+#include <trace.h>
 
 #define SINGLE_TASK
 //#define DEBUG_SINGLE_PAIR
@@ -152,6 +153,28 @@ correlate(Image &primary_image,
 	  const char *param_filename,
 	  const char *residual_filename,
 	  Context &context) {
+  // READ in the HGSC stars
+  FILE *hgsc_fp = fopen(HGSCfilename, "r");
+  if(!hgsc_fp) {
+    fprintf(stderr, "Correlate: cannot open '%s'\n", HGSCfilename);
+    return nullptr;
+  }
+  HGSCList hgsc(hgsc_fp);
+  fclose(hgsc_fp);
+
+  return correlate(primary_image, list, hgsc, ref_location,
+		   param_filename, residual_filename, context);
+}
+
+const WCS *
+correlate(Image &primary_image,
+	  IStarList *list,
+	  HGSCList &hgsc,
+	  DEC_RA *ref_location,
+	  const char *param_filename,
+	  const char *residual_filename,
+	  Context &context) {
+  TraceSpan span("correlate");
   std::ofstream param_stream;
   if(param_filename) param_stream.open(param_filename);
 
@@ -186,15 +209,6 @@ correlate(Image &primary_image,
 
   //Truth truth(context.image_filename);
 
-  // READ in the HGSC stars
-  FILE *hgsc_fp = fopen(HGSCfilename, "r");
-  if(!hgsc_fp) {
-    fprintf(stderr, "Correlate: cannot open '%s'\n", HGSCfilename);
-    return nullptr;
-  }
-  HGSCList hgsc(hgsc_fp);
-  fclose(hgsc_fp);
-
   //********************************
   // Create the master image_list
   // (This is already sorted by brightness, since the IStarList in the
@@ -361,6 +375,7 @@ correlate(Image &primary_image,
 
   fprintf(stderr, "Best solution is at %.1lf sigma above average.\n", num_stddev);
 
+  const WCS *result = nullptr;
   if (best_solution.solution_wcs == nullptr or num_stddev < 4.0) {
     fprintf(stderr, "No solution found.\n");
   } else {
@@ -379,9 +394,20 @@ correlate(Image &primary_image,
     fprintf(stderr, "final num_match = %d\n", num_match);
     best_solution.solution_wcs->PrintRotAndScale();
   
-    return best_solution.solution_wcs;
+    result = best_solution.solution_wcs;
   }
-  return nullptr;
+
+  // Undo the wraparound fix so that the caller's catalog can be
+  // used again.
+  if (context.wraparound) {
+    for (HGSC *h = it.First(); h; h = it.Next()) {
+      if (h->location.ra_radians() < 0.0) {
+	h->location = DEC_RA(h->location.dec(),
+			     h->location.ra_radians() + 2*M_PI);
+      }
+    }
+  }
+  return result;
 }
 
 IMG_DATA::IMG_DATA(IStarList::IStarOneStar &starlist_entry) : star(starlist_entry) {
@@ -22,6 +22,7 @@
 
 #include <IStarList.h>
 #include <dec_ra.h>
+#include <HGSC.h>
 #include <Image.h>
 #include "TCS.h"
 #include "wcs.h"
@@ -67,4 +68,16 @@ correlate(Image &primary_image,
 	  const char *residual_filename,
 	  Context &context);
 
+// Same, but with a catalog that is already in memory. The catalog is
+// used as scratch space while correlate() runs (so it must not be
+// shared with another thread), but is left as it was found.
+const WCS *
+correlate(Image &primary_image,
+	  IStarList *list,
+	  HGSCList &hgsc,
+	  DEC_RA *ref_location,
+	  const char *param_filename,
+	  const char *residual_filename,
+	  Context &context);
+
 #endif
@@ -67,6 +67,7 @@ int main(int argc, char **argv) {
       printerror(status);
     }
   }
+  IStarList::RemoveSidecar(image_filename);
 
   return 0;
 }
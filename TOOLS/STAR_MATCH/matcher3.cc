@@ -21,6 +21,7 @@
 #include <dec_ra.h>
 #include <math.h>
 #include <algorithm>
+#include <vector>
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_linalg.h>
@@ -388,10 +389,21 @@ Matcher(Context *context,
 #ifdef PRINTSTARLISTS
   fprintf(stderr, "image_list follows:\n");
 #endif
+  // This runs once per trial WCS, so the trial locations are all
+  // converted in a single call.
+  std::vector<double> img_x(num_img_to_use);
+  std::vector<double> img_y(num_img_to_use);
+  std::vector<DEC_RA> img_loc(num_img_to_use);
+  for (int i=0; i<num_img_to_use; i++) {
+    img_x[i] = image_list[i]->star.nlls_x;
+    img_y[i] = image_list[i]->star.nlls_y;
+  }
+  wcs.TransformToDecRA(num_img_to_use, img_x.data(), img_y.data(), img_loc.data());
+
   for (unsigned int i=0; i<image_list.size(); i++) {
     IMG_DATA *x = image_list[i];
     if ((int) i < num_img_to_use) {
-      x->trial_loc = grid->Normalize(wcs.Transform(x->star.nlls_x, x->star.nlls_y));
+      x->trial_loc = grid->Normalize(img_loc[i]);
     }
     x->matches.clear();
 #ifdef PRINTSTARLISTS
@@ -1,6 +1,6 @@
 /*  star_match.cc -- Match stars in an image with a catalog
  *
- *  Copyright (C) 2007 Mark J. Munkacsy
+ *  Copyright (C) 2007, 2024 Mark J. Munkacsy
  *
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -27,6 +27,7 @@
 #include "correlate3.h"
 #include "aperture_phot.h"
 #include <gendefs.h>
+#include <vector>
 
 Verbosity verbosity = { .residuals = false,
 			.fixups = false,
@@ -53,6 +54,7 @@ int main(int argc, char **argv) {
   int  no_shortcuts = 0;	// used with "-b" command line option
   int use_high_precision = 0;
   char *residual_filename = 0;
+  int poly_order = 0;		// 0 means keep the bilinear WCS
 
   // Command line options:
   // -n star_name       Name of region around which image was taken
@@ -67,8 +69,11 @@ int main(int argc, char **argv) {
   // -w filename        Name of bias file to be used (values in
   // arcsec)
   // -u                 (upside-down): match the image inverted
+  // -P order           Fit a polynomial-distortion (POLY) WCS of
+  //                    this order (1..3) to the matched stars and
+  //                    write that instead
 
-  while((ch = getopt(argc, argv, "uw:r:ebhfn:i:d:s:p:")) != -1) {
+  while((ch = getopt(argc, argv, "uw:r:ebhfn:i:d:s:p:P:")) != -1) {
     switch(ch) {
     case 'u':
       upside_down = true;
@@ -99,6 +104,10 @@ int main(int argc, char **argv) {
       param_filename = strdup(optarg);
       break;
 
+    case 'P':
+      poly_order = atoi(optarg);
+      break;
+
     case 'n':			// name of star
       starname = optarg;
       break;
@@ -199,8 +208,11 @@ int main(int argc, char **argv) {
   const WCS *wcs = 0;
   Context context;
   {
-    char HGSCfilename[132];
-    sprintf(HGSCfilename, CATALOG_DIR"/%s", starname);
+    // (uses the session's compiled bundle for this star if there is one)
+    HGSCList catalog(starname);
+    if (!catalog.NameOK()) {
+      fprintf(stderr, "star_match: cannot open catalog '%s'\n", starname);
+    }
     
     // find 10 brighest stars in our image and set the "is_widefield"
     // flag (which is actually called SELECTED). 
@@ -221,8 +233,10 @@ int main(int argc, char **argv) {
     }
 
     context.image_filename = image_filename;
-    wcs = correlate(primary_image, List, HGSCfilename, &reference_location, param_filename,
-		    residual_filename, context);
+    if (catalog.NameOK()) {
+      wcs = correlate(primary_image, List, catalog, &reference_location, param_filename,
+		      residual_filename, context);
+    }
   }
 
   if (verbosity.starlists) {
@@ -230,6 +244,33 @@ int main(int argc, char **argv) {
     List->PrintStarSummary(stderr);
   }
 
+  if (wcs and poly_order > 0) {
+    // Every correlated star has its catalog location in dec_ra
+    std::vector<double> star_x;
+    std::vector<double> star_y;
+    std::vector<DEC_RA> star_loc;
+    for (int i=0; i<List->NumStars; i++) {
+      IStarList::IStarOneStar *star = List->FindByIndex(i);
+      if ((star->validity_flags & CORRELATED) &&
+	  (star->validity_flags & DEC_RA_VALID)) {
+	star_x.push_back(star->nlls_x);
+	star_y.push_back(star->nlls_y);
+	star_loc.push_back(star->dec_ra);
+      }
+    }
+    WCS_Poly *poly = new WCS_Poly;
+    poly->SetImageSize(primary_image.width, primary_image.height);
+    DEC_RA center = wcs->Center();
+    if (poly->Fit(poly_order, center, star_loc.size(),
+		  star_x.data(), star_y.data(), star_loc.data()) == 0) {
+      fprintf(stderr, "star_match: order %d WCS from %ld stars, rms = %.2lf pixels\n",
+	      poly_order, star_loc.size(), poly->FitResidual());
+      wcs = poly;
+    } else {
+      delete poly;		// (keep the bilinear WCS)
+    }
+  }
+
   // this will reload the image
   if (wcs) {
     ImageInfo info(image_filename);
@@ -2,7 +2,7 @@
  *  indicates what photometry reporting steps have been completed for
  *  each day
  *
- *  Copyright (C) 2017 Mark J. Munkacsy
+ *  Copyright (C) 2017, 2024 Mark J. Munkacsy
 
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -16,7 +16,7 @@
  *
  *   You should have received a copy of the GNU General Public License
  *   along with this program (file: COPYING).  If not, see
- *   <http://www.gnu.org/licenses/>. 
+ *   <http://www.gnu.org/licenses/>.
  */
 #include <unistd.h>		// unlink()
 #include <stdlib.h>		// system(), mkstemp()
@@ -27,8 +27,15 @@
 #include <dirent.h>		// opendir(), ...
 #include <assert.h>
 #include <stdio.h>
-#include <list>			// std::list
+#include <math.h>		// isnormal()
+#include <vector>
+#include <map>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>		// std::sort()
 #include <obs_record.h>
+#include <gendefs.h>		// OBS_RECORD_FILENAME
 
 //****************************************************************
 //        Class OneDay
@@ -47,16 +54,29 @@ public:
   bool photometry_imported;
   bool has_aavso_sent_file;
 
+  // These decide whether the cached summary is still good
+  struct timespec dir_mtime;
+  struct timespec csv_mtime;	// zero if no aavso.csv file
+  int photometry_found;
+  int lookups_found;
+
+  // (starname, JD) from each line of aavso.csv; only filled in while
+  // the day is being scanned
+  std::vector<std::pair<std::string, double>> csv_entries;
+
   OneDay(void);
   ~OneDay(void);
 };
 
 OneDay::OneDay(void) {
+  dir_path = folder_shortname = nullptr;
   has_aavso_csv_file =
     has_bvri_db_file =
     has_aavso_sent_file =
     photometry_imported =
     has_aavso_report_file = false;
+  dir_mtime = csv_mtime = {0, 0};
+  photometry_found = lookups_found = 0;
 }
 
 OneDay::~OneDay(void) {
@@ -74,35 +94,163 @@ bool compareDay(const OneDay *a, const OneDay *b) {
   return a->day > b->day;
 }
 
+static bool SameTime(const struct timespec &a, const struct timespec &b) {
+  return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
 //****************************************************************
 
 ObsRecord *all_observations = 0;
 
-typedef std::list<OneDay *> DayList;
+typedef std::vector<OneDay *> DayList;
 
 DayList all_days;
 
 const static char *image_directory = "/home/IMAGES";
 
-void CheckObservations(const char *aavso_filename, OneDay *d) {
-  // if at least one entry in the aavso.csv file has had photometry
-  // data entered into the observations database, then this check
-  // succeeds, and we set the photometry_imported flag in d.
+//****************************************************************
+//        The summary cache
+// One line per day directory, holding everything PrintSummary()
+// needs along with the modification times it was computed from. A
+// day is rescanned only if its directory has changed (a file was
+// added, removed, or renamed) or its aavso.csv file has been
+// rewritten. The exception is a day whose photometry has not been
+// imported yet: it is also rechecked whenever the observations file
+// changes.
+//****************************************************************
+const static char *summary_cache = "/home/IMAGES/.session_summary";
+
+struct CachedDay {
+  struct timespec dir_mtime;
+  struct timespec csv_mtime;
+  unsigned int flags;
+  int photometry_found;
+  int lookups_found;
+};
+
+#define SUM_CSV      0x01
+#define SUM_BVRI     0x02
+#define SUM_REPORT   0x04
+#define SUM_IMPORTED 0x08
+#define SUM_SENT     0x10
+
+std::map<std::string, CachedDay> cached_days;
+struct timespec cached_obs_mtime = {0, 0};
+
+void ReadSummaryCache(void) {
+  FILE *fp = fopen(summary_cache, "r");
+  if (!fp) return;		// first run; everything gets scanned
+
+  char buffer[256];
+  if (fgets(buffer, sizeof(buffer), fp) == nullptr ||
+      sscanf(buffer, "observations %ld %ld",
+	     &cached_obs_mtime.tv_sec, &cached_obs_mtime.tv_nsec) != 2) {
+    fprintf(stderr, "summarize_sessions: ignoring bad cache file %s\n",
+	    summary_cache);
+    fclose(fp);
+    return;
+  }
+
+  while(fgets(buffer, sizeof(buffer), fp)) {
+    char name[128];
+    CachedDay c;
+    if (sscanf(buffer, "%127s %ld %ld %ld %ld %x %d %d",
+	       name,
+	       &c.dir_mtime.tv_sec, &c.dir_mtime.tv_nsec,
+	       &c.csv_mtime.tv_sec, &c.csv_mtime.tv_nsec,
+	       &c.flags, &c.photometry_found, &c.lookups_found) != 8) continue;
+    cached_days[name] = c;
+  }
+  fclose(fp);
+}
+
+void WriteSummaryCache(const struct timespec &obs_mtime) {
+  char temp_filename[256];
+  sprintf(temp_filename, "%s.%d", summary_cache, getpid());
+  FILE *fp = fopen(temp_filename, "w");
+  if (!fp) {
+    fprintf(stderr, "summarize_sessions: cannot create %s\n", temp_filename);
+    return;
+  }
+
+  fprintf(fp, "observations %ld %ld\n", obs_mtime.tv_sec, obs_mtime.tv_nsec);
+  for (OneDay *d : all_days) {
+    const unsigned int flags =
+      (d->has_aavso_csv_file ? SUM_CSV : 0) |
+      (d->has_bvri_db_file ? SUM_BVRI : 0) |
+      (d->has_aavso_report_file ? SUM_REPORT : 0) |
+      (d->photometry_imported ? SUM_IMPORTED : 0) |
+      (d->has_aavso_sent_file ? SUM_SENT : 0);
+    fprintf(fp, "%s %ld %ld %ld %ld %x %d %d\n",
+	    d->folder_shortname,
+	    d->dir_mtime.tv_sec, d->dir_mtime.tv_nsec,
+	    d->csv_mtime.tv_sec, d->csv_mtime.tv_nsec,
+	    flags, d->photometry_found, d->lookups_found);
+  }
+
+  // rename() so that a reader never sees a partial file
+  if (fclose(fp) || rename(temp_filename, summary_cache)) {
+    perror("summarize_sessions: cannot update summary cache:");
+    unlink(temp_filename);
+  }
+}
+
+// Fills in d from the cache and returns true if the cached entry is
+// still good.
+bool UseCachedDay(OneDay *d, const struct timespec &obs_mtime) {
+  auto it = cached_days.find(d->folder_shortname);
+  if (it == cached_days.end()) return false;
+  const CachedDay &c = it->second;
+
+  if (!SameTime(c.dir_mtime, d->dir_mtime)) return false;
+  if (c.flags & SUM_CSV) {
+    // aavso.csv can be rewritten in place, which doesn't change the
+    // directory's mtime
+    char *csv_filename = (char *) malloc(strlen(d->dir_path) + 16);
+    struct stat f_stat;
+    sprintf(csv_filename, "%s/aavso.csv", d->dir_path);
+    const int err = stat(csv_filename, &f_stat);
+    free(csv_filename);
+    if (err || !SameTime(c.csv_mtime, f_stat.st_mtim)) return false;
+    // Photometry may have been imported since then
+    if ((c.flags & SUM_IMPORTED) == 0 &&
+	!SameTime(cached_obs_mtime, obs_mtime)) return false;
+  }
+
+  d->csv_mtime = c.csv_mtime;
+  d->has_aavso_csv_file = (c.flags & SUM_CSV);
+  d->has_bvri_db_file = (c.flags & SUM_BVRI);
+  d->has_aavso_report_file = (c.flags & SUM_REPORT);
+  d->photometry_imported = (c.flags & SUM_IMPORTED);
+  d->has_aavso_sent_file = (c.flags & SUM_SENT);
+  d->photometry_found = c.photometry_found;
+  d->lookups_found = c.lookups_found;
+  return true;
+}
+
+//****************************************************************
+//        Scanning a day
+// ReadAAVSOFile() and GetData() only touch files in the day's own
+// directory, so several days can be scanned at once.
+// CheckObservations() uses the (shared) ObsRecord and is run
+// afterwards, one day at a time.
+//****************************************************************
+
+void ReadAAVSOFile(const char *aavso_filename, OneDay *d) {
   FILE *fp = fopen(aavso_filename, "r");
   if (!fp) return;
   char buffer[132];
-  int lookups_found = 0;
-  int photometry_found = 0;
 
   while(fgets(buffer, sizeof(buffer), fp)) {
     // use strtok to split up the .csv file line; we want to grab the
     // first four words (starname, designation, filenumbers, julian day)
     char *tok_p = buffer;
+    char *save_p;
     const char *delim = ",";
     char *words[8];
 
     for (int i=0; i<4; i++) {
-      words[i] = strtok(tok_p, delim);
+      words[i] = strtok_r(tok_p, delim, &save_p);
       tok_p = 0; // ...because this is how strtok() works.
     }
 
@@ -117,12 +265,27 @@ void CheckObservations(const char *aavso_filename, OneDay *d) {
       continue;
     }
 
+    d->csv_entries.push_back(std::make_pair(std::string(words[0]),
+					    julian_double));
+  }
+
+  fclose(fp);
+}
+
+void CheckObservations(OneDay *d, ObsRecord *all_obs) {
+  // if at least one entry in the aavso.csv file has had photometry
+  // data entered into the observations database, then this check
+  // succeeds, and we set the photometry_imported flag in d.
+  int lookups_found = 0;
+  int photometry_found = 0;
+
+  for (auto &entry : d->csv_entries) {
     // find the observation that matches in the "observations.txt" file
     ObsRecord::Observation *obs =
-      all_observations->FindObservation(words[0], JULIAN(julian_double));
+      all_obs->FindObservation(entry.first.c_str(), JULIAN(entry.second));
     if (!obs) {
-      //fprintf(stderr, "summarize_sessions: can't find obs for: %s,...,%s\n",
-      //      words[0], words[3]);
+      //fprintf(stderr, "summarize_sessions: can't find obs for: %s,...,%lf\n",
+      //      entry.first.c_str(), entry.second);
       continue;
     }
 
@@ -135,15 +298,16 @@ void CheckObservations(const char *aavso_filename, OneDay *d) {
 	isnormal(obs->I_mag)) photometry_found++;
   }
 
-  fclose(fp);
-
+  d->csv_entries.clear();
+  d->photometry_found = photometry_found;
+  d->lookups_found = lookups_found;
   d->photometry_imported = (photometry_found > 0);
   fprintf(stderr, "%s: %d of %d photometry found.\n",
 	  d->folder_shortname, photometry_found, lookups_found);
 }
-  
 
-void GetData(OneDay *d, ObsRecord *all_obs) {
+
+void GetData(OneDay *d) {
   char *temp_filename = (char *) malloc(strlen(d->dir_path) + 255);
   struct stat f_stat;
   if (!temp_filename) {
@@ -156,10 +320,12 @@ void GetData(OneDay *d, ObsRecord *all_obs) {
   if (stat(temp_filename, &f_stat)) {
     // error occured during stat()
     d->has_aavso_csv_file = false;
+    free(temp_filename);
     return;
   } else {
     d->has_aavso_csv_file = true;
-    CheckObservations(temp_filename, d);
+    d->csv_mtime = f_stat.st_mtim;
+    ReadAAVSOFile(temp_filename, d);
   }
 
   // Is there a bvri.db file??
@@ -167,11 +333,12 @@ void GetData(OneDay *d, ObsRecord *all_obs) {
   if (stat(temp_filename, &f_stat)) {
     // error occured during stat()
     d->has_bvri_db_file = false;
+    free(temp_filename);
     return;
   } else {
     d->has_bvri_db_file = true;
   }
-  
+
   // Is there an aavso.report file??
   sprintf(temp_filename, "%s/aavso.report", d->dir_path);
   if (stat(temp_filename, &f_stat)) {
@@ -180,6 +347,7 @@ void GetData(OneDay *d, ObsRecord *all_obs) {
     sprintf(temp_filename, "%s/aavso.report.txt", d->dir_path);
     if (stat(temp_filename, &f_stat)) {
       d->has_aavso_report_file = false;
+      free(temp_filename);
       return;
     }
   }
@@ -191,15 +359,24 @@ void GetData(OneDay *d, ObsRecord *all_obs) {
     // error occured during stat()
     d->has_aavso_sent_file = false;
     fprintf(stderr, "%s: sent false\n", temp_filename);
-    return;
   } else {
     d->has_aavso_sent_file = true;
     fprintf(stderr, "%s: sent true\n", temp_filename);
   }
+  free(temp_filename);
+}
+
+// Each thread takes the next unscanned day until there are none left
+static void ScanDays(std::vector<OneDay *> *to_scan,
+		     std::atomic<unsigned int> *next_day) {
+  unsigned int i;
+  while((i = (*next_day)++) < to_scan->size()) {
+    GetData((*to_scan)[i]);
+  }
 }
-  
 
-void InitDayList(ObsRecord *all_obs) {
+
+void InitDayList(bool use_cache, int num_threads) {
 
   DIR *image_dir = opendir(image_directory);
   if(!image_dir) {
@@ -208,8 +385,26 @@ void InitDayList(ObsRecord *all_obs) {
     return;
   }
 
+  if (use_cache) ReadSummaryCache();
+
+  struct stat obs_stat;
+  struct timespec obs_mtime = {0, 0};
+  if (stat(OBS_RECORD_FILENAME, &obs_stat) == 0) {
+    obs_mtime = obs_stat.st_mtim;
+  }
+
+  std::vector<OneDay *> to_scan;
   struct dirent *dp;
   while((dp = readdir(image_dir)) != NULL) {
+    // is it a valid "date" directory name?
+    int d_year;
+    int d_month;
+    int d_day;
+    int num_converted;
+
+    num_converted = sscanf(dp->d_name, "%u-%u-%u", &d_month, &d_day, &d_year);
+    if (num_converted != 3) continue;
+
     // Build a string that holds the full pathname
     const int pathlen = strlen(dp->d_name) + strlen(image_directory) + 5;
     char *full_path = (char *) malloc(pathlen);
@@ -224,24 +419,19 @@ void InitDayList(ObsRecord *all_obs) {
     if (stat(full_path, &dir_stat)) {
       // error occured during stat()
       perror("summarize_sessions: stat() failed:");
+      free(full_path);
       continue; // go to next folder in directory
     }
     // is it a directory?
-    if ((dir_stat.st_mode & S_IFDIR) == 0) continue; // no: skip entry
-    
-    // is it a valid "date" directory name?
-    int d_year;
-    int d_month;
-    int d_day;
-    int num_converted;
+    if ((dir_stat.st_mode & S_IFDIR) == 0) {
+      free(full_path);
+      continue; // no: skip entry
+    }
 
-    num_converted = sscanf(dp->d_name, "%u-%u-%u", &d_month, &d_day, &d_year);
-    if (num_converted != 3) continue;
-    
     // got one!
 
     OneDay *new_day = new OneDay;
-    
+
     if(!new_day) {
       fprintf(stderr, "Unknown error reading directory: %s\n",
 	      full_path);
@@ -251,34 +441,58 @@ void InitDayList(ObsRecord *all_obs) {
       new_day->year = d_year;
       new_day->month = d_month;
       new_day->day = d_day;
+      new_day->dir_mtime = dir_stat.st_mtim;
       all_days.push_back(new_day);
+
+      if (!UseCachedDay(new_day, obs_mtime)) to_scan.push_back(new_day);
     }
   }
   closedir(image_dir);
 
+  fprintf(stderr, "summarize_sessions: %d of %d days need scanning.\n",
+	  (int) to_scan.size(), (int) all_days.size());
+
+  if (to_scan.size()) {
+    // Scan new and changed days in parallel
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > (int) to_scan.size()) num_threads = to_scan.size();
+
+    std::atomic<unsigned int> next_day {0};
+    std::vector<std::thread> threads;
+    for (int i=0; i<num_threads; i++) {
+      threads.emplace_back(ScanDays, &to_scan, &next_day);
+    }
+    for (std::thread &t : threads) t.join();
+
+    // The observations file is big; only read it if some day has an
+    // aavso.csv file that needs checking against it
+    for (OneDay *d : to_scan) {
+      if (!d->has_aavso_csv_file) continue;
+      if (!all_observations) all_observations = new ObsRecord;
+      CheckObservations(d, all_observations);
+    }
+  }
+
   // now sort the list into the order desired for display (most recent
   // entries are first)
-  all_days.sort(compareDay);
+  std::sort(all_days.begin(), all_days.end(), compareDay);
 
-  DayList::iterator it;
-  for (it=all_days.begin(); it != all_days.end(); it++) {
-    OneDay *d = (*it);
-    GetData(d, all_obs);
+  // Save the merged summary only if something changed
+  if (to_scan.size() || all_days.size() != cached_days.size()) {
+    WriteSummaryCache(obs_mtime);
   }
 }
 
 void usage(void) {
-  fprintf(stderr, "Usage: summarize_sessions -o filename.txt\n");
+  fprintf(stderr, "Usage: summarize_sessions [-r] [-t threads] -o filename.txt\n");
+  fprintf(stderr, "     -r     Rescan every day (ignore the summary cache)\n");
   exit(-1);
 }
 
 void PrintSummary(FILE *fp) {
   fprintf(fp, "Date        Obs Analyzed Report Imported Uploaded\n");
 
-  DayList::iterator it;
-  for (it = all_days.begin(); it != all_days.end(); it++) {
-    OneDay *d = (*it);
-
+  for (OneDay *d : all_days) {
     fprintf(fp, "%-12s  %c     %c       %c       %c      %c\n",
 	    d->folder_shortname,
 	    (d->has_aavso_csv_file ? 'X' : ' '),
@@ -288,7 +502,7 @@ void PrintSummary(FILE *fp) {
 	    (d->has_aavso_sent_file ? 'X' : ' '));
   }
 }
-	  
+
 
 //****************************************************************
 //        main()
@@ -296,13 +510,23 @@ void PrintSummary(FILE *fp) {
 int main(int argc, char **argv) {
   int option_char;
   char *output_filename = 0;
+  bool use_cache = true;
+  int num_threads = std::thread::hardware_concurrency();
 
-  while((option_char = getopt(argc, argv, "o:")) > 0) {
+  while((option_char = getopt(argc, argv, "o:rt:")) > 0) {
     switch (option_char) {
     case 'o':
       output_filename = optarg;
       break;
 
+    case 'r':			// rescan everything
+      use_cache = false;
+      break;
+
+    case 't':			// number of threads
+      num_threads = atoi(optarg);
+      break;
+
     case '?':			// invalid argument
     default:
       fprintf(stderr, "Invalid argument.\n");
@@ -310,6 +534,8 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (output_filename == 0) usage();
+
   FILE *fp_out = fopen(output_filename, "w");
   if (!fp_out) {
     fprintf(stderr, "summarize_sessions: cannot open output file: %s\n",
@@ -318,10 +544,8 @@ int main(int argc, char **argv) {
     usage();
     /*NOTREACHED*/
   }
-  
-  all_observations = new ObsRecord;
-  
-  InitDayList(all_observations);
+
+  InitDayList(use_cache, num_threads);
 
   PrintSummary(fp_out);
 
@@ -333,6 +557,6 @@ int main(int argc, char **argv) {
     exit(-2);
     /*NOTREACHED*/
   }
-  
+
   return 0;
 }
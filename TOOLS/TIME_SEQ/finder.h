@@ -27,7 +27,7 @@
 int
 Finder(const char *object_name,
        DEC_RA &target_location,
-       double tolerance /*arc-sec*/,
+       double tolerance /*radians*/,
        Filter &filter);
 
 #endif
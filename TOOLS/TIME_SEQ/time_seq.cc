@@ -26,6 +26,7 @@
 #include "proc_messages.h"
 #include "running_focus.h"
 #include "finder.h"
+#include "image_pipeline.h"
 #include <Image.h>
 #include <unistd.h> 		// for getopt()
 #include <stdlib.h>		// for atof()
@@ -33,7 +34,10 @@
 #include <named_stars.h>
 #include <dark.h>
 #include <ctype.h>		// isdigit()
+#include <pthread.h>
+#include <time.h>		// clock_gettime()
 #include "system_config.h"
+#include "trace.h"
 
 //#define USE_SIMULATOR
 
@@ -46,7 +50,11 @@
 #define FLIP_TIME (7*60+1) // 12:01am; make bigger than STOP_TIME to
 			   // prevent flip
 
-Image *ProcessImage(const char *exposure_filename, Drifter *drift);
+void SubmitForAnalysis(const char *exposure_filename, bool use_for_focus,
+		       Drifter *drift);
+void FinishAnalysis(Drifter *drift);
+void TrackDrift(Drifter *drift, const char *exposure_filename);
+void *analysis_thread(void *);
 
 static void Terminate(void) {
   disconnect_camera();
@@ -205,11 +213,84 @@ void usage(void) {
 const char *darkfilename = 0;
 const char *quickdarkname = 0;
 const char *starname = 0;
-char darkfilearg[256];
-char quickdarkarg[256];
-const char *current_dark_name = 0;
+// One pipeline per dark; the analysis thread only reads them
+ImagePipeline main_pipeline;
+ImagePipeline quick_pipeline;
+const ImagePipeline *current_pipeline = &main_pipeline;
 const char *profile_name = "time_seq"; // default
 
+//********************************
+//    Analysis pipeline
+// Each image is handed to the analysis thread (ImagePipeline
+// detect/solve, image center, running focus) as soon as it has been
+// read out, and the next exposure starts immediately. Only one image
+// is ever being analyzed at a time: SubmitForAnalysis() waits for
+// the previous image's analysis to finish. The image center found by
+// the analysis is handed to the Drifter by the main thread (the
+// Drifter is busy guiding during exposures), so each measurement
+// takes effect with the next exposure to start. Once the Drifter is
+// tracking stars (see TrackDrift()), it measures each image itself as
+// soon as it's read out, and image centers are no longer needed.
+//********************************
+struct AnalysisJob {
+  char *exposure_filename;
+  const ImagePipeline *pipeline;
+  bool use_for_focus;
+  bool need_center;
+
+  // results
+  bool center_valid;
+  DEC_RA center;
+  JULIAN midpoint;
+  double analysis_time;		// seconds
+};
+
+pthread_mutex_t mutex_analysis = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t analysis_request = PTHREAD_COND_INITIALIZER;
+pthread_cond_t analysis_finished = PTHREAD_COND_INITIALIZER;
+// protected by mutex_analysis
+AnalysisJob *job_pending = nullptr;
+AnalysisJob *job_done = nullptr;
+bool analysis_quit = false;
+// only touched by the main thread
+AnalysisJob *job_in_flight = nullptr;
+
+// RunningFocus is used by both threads: AddImage() from the analysis
+// thread, everything else from the main thread.
+pthread_mutex_t mutex_focus = PTHREAD_MUTEX_INITIALIZER;
+RunningFocus *running_focus = nullptr;
+
+// Cadence and duty-cycle bookkeeping (main thread only)
+struct CadenceStats {
+  double first_start {-1.0};
+  double last_start {-1.0};
+  double shutter_time {0.0};	// sum of exposure times
+  double stall_time {0.0};	// waiting for analysis to finish
+  int num_exposures {0};
+} cadence;
+
+static double WallSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1.0e9;
+}
+
+// returns seconds since the previous exposure started (or 0.0)
+static double CadenceExposureStart(double exposure_time) {
+  const double now = WallSeconds();
+  const double interval = (cadence.last_start < 0.0 ? 0.0 : now - cadence.last_start);
+  if (cadence.first_start < 0.0) cadence.first_start = now;
+  cadence.last_start = now;
+  cadence.shutter_time += exposure_time;
+  cadence.num_exposures++;
+  return interval;
+}
+
+static double DutyCycle(void) {
+  const double elapsed = WallSeconds() - cadence.first_start;
+  return (elapsed > 0.0 ? 100.0*cadence.shutter_time/elapsed : 0.0);
+}
+
 //********************************
 //        main()
 //********************************
@@ -362,15 +443,11 @@ int main(int argc, char **argv) {
   //********************************
   darkfilename = get_darkfilename(exposure_time_val);
   if (darkfilename) {
-    sprintf(darkfilearg, " -d %s ", darkfilename);
-  } else {
-    strcpy(darkfilearg, "  ");
+    (void) main_pipeline.SetDark(darkfilename);
   }
   quickdarkname = get_darkfilename(20.0);
   if (quickdarkname) {
-    sprintf(quickdarkarg, " -d %s ", quickdarkname);
-  } else {
-    strcpy(quickdarkarg, "  ");
+    (void) quick_pipeline.SetDark(quickdarkname);
   }
 #else
   InitializeSimulator("/tmp/simulator.log");
@@ -415,6 +492,15 @@ int main(int argc, char **argv) {
   if (use_running_focus) {
     focus.SetInitialImagesToIgnore(3);
   }
+  running_focus = &focus;
+
+#ifndef USE_SIMULATOR
+  pthread_t analysis_tid;
+  if (pthread_create(&analysis_tid, nullptr, analysis_thread, nullptr)) {
+    perror("time_seq: cannot create analysis thread");
+    Terminate();
+  }
+#endif
   
   Drifter *drift = nullptr;
   FILE *drifter_fp = nullptr;
@@ -443,9 +529,9 @@ int main(int argc, char **argv) {
   // after a meridian flip.
   while (!finished) {
     if (do_quick_init) {
-      current_dark_name = quickdarkarg;
+      current_pipeline = &quick_pipeline;
     } else {
-      current_dark_name = darkfilearg;
+      current_pipeline = &main_pipeline;
     }
 
 #ifndef USE_SIMULATOR
@@ -462,15 +548,20 @@ int main(int argc, char **argv) {
       drift->SetNorthUp(first_image->GetImageInfo()->NorthIsUp());
     }
     delete first_image;
-    first_image = ProcessImage(exposure_filename, drift);
     // Short exposures used for quick_init tend to confuse the focus
     // manager, because they are sharper just because they are
     // shorter. Only let drift guider initialization images be used
     // for focus if they're the right exposure length.
-    if (use_running_focus and !do_quick_init) {
-      focus.AddImage(first_image);
+    SubmitForAnalysis(exposure_filename, use_running_focus and !do_quick_init,
+		      drift);
+    // The drifter needs a starting point before the next exposure
+    FinishAnalysis(drift);
+    if (drift) {
+      // the analysis has now plate-solved the setup image; from here on
+      // the drifter follows a few of its stars directly
+      Image reference(exposure_filename);
+      drift->StartTracking(&reference);
     }
-    delete first_image;
   
 #else
     // SIMULATOR
@@ -490,22 +581,26 @@ int main(int argc, char **argv) {
 	  fprintf(stderr, "time_seq_new: received notify message. Quitting.\n");
 	  Terminate();
 	}
+	CadenceExposureStart(initialize_exposure_time);
 	exposure_filename = expose_image(initialize_exposure_time, flags, "DRIFT_SETUP",
 					 drift);
 	fprintf(logfile, "%s: %s\n",
 		current_time_string(), exposure_filename);
-	Image *image = ProcessImage(exposure_filename, drift);
-	if (use_running_focus) {
-	  focus.AddImage(image);
+	TrackDrift(drift, exposure_filename);
+	if (exposure_filename) {
+	  PublishMessage(SM_TOPIC_IMAGE, SM_ID_ImageReady, 0, exposure_filename);
 	}
-	delete image;
+	SubmitForAnalysis(exposure_filename, use_running_focus, drift);
       }
+      FinishAnalysis(drift);
       // finished quick init
       fprintf(stderr, "Finished initialization with short exposures.\n");
     }
 
-    current_dark_name = darkfilearg;
+    current_pipeline = &main_pipeline;
+    pthread_mutex_lock(&mutex_focus);
     focus.PerformFocusDither();
+    pthread_mutex_unlock(&mutex_focus);
 
     // This is the inner while() loop. It is traversed hundreds of
     // times and is used for most images.
@@ -519,7 +614,11 @@ int main(int argc, char **argv) {
       }
 
       if (use_running_focus) {
+	// The newest measurement available here is from the image
+	// before last; the last one is still being analyzed.
+	pthread_mutex_lock(&mutex_focus);
 	focus.UpdateFocus(); // adjust focus if needed
+	pthread_mutex_unlock(&mutex_focus);
       }
 
 #ifndef USE_SIMULATOR
@@ -530,16 +629,22 @@ int main(int argc, char **argv) {
 	focus_this_image = !use_alternate_color;
       }
 	
+      const double interval = CadenceExposureStart(exposure_time_val);
       exposure_filename = expose_image(exposure_time_val, flags, "PHOTOMETRY",
 				       drift);
       fprintf(logfile, "%s: %s (%s)\n",
 	      current_time_string(), exposure_filename,
 	      flags.FilterRequested().NameOf());
-      Image *image = ProcessImage(exposure_filename, drift);
-      if (use_running_focus and focus_this_image) {
-	focus.AddImage(image);
+      TrackDrift(drift, exposure_filename);
+      if (exposure_filename) {
+	PublishMessage(SM_TOPIC_IMAGE, SM_ID_ImageReady, 0, exposure_filename);
+      }
+      SubmitForAnalysis(exposure_filename, use_running_focus and focus_this_image,
+			drift);
+      if (interval > 0.0) {
+	fprintf(logfile, "    cadence = %.1lf sec, duty cycle = %.1lf%% (%.1lf sec stalled)\n",
+		interval, DutyCycle(), cadence.stall_time);
       }
-      delete image;
 #else
       sim_now += (15 + exposure_time_val/2);
       SetSimulatorTime(sim_now);
@@ -556,6 +661,7 @@ int main(int argc, char **argv) {
 	  (time(0) - starting_time) > (flipping_minutes - starting_minutes)*60) {
 	// time to perform a flip
 	fprintf(stderr, "Time to perform meridian flip.\n");
+	FinishAnalysis(drift);
 	if(system("~/ASTRO/CURRENT/TOOLS/MOUNT/flip")) {
 	  fprintf(stderr, "flip command did not execute okay.\n");
 	} else {
@@ -567,8 +673,10 @@ int main(int argc, char **argv) {
 	    drift = new Drifter(drifter_fp);
 	  }
 	  fprintf(stderr, "Restarting running focus.\n");
+	  pthread_mutex_lock(&mutex_focus);
 	  focus.Restart();
-	  sleep(60); // pause to let the mount stabilize
+	  pthread_mutex_unlock(&mutex_focus);
+	  WaitForMountSettled(); // let the mount stabilize
 	  if (use_drift_guider) {
 	    break; // force out of the photometry loop to repeat the
 	    // drift initialization cycle
@@ -580,7 +688,21 @@ int main(int argc, char **argv) {
 	break;
       }
     } while (1); // end of photometry loop
+    FinishAnalysis(drift);
   } // end of entire session
+
+  pthread_mutex_lock(&mutex_analysis);
+  analysis_quit = true;
+  pthread_cond_signal(&analysis_request);
+  pthread_mutex_unlock(&mutex_analysis);
+  pthread_join(analysis_tid, nullptr);
+
+  if (cadence.num_exposures > 1) {
+    fprintf(logfile, "%d exposures, mean cadence = %.1lf sec, duty cycle = %.1lf%%, %.1lf sec stalled for analysis\n",
+	    cadence.num_exposures,
+	    (cadence.last_start - cadence.first_start)/(cadence.num_exposures-1),
+	    DutyCycle(), cadence.stall_time);
+  }
 #else
 } while (sim_now < quit_time_minutes);
 #endif
@@ -591,26 +713,131 @@ int main(int argc, char **argv) {
   return 0;
 }
 
-Image *ProcessImage(const char *exposure_filename, Drifter *drift) {
-  fprintf(stderr, "ProcessImage(): starting.\n");
-  char command[512];
-  
-  sprintf(command, "find_stars  %s -i %s;star_match -e -f -b -h -n %s -i %s",
-	  current_dark_name, exposure_filename, starname, exposure_filename);
-  if (system(command) == -1) {
-    fprintf(stderr, "time_seq_new: cannot invoke find_stars/star_match.\n");
-    Terminate();
+//****************************************************************
+//        Analysis thread
+//****************************************************************
+static void AnalyzeImage(AnalysisJob *job) {
+  TraceSpan span("time_seq_analysis");
+  const double start = WallSeconds();
+  fprintf(stderr, "AnalyzeImage(): starting %s.\n", job->exposure_filename);
+  Image image(job->exposure_filename);
+
+  // Running focus has always measured the raw image; do that before
+  // the pipeline calibrates it in place.
+  if (job->use_for_focus) {
+    pthread_mutex_lock(&mutex_focus);
+    running_focus->AddImage(&image);
+    pthread_mutex_unlock(&mutex_focus);
   }
 
-  Image *image = new Image(exposure_filename); // pick up new starlist
-  if (drift) {
-    int status = 0;
-    DEC_RA image_center = image->ImageCenter(status);
-    ImageInfo *info = image->GetImageInfo();
-    if (status == STATUS_OK) {
-      drift->AcceptCenter(image_center, info->GetExposureMidpoint());
+  IStarList *stars = job->pipeline->Run(image, starname);
+  const WCS *wcs = (image.GetImageInfo() ? image.GetImageInfo()->GetWCS() : nullptr);
+  job->center_valid = false;
+  if (stars and wcs) {
+    // Leave the same star list and WCS in the file that star_match
+    // used to; the Drifter's StartTracking() reads them back.
+    ImageInfo file_info(job->exposure_filename);
+    wcs->UpdateFITSHeader(&file_info);
+    file_info.WriteFITS();
+    stars->SaveIntoFITSFile(job->exposure_filename, 1);
+
+    if (job->need_center) {
+      int status = 0;
+      DEC_RA image_center = image.ImageCenter(status);
+      if (status == STATUS_OK) {
+	job->center = image_center;
+	job->midpoint = image.GetImageInfo()->GetExposureMidpoint();
+	job->center_valid = true;
+      }
     }
+  } else {
+    fprintf(stderr, "AnalyzeImage(): %s did not match.\n",
+	    job->exposure_filename);
   }
-  fprintf(stderr, "ProcessImage(): finished.\n");
-  return image; // this is raw (not dark-subtracted)
- }
+  delete stars;
+  job->analysis_time = WallSeconds() - start;
+  fprintf(stderr, "AnalyzeImage(): finished (%.1lf sec).\n", job->analysis_time);
+}
+
+void *analysis_thread(void *) {
+  do {
+    pthread_mutex_lock(&mutex_analysis);
+    while (job_pending == nullptr && !analysis_quit) {
+      pthread_cond_wait(&analysis_request, &mutex_analysis);
+    }
+    AnalysisJob *job = job_pending;
+    job_pending = nullptr;
+    pthread_mutex_unlock(&mutex_analysis);
+
+    if (job == nullptr) break; // analysis_quit
+
+    AnalyzeImage(job);
+
+    pthread_mutex_lock(&mutex_analysis);
+    job_done = job;
+    pthread_cond_signal(&analysis_finished);
+    pthread_mutex_unlock(&mutex_analysis);
+  } while (1);
+  return nullptr;
+}
+
+//****************************************************************
+//        FinishAnalysis()
+//    Waits for the image currently being analyzed (if any) and
+//    hands its result to the Drifter.
+//****************************************************************
+void FinishAnalysis(Drifter *drift) {
+  if (job_in_flight == nullptr) return;
+
+  const double start = WallSeconds();
+  pthread_mutex_lock(&mutex_analysis);
+  while (job_done == nullptr) {
+    pthread_cond_wait(&analysis_finished, &mutex_analysis);
+  }
+  AnalysisJob *job = job_done;
+  job_done = nullptr;
+  pthread_mutex_unlock(&mutex_analysis);
+  cadence.stall_time += (WallSeconds() - start);
+  TraceCounter("time_seq_analysis_sec", job->analysis_time);
+
+  if (drift && job->center_valid) {
+    drift->AcceptCenter(job->center, job->midpoint);
+  }
+  free(job->exposure_filename);
+  delete job;
+  job_in_flight = nullptr;
+}
+
+//****************************************************************
+//        TrackDrift()
+//    Measures the image's drift with the Drifter's star trackers
+//    (main thread; fast enough to finish before the next exposure).
+//****************************************************************
+void TrackDrift(Drifter *drift, const char *exposure_filename) {
+  if (drift == nullptr || exposure_filename == nullptr || !drift->Tracking()) return;
+  TraceSpan span("time_seq_track_drift");
+  if (!drift->TrackImage(exposure_filename) && !drift->Tracking()) {
+    fprintf(stderr, "time_seq: drift tracking lost; using image centers.\n");
+  }
+}
+
+void SubmitForAnalysis(const char *exposure_filename, bool use_for_focus,
+		       Drifter *drift) {
+  if (exposure_filename == nullptr) return;
+  FinishAnalysis(drift);
+
+  AnalysisJob *job = new AnalysisJob;
+  job->exposure_filename = strdup(exposure_filename);
+  job->pipeline = current_pipeline;
+  job->use_for_focus = use_for_focus;
+  // A drifter that is tracking stars has already measured this image
+  job->need_center = (drift != nullptr && !drift->Tracking());
+  job->center_valid = false;
+  job->analysis_time = 0.0;
+
+  job_in_flight = job;
+  pthread_mutex_lock(&mutex_analysis);
+  job_pending = job;
+  pthread_cond_signal(&analysis_request);
+  pthread_mutex_unlock(&mutex_analysis);
+}